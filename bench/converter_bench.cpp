@@ -0,0 +1,451 @@
+// Stage and end-to-end throughput benchmarks over a generated corpus. Results are
+// written as JSON so runs from different commits can be compared directly.
+//
+// Usage: converter_bench [--work-dir DIR] [--scale small|medium|large] [--iterations N]
+//                        [--filter SUBSTRING] [--label TEXT] [--output FILE] [--no-buffer-pool]
+//
+// Each stage also reports page faults and operator new calls per iteration; run once
+// with --no-buffer-pool to compare against the pipeline without buffer reuse.
+
+#include "corpus_generator.h"
+
+#include "buffer_pool.h"
+#include "cbz_creator.h"
+#include "cbz_to_pdf_converter.h"
+#include "concurrency.h"
+#include "converter_service.h"
+#include "json_util.h"
+#include "pdf_creator.h"
+#include "pdf_image_extractor.h"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Counts heap allocations made through operator new (C libraries calling malloc
+// directly are not included).
+namespace {
+std::atomic<std::uint64_t> g_allocations{0};
+}
+
+void* operator new(std::size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* pointer = std::malloc(size == 0 ? 1 : size)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+namespace {
+struct BenchOptions {
+    std::filesystem::path work_dir = "converter_bench_work";
+    std::string scale = "small";
+    int iterations = 3;
+    std::string filter;
+    std::string label;
+    std::string output_path;
+    bool buffer_pool = true;
+    std::string converter;  // CLI executable for the batch stages; empty skips them
+};
+
+struct StageRun {
+    bool ok = false;
+    int pages = 0;
+    std::uint64_t input_bytes = 0;
+};
+
+struct StageResult {
+    std::string name;
+    bool ok = true;
+    int pages = 0;
+    std::uint64_t input_bytes = 0;
+    std::uint64_t output_bytes = 0;
+    std::vector<double> wall_seconds;
+    std::vector<double> cpu_seconds;
+    std::uint64_t minor_faults = 0;  // totals over all iterations
+    std::uint64_t major_faults = 0;
+    std::uint64_t allocations = 0;
+};
+
+struct Stage {
+    std::string name;
+    std::function<StageRun(const std::filesystem::path& output_dir)> run;
+};
+
+// The converters report progress on std::cout; silence it while timing.
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+};
+
+class ScopedSilence {
+public:
+    ScopedSilence() : previous_(std::cout.rdbuf(&null_buffer_)) {}
+    ~ScopedSilence() { std::cout.rdbuf(previous_); }
+
+private:
+    NullBuffer null_buffer_;
+    std::streambuf* previous_;
+};
+
+std::uint64_t file_size_or_zero(const std::filesystem::path& path) {
+    std::error_code ec;
+    const auto size = std::filesystem::file_size(path, ec);
+    return ec ? 0 : size;
+}
+
+std::uint64_t directory_size(const std::filesystem::path& directory) {
+    std::uint64_t total = 0;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(directory, ec)) {
+        if (entry.is_regular_file(ec)) {
+            total += file_size_or_zero(entry.path());
+        }
+    }
+    return total;
+}
+
+std::uint64_t total_data_size(const std::vector<PDFImageInput>& images) {
+    std::uint64_t total = 0;
+    for (const auto& image : images) {
+        total += image.data.size();
+    }
+    return total;
+}
+
+struct ResourceSample {
+    std::uint64_t minor_faults = 0;
+    std::uint64_t major_faults = 0;
+    std::uint64_t allocations = 0;
+};
+
+ResourceSample sample_resources() {
+    ResourceSample sample;
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        sample.minor_faults = static_cast<std::uint64_t>(usage.ru_minflt);
+        sample.major_faults = static_cast<std::uint64_t>(usage.ru_majflt);
+    }
+    sample.allocations = g_allocations.load(std::memory_order_relaxed);
+    return sample;
+}
+
+double median(std::vector<double> values) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    const std::size_t middle = values.size() / 2;
+    return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2.0;
+}
+
+double mean(const std::vector<double>& values) {
+    double sum = 0.0;
+    for (const double value : values) {
+        sum += value;
+    }
+    return values.empty() ? 0.0 : sum / static_cast<double>(values.size());
+}
+
+StageResult run_stage(const Stage& stage, const BenchOptions& options) {
+    StageResult result;
+    result.name = stage.name;
+    const auto output_dir = options.work_dir / "runs" / stage.name;
+
+    for (int iteration = 0; iteration < options.iterations; ++iteration) {
+        std::error_code ec;
+        std::filesystem::remove_all(output_dir, ec);
+        std::filesystem::create_directories(output_dir, ec);
+
+        StageRun run;
+        const ResourceSample resources_start = sample_resources();
+        const std::clock_t cpu_start = std::clock();
+        const auto wall_start = std::chrono::steady_clock::now();
+        {
+            ScopedSilence silence;
+            run = stage.run(output_dir);
+        }
+        const auto wall_end = std::chrono::steady_clock::now();
+        const std::clock_t cpu_end = std::clock();
+        const ResourceSample resources_end = sample_resources();
+
+        result.minor_faults += resources_end.minor_faults - resources_start.minor_faults;
+        result.major_faults += resources_end.major_faults - resources_start.major_faults;
+        result.allocations += resources_end.allocations - resources_start.allocations;
+
+        result.ok = result.ok && run.ok;
+        result.pages = run.pages;
+        result.input_bytes = run.input_bytes;
+        result.output_bytes = directory_size(output_dir);
+        result.wall_seconds.push_back(std::chrono::duration<double>(wall_end - wall_start).count());
+        result.cpu_seconds.push_back(static_cast<double>(cpu_end - cpu_start) / CLOCKS_PER_SEC);
+    }
+
+    return result;
+}
+
+std::string format_double(double value) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.6f", value);
+    return text;
+}
+
+std::string to_json(const BenchOptions& options, const CorpusSpec& spec, const std::vector<StageResult>& results) {
+    std::string json = "{\n";
+    json += "  \"benchmark\": \"converter_bench\",\n";
+    json += "  \"label\": \"" + JsonUtil::escape(options.label) + "\",\n";
+    json += "  \"scale\": \"" + JsonUtil::escape(options.scale) + "\",\n";
+    json += "  \"iterations\": " + std::to_string(options.iterations) + ",\n";
+    json += "  \"buffer_pool\": " + std::string(options.buffer_pool ? "true" : "false") + ",\n";
+    json += "  \"hardware_threads\": " + std::to_string(std::thread::hardware_concurrency()) + ",\n";
+    json += "  \"available_cpus\": " + std::to_string(Concurrency::available_cpus()) + ",\n";
+    json += "  \"corpus\": {\"seed\": " + std::to_string(spec.seed) +
+            ", \"vector_pages\": " + std::to_string(spec.vector_pages) +
+            ", \"vector_paths\": " + std::to_string(spec.vector_paths) +
+            ", \"scan_pages\": " + std::to_string(spec.scan_pages) +
+            ", \"scan_width\": " + std::to_string(spec.scan_width) +
+            ", \"scan_height\": " + std::to_string(spec.scan_height) + "},\n";
+    json += "  \"results\": [";
+
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const auto& result = results[i];
+        const double median_wall = median(result.wall_seconds);
+        const double pages_per_second = median_wall > 0 ? result.pages / median_wall : 0.0;
+        const double megabytes = static_cast<double>(std::max(result.input_bytes, result.output_bytes)) / (1024.0 * 1024.0);
+
+        json += i == 0 ? "\n" : ",\n";
+        json += "    {\"stage\": \"" + JsonUtil::escape(result.name) + "\"";
+        json += ", \"ok\": " + std::string(result.ok ? "true" : "false");
+        json += ", \"pages\": " + std::to_string(result.pages);
+        json += ", \"input_bytes\": " + std::to_string(result.input_bytes);
+        json += ", \"output_bytes\": " + std::to_string(result.output_bytes);
+        json += ", \"wall_seconds\": {\"min\": " + format_double(*std::min_element(result.wall_seconds.begin(), result.wall_seconds.end())) +
+                ", \"median\": " + format_double(median_wall) +
+                ", \"mean\": " + format_double(mean(result.wall_seconds)) + "}";
+        json += ", \"cpu_seconds_mean\": " + format_double(mean(result.cpu_seconds));
+        const auto iterations = static_cast<std::uint64_t>(std::max<std::size_t>(result.wall_seconds.size(), 1));
+        json += ", \"minor_page_faults\": " + std::to_string(result.minor_faults / iterations);
+        json += ", \"major_page_faults\": " + std::to_string(result.major_faults / iterations);
+        json += ", \"allocations\": " + std::to_string(result.allocations / iterations);
+        json += ", \"pages_per_second\": " + format_double(pages_per_second);
+        json += ", \"megabytes_per_second\": " + format_double(median_wall > 0 ? megabytes / median_wall : 0.0) + "}";
+    }
+
+    json += results.empty() ? "]\n" : "\n  ]\n";
+    json += "}\n";
+    return json;
+}
+
+StageRun extract_pdf(const std::filesystem::path& pdf_path, const std::filesystem::path& output_dir) {
+    StageRun run;
+    run.input_bytes = file_size_or_zero(pdf_path);
+    PDFImageExtractor extractor(pdf_path.string(), "jpeg", 80, 150.0);
+    if (!extractor.is_valid()) {
+        return run;
+    }
+    run.pages = static_cast<int>(extractor.extract_all_images(output_dir.string()).size());
+    run.ok = run.pages == extractor.get_page_count();
+    return run;
+}
+
+StageRun convert_cbz(const std::filesystem::path& cbz_path, const std::filesystem::path& output_dir, int pages,
+                     const PageDownscale& downscale = {}) {
+    StageRun run;
+    run.input_bytes = file_size_or_zero(cbz_path);
+    run.pages = pages;
+    run.ok = CBZToPDFConverter::convert_cbz_to_pdf(cbz_path.string(), (output_dir / "out.pdf").string(), {}, downscale);
+    return run;
+}
+
+// Runs the command line tool on a directory of PDFs, for comparing its batch modes.
+// CPU time of the tool is not included in cpu_seconds, which only covers this process.
+StageRun run_converter(const std::string& converter, const std::filesystem::path& batch_dir,
+                       const std::filesystem::path& output_dir, const std::string& mode_arguments, int pages) {
+    StageRun run;
+    run.input_bytes = directory_size(batch_dir);
+    run.pages = pages;
+    const std::string command = "\"" + converter + "\" \"" + batch_dir.string() + "\" \"" + output_dir.string() +
+                                "\" --cbz --clean --log-level quiet " + mode_arguments + " > /dev/null";
+    run.ok = std::system(command.c_str()) == 0;
+    return run;
+}
+
+std::vector<Stage> build_stages(const Corpus& corpus, const std::filesystem::path& page_images_dir,
+                                const BenchOptions& options) {
+    const int scan_pages = static_cast<int>(corpus.scan_images.size());
+    std::vector<Stage> stages;
+
+    stages.push_back({"extract_vector_pdf", [&corpus](const std::filesystem::path& output_dir) {
+        return extract_pdf(corpus.vector_pdf, output_dir);
+    }});
+    stages.push_back({"extract_scan_pdf", [&corpus](const std::filesystem::path& output_dir) {
+        return extract_pdf(corpus.scan_pdf, output_dir);
+    }});
+    stages.push_back({"cbz_create", [page_images_dir, scan_pages](const std::filesystem::path& output_dir) {
+        StageRun run;
+        run.input_bytes = directory_size(page_images_dir);
+        run.pages = scan_pages;
+        run.ok = CBZCreator::create_cbz_from_directory(page_images_dir.string(), (output_dir / "out.cbz").string());
+        return run;
+    }});
+    stages.push_back({"pdf_write", [&corpus, scan_pages](const std::filesystem::path& output_dir) {
+        StageRun run;
+        run.input_bytes = total_data_size(corpus.scan_images);
+        run.pages = scan_pages;
+        run.ok = PDFCreator::create_pdf_from_images(corpus.scan_images, (output_dir / "out.pdf").string());
+        return run;
+    }});
+    stages.push_back({"cbz_to_pdf_stored", [&corpus, scan_pages](const std::filesystem::path& output_dir) {
+        return convert_cbz(corpus.stored_cbz, output_dir, scan_pages);
+    }});
+    stages.push_back({"cbz_to_pdf_deflated", [&corpus, scan_pages](const std::filesystem::path& output_dir) {
+        return convert_cbz(corpus.deflated_cbz, output_dir, scan_pages);
+    }});
+    stages.push_back({"cbz_to_pdf_downscaled", [&corpus, scan_pages](const std::filesystem::path& output_dir) {
+        // Two thirds of the scan size: a 1/2 scaled decode followed by a resample.
+        PageDownscale downscale;
+        downscale.max_width = corpus.scan_images.front().width * 2 / 3;
+        downscale.max_height = corpus.scan_images.front().height * 2 / 3;
+        return convert_cbz(corpus.stored_cbz, output_dir, scan_pages, downscale);
+    }});
+    stages.push_back({"end_to_end_pdf_to_cbz", [&corpus, scan_pages](const std::filesystem::path& output_dir) {
+        PdfConversionOptions options;
+        options.create_cbz = true;
+        options.clean_images = true;
+        StageRun run;
+        run.input_bytes = file_size_or_zero(corpus.scan_pdf);
+        run.pages = scan_pages;
+        run.ok = ConverterService::ConvertSinglePdf(corpus.scan_pdf, output_dir, options, [](const std::string&) {});
+        return run;
+    }});
+    stages.push_back({"end_to_end_cbz_to_pdf", [&corpus, scan_pages](const std::filesystem::path& output_dir) {
+        StageRun run;
+        run.input_bytes = file_size_or_zero(corpus.deflated_cbz);
+        run.pages = scan_pages;
+        run.ok = ConverterService::ConvertSingleCbz(corpus.deflated_cbz, output_dir, {}, [](const std::string&) {});
+        return run;
+    }});
+
+    // The same batch converted by parallel threads in one process and by as many worker
+    // processes, to weigh the isolation of --processes against its overhead.
+    if (!options.converter.empty()) {
+        const auto batch_dir = options.work_dir / "corpus" / "batch";
+        std::error_code ec;
+        std::filesystem::create_directories(batch_dir, ec);
+        int batch_pages = 0;
+        for (int copy = 0; copy < 2; ++copy) {
+            for (const auto& pdf : {corpus.vector_pdf, corpus.scan_pdf}) {
+                const auto target = batch_dir / (std::to_string(copy) + "_" + pdf.filename().string());
+                std::filesystem::copy_file(pdf, target, std::filesystem::copy_options::overwrite_existing, ec);
+                PDFImageExtractor extractor(pdf.string());
+                batch_pages += extractor.get_page_count();
+            }
+        }
+        const std::string parallel = std::to_string(std::clamp(Concurrency::available_cpus(), 2u, 4u));
+        stages.push_back({"batch_threads", [options, batch_dir, batch_pages, parallel](const std::filesystem::path& output_dir) {
+            return run_converter(options.converter, batch_dir, output_dir, "--jobs " + parallel, batch_pages);
+        }});
+        stages.push_back({"batch_processes", [options, batch_dir, batch_pages, parallel](const std::filesystem::path& output_dir) {
+            return run_converter(options.converter, batch_dir, output_dir, "--processes " + parallel, batch_pages);
+        }});
+    }
+
+    return stages;
+}
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--work-dir" && i + 1 < argc) {
+            options.work_dir = argv[++i];
+        } else if (arg == "--scale" && i + 1 < argc) {
+            options.scale = argv[++i];
+        } else if (arg == "--iterations" && i + 1 < argc) {
+            options.iterations = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--filter" && i + 1 < argc) {
+            options.filter = argv[++i];
+        } else if (arg == "--label" && i + 1 < argc) {
+            options.label = argv[++i];
+        } else if (arg == "--output" && i + 1 < argc) {
+            options.output_path = argv[++i];
+        } else if (arg == "--no-buffer-pool") {
+            options.buffer_pool = false;
+        } else if (arg == "--converter" && i + 1 < argc) {
+            options.converter = argv[++i];
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--work-dir DIR] [--scale small|medium|large] [--iterations N]"
+                      << " [--filter SUBSTRING] [--label TEXT] [--output FILE] [--no-buffer-pool]"
+                      << " [--converter PATH]" << std::endl;
+            return 1;
+        }
+    }
+
+    BufferPool::shared().set_enabled(options.buffer_pool);
+
+    const CorpusSpec spec = CorpusGenerator::spec_for_scale(options.scale);
+    Corpus corpus;
+    std::cerr << "Generating " << options.scale << " corpus in " << options.work_dir << std::endl;
+    if (!CorpusGenerator::generate(options.work_dir / "corpus", spec, corpus)) {
+        std::cerr << "Failed to generate benchmark corpus" << std::endl;
+        return 1;
+    }
+
+    // CBZ creation packs already-rendered pages; render them once outside the timings.
+    const auto page_images_dir = options.work_dir / "corpus" / "pages";
+    {
+        std::error_code ec;
+        std::filesystem::remove_all(page_images_dir, ec);
+        ScopedSilence silence;
+        extract_pdf(corpus.scan_pdf, page_images_dir);
+    }
+
+    std::vector<StageResult> results;
+    for (const auto& stage : build_stages(corpus, page_images_dir, options)) {
+        if (!options.filter.empty() && stage.name.find(options.filter) == std::string::npos) {
+            continue;
+        }
+        std::cerr << "Running " << stage.name << "..." << std::endl;
+        results.push_back(run_stage(stage, options));
+        std::cerr << "  median " << median(results.back().wall_seconds) << " s"
+                  << (results.back().ok ? "" : " (FAILED)") << std::endl;
+    }
+
+    const std::string json = to_json(options, spec, results);
+    if (options.output_path.empty()) {
+        std::cout << json;
+    } else {
+        std::ofstream output(options.output_path, std::ios::binary);
+        output << json;
+        if (!output) {
+            std::cerr << "Failed to write " << options.output_path << std::endl;
+            return 1;
+        }
+    }
+
+    const bool all_ok = std::all_of(results.begin(), results.end(), [](const StageResult& result) { return result.ok; });
+    return all_ok ? 0 : 1;
+}
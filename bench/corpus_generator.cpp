@@ -0,0 +1,280 @@
+#include "corpus_generator.h"
+
+#include "image_encoder.h"
+#include "output_sink.h"
+
+#include <zip.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+namespace {
+// xorshift32: unlike the <random> distributions its output is identical on every
+// standard library, which keeps the corpus byte-for-byte reproducible.
+class Random {
+public:
+    explicit Random(std::uint32_t seed) : state_(seed ? seed : 0x9E3779B9u) {}
+
+    std::uint32_t next() {
+        state_ ^= state_ << 13;
+        state_ ^= state_ >> 17;
+        state_ ^= state_ << 5;
+        return state_;
+    }
+
+    int uniform(int low, int high) {
+        return low + static_cast<int>(next() % static_cast<std::uint32_t>(high - low + 1));
+    }
+
+private:
+    std::uint32_t state_;
+};
+
+std::uint8_t clamp_channel(int value) {
+    return static_cast<std::uint8_t>(std::clamp(value, 0, 255));
+}
+
+// Paper-coloured background with grain, a grid of inked panels with gradient fills and
+// hatching: enough structure that JPEG sizes resemble real scanned comic pages.
+std::vector<std::uint8_t> render_scan_page(const CorpusSpec& spec, Random& random) {
+    const int width = spec.scan_width;
+    const int height = spec.scan_height;
+    std::vector<std::uint8_t> pixels(static_cast<std::size_t>(width) * height * 3);
+
+    for (int y = 0; y < height; ++y) {
+        std::uint8_t* row = pixels.data() + static_cast<std::size_t>(y) * width * 3;
+        for (int x = 0; x < width; ++x) {
+            const int grain = static_cast<int>(random.next() % 17) - 8;
+            row[x * 3 + 0] = clamp_channel(240 + grain);
+            row[x * 3 + 1] = clamp_channel(236 + grain);
+            row[x * 3 + 2] = clamp_channel(226 + grain);
+        }
+    }
+
+    const int columns = random.uniform(1, 3);
+    const int rows = random.uniform(2, 4);
+    const int margin = width / 20;
+    const int cell_width = (width - 2 * margin) / columns;
+    const int cell_height = (height - 2 * margin) / rows;
+    for (int row_index = 0; row_index < rows; ++row_index) {
+        for (int column = 0; column < columns; ++column) {
+            const int left = margin + column * cell_width + 8;
+            const int top = margin + row_index * cell_height + 8;
+            const int right = left + cell_width - 16;
+            const int bottom = top + cell_height - 16;
+            const int base = random.uniform(60, 200);
+            const int hatch = random.uniform(6, 18);
+
+            for (int y = top; y < bottom; ++y) {
+                std::uint8_t* row = pixels.data() + static_cast<std::size_t>(y) * width * 3;
+                for (int x = left; x < right; ++x) {
+                    const bool border = x < left + 5 || x >= right - 5 || y < top + 5 || y >= bottom - 5;
+                    const bool hatched = ((x + y) % hatch) < 2;
+                    const int grain = static_cast<int>(random.next() % 13) - 6;
+                    const int shade = grain + (border ? 20 : base + (y - top) * 40 / (bottom - top) - (hatched ? 50 : 0));
+                    row[x * 3 + 0] = clamp_channel(shade);
+                    row[x * 3 + 1] = clamp_channel(shade - 10);
+                    row[x * 3 + 2] = clamp_channel(shade + 15);
+                }
+            }
+        }
+    }
+
+    return pixels;
+}
+
+std::string coordinate(Random& random, int limit) {
+    char text[16];
+    std::snprintf(text, sizeof(text), "%.1f", random.uniform(0, limit * 10) / 10.0);
+    return text;
+}
+
+std::string vector_page_content(const CorpusSpec& spec, Random& random) {
+    std::string content;
+    for (int i = 0; i < spec.vector_paths; ++i) {
+        char color[64];
+        std::snprintf(color, sizeof(color), "%.3f %.3f %.3f", random.uniform(0, 1000) / 1000.0,
+                      random.uniform(0, 1000) / 1000.0, random.uniform(0, 1000) / 1000.0);
+        content += std::string(color) + (i % 2 ? " RG " : " rg ");
+        content += std::to_string(random.uniform(1, 4)) + " w\n";
+        content += coordinate(random, 612) + " " + coordinate(random, 792) + " m\n";
+        const int segments = random.uniform(2, 6);
+        for (int s = 0; s < segments; ++s) {
+            for (int point = 0; point < 3; ++point) {
+                content += coordinate(random, 612) + " " + coordinate(random, 792) + " ";
+            }
+            content += "c\n";
+        }
+        content += i % 2 ? "S\n" : "h f\n";
+    }
+
+    content += "0 0 0 rg\nBT /F1 9 Tf 40 760 Td 11 TL\n";
+    for (int line = 0; line < 60; ++line) {
+        content += "(Synthetic benchmark text line " + std::to_string(line) + " with some filler words) '\n";
+    }
+    content += "ET\n";
+    return content;
+}
+
+bool write_vector_pdf(const std::filesystem::path& path, const CorpusSpec& spec, Random& random) {
+    OutputSink output;
+    if (!output.open(path.string())) {
+        std::cerr << output.error() << std::endl;
+        return false;
+    }
+
+    const int object_count = 3 + spec.vector_pages * 2;
+    std::vector<std::uint64_t> offsets(static_cast<std::size_t>(object_count) + 1);
+    output.write("%PDF-1.4\n");
+
+    offsets[1] = output.offset();
+    output.write("1 0 obj\n<< /Type /Catalog /Pages 2 0 R >>\nendobj\n");
+
+    offsets[2] = output.offset();
+    std::string kids;
+    for (int page = 0; page < spec.vector_pages; ++page) {
+        kids += " " + std::to_string(4 + page * 2) + " 0 R";
+    }
+    output.write("2 0 obj\n<< /Type /Pages /Count " + std::to_string(spec.vector_pages) + " /Kids [" + kids + " ] >>\nendobj\n");
+
+    offsets[3] = output.offset();
+    output.write("3 0 obj\n<< /Type /Font /Subtype /Type1 /BaseFont /Helvetica >>\nendobj\n");
+
+    for (int page = 0; page < spec.vector_pages; ++page) {
+        const int page_id = 4 + page * 2;
+        const int content_id = page_id + 1;
+        const std::string content = vector_page_content(spec, random);
+
+        std::vector<std::uint8_t> compressed(compressBound(static_cast<uLong>(content.size())));
+        uLongf compressed_size = static_cast<uLongf>(compressed.size());
+        if (compress2(compressed.data(), &compressed_size, reinterpret_cast<const Bytef*>(content.data()),
+                      static_cast<uLong>(content.size()), 6) != Z_OK) {
+            return false;
+        }
+
+        offsets[static_cast<std::size_t>(page_id)] = output.offset();
+        output.write(std::to_string(page_id) + " 0 obj\n<< /Type /Page /Parent 2 0 R /MediaBox [0 0 612 792] "
+                     "/Resources << /Font << /F1 3 0 R >> >> /Contents " + std::to_string(content_id) + " 0 R >>\nendobj\n");
+
+        offsets[static_cast<std::size_t>(content_id)] = output.offset();
+        output.write(std::to_string(content_id) + " 0 obj\n<< /Length " + std::to_string(compressed_size) +
+                     " /Filter /FlateDecode >>\nstream\n");
+        output.write(compressed.data(), compressed_size);
+        output.write("\nendstream\nendobj\n");
+    }
+
+    const std::uint64_t xref_offset = output.offset();
+    output.write("xref\n0 " + std::to_string(object_count + 1) + "\n0000000000 65535 f \n");
+    for (int id = 1; id <= object_count; ++id) {
+        char entry[32];
+        std::snprintf(entry, sizeof(entry), "%010llu 00000 n \n",
+                      static_cast<unsigned long long>(offsets[static_cast<std::size_t>(id)]));
+        output.write(entry);
+    }
+    output.write("trailer\n<< /Size " + std::to_string(object_count + 1) + " /Root 1 0 R >>\nstartxref\n" +
+                 std::to_string(xref_offset) + "\n%%EOF\n");
+
+    if (!output.commit()) {
+        std::cerr << output.error() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool write_cbz(const std::filesystem::path& path, const std::vector<PDFImageInput>& pages, zip_int32_t method) {
+    int error = 0;
+    zip_t* archive = zip_open(path.string().c_str(), ZIP_CREATE | ZIP_TRUNCATE, &error);
+    if (!archive) {
+        std::cerr << "Failed to create " << path << std::endl;
+        return false;
+    }
+
+    for (const auto& page : pages) {
+        zip_source_t* source = zip_source_buffer(archive, page.data.data(), page.data.size(), 0);
+        const zip_int64_t index = source ? zip_file_add(archive, page.name.c_str(), source, ZIP_FL_OVERWRITE) : -1;
+        if (index < 0) {
+            zip_source_free(source);
+            zip_discard(archive);
+            std::cerr << "Failed to add " << page.name << " to " << path << std::endl;
+            return false;
+        }
+        zip_set_file_compression(archive, static_cast<zip_uint64_t>(index), method, 0);
+    }
+
+    if (zip_close(archive) != 0) {
+        std::cerr << "Failed to write " << path << std::endl;
+        zip_discard(archive);
+        return false;
+    }
+    return true;
+}
+}
+
+CorpusSpec CorpusGenerator::spec_for_scale(const std::string& scale) {
+    CorpusSpec spec;
+    if (scale == "medium") {
+        spec.vector_pages = 32;
+        spec.vector_paths = 1500;
+        spec.scan_pages = 60;
+        spec.scan_width = 1800;
+        spec.scan_height = 2700;
+    } else if (scale == "large") {
+        spec.vector_pages = 120;
+        spec.vector_paths = 4000;
+        spec.scan_pages = 240;
+        spec.scan_width = 2400;
+        spec.scan_height = 3600;
+    }
+    return spec;
+}
+
+bool CorpusGenerator::generate(const std::filesystem::path& directory, const CorpusSpec& spec, Corpus& corpus) {
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+    if (ec) {
+        std::cerr << "Failed to create corpus directory: " << directory << std::endl;
+        return false;
+    }
+
+    Random random(spec.seed);
+
+    corpus.vector_pdf = directory / "vector.pdf";
+    if (!write_vector_pdf(corpus.vector_pdf, spec, random)) {
+        return false;
+    }
+
+    corpus.scan_images.clear();
+    for (int page = 0; page < spec.scan_pages; ++page) {
+        const std::vector<std::uint8_t> pixels = render_scan_page(spec, random);
+
+        PixelBuffer buffer;
+        buffer.data = pixels.data();
+        buffer.width = spec.scan_width;
+        buffer.height = spec.scan_height;
+        buffer.stride = static_cast<std::size_t>(spec.scan_width) * 3;
+        buffer.format = PixelFormat::rgb24;
+
+        char name[32];
+        std::snprintf(name, sizeof(name), "page%03d.jpg", page + 1);
+
+        PDFImageInput image;
+        image.name = name;
+        image.width = spec.scan_width;
+        image.height = spec.scan_height;
+        image.components = 3;
+        if (!ImageEncoder::encode_jpeg(buffer, spec.jpeg_quality, 0, image.data)) {
+            std::cerr << "Failed to encode synthetic page " << name << std::endl;
+            return false;
+        }
+        corpus.scan_images.push_back(std::move(image));
+    }
+
+    corpus.scan_pdf = directory / "scan.pdf";
+    corpus.stored_cbz = directory / "stored.cbz";
+    corpus.deflated_cbz = directory / "deflated.cbz";
+    return PDFCreator::create_pdf_from_images(corpus.scan_images, corpus.scan_pdf.string()) &&
+           write_cbz(corpus.stored_cbz, corpus.scan_images, ZIP_CM_STORE) &&
+           write_cbz(corpus.deflated_cbz, corpus.scan_images, ZIP_CM_DEFLATE);
+}
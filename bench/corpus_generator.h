@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "pdf_creator.h"
+
+struct CorpusSpec {
+    int vector_pages = 8;       // pages of the path/text-heavy PDF
+    int vector_paths = 400;     // filled and stroked paths per vector page
+    int scan_pages = 12;        // pages of the single-image-per-page PDF and CBZs
+    int scan_width = 1200;
+    int scan_height = 1800;
+    int jpeg_quality = 85;
+    std::uint32_t seed = 1;
+};
+
+struct Corpus {
+    std::filesystem::path vector_pdf;
+    std::filesystem::path scan_pdf;
+    std::filesystem::path stored_cbz;
+    std::filesystem::path deflated_cbz;
+    // The encoded scan pages, kept in memory for PDFCreator benchmarks.
+    std::vector<PDFImageInput> scan_images;
+};
+
+// Generates deterministic benchmark inputs: the same spec always produces the same
+// bytes, so results from different commits are comparable.
+class CorpusGenerator {
+public:
+    // "small", "medium" or "large"; unknown names fall back to "small".
+    static CorpusSpec spec_for_scale(const std::string& scale);
+
+    static bool generate(const std::filesystem::path& directory, const CorpusSpec& spec, Corpus& corpus);
+};
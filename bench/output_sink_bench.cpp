@@ -0,0 +1,167 @@
+// Compares OutputSink against the std::ofstream pattern it replaced in PDFCreator
+// (operator<< formatting, tellp per object, snprintf for xref lines) on a PDF-shaped
+// workload: many small formatted object headers interleaved with large image payloads.
+//
+// Usage: output_sink_bench <output_dir> [--size-gb N] [--payload-kb N] [--sync none|fdatasync|fsync]
+
+#include "output_sink.h"
+
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+struct BenchConfig {
+    std::filesystem::path output_dir;
+    std::uint64_t total_bytes = 4ull << 30;
+    std::size_t payload_size = 512 * 1024;
+    SyncMode sync = SyncMode::none;
+};
+
+struct BenchResult {
+    std::uint64_t bytes = 0;
+    double seconds = 0.0;
+};
+
+std::vector<char> make_payload(std::size_t size) {
+    std::vector<char> payload(size);
+    std::mt19937 generator(42);
+    for (auto& byte : payload) {
+        byte = static_cast<char>(generator());
+    }
+    return payload;
+}
+
+BenchResult run_ofstream(const BenchConfig& config, const std::vector<char>& payload) {
+    const auto path = config.output_dir / "ofstream.pdf";
+    const auto start = std::chrono::steady_clock::now();
+
+    std::ofstream output(path, std::ios::binary);
+    std::vector<std::streamoff> offsets;
+    output << "%PDF-1.4\n";
+    int id = 1;
+    while (static_cast<std::uint64_t>(output.tellp()) < config.total_bytes) {
+        offsets.push_back(output.tellp());
+        output << id << " 0 obj\n<< /Type /XObject /Subtype /Image /Length " << payload.size() << " >>\nstream\n";
+        output.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+        output << "\nendstream\nendobj\n";
+        ++id;
+    }
+
+    const auto xref_offset = output.tellp();
+    output << "xref\n0 " << id << "\n0000000000 65535 f \n";
+    for (const auto offset : offsets) {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%010llu 00000 n \n", static_cast<unsigned long long>(offset));
+        output << buffer;
+    }
+    output << "trailer\n<< /Size " << id << " >>\nstartxref\n" << xref_offset << "\n%%EOF";
+    output.close();
+
+    BenchResult result;
+    result.bytes = std::filesystem::file_size(path);
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::filesystem::remove(path);
+    return result;
+}
+
+BenchResult run_sink(const BenchConfig& config, const std::vector<char>& payload) {
+    const auto path = config.output_dir / "sink.pdf";
+    const auto start = std::chrono::steady_clock::now();
+
+    OutputSinkOptions options;
+    options.sync = config.sync;
+    OutputSink output(options);
+    if (!output.open(path.string())) {
+        std::cerr << output.error() << std::endl;
+        return {};
+    }
+
+    std::vector<std::uint64_t> offsets;
+    output.write("%PDF-1.4\n");
+    std::uint64_t id = 1;
+    while (output.offset() < config.total_bytes) {
+        offsets.push_back(output.offset());
+        output.write_number(id);
+        output.write(" 0 obj\n<< /Type /XObject /Subtype /Image /Length ");
+        output.write_number(payload.size());
+        output.write(" >>\nstream\n");
+        output.write(payload.data(), payload.size());
+        output.write("\nendstream\nendobj\n");
+        ++id;
+    }
+
+    const std::uint64_t xref_offset = output.offset();
+    output.write("xref\n0 ");
+    output.write_number(id);
+    output.write("\n0000000000 65535 f \n");
+    for (const auto offset : offsets) {
+        char entry[] = "0000000000 00000 n \n";
+        char digits[20];
+        const auto length = static_cast<std::size_t>(std::to_chars(digits, digits + sizeof(digits), offset).ptr - digits);
+        std::memcpy(entry + 10 - length, digits, length);
+        output.write(entry, 20);
+    }
+    output.write("trailer\n<< /Size ");
+    output.write_number(id);
+    output.write(" >>\nstartxref\n");
+    output.write_number(xref_offset);
+    output.write("\n%%EOF");
+
+    BenchResult result;
+    result.bytes = output.offset();
+    if (!output.commit()) {
+        std::cerr << output.error() << std::endl;
+        return {};
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::filesystem::remove(path);
+    return result;
+}
+
+void report(const std::string& name, const BenchResult& result) {
+    const double megabytes = static_cast<double>(result.bytes) / (1024.0 * 1024.0);
+    std::cout << name << ": " << megabytes << " MiB in " << result.seconds << " s ("
+              << (result.seconds > 0 ? megabytes / result.seconds : 0.0) << " MiB/s)" << std::endl;
+}
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cout << "Usage: " << argv[0]
+                  << " <output_dir> [--size-gb N] [--payload-kb N] [--sync none|fdatasync|fsync]" << std::endl;
+        return 1;
+    }
+
+    BenchConfig config;
+    config.output_dir = argv[1];
+    for (int i = 2; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--size-gb" && i + 1 < argc) {
+            config.total_bytes = static_cast<std::uint64_t>(std::atof(argv[++i]) * (1ull << 30));
+        } else if (arg == "--payload-kb" && i + 1 < argc) {
+            config.payload_size = static_cast<std::size_t>(std::atoi(argv[++i])) * 1024;
+        } else if (arg == "--sync" && i + 1 < argc) {
+            const std::string mode = argv[++i];
+            config.sync = mode == "fsync" ? SyncMode::fsync : mode == "fdatasync" ? SyncMode::fdatasync : SyncMode::none;
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    std::filesystem::create_directories(config.output_dir);
+    const auto payload = make_payload(config.payload_size);
+
+    report("std::ofstream", run_ofstream(config, payload));
+    report("OutputSink", run_sink(config, payload));
+    return 0;
+}
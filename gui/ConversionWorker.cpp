@@ -1,4 +1,5 @@
 #include "ConversionWorker.h"
+#include "concurrency.h"
 
 #include <QStringLiteral>
 
@@ -6,6 +7,12 @@
 #include <vector>
 
 namespace {
+// The progress bar advances this many steps per file, driven by per-page progress.
+constexpr int kProgressStepsPerFile = 100;
+
+// Lines held for the GUI between refreshes; older lines are dropped beyond this.
+constexpr int kMaxPendingLines = 1000;
+
 #ifdef _WIN32
 std::filesystem::path MakePath(const QString& value) {
     return std::filesystem::path(value.toStdWString());
@@ -24,6 +31,48 @@ void ConversionWorker::requestCancel() {
     cancelled_.store(true);
 }
 
+ConversionWorker::Updates ConversionWorker::takeUpdates() {
+    std::lock_guard<std::mutex> lock(updatesMutex_);
+    Updates updates = std::move(pending_);
+    pending_ = Updates{};
+    updatesPosted_ = false;
+    return updates;
+}
+
+void ConversionWorker::postLog(const QString& message) {
+    std::unique_lock<std::mutex> lock(updatesMutex_);
+    pending_.lines.append(message);
+    if (pending_.lines.size() > kMaxPendingLines) {
+        pending_.lines.removeFirst();
+        ++pending_.droppedLines;
+    }
+    notifyUpdates(lock);
+}
+
+void ConversionWorker::postProgress(int value) {
+    std::unique_lock<std::mutex> lock(updatesMutex_);
+    if (pending_.progress == value) {
+        return;
+    }
+    pending_.progress = value;
+    notifyUpdates(lock);
+}
+
+void ConversionWorker::postPage(int file, int page, const QString& path) {
+    std::unique_lock<std::mutex> lock(updatesMutex_);
+    pending_.pages.append(FinishedPage{file, page, path});
+    notifyUpdates(lock);
+}
+
+void ConversionWorker::notifyUpdates(std::unique_lock<std::mutex>& lock) {
+    if (updatesPosted_) {
+        return;
+    }
+    updatesPosted_ = true;
+    lock.unlock();
+    emit updatesAvailable();
+}
+
 std::filesystem::path ConversionWorker::ToPath(const QString& value) {
     return MakePath(value);
 }
@@ -31,9 +80,22 @@ std::filesystem::path ConversionWorker::ToPath(const QString& value) {
 void ConversionWorker::process() {
     auto input_path = ToPath(settings_.inputPath);
     auto output_path = ToPath(settings_.outputPath);
+    Concurrency::set_worker_threads(static_cast<unsigned int>(settings_.workerThreads));
+    postLog(QStringLiteral("CPUs available: %1; page workers: %2")
+                .arg(QString::fromStdString(Concurrency::describe()))
+                .arg(Concurrency::worker_threads()));
 
+    // Called from page worker threads as well as this one.
     auto logger = [this](const std::string& message) {
-        emit logMessage(QString::fromStdString(message));
+        postLog(QString::fromStdString(message));
+    };
+
+    // Progress within the current file, mapped onto its slice of the overall bar.
+    int current_file = 0;
+    ConversionContext context;
+    context.cancel = &cancelled_;
+    context.progress = [this, &current_file](int done, int total) {
+        postProgress(current_file * kProgressStepsPerFile + (total > 0 ? done * kProgressStepsPerFile / total : 0));
     };
 
     auto ensure_output_dir = [this](const std::filesystem::path& directory) -> bool {
@@ -71,8 +133,8 @@ void ConversionWorker::process() {
                 return;
             }
 
-            emit progressRange(static_cast<int>(cbz_files.size()));
-            emit progressValue(0);
+            emit progressRange(static_cast<int>(cbz_files.size()) * kProgressStepsPerFile);
+            postProgress(0);
 
             int processed = 0;
             int successful = 0;
@@ -80,11 +142,16 @@ void ConversionWorker::process() {
 
             for (const auto& cbz : cbz_files) {
                 if (cancelled_.load()) {
-                    emit logMessage(QStringLiteral("Conversion cancelled by user."));
+                    postLog(QStringLiteral("Conversion cancelled by user."));
                     break;
                 }
 
-                bool ok = ConverterService::ConvertSingleCbz(cbz, output_path, logger);
+                current_file = processed;
+                bool ok = ConverterService::ConvertSingleCbz(cbz, output_path, settings_.cbzOptions, logger, context);
+                if (!ok && cancelled_.load()) {
+                    postLog(QStringLiteral("Conversion cancelled by user."));
+                    break;
+                }
                 if (ok) {
                     ++successful;
                 } else {
@@ -92,7 +159,7 @@ void ConversionWorker::process() {
                 }
 
                 ++processed;
-                emit progressValue(processed);
+                postProgress(processed * kProgressStepsPerFile);
             }
 
             emit finished(successful, failed, cancelled_.load());
@@ -120,8 +187,15 @@ void ConversionWorker::process() {
             return;
         }
 
-        emit progressRange(static_cast<int>(pdf_files.size()));
-        emit progressValue(0);
+        // Page images only survive the conversion when they are not cleaned up afterwards.
+        if (!settings_.pdfOptions.clean_images) {
+            context.page_written = [this, &current_file](int page, const std::string& path) {
+                postPage(current_file, page, QString::fromStdString(path));
+            };
+        }
+
+        emit progressRange(static_cast<int>(pdf_files.size()) * kProgressStepsPerFile);
+        postProgress(0);
 
         int processed = 0;
         int successful = 0;
@@ -129,11 +203,16 @@ void ConversionWorker::process() {
 
         for (const auto& pdf : pdf_files) {
             if (cancelled_.load()) {
-                emit logMessage(QStringLiteral("Conversion cancelled by user."));
+                postLog(QStringLiteral("Conversion cancelled by user."));
                 break;
             }
 
-            bool ok = ConverterService::ConvertSinglePdf(pdf, output_path, settings_.pdfOptions, logger);
+            current_file = processed;
+            bool ok = ConverterService::ConvertSinglePdf(pdf, output_path, settings_.pdfOptions, logger, context);
+            if (!ok && cancelled_.load()) {
+                postLog(QStringLiteral("Conversion cancelled by user."));
+                break;
+            }
             if (ok) {
                 ++successful;
             } else {
@@ -141,7 +220,7 @@ void ConversionWorker::process() {
             }
 
             ++processed;
-            emit progressValue(processed);
+            postProgress(processed * kProgressStepsPerFile);
         }
 
         emit finished(successful, failed, cancelled_.load());
@@ -1,10 +1,13 @@
 #pragma once
 
+#include <QList>
 #include <QObject>
 #include <QString>
+#include <QStringList>
 
 #include <atomic>
 #include <filesystem>
+#include <mutex>
 
 #include "converter_service.h"
 
@@ -16,20 +19,41 @@ public:
         QString inputPath;
         QString outputPath;
         PdfConversionOptions pdfOptions;
+        CbzConversionOptions cbzOptions;
         bool convertToPdf = false;
+        int workerThreads = 0;  // page workers per file; 0 uses every CPU the process may use
+    };
+
+    // A page image written to disk, for the preview strip.
+    struct FinishedPage {
+        int file = 0;
+        int page = 0;
+        QString path;
+    };
+
+    // Log lines, progress and finished pages accumulated since the last takeUpdates() call.
+    struct Updates {
+        QStringList lines;
+        int droppedLines = 0;  // oldest lines discarded because the GUI fell behind
+        int progress = -1;     // latest progress value, or -1 if unchanged
+        QList<FinishedPage> pages;
     };
 
     explicit ConversionWorker(Settings settings, QObject* parent = nullptr);
 
     void requestCancel();
 
+    // Thread-safe; called from the GUI thread after updatesAvailable().
+    Updates takeUpdates();
+
 public slots:
     void process();
 
 signals:
-    void logMessage(const QString& message);
+    // Emitted once when updates become pending and not again until they are taken, so
+    // at most one notification is queued however fast pages complete.
+    void updatesAvailable();
     void progressRange(int maximum);
-    void progressValue(int value);
     void finished(int successful, int failed, bool cancelled);
     void error(const QString& message);
 
@@ -37,5 +61,14 @@ private:
     Settings settings_;
     std::atomic_bool cancelled_{false};
 
+    std::mutex updatesMutex_;
+    Updates pending_;
+    bool updatesPosted_ = false;
+
+    void postLog(const QString& message);
+    void postProgress(int value);
+    void postPage(int file, int page, const QString& path);
+    void notifyUpdates(std::unique_lock<std::mutex>& lock);
+
     static std::filesystem::path ToPath(const QString& value);
 };
@@ -1,7 +1,10 @@
 #include "MainWindow.h"
+#include "PagePreviewModel.h"
+#include "concurrency.h"
 
 #include <QCheckBox>
 #include <QComboBox>
+#include <QDesktopServices>
 #include <QDoubleSpinBox>
 #include <QFileDialog>
 #include <QDir>
@@ -10,21 +13,37 @@
 #include <QHBoxLayout>
 #include <QLabel>
 #include <QLineEdit>
+#include <QListView>
 #include <QMessageBox>
 #include <QPlainTextEdit>
 #include <QProgressBar>
 #include <QPushButton>
+#include <QScrollBar>
 #include <QSpinBox>
 #include <QStringLiteral>
 #include <QTextCursor>
 #include <QThread>
+#include <QTimer>
+#include <QUrl>
 #include <QVBoxLayout>
 #include <QWidget>
 
+namespace {
+// Worker updates are applied at most this often (about 30 frames per second).
+constexpr int kRefreshIntervalMs = 33;
+
+// The log view keeps only the most recent lines.
+constexpr int kMaxLogLines = 5000;
+
+// Room around each thumbnail in the preview strip for its caption.
+constexpr int kPreviewCellMargin = 12;
+constexpr int kPreviewCaptionHeight = 24;
+}
+
 MainWindow::MainWindow(QWidget* parent)
     : QMainWindow(parent) {
     setWindowTitle(tr("C++ Comic Converter"));
-    resize(820, 600);
+    resize(820, 800);
 
     auto* centralWidget = new QWidget(this);
     auto* mainLayout = new QVBoxLayout(centralWidget);
@@ -90,9 +109,24 @@ MainWindow::MainWindow(QWidget* parent)
     pdfCheck_ = new QCheckBox(tr("Convert CBZ to PDF"), this);
     connect(pdfCheck_, &QCheckBox::toggled, this, &MainWindow::handlePdfToggle);
 
+    pdfLayoutCombo_ = new QComboBox(this);
+    pdfLayoutCombo_->addItems({QStringLiteral("classic"), QStringLiteral("compact"), QStringLiteral("linearized")});
+    pdfLayoutCombo_->setEnabled(false);
+
     grid->addWidget(cbzCheck_, 5, 0, 1, 2);
     grid->addWidget(cleanCheck_, 6, 0, 1, 2);
     grid->addWidget(pdfCheck_, 7, 0, 1, 2);
+    grid->addWidget(new QLabel(tr("PDF layout"), this), 8, 0);
+    grid->addWidget(pdfLayoutCombo_, 8, 1);
+
+    // 0 shows as "Auto": one worker per CPU allowed by the affinity mask and cgroup quota.
+    threadsSpin_ = new QSpinBox(this);
+    threadsSpin_->setRange(0, 256);
+    threadsSpin_->setSpecialValueText(tr("Auto (%1)").arg(Concurrency::available_cpus()));
+    threadsSpin_->setValue(0);
+
+    grid->addWidget(new QLabel(tr("Worker threads"), this), 9, 0);
+    grid->addWidget(threadsSpin_, 9, 1);
 
     mainLayout->addLayout(grid);
 
@@ -115,11 +149,40 @@ MainWindow::MainWindow(QWidget* parent)
     progressBar_->setTextVisible(true);
     mainLayout->addWidget(progressBar_);
 
+    // Single-row strip of finished pages. Uniform item sizes and batched layout keep it
+    // responsive with thousands of items; the model only decodes visible thumbnails.
+    const QSize thumbnail = PagePreviewModel::thumbnailSize();
+    const QSize cell(thumbnail.width() + kPreviewCellMargin,
+                     thumbnail.height() + kPreviewCellMargin + kPreviewCaptionHeight);
+    previewModel_ = new PagePreviewModel(this);
+    previewView_ = new QListView(this);
+    previewView_->setModel(previewModel_);
+    previewView_->setViewMode(QListView::IconMode);
+    previewView_->setFlow(QListView::LeftToRight);
+    previewView_->setWrapping(false);
+    previewView_->setMovement(QListView::Static);
+    previewView_->setResizeMode(QListView::Adjust);
+    previewView_->setUniformItemSizes(true);
+    previewView_->setLayoutMode(QListView::Batched);
+    previewView_->setIconSize(thumbnail);
+    previewView_->setGridSize(cell);
+    previewView_->setHorizontalScrollMode(QAbstractItemView::ScrollPerPixel);
+    previewView_->setFixedHeight(cell.height() + previewView_->horizontalScrollBar()->sizeHint().height() + 2 * previewView_->frameWidth());
+    previewView_->setToolTip(tr("Double-click a page to open it"));
+    connect(previewView_, &QListView::doubleClicked, this, &MainWindow::openPreviewPage);
+    mainLayout->addWidget(previewView_);
+
     logView_ = new QPlainTextEdit(this);
     logView_->setReadOnly(true);
-    logView_->setMinimumHeight(280);
+    logView_->setMinimumHeight(200);
+    logView_->setMaximumBlockCount(kMaxLogLines);
     mainLayout->addWidget(logView_, 1);
 
+    refreshTimer_ = new QTimer(this);
+    refreshTimer_->setSingleShot(true);
+    refreshTimer_->setInterval(kRefreshIntervalMs);
+    connect(refreshTimer_, &QTimer::timeout, this, &MainWindow::applyWorkerUpdates);
+
     setCentralWidget(centralWidget);
 }
 
@@ -183,6 +246,7 @@ void MainWindow::startConversion() {
     }
 
     logView_->clear();
+    previewModel_->clear();
     appendLog(tr("Starting conversion..."));
     progressBar_->setRange(0, 0);
     progressBar_->setValue(0);
@@ -196,9 +260,8 @@ void MainWindow::startConversion() {
     worker_->moveToThread(workerThread_);
 
     connect(workerThread_, &QThread::started, worker_, &ConversionWorker::process);
-    connect(worker_, &ConversionWorker::logMessage, this, &MainWindow::handleLogMessage);
+    connect(worker_, &ConversionWorker::updatesAvailable, this, &MainWindow::handleUpdatesAvailable);
     connect(worker_, &ConversionWorker::progressRange, this, &MainWindow::handleProgressRange);
-    connect(worker_, &ConversionWorker::progressValue, this, &MainWindow::handleProgressValue);
     connect(worker_, &ConversionWorker::finished, this, &MainWindow::handleFinished);
     connect(worker_, &ConversionWorker::error, this, &MainWindow::handleError);
 
@@ -220,8 +283,31 @@ void MainWindow::cancelConversion() {
     }
 }
 
-void MainWindow::handleLogMessage(const QString& message) {
-    appendLog(message);
+void MainWindow::handleUpdatesAvailable() {
+    if (!refreshTimer_->isActive()) {
+        refreshTimer_->start();
+    }
+}
+
+void MainWindow::applyWorkerUpdates() {
+    refreshTimer_->stop();
+    if (!worker_) {
+        return;
+    }
+
+    auto updates = worker_->takeUpdates();
+    if (updates.droppedLines > 0) {
+        appendLog(tr("... %1 log lines skipped").arg(updates.droppedLines));
+    }
+    if (!updates.lines.isEmpty()) {
+        appendLogLines(updates.lines);
+    }
+    if (updates.progress >= 0 && progressBar_->maximum() != 0) {
+        progressBar_->setValue(updates.progress);
+    }
+    for (const auto& page : updates.pages) {
+        previewModel_->addPage(page.file, page.page, page.path);
+    }
 }
 
 void MainWindow::handleProgressRange(int maximum) {
@@ -233,14 +319,8 @@ void MainWindow::handleProgressRange(int maximum) {
     }
 }
 
-void MainWindow::handleProgressValue(int value) {
-    if (progressBar_->maximum() == 0) {
-        return;
-    }
-    progressBar_->setValue(value);
-}
-
 void MainWindow::handleFinished(int successful, int failed, bool cancelled) {
+    applyWorkerUpdates();
     QString summary = tr("Completed. Successful: %1, Failed: %2").arg(successful).arg(failed);
     if (cancelled) {
         summary.append(tr(" (cancelled)"));
@@ -251,6 +331,7 @@ void MainWindow::handleFinished(int successful, int failed, bool cancelled) {
 }
 
 void MainWindow::handleError(const QString& message) {
+    applyWorkerUpdates();
     appendLog(message);
     QMessageBox::warning(this, tr("Conversion error"), message);
 }
@@ -270,6 +351,13 @@ void MainWindow::handleFormatChanged(const QString& format) {
     qualitySpin_->setEnabled(enableQuality);
 }
 
+void MainWindow::openPreviewPage(const QModelIndex& index) {
+    const QString path = previewModel_->pathAt(index.row());
+    if (!path.isEmpty()) {
+        QDesktopServices::openUrl(QUrl::fromLocalFile(path));
+    }
+}
+
 void MainWindow::setRunningState(bool running) {
     const bool pdfMode = pdfCheck_->isChecked();
     const bool cbzMode = cbzCheck_->isChecked() && !pdfMode;
@@ -291,6 +379,8 @@ void MainWindow::setRunningState(bool running) {
     cbzCheck_->setEnabled(!running && !pdfMode);
     cleanCheck_->setEnabled(cleanEnabled);
     pdfCheck_->setEnabled(!running);
+    pdfLayoutCombo_->setEnabled(!running && pdfMode);
+    threadsSpin_->setEnabled(!running);
 }
 
 ConversionWorker::Settings MainWindow::gatherSettings() const {
@@ -298,6 +388,7 @@ ConversionWorker::Settings MainWindow::gatherSettings() const {
     settings.inputPath = inputPathEdit_->text();
     settings.outputPath = outputPathEdit_->text();
     settings.convertToPdf = pdfCheck_->isChecked();
+    settings.workerThreads = threadsSpin_->value();
 
     PdfConversionOptions options;
     options.format = formatCombo_->currentText().toStdString();
@@ -307,6 +398,15 @@ ConversionWorker::Settings MainWindow::gatherSettings() const {
     options.clean_images = cleanCheck_->isChecked();
     settings.pdfOptions = options;
 
+    CbzConversionOptions cbzOptions;
+    const QString layout = pdfLayoutCombo_->currentText();
+    if (layout == QStringLiteral("compact")) {
+        cbzOptions.pdf_layout = PDFLayout::compact;
+    } else if (layout == QStringLiteral("linearized")) {
+        cbzOptions.pdf_layout = PDFLayout::linearized;
+    }
+    settings.cbzOptions = cbzOptions;
+
     return settings;
 }
 
@@ -316,3 +416,8 @@ void MainWindow::appendLog(const QString& message) {
     cursor.movePosition(QTextCursor::End);
     logView_->setTextCursor(cursor);
 }
+
+void MainWindow::appendLogLines(const QStringList& lines) {
+    // One append per batch keeps layout work independent of the page rate.
+    appendLog(lines.join(QLatin1Char('\n')));
+}
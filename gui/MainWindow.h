@@ -4,15 +4,19 @@
 
 #include "ConversionWorker.h"
 
+class PagePreviewModel;
+
 class QLineEdit;
 class QComboBox;
 class QSpinBox;
 class QDoubleSpinBox;
 class QCheckBox;
 class QPushButton;
+class QListView;
 class QPlainTextEdit;
 class QProgressBar;
 class QThread;
+class QTimer;
 
 class MainWindow : public QMainWindow {
     Q_OBJECT
@@ -27,31 +31,38 @@ private slots:
     void browseOutput();
     void startConversion();
     void cancelConversion();
-    void handleLogMessage(const QString& message);
+    void handleUpdatesAvailable();
+    void applyWorkerUpdates();
     void handleProgressRange(int maximum);
-    void handleProgressValue(int value);
     void handleFinished(int successful, int failed, bool cancelled);
     void handleError(const QString& message);
     void handlePdfToggle(bool enabled);
     void handleFormatChanged(const QString& format);
+    void openPreviewPage(const QModelIndex& index);
 
 private:
     void setRunningState(bool running);
     ConversionWorker::Settings gatherSettings() const;
     void appendLog(const QString& message);
+    void appendLogLines(const QStringList& lines);
 
     QLineEdit* inputPathEdit_ = nullptr;
     QLineEdit* outputPathEdit_ = nullptr;
     QComboBox* formatCombo_ = nullptr;
     QSpinBox* qualitySpin_ = nullptr;
     QDoubleSpinBox* dpiSpin_ = nullptr;
+    QSpinBox* threadsSpin_ = nullptr;
     QCheckBox* cbzCheck_ = nullptr;
     QCheckBox* cleanCheck_ = nullptr;
     QCheckBox* pdfCheck_ = nullptr;
+    QComboBox* pdfLayoutCombo_ = nullptr;
     QPushButton* startButton_ = nullptr;
     QPushButton* cancelButton_ = nullptr;
     QPlainTextEdit* logView_ = nullptr;
     QProgressBar* progressBar_ = nullptr;
+    QListView* previewView_ = nullptr;
+    PagePreviewModel* previewModel_ = nullptr;
+    QTimer* refreshTimer_ = nullptr;
 
     QThread* workerThread_ = nullptr;
     ConversionWorker* worker_ = nullptr;
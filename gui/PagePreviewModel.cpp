@@ -0,0 +1,181 @@
+#include "PagePreviewModel.h"
+
+#include <QColor>
+#include <QImageReader>
+#include <QMetaObject>
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+namespace {
+constexpr int kThumbnailWidth = 120;
+constexpr int kThumbnailHeight = 170;
+
+// Cache budget in KiB: about 64 MiB, several hundred thumbnails.
+constexpr int kCacheCostKiB = 64 * 1024;
+
+// Requests beyond this are for items scrolled past long ago and are dropped; they are
+// requested again if they come back into view.
+constexpr std::size_t kMaxQueuedRequests = 64;
+
+constexpr int kLoaderThreads = 2;
+}
+
+// Shared with the loader jobs. Requests are served newest first, so the items on
+// screen now load before the ones the user scrolled past.
+struct PagePreviewModel::LoadQueue {
+    std::mutex mutex;
+    std::vector<QString> requests;
+    quint64 generation = 0;
+};
+
+PagePreviewModel::PagePreviewModel(QObject* parent)
+    : QAbstractListModel(parent), queue_(std::make_shared<LoadQueue>()) {
+    cache_.setMaxCost(kCacheCostKiB);
+    pool_.setMaxThreadCount(kLoaderThreads);
+
+    placeholder_ = QPixmap(thumbnailSize());
+    placeholder_.fill(QColor(230, 230, 230));
+}
+
+PagePreviewModel::~PagePreviewModel() {
+    {
+        std::lock_guard<std::mutex> lock(queue_->mutex);
+        queue_->requests.clear();
+    }
+    pool_.waitForDone();
+}
+
+QSize PagePreviewModel::thumbnailSize() {
+    return QSize(kThumbnailWidth, kThumbnailHeight);
+}
+
+int PagePreviewModel::rowCount(const QModelIndex& parent) const {
+    return parent.isValid() ? 0 : static_cast<int>(pages_.size());
+}
+
+QVariant PagePreviewModel::data(const QModelIndex& index, int role) const {
+    if (!index.isValid() || index.row() >= pages_.size()) {
+        return {};
+    }
+
+    const Page& page = pages_[index.row()];
+    switch (role) {
+    case Qt::DisplayRole:
+        return tr("Page %1").arg(page.page + 1);
+    case Qt::ToolTipRole:
+        return page.path;
+    case Qt::DecorationRole:
+        // The view only asks for items it is about to paint, which makes loading lazy.
+        if (const QPixmap* pixmap = cache_.object(page.path)) {
+            return *pixmap;
+        }
+        requestThumbnail(page.path);
+        return placeholder_;
+    default:
+        return {};
+    }
+}
+
+void PagePreviewModel::addPage(int file, int page, const QString& path) {
+    Page entry{file, page, path};
+    const auto position = std::lower_bound(pages_.begin(), pages_.end(), entry, [](const Page& a, const Page& b) {
+        return a.file != b.file ? a.file < b.file : a.page < b.page;
+    });
+    const int row = static_cast<int>(position - pages_.begin());
+
+    beginInsertRows(QModelIndex(), row, row);
+    pages_.insert(row, entry);
+    // Pages mostly arrive in order, so usually only the new row is indexed here.
+    for (int shifted = row; shifted < pages_.size(); ++shifted) {
+        rows_.insert(pages_[shifted].path, shifted);
+    }
+    endInsertRows();
+}
+
+void PagePreviewModel::clear() {
+    beginResetModel();
+    pages_.clear();
+    rows_.clear();
+    cache_.clear();
+    requested_.clear();
+    {
+        std::lock_guard<std::mutex> lock(queue_->mutex);
+        queue_->requests.clear();
+        queue_->generation = ++generation_;
+    }
+    endResetModel();
+}
+
+QString PagePreviewModel::pathAt(int row) const {
+    return row >= 0 && row < pages_.size() ? pages_[row].path : QString();
+}
+
+void PagePreviewModel::requestThumbnail(const QString& path) const {
+    if (requested_.contains(path)) {
+        return;
+    }
+    requested_.insert(path);
+
+    QString dropped;
+    {
+        std::lock_guard<std::mutex> lock(queue_->mutex);
+        queue_->requests.push_back(path);
+        if (queue_->requests.size() > kMaxQueuedRequests) {
+            dropped = queue_->requests.front();
+            queue_->requests.erase(queue_->requests.begin());
+        }
+    }
+    if (!dropped.isEmpty()) {
+        requested_.remove(dropped);
+    }
+
+    // One job per request; each takes whichever request is newest when it runs.
+    auto* model = const_cast<PagePreviewModel*>(this);
+    auto queue = queue_;
+    pool_.start([model, queue]() {
+        QString next;
+        quint64 generation = 0;
+        {
+            std::lock_guard<std::mutex> lock(queue->mutex);
+            if (queue->requests.empty()) {
+                return;
+            }
+            next = queue->requests.back();
+            queue->requests.pop_back();
+            generation = queue->generation;
+        }
+
+        // Decoding at the reduced size lets the JPEG decoder skip most of the work.
+        QImageReader reader(next);
+        reader.setAutoTransform(true);
+        const QSize full = reader.size();
+        if (full.isValid()) {
+            reader.setScaledSize(full.scaled(thumbnailSize(), Qt::KeepAspectRatio));
+        }
+        const QImage image = reader.read();
+
+        QMetaObject::invokeMethod(model, [model, generation, next, image]() {
+            model->thumbnailLoaded(generation, next, image);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void PagePreviewModel::thumbnailLoaded(quint64 generation, const QString& path, const QImage& image) {
+    if (generation != generation_) {
+        return;
+    }
+    requested_.remove(path);
+
+    // Unreadable pages keep the placeholder instead of being retried on every repaint.
+    auto* pixmap = new QPixmap(image.isNull() ? placeholder_ : QPixmap::fromImage(image));
+    const int cost = std::max(1, pixmap->width() * pixmap->height() * pixmap->depth() / 8 / 1024);
+    cache_.insert(path, pixmap, cost);
+
+    const auto row = rows_.constFind(path);
+    if (row != rows_.constEnd()) {
+        const QModelIndex changed = index(row.value());
+        emit dataChanged(changed, changed, {Qt::DecorationRole});
+    }
+}
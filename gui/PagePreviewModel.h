@@ -0,0 +1,57 @@
+#pragma once
+
+#include <QAbstractListModel>
+#include <QCache>
+#include <QHash>
+#include <QImage>
+#include <QPixmap>
+#include <QSet>
+#include <QSize>
+#include <QString>
+#include <QThreadPool>
+#include <QVector>
+
+#include <memory>
+
+// List model of finished page images for the preview strip. Thumbnails are decoded
+// only when the view asks for an item (i.e. when it is visible), downscaled while
+// decoding on a small background pool, and kept in a bounded LRU pixmap cache.
+class PagePreviewModel : public QAbstractListModel {
+    Q_OBJECT
+
+public:
+    explicit PagePreviewModel(QObject* parent = nullptr);
+    ~PagePreviewModel() override;
+
+    static QSize thumbnailSize();
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+
+    // Pages may arrive in any order; they are kept sorted by file, then page.
+    void addPage(int file, int page, const QString& path);
+    void clear();
+
+    QString pathAt(int row) const;
+
+private:
+    struct Page {
+        int file = 0;
+        int page = 0;
+        QString path;
+    };
+
+    struct LoadQueue;
+
+    void requestThumbnail(const QString& path) const;
+    void thumbnailLoaded(quint64 generation, const QString& path, const QImage& image);
+
+    QVector<Page> pages_;
+    QHash<QString, int> rows_; // path -> row in pages_
+    mutable QCache<QString, QPixmap> cache_;
+    mutable QSet<QString> requested_; // queued or being decoded
+    QPixmap placeholder_;
+    quint64 generation_ = 0;
+    std::shared_ptr<LoadQueue> queue_;
+    mutable QThreadPool pool_;
+};
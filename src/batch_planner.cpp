@@ -0,0 +1,150 @@
+#include "batch_planner.h"
+#include "image_header.h"
+#include "trace.h"
+
+#include <poppler-document.h>
+#include <poppler-page.h>
+#include <zip.h>
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <numeric>
+#include <thread>
+
+namespace {
+// Cost model coefficients, in seconds. They are rough starting points rather than
+// measurements of any particular machine; the estimates are logged next to the actual
+// times so they can be checked and tuned against real runs.
+constexpr double kRenderSecondsPerMegapixel = 0.010;
+constexpr double kJpegSecondsPerMegapixel = 0.006;
+constexpr double kPngSecondsPerMegapixel = 0.030;
+constexpr double kPdfSecondsPerPage = 0.002;
+constexpr double kPdfSecondsPerByte = 5e-9;       // parsing and reading the document
+constexpr double kCopySecondsPerByte = 2e-9;      // JPEG entries copied into the PDF
+constexpr double kPngEntrySecondsPerByte = 2e-8;  // PNG entries are inflated and recompressed
+constexpr double kCbzSecondsPerPage = 0.0005;
+constexpr double kUnopenedPdfSecondsPerByte = 1e-7;  // whole conversion, from the file size only
+
+// Page boxes looked at per document; longer documents are sampled evenly.
+constexpr int kSampledPages = 64;
+
+std::uint64_t file_size(const std::string& path) {
+    std::error_code ec;
+    const auto size = std::filesystem::file_size(path, ec);
+    return ec ? 0 : size;
+}
+}
+
+JobEstimate BatchPlanner::estimate_pdf(const std::string& pdf_path, double dpi, const PageResolution& resolution,
+                                       const std::string& format) {
+    JobEstimate estimate;
+    estimate.input_bytes = file_size(pdf_path);
+
+    try {
+        const std::unique_ptr<poppler::document> document(poppler::document::load_from_file(pdf_path));
+        if (document && !document->is_locked()) {
+            estimate.pages = document->pages();
+            const int samples = std::min(estimate.pages, kSampledPages);
+            double sampled_pixels = 0.0;
+            for (int s = 0; s < samples; ++s) {
+                const int index = static_cast<int>(static_cast<long long>(s) * estimate.pages / samples);
+                const std::unique_ptr<poppler::page> page(document->create_page(index));
+                if (!page) {
+                    continue;
+                }
+                const poppler::rectf rect = page->page_rect();
+                const double scale = PDFImageExtractor::page_dpi(*page, dpi, resolution) / 72.0;
+                sampled_pixels += std::max(0.0, rect.width() * scale) * std::max(0.0, rect.height() * scale);
+            }
+            if (samples > 0) {
+                estimate.megapixels = sampled_pixels / samples * estimate.pages / 1e6;
+            }
+        }
+    } catch (const std::exception&) {
+        // Left to the conversion to report; the estimate falls back to the file size.
+    }
+
+    const double encode = format == "jpeg" ? kJpegSecondsPerMegapixel : kPngSecondsPerMegapixel;
+    estimate.seconds = estimate.megapixels * (kRenderSecondsPerMegapixel + encode) +
+                       estimate.pages * kPdfSecondsPerPage +
+                       static_cast<double>(estimate.input_bytes) * kPdfSecondsPerByte;
+    return estimate;
+}
+
+JobEstimate BatchPlanner::estimate_pdf_size(const std::string& pdf_path) {
+    JobEstimate estimate;
+    estimate.input_bytes = file_size(pdf_path);
+    estimate.seconds = static_cast<double>(estimate.input_bytes) * kUnopenedPdfSecondsPerByte;
+    return estimate;
+}
+
+JobEstimate BatchPlanner::estimate_cbz(const std::string& cbz_path) {
+    JobEstimate estimate;
+    estimate.input_bytes = file_size(cbz_path);
+
+    std::uint64_t jpeg_bytes = 0;
+    std::uint64_t png_bytes = 0;
+    int zip_error = 0;
+    zip_t* archive = zip_open(cbz_path.c_str(), ZIP_RDONLY, &zip_error);
+    if (archive) {
+        const zip_int64_t entry_count = zip_get_num_entries(archive, 0);
+        for (zip_int64_t i = 0; i < entry_count; ++i) {
+            zip_stat_t stat;
+            if (zip_stat_index(archive, static_cast<zip_uint64_t>(i), ZIP_FL_ENC_GUESS, &stat) != 0 || stat.name == nullptr) {
+                continue;
+            }
+            const ImageFormat format = ImageHeaderParser::format_from_name(stat.name);
+            if (format == ImageFormat::jpeg) {
+                jpeg_bytes += stat.size;
+                ++estimate.pages;
+            } else if (format == ImageFormat::png) {
+                png_bytes += stat.size;
+                ++estimate.pages;
+            }
+        }
+        zip_close(archive);
+    } else {
+        jpeg_bytes = estimate.input_bytes;
+    }
+
+    estimate.seconds = static_cast<double>(jpeg_bytes) * kCopySecondsPerByte +
+                       static_cast<double>(png_bytes) * kPngEntrySecondsPerByte +
+                       estimate.pages * kCbzSecondsPerPage;
+    return estimate;
+}
+
+std::vector<std::size_t> BatchPlanner::longest_first(const std::vector<JobEstimate>& jobs) {
+    std::vector<std::size_t> order(jobs.size());
+    std::iota(order.begin(), order.end(), std::size_t{0});
+    std::stable_sort(order.begin(), order.end(), [&jobs](std::size_t a, std::size_t b) {
+        return jobs[a].seconds > jobs[b].seconds;
+    });
+    return order;
+}
+
+void BatchPlanner::run(const std::vector<JobEstimate>& jobs, int parallel, const std::function<void(std::size_t)>& run_job) {
+    const std::vector<std::size_t> order = longest_first(jobs);
+    const std::size_t thread_count = std::min<std::size_t>(order.size(), static_cast<std::size_t>(std::max(parallel, 1)));
+    if (thread_count <= 1) {
+        for (const std::size_t index : order) {
+            run_job(index);
+        }
+        return;
+    }
+
+    std::atomic<std::size_t> next{0};
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count);
+    for (std::size_t t = 0; t < thread_count; ++t) {
+        threads.emplace_back([&]() {
+            Trace::set_thread_name("batch job");
+            for (std::size_t i = next++; i < order.size(); i = next++) {
+                run_job(order[i]);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "pdf_image_extractor.h"
+
+// Estimated cost of converting one file, from a quick look at the input that neither
+// renders nor decodes anything.
+struct JobEstimate {
+    int pages = 0;
+    double megapixels = 0.0;         // pixels to render, PDF input only
+    std::uint64_t input_bytes = 0;
+    double seconds = 0.0;            // estimated conversion time
+};
+
+// Orders a batch so that the costliest files start first. Files are otherwise taken in
+// path order, and one very large file near the end of the list runs alone long after
+// everything else has finished; starting the longest jobs first (LPT scheduling) keeps
+// the tail short when several files convert at once.
+class BatchPlanner {
+public:
+    // Page count and rendered area come from the document's page boxes, sampled on
+    // long documents; nothing is rendered.
+    static JobEstimate estimate_pdf(const std::string& pdf_path, double dpi, const PageResolution& resolution,
+                                    const std::string& format);
+    // From the file size alone, for callers that must not open the document themselves
+    // (worker processes isolate a document that crashes the renderer).
+    static JobEstimate estimate_pdf_size(const std::string& pdf_path);
+    // Entry count and sizes come from the archive's central directory.
+    static JobEstimate estimate_cbz(const std::string& cbz_path);
+
+    // Job indices, costliest first; equal estimates keep their input order.
+    static std::vector<std::size_t> longest_first(const std::vector<JobEstimate>& jobs);
+
+    // Calls run_job(index) for every job on up to `parallel` threads, each thread taking
+    // the costliest job not yet started. Returns once all jobs have finished.
+    static void run(const std::vector<JobEstimate>& jobs, int parallel, const std::function<void(std::size_t)>& run_job);
+};
@@ -0,0 +1,137 @@
+#include "buffer_pool.h"
+
+#include <iterator>
+#include <utility>
+
+namespace {
+// Enough for every page worker plus the buffers of one CBZ to PDF conversion.
+constexpr std::size_t kMaxPooledBuffers = 64;
+
+// Buffers a thread keeps for itself: a page worker's pages in flight plus the one it is
+// encoding.
+constexpr std::size_t kMaxThreadBuffers = 4;
+
+// Buffers that grew past this (an unusually large page) are freed rather than kept.
+constexpr std::size_t kMaxRetainedBytes = 256 * 1024 * 1024;
+
+// Index of the most recently returned buffer with at least size_hint bytes of capacity,
+// or of the most recent one if none is large enough. list must not be empty.
+std::size_t pick_buffer(const std::vector<std::unique_ptr<BufferPool::Buffer>>& list, std::size_t size_hint) {
+    for (std::size_t i = list.size(); i-- > 0;) {
+        if (list[i]->capacity() >= size_hint) {
+            return i;
+        }
+    }
+    return list.size() - 1;
+}
+}
+
+// Hands its buffers to the shared list when the thread exits.
+struct BufferPool::ThreadCache {
+    std::vector<std::unique_ptr<Buffer>> free;
+
+    ~ThreadCache() {
+        for (auto& buffer : free) {
+            BufferPool::shared().release_shared(std::move(buffer));
+        }
+    }
+};
+
+BufferPool::Lease::Lease(BufferPool* pool, std::unique_ptr<Buffer> buffer)
+    : pool_(pool), buffer_(std::move(buffer)) {}
+
+BufferPool::Lease::Lease(Lease&& other) noexcept
+    : pool_(std::exchange(other.pool_, nullptr)), buffer_(std::move(other.buffer_)) {}
+
+BufferPool::Lease& BufferPool::Lease::operator=(Lease&& other) noexcept {
+    if (this != &other) {
+        if (pool_ && buffer_) {
+            pool_->release(std::move(buffer_));
+        }
+        pool_ = std::exchange(other.pool_, nullptr);
+        buffer_ = std::move(other.buffer_);
+    }
+    return *this;
+}
+
+BufferPool::Lease::~Lease() {
+    if (pool_ && buffer_) {
+        pool_->release(std::move(buffer_));
+    }
+}
+
+BufferPool& BufferPool::shared() {
+    static BufferPool pool;
+    return pool;
+}
+
+BufferPool::ThreadCache* BufferPool::thread_cache() {
+    if (this != &shared()) {
+        return nullptr;
+    }
+    thread_local ThreadCache cache;
+    return &cache;
+}
+
+BufferPool::Lease BufferPool::acquire(std::size_t size_hint) {
+    ++leases_;
+    std::unique_ptr<Buffer> buffer;
+    ThreadCache* cache = enabled_ ? thread_cache() : nullptr;
+    if (cache && !cache->free.empty()) {
+        const std::size_t chosen = pick_buffer(cache->free, size_hint);
+        buffer = std::move(cache->free[chosen]);
+        cache->free.erase(cache->free.begin() + static_cast<std::ptrdiff_t>(chosen));
+    } else {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!free_.empty()) {
+            const std::size_t chosen = pick_buffer(free_, size_hint);
+            buffer = std::move(free_[chosen]);
+            free_.erase(free_.begin() + static_cast<std::ptrdiff_t>(chosen));
+        }
+    }
+
+    if (buffer) {
+        ++reused_;
+    } else {
+        buffer = std::make_unique<Buffer>();
+    }
+    buffer->clear();
+    if (buffer->capacity() < size_hint) {
+        buffer->reserve(size_hint);
+    }
+    return Lease(this, std::move(buffer));
+}
+
+void BufferPool::set_enabled(bool enabled) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    enabled_ = enabled;
+    if (!enabled_) {
+        free_.clear();
+        if (ThreadCache* cache = thread_cache()) {
+            cache->free.clear();
+        }
+    }
+}
+
+BufferPool::Counters BufferPool::counters() const {
+    return Counters{leases_.load(), reused_.load()};
+}
+
+void BufferPool::release(std::unique_ptr<Buffer> buffer) {
+    if (buffer->capacity() > kMaxRetainedBytes || !enabled_) {
+        return;
+    }
+    ThreadCache* cache = thread_cache();
+    if (cache && cache->free.size() < kMaxThreadBuffers) {
+        cache->free.push_back(std::move(buffer));
+        return;
+    }
+    release_shared(std::move(buffer));
+}
+
+void BufferPool::release_shared(std::unique_ptr<Buffer> buffer) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (enabled_ && free_.size() < kMaxPooledBuffers) {
+        free_.push_back(std::move(buffer));
+    }
+}
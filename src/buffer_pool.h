@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Free lists of byte buffers for the page pipeline. Each thread keeps a few buffers of
+// its own: a page worker's released buffers serve its next pages without taking a lock
+// or meeting other workers' buffers, so each worker settles on buffers sized to the
+// pages it handles. Buffers beyond that, and those of a thread that exits, go to a
+// process-wide list for the next worker or file. Released buffers keep their capacity,
+// so steady-state pages neither allocate nor fault in fresh memory. All methods are
+// thread-safe.
+class BufferPool {
+public:
+    using Buffer = std::vector<std::uint8_t>;
+
+    class Lease {
+    public:
+        Lease() = default;
+        Lease(Lease&& other) noexcept;
+        Lease& operator=(Lease&& other) noexcept;
+        ~Lease();
+
+        Buffer& operator*() { return *buffer_; }
+        Buffer* operator->() { return buffer_.get(); }
+
+    private:
+        friend class BufferPool;
+        Lease(BufferPool* pool, std::unique_ptr<Buffer> buffer);
+
+        BufferPool* pool_ = nullptr;
+        std::unique_ptr<Buffer> buffer_;
+    };
+
+    struct Counters {
+        std::uint64_t leases = 0;
+        std::uint64_t reused = 0;  // leases served from a pooled buffer
+    };
+
+    static BufferPool& shared();
+
+    // Returns an empty buffer with room for at least size_hint bytes, preferring the
+    // calling thread's own buffers, then the most recently returned shared buffer that is
+    // already large enough.
+    Lease acquire(std::size_t size_hint = 0);
+
+    // A disabled pool hands out fresh buffers and frees them on release; used by the
+    // benchmark to measure the pipeline without pooling.
+    void set_enabled(bool enabled);
+    Counters counters() const;
+
+private:
+    struct ThreadCache;
+
+    void release(std::unique_ptr<Buffer> buffer);
+    void release_shared(std::unique_ptr<Buffer> buffer);
+    // The calling thread's buffers, for the shared pool only (a thread outlives any
+    // other pool it might use); null for other pools.
+    ThreadCache* thread_cache();
+
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<Buffer>> free_;
+    std::atomic<bool> enabled_{true};
+    std::atomic<std::uint64_t> leases_{0};
+    std::atomic<std::uint64_t> reused_{0};
+};
@@ -1,46 +1,190 @@
 #include "cbz_creator.h"
+#include "buffer_pool.h"
+#include "content_hash.h"
+#include "conversion_stats.h"
+#include "log.h"
+#include "trace.h"
 #include <zip.h>
-#include <iostream>
 #include <filesystem>
 #include <fstream>
 #include <algorithm>
+#include <chrono>
 #include <regex>
+#include <unordered_set>
+
+namespace {
+constexpr std::size_t kCopyChunkSize = 1024 * 1024;
+
+// libzip does the reading and compressing inside zip_close; these hooks let a long
+// close report progress (libzip 1.3+) and be cancelled (libzip 1.6+).
+struct CloseState {
+    const ConversionContext* context;
+    int total;
+    int reported;
+};
+
+#if LIBZIP_VERSION_MAJOR > 1 || (LIBZIP_VERSION_MAJOR == 1 && LIBZIP_VERSION_MINOR >= 3)
+void on_close_progress(zip_t*, double fraction, void* user_data) {
+    auto* state = static_cast<CloseState*>(user_data);
+    const int done = static_cast<int>(fraction * state->total);
+    if (done != state->reported) {
+        state->reported = done;
+        state->context->report_progress(done, state->total);
+    }
+}
+#endif
+
+#if LIBZIP_VERSION_MAJOR > 1 || (LIBZIP_VERSION_MAJOR == 1 && LIBZIP_VERSION_MINOR >= 6)
+int on_close_cancel(zip_t*, void* user_data) {
+    return static_cast<CloseState*>(user_data)->context->cancelled() ? 1 : 0;
+}
+#endif
+
+// A ZIP entry cannot point at another entry's data, so repeated pages are still
+// stored in full, but only their first copy is compressed; repeats are stored as is.
+struct RepeatedPages {
+    std::unordered_set<ContentHash, ContentHash::Hasher> seen;
+    int duplicate_pages = 0;
+    std::uint64_t duplicate_bytes = 0;
+    std::uint64_t compressed_bytes = 0;
+
+    // For in-memory pages, which are fingerprinted here.
+    void add(zip_t* archive, zip_int64_t index, const std::string& filename, const ContentHash& hash,
+             std::uint64_t size, const ConversionContext& context) {
+        add(archive, index, filename, !seen.insert(hash).second, size, context);
+    }
+
+    void add(zip_t* archive, zip_int64_t index, const std::string& filename, bool repeat, std::uint64_t size,
+             const ConversionContext& context) {
+        if (repeat && zip_set_file_compression(archive, static_cast<zip_uint64_t>(index), ZIP_CM_STORE, 0) == 0) {
+            ++duplicate_pages;
+            duplicate_bytes += size;
+            LogMessage(LogLevel::debug, context.log) << "Storing repeated page uncompressed: " << filename;
+        } else {
+            compressed_bytes += size;
+        }
+    }
+};
+
+// Writes the archive: libzip reads and compresses every entry in zip_close. On failure
+// the archive is discarded and its output left untouched.
+bool close_archive(zip_t* archive, int total, const RepeatedPages& repeats, const ConversionContext& context) {
+    CloseState close_state{&context, total, -1};
+#if LIBZIP_VERSION_MAJOR > 1 || (LIBZIP_VERSION_MAJOR == 1 && LIBZIP_VERSION_MINOR >= 3)
+    if (context.progress) {
+        zip_register_progress_callback_with_state(archive, 0.01, on_close_progress, nullptr, &close_state);
+    }
+#endif
+#if LIBZIP_VERSION_MAJOR > 1 || (LIBZIP_VERSION_MAJOR == 1 && LIBZIP_VERSION_MINOR >= 6)
+    if (context.cancel) {
+        zip_register_cancel_callback_with_state(archive, on_close_cancel, nullptr, &close_state);
+    }
+#endif
+
+    bool closed = false;
+    const auto close_started = ConversionStats::Clock::now();
+    {
+        // libzip reads and compresses every entry here, so this is usually the long span.
+        TraceSpan span("zip_close");
+        closed = zip_close(archive) == 0;
+    }
+    const auto close_elapsed = ConversionStats::Clock::now() - close_started;
+    if (!closed) {
+        // A failed close leaves the archive open and the output untouched.
+        zip_discard(archive);
+        if (!context.cancelled()) {
+            LogMessage(LogLevel::error, context.log) << "Failed to close CBZ archive";
+        }
+        return false;
+    }
+    if (close_state.reported != close_state.total) {
+        context.report_progress(close_state.total, close_state.total);
+    }
+
+    if (repeats.duplicate_pages > 0) {
+        // Compression time saved, at the rate measured for the pages that were compressed.
+        const auto saved = std::chrono::duration_cast<ConversionStats::Clock::duration>(
+            close_elapsed * (static_cast<double>(repeats.duplicate_bytes) /
+                             static_cast<double>(std::max<std::uint64_t>(repeats.compressed_bytes, 1))));
+        if (context.stats) {
+            context.stats->add_duplicates(ConversionStage::zip, repeats.duplicate_pages, repeats.duplicate_bytes, saved);
+        }
+        LogMessage(LogLevel::info, context.log) << "Stored " << repeats.duplicate_pages << " repeated pages without recompressing ("
+                                                << repeats.duplicate_bytes << " bytes)";
+    }
+    return true;
+}
+
+// Hands the finished in-memory archive held by source to output.
+bool copy_source(zip_source_t* source, const OutputWriter& output) {
+    if (zip_source_open(source) != 0) {
+        return false;
+    }
+    BufferPool::Lease buffer = BufferPool::shared().acquire(kCopyChunkSize);
+    buffer->resize(kCopyChunkSize);
+    bool ok = true;
+    while (ok) {
+        const zip_int64_t bytes_read = zip_source_read(source, buffer->data(), buffer->size());
+        if (bytes_read <= 0) {
+            ok = bytes_read == 0;
+            break;
+        }
+        ok = output(buffer->data(), static_cast<std::size_t>(bytes_read));
+    }
+    zip_source_close(source);
+    return ok;
+}
+}
 
 bool CBZCreator::create_cbz_from_images(const std::vector<std::string>& image_paths, 
-                                        const std::string& output_cbz_path) {
+                                        const std::string& output_cbz_path,
+                                        const ConversionContext& context,
+                                        const RepeatedPageNames& repeated_pages) {
     if (image_paths.empty()) {
-        std::cerr << "No images provided for CBZ creation" << std::endl;
+        LogMessage(LogLevel::error, context.log) << "No images provided for CBZ creation";
         return false;
     }
     
+    // libzip reads and compresses the sources in zip_close, so the whole function counts.
+    StageTimer timer(context.stats, ConversionStage::zip);
+    
     int error = 0;
     zip_t* archive = zip_open(output_cbz_path.c_str(), ZIP_CREATE | ZIP_TRUNCATE, &error);
     
     if (!archive) {
         zip_error_t zip_error;
         zip_error_init_with_code(&zip_error, error);
-        std::cerr << "Failed to create CBZ archive: " << zip_error_strerror(&zip_error) << std::endl;
+        LogMessage(LogLevel::error, context.log) << "Failed to create CBZ archive: " << zip_error_strerror(&zip_error);
         zip_error_fini(&zip_error);
         return false;
     }
     
-    std::cout << "Creating CBZ archive: " << output_cbz_path << std::endl;
+    LogMessage(LogLevel::info, context.log) << "Creating CBZ archive: " << output_cbz_path;
+
+    RepeatedPages repeats;
     
     for (size_t i = 0; i < image_paths.size(); ++i) {
+        if (context.cancelled()) {
+            zip_discard(archive);
+            return false;
+        }
+
         const auto& image_path = image_paths[i];
         
         if (!std::filesystem::exists(image_path)) {
-            std::cerr << "Warning: Image file not found: " << image_path << std::endl;
+            LogMessage(LogLevel::warning, context.log) << "Warning: Image file not found: " << image_path;
             continue;
         }
         
+        TraceSpan span("zip_add");
+
         // Get just the filename for the archive
         std::string filename = std::filesystem::path(image_path).filename().string();
         
         // Create zip source directly from file - more reliable than buffer
         zip_source_t* source = zip_source_file(archive, image_path.c_str(), 0, 0);
         if (!source) {
-            std::cerr << "Warning: Failed to create zip source for: " << filename << std::endl;
+            LogMessage(LogLevel::warning, context.log) << "Warning: Failed to create zip source for: " << filename;
             continue;
         }
         
@@ -50,41 +194,113 @@ bool CBZCreator::create_cbz_from_images(const std::vector<std::string>& image_pa
         // Add file to archive
         zip_int64_t index = zip_file_add(archive, filename.c_str(), source, ZIP_FL_OVERWRITE);
         if (index < 0) {
-            std::cerr << "Warning: Failed to add file to archive: " << filename << std::endl;
+            LogMessage(LogLevel::warning, context.log) << "Warning: Failed to add file to archive: " << filename;
             zip_source_free(source);
             continue;
         }
         
-        std::cout << "Added to CBZ: " << filename << " (" << file_size << " bytes)" << std::endl;
+        repeats.add(archive, index, filename, repeated_pages.count(filename) > 0, file_size, context);
+
+        timer.add_bytes(file_size);
+        LogMessage(LogLevel::debug, context.log) << "Added to CBZ: " << filename << " (" << file_size << " bytes)";
     }
     
-    if (zip_close(archive) != 0) {
-        std::cerr << "Failed to close CBZ archive" << std::endl;
+    if (!close_archive(archive, static_cast<int>(image_paths.size()), repeats, context)) {
         return false;
     }
     
-    std::cout << "CBZ archive created successfully: " << output_cbz_path << std::endl;
+    LogMessage(LogLevel::info, context.log) << "CBZ archive created successfully: " << output_cbz_path;
+    return true;
+}
+
+bool CBZCreator::create_cbz_from_images(const std::vector<CBZImageInput>& images,
+                                        const OutputWriter& output,
+                                        const ConversionContext& context) {
+    if (images.empty()) {
+        LogMessage(LogLevel::error, context.log) << "No images provided for CBZ creation";
+        return false;
+    }
+
+    StageTimer timer(context.stats, ConversionStage::zip);
+
+    // The archive is assembled in a growing libzip buffer source, kept alive past
+    // zip_close so that its contents can be read back out.
+    zip_error_t error;
+    zip_error_init(&error);
+    zip_source_t* buffer_source = zip_source_buffer_create(nullptr, 0, 0, &error);
+    zip_t* archive = buffer_source ? zip_open_from_source(buffer_source, ZIP_TRUNCATE, &error) : nullptr;
+    if (!archive) {
+        LogMessage(LogLevel::error, context.log) << "Failed to create CBZ archive: " << zip_error_strerror(&error);
+        zip_error_fini(&error);
+        if (buffer_source) {
+            zip_source_free(buffer_source);
+        }
+        return false;
+    }
+    zip_error_fini(&error);
+    zip_source_keep(buffer_source);
+
+    RepeatedPages repeats;
+    for (const auto& image : images) {
+        if (context.cancelled()) {
+            zip_discard(archive);
+            zip_source_free(buffer_source);
+            return false;
+        }
+
+        TraceSpan span("zip_add");
+        // The caller keeps the image data alive until zip_close has read it.
+        zip_source_t* source = zip_source_buffer(archive, image.data.data(), image.data.size(), 0);
+        const zip_int64_t index = source ? zip_file_add(archive, image.name.c_str(), source, ZIP_FL_OVERWRITE) : -1;
+        if (index < 0) {
+            LogMessage(LogLevel::warning, context.log) << "Warning: Failed to add file to archive: " << image.name;
+            if (source) {
+                zip_source_free(source);
+            }
+            continue;
+        }
+
+        repeats.add(archive, index, image.name, ContentHash::of(image.data.data(), image.data.size()),
+                    image.data.size(), context);
+        timer.add_bytes(image.data.size());
+        LogMessage(LogLevel::debug, context.log) << "Added to CBZ: " << image.name << " (" << image.data.size() << " bytes)";
+    }
+
+    if (!close_archive(archive, static_cast<int>(images.size()), repeats, context)) {
+        zip_source_free(buffer_source);
+        return false;
+    }
+
+    const bool copied = copy_source(buffer_source, output);
+    zip_source_free(buffer_source);
+    if (!copied) {
+        LogMessage(LogLevel::error, context.log) << "Failed to write CBZ archive to output stream";
+        return false;
+    }
+    LogMessage(LogLevel::info, context.log) << "CBZ archive created successfully in memory";
     return true;
 }
 
 bool CBZCreator::create_cbz_from_directory(const std::string& image_directory, 
-                                           const std::string& output_cbz_path) {
+                                           const std::string& output_cbz_path,
+                                           const ConversionContext& context,
+                                           const RepeatedPageNames& repeated_pages) {
     if (!std::filesystem::exists(image_directory)) {
-        std::cerr << "Image directory does not exist: " << image_directory << std::endl;
+        LogMessage(LogLevel::error, context.log) << "Image directory does not exist: " << image_directory;
         return false;
     }
     
     auto image_files = get_image_files_from_directory(image_directory);
     if (image_files.empty()) {
-        std::cerr << "No image files found in directory: " << image_directory << std::endl;
+        LogMessage(LogLevel::error, context.log) << "No image files found in directory: " << image_directory;
         return false;
     }
     
     sort_image_files_naturally(image_files);
     
-    std::cout << "Found " << image_files.size() << " image files in directory" << std::endl;
+    LogMessage(LogLevel::debug, context.log) << "Found " << image_files.size() << " image files in directory";
     
-    return create_cbz_from_images(image_files, output_cbz_path);
+    return create_cbz_from_images(image_files, output_cbz_path, context, repeated_pages);
 }
 
 std::vector<std::string> CBZCreator::get_image_files_from_directory(const std::string& directory) {
@@ -104,7 +320,7 @@ std::vector<std::string> CBZCreator::get_image_files_from_directory(const std::s
             }
         }
     } catch (const std::exception& e) {
-        std::cerr << "Error reading directory: " << e.what() << std::endl;
+        LogMessage(LogLevel::error) << "Error reading directory: " << e.what();
     }
     
     return image_files;
@@ -1,15 +1,41 @@
 #pragma once
 
+#include <cstdint>
+#include <span>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
+#include "conversion_context.h"
+#include "output_sink.h"
+
+// A page image held in memory, added to the archive under name.
+struct CBZImageInput {
+    std::string name;
+    std::span<const std::uint8_t> data;
+};
+
+// File names of pages known to be copies of an earlier page (PDFImageExtractor reports
+// them); they are stored without recompressing. Files are not read to find others.
+using RepeatedPageNames = std::unordered_set<std::string>;
+
 class CBZCreator {
 public:
     static bool create_cbz_from_images(const std::vector<std::string>& image_paths, 
-                                       const std::string& output_cbz_path);
+                                       const std::string& output_cbz_path,
+                                       const ConversionContext& context = {},
+                                       const RepeatedPageNames& repeated_pages = {});
+
+    // Builds the archive in memory and hands it to output once complete, without
+    // touching the filesystem. The image data must stay valid until this returns.
+    static bool create_cbz_from_images(const std::vector<CBZImageInput>& images,
+                                       const OutputWriter& output,
+                                       const ConversionContext& context = {});
     
     static bool create_cbz_from_directory(const std::string& image_directory, 
-                                          const std::string& output_cbz_path);
+                                          const std::string& output_cbz_path,
+                                          const ConversionContext& context = {},
+                                          const RepeatedPageNames& repeated_pages = {});
 
 private:
     static std::vector<std::string> get_image_files_from_directory(const std::string& directory);
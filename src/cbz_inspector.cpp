@@ -0,0 +1,122 @@
+#include "cbz_inspector.h"
+#include "json_util.h"
+#include "log.h"
+#include "page_order.h"
+
+#include <zip.h>
+#include <algorithm>
+#include <utility>
+
+namespace {
+// Enough for the SOF of a typical JPEG and for any PNG or WebP header. Entries whose
+// header lies further in (large EXIF or ICC segments) are read in growing steps.
+constexpr std::size_t kInitialProbeSize = 4 * 1024;
+constexpr std::size_t kProbeGrowthFactor = 4;
+
+void read_page_header(zip_t* archive, zip_uint64_t index, CBZPageInfo& page) {
+    zip_file_t* file = zip_fopen_index(archive, index, 0);
+    if (!file) {
+        return;
+    }
+
+    std::vector<std::uint8_t> buffer;
+    std::size_t target = std::min<std::uint64_t>(page.size, kInitialProbeSize);
+    while (true) {
+        const std::size_t filled = buffer.size();
+        buffer.resize(target);
+        const zip_int64_t bytes_read = zip_fread(file, buffer.data() + filled, target - filled);
+        if (bytes_read < 0) {
+            break;
+        }
+        buffer.resize(filled + static_cast<std::size_t>(bytes_read));
+
+        ImageHeader header;
+        const HeaderStatus status = ImageHeaderParser::parse(buffer.data(), buffer.size(), header);
+        if (status == HeaderStatus::complete) {
+            page.format = header.format;
+            page.width = header.width;
+            page.height = header.height;
+            page.components = header.components;
+            page.valid = true;
+            break;
+        }
+        if (status == HeaderStatus::invalid || buffer.size() >= page.size ||
+            static_cast<zip_uint64_t>(bytes_read) < target - filled) {
+            break;
+        }
+        target = static_cast<std::size_t>(std::min<std::uint64_t>(page.size, target * kProbeGrowthFactor));
+    }
+
+    zip_fclose(file);
+}
+
+}
+
+bool CBZInspector::inspect(const std::string& cbz_path, CBZIndex& index) {
+    index = CBZIndex{};
+    index.path = cbz_path;
+
+    int zip_error = 0;
+    zip_t* archive = zip_open(cbz_path.c_str(), ZIP_RDONLY, &zip_error);
+    if (!archive) {
+        zip_error_t error;
+        zip_error_init_with_code(&error, zip_error);
+        LogMessage(LogLevel::error) << "Failed to open CBZ: " << cbz_path << ". Reason: " << zip_error_strerror(&error);
+        zip_error_fini(&error);
+        return false;
+    }
+
+    const zip_int64_t entry_count = zip_get_num_entries(archive, 0);
+    index.pages.reserve(static_cast<std::size_t>(std::max<zip_int64_t>(entry_count, 0)));
+    for (zip_int64_t i = 0; i < entry_count; ++i) {
+        zip_stat_t stat;
+        if (zip_stat_index(archive, static_cast<zip_uint64_t>(i), ZIP_FL_ENC_GUESS, &stat) != 0 || stat.name == nullptr) {
+            ++index.skipped_entries;
+            continue;
+        }
+
+        CBZPageInfo page;
+        page.name = stat.name;
+        page.format = ImageHeaderParser::format_from_name(page.name);
+        if (page.format == ImageFormat::unknown || (!page.name.empty() && page.name.back() == '/')) {
+            ++index.skipped_entries;
+            continue;
+        }
+
+        page.size = stat.size;
+        page.compressed_size = stat.comp_size;
+        page.stored = stat.comp_method == ZIP_CM_STORE;
+        read_page_header(archive, static_cast<zip_uint64_t>(i), page);
+        index.pages.push_back(std::move(page));
+    }
+
+    zip_close(archive);
+
+    PageOrder::sort(index.pages, [](const CBZPageInfo& page) { return page.name; });
+    return true;
+}
+
+std::string CBZInspector::to_json(const CBZIndex& index) {
+    std::string json = "{\n";
+    json += "  \"path\": \"" + JsonUtil::escape(index.path) + "\",\n";
+    json += "  \"page_count\": " + std::to_string(index.pages.size()) + ",\n";
+    json += "  \"skipped_entries\": " + std::to_string(index.skipped_entries) + ",\n";
+    json += "  \"pages\": [";
+    for (std::size_t i = 0; i < index.pages.size(); ++i) {
+        const auto& page = index.pages[i];
+        json += i == 0 ? "\n" : ",\n";
+        json += "    {\"index\": " + std::to_string(i + 1) +
+                ", \"name\": \"" + JsonUtil::escape(page.name) + "\"" +
+                ", \"format\": \"" + ImageHeaderParser::format_name(page.format) + "\"" +
+                ", \"width\": " + std::to_string(page.width) +
+                ", \"height\": " + std::to_string(page.height) +
+                ", \"components\": " + std::to_string(page.components) +
+                ", \"size\": " + std::to_string(page.size) +
+                ", \"compressed_size\": " + std::to_string(page.compressed_size) +
+                ", \"stored\": " + (page.stored ? "true" : "false") +
+                ", \"valid\": " + (page.valid ? "true" : "false") + "}";
+    }
+    json += index.pages.empty() ? "]\n" : "\n  ]\n";
+    json += "}";
+    return json;
+}
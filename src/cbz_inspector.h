@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "image_header.h"
+
+struct CBZPageInfo {
+    std::string name;
+    ImageFormat format = ImageFormat::unknown;
+    int width = 0;
+    int height = 0;
+    int components = 0;
+    std::uint64_t size = 0;
+    std::uint64_t compressed_size = 0;
+    bool stored = false;
+    // False when the entry could not be read or its header was not recognised; the
+    // dimensions are zero in that case.
+    bool valid = false;
+};
+
+struct CBZIndex {
+    std::string path;
+    std::vector<CBZPageInfo> pages;  // in page order
+    std::size_t skipped_entries = 0; // directories and files that are not images
+};
+
+class CBZInspector {
+public:
+    // Lists the image pages of a CBZ archive in page order with their format and pixel
+    // dimensions. Each entry is only decompressed as far as needed to reach its image
+    // header, which is usually the first few kilobytes.
+    static bool inspect(const std::string& cbz_path, CBZIndex& index);
+
+    static std::string to_json(const CBZIndex& index);
+};
@@ -0,0 +1,345 @@
+#include "cbz_repacker.h"
+#include "buffer_pool.h"
+#include "concurrency.h"
+#include "conversion_stats.h"
+#include "image_encoder.h"
+#include "image_header.h"
+#include "log.h"
+#include "page_order.h"
+#include "trace.h"
+#include "zip_writer.h"
+
+#include <zip.h>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <ctime>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+
+namespace {
+// Pages a worker may run ahead of the writer, per worker, so memory stays bounded when
+// one slow page holds up the in-order write.
+constexpr std::size_t kPagesAheadPerWorker = 2;
+
+struct RepackEntry {
+    zip_uint64_t index = 0;
+    std::string source_name;
+    std::string output_name;
+    std::uint64_t size = 0;
+    std::time_t modified = 0;
+    ImageFormat format = ImageFormat::unknown;
+};
+
+struct RepackedPage {
+    BufferPool::Lease data;
+    bool optimized = false;
+    bool ready = false;
+};
+
+std::string base_name(const std::string& name) {
+    const auto slash = name.find_last_of("/\\");
+    return slash == std::string::npos ? name : name.substr(slash + 1);
+}
+
+bool is_comic_info(const std::string& name) {
+    std::string base = base_name(name);
+    std::transform(base.begin(), base.end(), base.begin(), [](unsigned char c) { return std::tolower(c); });
+    return base == "comicinfo.xml";
+}
+
+// Resource forks and Finder metadata that archivers on macOS add next to every file.
+bool is_metadata_junk(const std::string& name) {
+    return name.rfind("__MACOSX/", 0) == 0 || name.find("/__MACOSX/") != std::string::npos ||
+           base_name(name).rfind("._", 0) == 0;
+}
+
+std::string one_decimal(double value) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.1f", value);
+    return text;
+}
+
+const char* extension_for(ImageFormat format) {
+    switch (format) {
+    case ImageFormat::jpeg: return ".jpg";
+    case ImageFormat::png: return ".png";
+    case ImageFormat::webp: return ".webp";
+    default: return "";
+    }
+}
+
+bool read_entry(zip_t* archive, const RepackEntry& entry, std::vector<std::uint8_t>& buffer) {
+    zip_file_t* file = zip_fopen_index(archive, entry.index, 0);
+    if (!file) {
+        return false;
+    }
+    buffer.resize(static_cast<std::size_t>(entry.size));
+    const zip_int64_t bytes_read = zip_fread(file, buffer.data(), buffer.size());
+    zip_fclose(file);
+    return bytes_read == static_cast<zip_int64_t>(buffer.size());
+}
+
+// Lists the entries worth keeping, pages first in page order and ComicInfo.xml last,
+// with their new names.
+std::vector<RepackEntry> select_entries(zip_t* archive, RepackResult& result) {
+    std::vector<RepackEntry> pages;
+    std::vector<RepackEntry> metadata;
+    const zip_int64_t entry_count = zip_get_num_entries(archive, 0);
+    for (zip_int64_t i = 0; i < entry_count; ++i) {
+        zip_stat_t stat;
+        if (zip_stat_index(archive, static_cast<zip_uint64_t>(i), ZIP_FL_ENC_GUESS, &stat) != 0 || stat.name == nullptr) {
+            ++result.dropped_entries;
+            continue;
+        }
+
+        RepackEntry entry;
+        entry.index = static_cast<zip_uint64_t>(i);
+        entry.source_name = stat.name;
+        entry.size = stat.size;
+        entry.modified = (stat.valid & ZIP_STAT_MTIME) ? stat.mtime : std::time(nullptr);
+        entry.format = ImageHeaderParser::format_from_name(entry.source_name);
+
+        const bool directory = !entry.source_name.empty() && entry.source_name.back() == '/';
+        if (directory || is_metadata_junk(entry.source_name)) {
+            ++result.dropped_entries;
+        } else if (entry.format == ImageFormat::jpeg || entry.format == ImageFormat::png ||
+                   entry.format == ImageFormat::webp) {
+            pages.push_back(std::move(entry));
+        } else if (is_comic_info(entry.source_name) && metadata.empty()) {
+            entry.output_name = "ComicInfo.xml";
+            metadata.push_back(std::move(entry));
+        } else {
+            ++result.dropped_entries;
+        }
+    }
+
+    PageOrder::sort(pages, [](const RepackEntry& entry) { return entry.source_name; });
+
+    const std::size_t width = std::max<std::size_t>(3, std::to_string(pages.size()).size());
+    for (std::size_t i = 0; i < pages.size(); ++i) {
+        std::string number = std::to_string(i + 1);
+        pages[i].output_name = std::string(width - number.size(), '0') + number + extension_for(pages[i].format);
+    }
+
+    pages.insert(pages.end(), std::make_move_iterator(metadata.begin()), std::make_move_iterator(metadata.end()));
+    return pages;
+}
+}
+
+bool CBZRepacker::repack(const std::string& cbz_path, const std::string& output_path,
+                         const RepackOptions& options, RepackResult& result,
+                         const ConversionContext& context) {
+    result = RepackResult{};
+    const auto started = std::chrono::steady_clock::now();
+
+    std::vector<RepackEntry> entries;
+    {
+        TraceSpan span("archive_load");
+        StageTimer timer(context.stats, ConversionStage::load);
+        int zip_error = 0;
+        zip_t* archive = zip_open(cbz_path.c_str(), ZIP_RDONLY, &zip_error);
+        if (!archive) {
+            zip_error_t error;
+            zip_error_init_with_code(&error, zip_error);
+            LogMessage(LogLevel::error, context.log) << "Failed to open CBZ: " << cbz_path << ". Reason: " << zip_error_strerror(&error);
+            zip_error_fini(&error);
+            return false;
+        }
+        entries = select_entries(archive, result);
+        zip_close(archive);
+    }
+
+    const auto page_count = static_cast<int>(std::count_if(entries.begin(), entries.end(), [](const RepackEntry& entry) {
+        return entry.format != ImageFormat::unknown;
+    }));
+    if (page_count == 0) {
+        LogMessage(LogLevel::error, context.log) << "No images found in CBZ: " << cbz_path;
+        return false;
+    }
+
+    std::error_code size_error;
+    result.input_bytes = std::filesystem::file_size(cbz_path, size_error);
+
+    OutputSinkOptions sink_options;
+    sink_options.sync = options.sync;
+    ZipWriter writer(sink_options);
+    if (!writer.open(output_path)) {
+        LogMessage(LogLevel::error, context.log) << "Failed to create " << output_path << ": " << writer.error();
+        return false;
+    }
+
+    // Workers take entries in order and leave each result in its slot; this thread writes
+    // the slots out in order as they become ready. A worker never runs more than
+    // `window` entries ahead of the writer.
+    const std::size_t worker_count = std::max<std::size_t>(1, std::min<std::size_t>(
+        entries.size(), Concurrency::worker_threads()));
+    const std::size_t window = worker_count * kPagesAheadPerWorker;
+
+    std::mutex mutex;
+    std::condition_variable slot_ready;
+    std::condition_variable slot_freed;
+    std::deque<RepackedPage> slots(entries.size());
+    std::size_t next_entry = 0;
+    std::size_t written = 0;
+    bool failed = false;
+
+    auto stop_requested = [&]() { return failed || context.cancelled(); };
+
+    auto worker = [&](unsigned int worker_index) {
+        Trace::set_thread_name("repack worker");
+        Concurrency::pin_current_thread(worker_index, context.cpu_slot);
+        int zip_error = 0;
+        zip_t* archive = zip_open(cbz_path.c_str(), ZIP_RDONLY, &zip_error);
+        if (!archive) {
+            LogMessage(LogLevel::error, context.log) << "Failed to open CBZ: " << cbz_path;
+        }
+
+        while (true) {
+            std::size_t job = 0;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                slot_freed.wait(lock, [&]() { return stop_requested() || next_entry >= entries.size() ||
+                                                     next_entry < written + window; });
+                if (!archive) {
+                    failed = true;
+                }
+                if (stop_requested() || next_entry >= entries.size()) {
+                    break;
+                }
+                job = next_entry++;
+            }
+
+            const RepackEntry& entry = entries[job];
+            BufferPool::Lease data = BufferPool::shared().acquire(static_cast<std::size_t>(entry.size));
+            bool loaded = false;
+            {
+                TraceSpan span("read");
+                StageTimer timer(context.stats, ConversionStage::read);
+                loaded = read_entry(archive, entry, *data);
+                timer.add_bytes(data->size());
+            }
+
+            bool optimized = false;
+            if (loaded && entry.format == ImageFormat::jpeg) {
+                TraceSpan span("encode");
+                StageTimer timer(context.stats, ConversionStage::encode);
+                BufferPool::Lease rewritten = BufferPool::shared().acquire(data->size());
+                if (ImageEncoder::optimize_jpeg(data->data(), data->size(), options.progressive, *rewritten) &&
+                    rewritten->size() < data->size()) {
+                    std::swap(data, rewritten);
+                    optimized = true;
+                } else if (rewritten->empty()) {
+                    LogMessage(LogLevel::debug, context.log) << "Keeping " << entry.source_name
+                                                             << " unchanged: not a clean baseline or progressive JPEG";
+                }
+                timer.add_bytes(data->size());
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!loaded) {
+                LogMessage(LogLevel::error, context.log) << "Failed to read " << entry.source_name << " from " << cbz_path;
+                failed = true;
+            }
+            slots[job].data = std::move(data);
+            slots[job].optimized = optimized;
+            slots[job].ready = true;
+            slot_ready.notify_all();
+        }
+
+        if (archive) {
+            zip_close(archive);
+        }
+        // Wake the writer and the other workers if this one stopped on an error.
+        slot_ready.notify_all();
+        slot_freed.notify_all();
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(worker_count);
+    for (std::size_t t = 0; t < worker_count; ++t) {
+        workers.emplace_back(worker, static_cast<unsigned int>(t));
+    }
+
+    int pages_done = 0;
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        RepackedPage page;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            slot_ready.wait(lock, [&]() { return stop_requested() || slots[i].ready; });
+            if (stop_requested()) {
+                break;
+            }
+            page = std::move(slots[i]);
+        }
+
+        {
+            TraceSpan span("zip");
+            StageTimer timer(context.stats, ConversionStage::zip);
+            if (!writer.add_stored(entries[i].output_name, page.data->data(), page.data->size(), entries[i].modified)) {
+                LogMessage(LogLevel::error, context.log) << "Failed to write " << output_path << ": " << writer.error();
+                std::lock_guard<std::mutex> lock(mutex);
+                failed = true;
+                break;
+            }
+            timer.add_bytes(page.data->size());
+        }
+
+        if (entries[i].format != ImageFormat::unknown) {
+            ++result.pages;
+            result.optimized_pages += page.optimized ? 1 : 0;
+            context.report_progress(++pages_done, page_count);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        written = i + 1;
+        slot_freed.notify_all();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (written < entries.size()) {
+            failed = true;
+        }
+        slot_freed.notify_all();
+    }
+    for (auto& thread : workers) {
+        thread.join();
+    }
+
+    if (failed || context.cancelled()) {
+        // The writer discards its temporary file when it goes out of scope.
+        return false;
+    }
+
+    {
+        TraceSpan span("zip");
+        StageTimer timer(context.stats, ConversionStage::zip);
+        if (!writer.commit()) {
+            LogMessage(LogLevel::error, context.log) << "Failed to write " << output_path << ": " << writer.error();
+            return false;
+        }
+    }
+
+    result.output_bytes = writer.offset();
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    if (context.stats) {
+        context.stats->add_pages(result.pages);
+        context.stats->set_io_bytes(result.input_bytes, result.output_bytes);
+    }
+
+    const double reduction = result.input_bytes > 0
+        ? 100.0 * (1.0 - static_cast<double>(result.output_bytes) / static_cast<double>(result.input_bytes))
+        : 0.0;
+    const double throughput = result.seconds > 0.0 ? static_cast<double>(result.input_bytes) / (1024.0 * 1024.0) / result.seconds : 0.0;
+    LogMessage(LogLevel::info, context.log) << "Repacked " << cbz_path << ": " << result.pages << " pages ("
+                                            << result.optimized_pages << " optimized, " << result.dropped_entries
+                                            << " entries dropped), " << result.input_bytes << " -> " << result.output_bytes
+                                            << " bytes (" << one_decimal(reduction) << "% smaller), "
+                                            << one_decimal(throughput) << " MB/s";
+    return true;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "conversion_context.h"
+#include "output_sink.h"
+
+struct RepackOptions {
+    // Rewrite JPEGs as progressive rather than baseline; usually a few percent smaller,
+    // but slower to decode on some readers.
+    bool progressive = false;
+    SyncMode sync = SyncMode::none;
+};
+
+struct RepackResult {
+    int pages = 0;
+    int optimized_pages = 0;    // JPEGs whose optimized form was smaller and replaced them
+    int dropped_entries = 0;    // directories, metadata junk and non-image files
+    std::uint64_t input_bytes = 0;   // archive size on disk
+    std::uint64_t output_bytes = 0;
+    double seconds = 0.0;
+};
+
+class CBZRepacker {
+public:
+    // Writes a clean copy of a CBZ archive: pages in page order renamed to zero-padded
+    // numbers, ComicInfo.xml kept, everything else dropped, and all entries stored
+    // uncompressed. JPEG pages are re-encoded losslessly with optimized Huffman tables
+    // on worker threads and the smaller of the two versions is kept, so the pixels of
+    // every page are unchanged.
+    static bool repack(const std::string& cbz_path, const std::string& output_path,
+                       const RepackOptions& options, RepackResult& result,
+                       const ConversionContext& context = {});
+};
@@ -1,140 +1,219 @@
 #include "cbz_to_pdf_converter.h"
+#include "buffer_pool.h"
+#include "concurrency.h"
+#include "content_hash.h"
+#include "conversion_stats.h"
+#include "image_encoder.h"
+#include "image_header.h"
+#include "log.h"
+#include "page_order.h"
 #include "pdf_creator.h"
+#include "png_image_loader.h"
+#include "trace.h"
+#include "zip_layout.h"
 
 #include <zip.h>
 #include <algorithm>
-#include <cctype>
-#include <cstring>
-#include <filesystem>
-#include <iostream>
-#include <limits>
-#include <regex>
+#include <atomic>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 namespace {
-struct ImageEntry {
-    std::string name;
-    std::vector<std::uint8_t> data;
-    int width = 0;
-    int height = 0;
-    int components = 0;
-};
-
-bool has_jpeg_extension(const std::string& file_name) {
-    const auto extension = std::filesystem::path(file_name).extension().string();
-    std::string lower;
-    lower.resize(extension.size());
-    std::transform(extension.begin(), extension.end(), lower.begin(), [](unsigned char c) {
-        return static_cast<char>(std::tolower(c));
-    });
-    return lower == ".jpg" || lower == ".jpeg";
+// Stored JPEG entries normally keep their SOF marker within the first few kilobytes;
+// large EXIF/ICC segments can push it further, in which case the whole entry is read.
+constexpr std::size_t kHeaderProbeSize = 64 * 1024;
+
+bool read_jpeg_header(const std::vector<std::uint8_t>& data, ImageHeader& header) {
+    return ImageHeaderParser::parse(data.data(), data.size(), header) == HeaderStatus::complete &&
+           header.format == ImageFormat::jpeg;
 }
 
-bool parse_jpeg_dimensions(const std::vector<std::uint8_t>& data, int& width, int& height, int& components) {
-    if (data.size() < 4) {
-        return false;
-    }
+bool read_segment(const PDFFileSegment& segment, std::vector<std::uint8_t>& output) {
+    std::ifstream input(segment.path, std::ios::binary);
+    output.resize(static_cast<std::size_t>(segment.length));
+    return input.seekg(static_cast<std::streamoff>(segment.offset)) &&
+           input.read(reinterpret_cast<char*>(output.data()), static_cast<std::streamsize>(output.size()));
+}
 
-    if (!(data[0] == 0xFF && data[1] == 0xD8)) {
-        return false;
+// Entries are only fingerprinted when another entry has the same CRC-32 and size in
+// the central directory, so that PDFCreator can share their image XObject; entries not
+// in memory (segment or deferred) are otherwise left unread until the PDF is written.
+void fingerprint_repeated_entries(std::vector<PDFImageInput>& images, const std::vector<std::uint32_t>& crcs,
+                                  const std::vector<std::uint64_t>& sizes, std::vector<std::uint8_t>& buffer,
+                                  const ConversionContext& context) {
+    std::map<std::pair<std::uint32_t, std::uint64_t>, std::vector<std::size_t>> candidates;
+    for (std::size_t i = 0; i < images.size(); ++i) {
+        candidates[{crcs[i], sizes[i]}].push_back(i);
     }
 
-    std::size_t index = 2;
-    while (index + 1 < data.size()) {
-        if (data[index] != 0xFF) {
-            ++index;
-            continue;
-        }
-
-        const std::uint8_t marker = data[index + 1];
-        index += 2;
-
-        if (marker == 0xD8 || marker == 0xD9) {
+    for (const auto& [key, indices] : candidates) {
+        if (indices.size() < 2) {
             continue;
         }
-
-        if (marker == 0xDA) {
-            break;
-        }
-
-        if (index + 1 >= data.size()) {
-            return false;
+        for (const std::size_t index : indices) {
+            PDFImageInput& image = images[index];
+            if (!image.segment && !image.deferred) {
+                continue; // PDFCreator fingerprints in-memory data itself
+            }
+            TraceSpan span("read");
+            StageTimer timer(context.stats, ConversionStage::read);
+            buffer.clear();
+            const bool loaded = image.segment ? read_segment(*image.segment, buffer) : image.deferred->load(buffer);
+            if (loaded) {
+                timer.add_bytes(buffer.size());
+                image.content_hash = ContentHash::of(buffer.data(), buffer.size());
+            }
         }
+    }
+}
 
-        const std::uint16_t segment_length = static_cast<std::uint16_t>(data[index] << 8 | data[index + 1]);
-        if (segment_length < 2 || index + segment_length > data.size()) {
-            return false;
+// Re-encodes the JPEG pages that exceed the downscale box, spread over the page
+// workers. Each page's bytes come from its segment, its data or its deferred loader;
+// deferred loaders read the archive, which libzip does not allow concurrently, so they
+// take turns. A page that cannot be downscaled keeps its original bytes. Repeats of a
+// page (the same content_hash) take its result rather than being downscaled again, and
+// keep the hash so that PDFCreator still writes their image once.
+void downscale_pages(std::vector<PDFImageInput>& images, const PageDownscale& downscale,
+                     const ConversionContext& context) {
+    std::vector<std::size_t> pending;
+    std::vector<std::pair<std::size_t, std::size_t>> repeats;  // repeat, page it repeats
+    std::unordered_map<ContentHash, std::size_t, ContentHash::Hasher> first_with_hash;
+    for (std::size_t i = 0; i < images.size(); ++i) {
+        if (images[i].filter != PDFImageFilter::dct || !downscale.exceeds(images[i].width, images[i].height)) {
+            continue;
         }
-
-        const bool is_sof = (marker >= 0xC0 && marker <= 0xC3) ||
-                            (marker >= 0xC5 && marker <= 0xC7) ||
-                            (marker >= 0xC9 && marker <= 0xCB) ||
-                            (marker >= 0xCD && marker <= 0xCF);
-        if (is_sof) {
-            if (segment_length < 8) {
-                return false;
+        if (images[i].content_hash) {
+            const auto [first, inserted] = first_with_hash.emplace(*images[i].content_hash, i);
+            if (!inserted) {
+                repeats.emplace_back(i, first->second);
+                continue;
             }
-            const std::size_t precision_index = index + 2;
-            const std::size_t height_index = precision_index + 1;
-            const std::size_t width_index = height_index + 2;
-            height = static_cast<int>(data[height_index] << 8 | data[height_index + 1]);
-            width = static_cast<int>(data[width_index] << 8 | data[width_index + 1]);
-            components = static_cast<int>(data[width_index + 2]);
-            return width > 0 && height > 0;
         }
-
-        index += segment_length;
+        pending.push_back(i);
     }
+    if (pending.empty()) {
+        return;
+    }
+    LogMessage(LogLevel::info, context.log) << "Downscaling " << pending.size() + repeats.size() << " of " << images.size()
+                                            << " pages to fit " << (downscale.max_width > 0 ? std::to_string(downscale.max_width) : "any")
+                                            << "x" << (downscale.max_height > 0 ? std::to_string(downscale.max_height) : "any");
+
+    std::atomic<std::size_t> next{0};
+    std::mutex archive_mutex;
+    std::vector<char> downscaled(images.size(), 0);
+    std::vector<ConversionStats::Clock::duration> downscale_time(images.size());
+    auto worker = [&](std::size_t worker_index) {
+        Trace::set_thread_name("downscale worker");
+        Concurrency::pin_current_thread(static_cast<unsigned int>(worker_index), context.cpu_slot);
+        std::vector<std::uint8_t> loaded;
+        for (std::size_t n = next++; n < pending.size() && !context.cancelled(); n = next++) {
+            PDFImageInput& image = images[pending[n]];
+            bool have_bytes = true;
+            if (image.segment) {
+                TraceSpan span("read");
+                StageTimer timer(context.stats, ConversionStage::read);
+                have_bytes = read_segment(*image.segment, loaded);
+                timer.add_bytes(have_bytes ? loaded.size() : 0);
+            } else if (image.deferred) {
+                std::lock_guard<std::mutex> lock(archive_mutex);
+                have_bytes = image.deferred->load(loaded);
+            }
+            const std::vector<std::uint8_t>& source = image.segment || image.deferred ? loaded : image.data;
+
+            std::vector<std::uint8_t> scaled;
+            int width = 0;
+            int height = 0;
+            bool ok = false;
+            if (have_bytes) {
+                TraceSpan span("downscale");
+                StageTimer timer(context.stats, ConversionStage::encode);
+                const auto started = ConversionStats::Clock::now();
+                ok = ImageEncoder::downscale_jpeg(source.data(), source.size(), downscale.max_width,
+                                                  downscale.max_height, downscale.quality, scaled, width, height);
+                downscale_time[pending[n]] = ConversionStats::Clock::now() - started;
+                timer.add_bytes(scaled.size());
+            }
+            if (!ok) {
+                LogMessage(LogLevel::warning, context.log) << "Warning: Could not downscale " << image.name
+                                                           << "; keeping it at full size";
+                continue;
+            }
 
-    return false;
-}
-
-int extract_page_hint(const std::string& name) {
-    static const std::regex number_regex(R"((\d+))");
-    std::smatch match;
-    if (std::regex_search(name, match, number_regex)) {
-        try {
-            return std::stoi(match[1].str());
-        } catch (const std::exception&) {
-            return std::numeric_limits<int>::max();
+            LogMessage(LogLevel::debug, context.log) << "Downscaled " << image.name << " from " << image.width << "x"
+                                                     << image.height << " to " << width << "x" << height;
+            image.width = width;
+            image.height = height;
+            image.data = std::move(scaled);
+            image.segment.reset();
+            image.deferred.reset();
+            downscaled[pending[n]] = 1;
         }
+    };
+
+    const std::size_t worker_count = std::max<std::size_t>(1, std::min<std::size_t>(
+        pending.size(), Concurrency::worker_threads()));
+    std::vector<std::thread> workers;
+    workers.reserve(worker_count);
+    for (std::size_t t = 0; t < worker_count; ++t) {
+        workers.emplace_back(worker, t);
+    }
+    for (auto& thread : workers) {
+        thread.join();
     }
-    return std::numeric_limits<int>::max();
-}
-
-void sort_images(std::vector<ImageEntry>& entries) {
-    std::sort(entries.begin(), entries.end(), [](const ImageEntry& lhs, const ImageEntry& rhs) {
-        const auto lhs_name = std::filesystem::path(lhs.name).stem().string();
-        const auto rhs_name = std::filesystem::path(rhs.name).stem().string();
-        const int lhs_number = extract_page_hint(lhs_name);
-        const int rhs_number = extract_page_hint(rhs_name);
-        if (lhs_number != rhs_number) {
-            return lhs_number < rhs_number;
-        }
-        return lhs_name < rhs_name;
-    });
-}
-}
 
-bool CBZToPDFConverter::convert_cbz_to_pdf(const std::string& cbz_path,
-                                           const std::string& output_pdf_path) {
-    int zip_error = 0;
-    zip_t* archive = zip_open(cbz_path.c_str(), ZIP_RDONLY, &zip_error);
-    if (!archive) {
-        zip_error_t error;
-        zip_error_init_with_code(&error, zip_error);
-        std::cerr << "Failed to open CBZ: " << cbz_path << ". Reason: " << zip_error_strerror(&error) << std::endl;
-        zip_error_fini(&error);
-        return false;
+    for (const auto& [repeat, original] : repeats) {
+        if (!downscaled[original]) {
+            continue;  // kept at full size, like the page it repeats
+        }
+        const PDFImageInput& source = images[original];
+        PDFImageInput& image = images[repeat];
+        image.width = source.width;
+        image.height = source.height;
+        image.data = source.data;
+        image.segment.reset();
+        image.deferred.reset();
+        if (context.stats) {
+            context.stats->add_duplicates(ConversionStage::encode, 1, source.data.size(), downscale_time[original]);
+        }
     }
+}
 
-    std::vector<ImageEntry> images;
+// Collects the pages of an open archive, which it closes, and passes them to write_pdf.
+// Stored JPEG entries listed in locations are copied from cbz_path when the PDF is
+// written, unless downscale shrinks them; cbz_path also names the archive in messages.
+bool convert_archive(zip_t* archive, const std::string& cbz_path, const std::vector<ZipEntryLocation>& locations,
+                     const PageDownscale& downscale,
+                     const std::function<bool(const std::vector<PDFImageInput>&, const ConversionContext&)>& write_pdf,
+                     const ConversionContext& context) {
+    // Scratch buffers reused for every entry: the JPEG header probe and whole PNG entries.
+    BufferPool::Lease probe_buffer = BufferPool::shared().acquire(kHeaderProbeSize);
+    BufferPool::Lease entry_buffer = BufferPool::shared().acquire();
+
+    std::vector<PDFImageInput> images;
+    // Central directory CRC-32 and size of each image's entry.
+    std::vector<std::uint32_t> crcs;
+    std::vector<std::uint64_t> sizes;
     const zip_int64_t entry_count = zip_get_num_entries(archive, ZIP_FL_UNCHANGED);
+    // Reading the entries is the first half of the reported progress, writing the PDF
+    // the second.
+    const int progress_half = static_cast<int>(std::max<zip_int64_t>(entry_count, 1));
     for (zip_int64_t i = 0; i < entry_count; ++i) {
+        if (context.cancelled()) {
+            zip_close(archive);
+            return false;
+        }
+        context.report_progress(static_cast<int>(i), 2 * progress_half);
+
         zip_stat_t stat;
         if (zip_stat_index(archive, i, ZIP_FL_ENC_GUESS, &stat) != 0) {
-            std::cerr << "Warning: Failed to stat entry index " << i << std::endl;
+            LogMessage(LogLevel::warning, context.log) << "Warning: Failed to stat entry index " << i;
             continue;
         }
 
@@ -147,69 +226,242 @@ bool CBZToPDFConverter::convert_cbz_to_pdf(const std::string& cbz_path,
             continue; // skip directories
         }
 
-        if (!has_jpeg_extension(entry_name)) {
-            continue; // unsupported format for now
+        const ImageFormat kind = ImageHeaderParser::format_from_name(entry_name);
+        if (kind != ImageFormat::jpeg && kind != ImageFormat::png) {
+            continue;
         }
 
         zip_file_t* file = zip_fopen_index(archive, i, ZIP_FL_UNCHANGED);
         if (!file) {
-            std::cerr << "Warning: Failed to open entry: " << entry_name << std::endl;
+            LogMessage(LogLevel::warning, context.log) << "Warning: Failed to open entry: " << entry_name;
+            continue;
+        }
+
+        if (kind == ImageFormat::png) {
+            std::vector<std::uint8_t>& buffer = *entry_buffer;
+            buffer.resize(static_cast<std::size_t>(stat.size));
+            zip_int64_t bytes_read = 0;
+            {
+                TraceSpan span("read");
+                StageTimer timer(context.stats, ConversionStage::read);
+                bytes_read = zip_fread(file, buffer.data(), buffer.size());
+                zip_fclose(file);
+                timer.add_bytes(bytes_read > 0 ? static_cast<std::uint64_t>(bytes_read) : 0);
+            }
+
+            if (bytes_read != static_cast<zip_int64_t>(buffer.size())) {
+                LogMessage(LogLevel::warning, context.log) << "Warning: Failed to read entire entry: " << entry_name;
+                continue;
+            }
+
+            PDFImageInput image;
+            image.name = entry_name;
+            TraceSpan span("encode");
+            StageTimer timer(context.stats, ConversionStage::encode);
+            if (!PNGImageLoader::load_for_pdf(buffer, image)) {
+                LogMessage(LogLevel::warning, context.log) << "Warning: Unable to read PNG image: " << entry_name;
+                continue;
+            }
+            images.push_back(std::move(image));
+            crcs.push_back(stat.crc);
+            sizes.push_back(stat.size);
             continue;
         }
 
-        std::vector<std::uint8_t> buffer;
-        buffer.resize(static_cast<std::size_t>(stat.size));
-        const zip_int64_t bytes_read = zip_fread(file, buffer.data(), buffer.size());
+        std::optional<PDFFileSegment> segment;
+        if (static_cast<std::size_t>(i) < locations.size()) {
+            const auto& location = locations[static_cast<std::size_t>(i)];
+            const char* raw_name = zip_get_name(archive, static_cast<zip_uint64_t>(i), ZIP_FL_ENC_RAW);
+            if (location.stored && location.size == stat.size &&
+                raw_name != nullptr && location.name == raw_name) {
+                segment = PDFFileSegment{cbz_path, location.data_offset, location.size};
+            }
+        }
+
+        // Only the header is needed here. Stored entries are copied file-to-file when the
+        // PDF is written; larger compressed ones are read again at that point, one at a
+        // time, rather than all being held in memory until then.
+        const std::size_t read_size = std::min<std::size_t>(static_cast<std::size_t>(stat.size), kHeaderProbeSize);
+
+        std::optional<TraceSpan> read_span(std::in_place, "read");
+        std::optional<StageTimer> read_timer(std::in_place, context.stats, ConversionStage::read);
+        std::vector<std::uint8_t>& buffer = *probe_buffer;
+        buffer.resize(read_size);
+        zip_int64_t bytes_read = zip_fread(file, buffer.data(), buffer.size());
+
+        ImageHeader header;
+        bool parsed = bytes_read == static_cast<zip_int64_t>(buffer.size()) &&
+                      read_jpeg_header(buffer, header);
+
+        if (!parsed && bytes_read == static_cast<zip_int64_t>(buffer.size()) && buffer.size() < stat.size) {
+            const std::size_t prefix_size = buffer.size();
+            buffer.resize(static_cast<std::size_t>(stat.size));
+            const zip_int64_t rest = zip_fread(file, buffer.data() + prefix_size, buffer.size() - prefix_size);
+            bytes_read = rest < 0 ? rest : bytes_read + rest;
+            parsed = bytes_read == static_cast<zip_int64_t>(buffer.size()) &&
+                     read_jpeg_header(buffer, header);
+        }
         zip_fclose(file);
+        read_timer->add_bytes(bytes_read > 0 ? static_cast<std::uint64_t>(bytes_read) : 0);
+        read_timer.reset();
+        read_span.reset();
 
         if (bytes_read != static_cast<zip_int64_t>(buffer.size())) {
-            std::cerr << "Warning: Failed to read entire entry: " << entry_name << std::endl;
+            LogMessage(LogLevel::warning, context.log) << "Warning: Failed to read entire entry: " << entry_name;
             continue;
         }
 
-        int width = 0;
-        int height = 0;
-        int components = 0;
-        if (!parse_jpeg_dimensions(buffer, width, height, components)) {
-            std::cerr << "Warning: Unable to read JPEG dimensions for: " << entry_name << std::endl;
+        if (!parsed) {
+            LogMessage(LogLevel::warning, context.log) << "Warning: Unable to read JPEG dimensions for: " << entry_name;
             continue;
         }
 
-        ImageEntry entry;
-        entry.name = entry_name;
-        entry.width = width;
-        entry.height = height;
-        entry.components = components;
-        entry.data = std::move(buffer);
-        images.push_back(std::move(entry));
+        PDFImageInput image;
+        image.name = entry_name;
+        image.width = header.width;
+        image.height = header.height;
+        image.components = header.components;
+        if (segment) {
+            image.segment = std::move(segment);
+        } else if (buffer.size() == stat.size) {
+            image.data.assign(buffer.begin(), buffer.end());
+        } else {
+            const std::uint64_t length = stat.size;
+            image.deferred = PDFDeferredData{length, [archive, i, length, &context](std::vector<std::uint8_t>& output) {
+                TraceSpan span("read");
+                StageTimer timer(context.stats, ConversionStage::read);
+                zip_file_t* entry = zip_fopen_index(archive, i, ZIP_FL_UNCHANGED);
+                if (!entry) {
+                    return false;
+                }
+                output.resize(static_cast<std::size_t>(length));
+                const zip_int64_t bytes_read = zip_fread(entry, output.data(), output.size());
+                zip_fclose(entry);
+                timer.add_bytes(bytes_read > 0 ? static_cast<std::uint64_t>(bytes_read) : 0);
+                return bytes_read == static_cast<zip_int64_t>(output.size());
+            }};
+        }
+        images.push_back(std::move(image));
+        crcs.push_back(stat.crc);
+        sizes.push_back(stat.size);
     }
 
-    zip_close(archive);
-
     if (images.empty()) {
-        std::cerr << "No supported images found inside CBZ: " << cbz_path << std::endl;
+        zip_close(archive);
+        LogMessage(LogLevel::error, context.log) << "No supported images found inside CBZ: " << cbz_path;
         return false;
     }
 
-    sort_images(images);
+    fingerprint_repeated_entries(images, crcs, sizes, *entry_buffer, context);
+    if (downscale.enabled()) {
+        downscale_pages(images, downscale, context);
+    }
+    PageOrder::sort(images, [](const PDFImageInput& image) { return image.name; });
 
-    std::vector<PDFImageInput> pdf_images;
-    pdf_images.reserve(images.size());
-    for (auto& entry : images) {
-        pdf_images.push_back(PDFImageInput{
-            entry.name,
-            entry.width,
-            entry.height,
-            entry.components,
-            std::move(entry.data)
-        });
+    ConversionContext write_context = context;
+    if (context.progress) {
+        write_context.progress = [&context, progress_half](int done, int total) {
+            context.report_progress(progress_half + done * progress_half / total, 2 * progress_half);
+        };
     }
 
-    if (!PDFCreator::create_pdf_from_images(pdf_images, output_pdf_path)) {
-        std::cerr << "Failed to create PDF for CBZ: " << cbz_path << std::endl;
+    // Deferred entries are read from the archive while the PDF is written.
+    const bool written = write_pdf(images, write_context);
+    zip_close(archive);
+
+    if (!written) {
+        if (context.cancelled()) {
+            return false;
+        }
+        LogMessage(LogLevel::error, context.log) << "Failed to create PDF for CBZ: " << cbz_path;
         return false;
     }
 
-    std::cout << "Created PDF: " << output_pdf_path << std::endl;
+    if (context.stats) {
+        context.stats->add_pages(static_cast<int>(images.size()));
+    }
+
     return true;
 }
+
+// Opens the archive at cbz_path and converts it with convert_archive.
+bool convert_archive_file(const std::string& cbz_path, const PageDownscale& downscale,
+                          const std::function<bool(const std::vector<PDFImageInput>&, const ConversionContext&)>& write_pdf,
+                          const ConversionContext& context) {
+    std::optional<TraceSpan> load_span(std::in_place, "archive_load");
+    std::optional<StageTimer> load_timer(std::in_place, context.stats, ConversionStage::load);
+    int zip_error = 0;
+    zip_t* archive = zip_open(cbz_path.c_str(), ZIP_RDONLY, &zip_error);
+    if (!archive) {
+        zip_error_t error;
+        zip_error_init_with_code(&error, zip_error);
+        LogMessage(LogLevel::error, context.log) << "Failed to open CBZ: " << cbz_path << ". Reason: " << zip_error_strerror(&error);
+        zip_error_fini(&error);
+        return false;
+    }
+
+    // Locations of stored entries inside the archive file, so their bytes can be
+    // moved straight into the PDF instead of being read through libzip.
+    const std::vector<ZipEntryLocation> locations = ZipLayout::locate_entries(cbz_path);
+    load_timer.reset();
+    load_span.reset();
+
+    return convert_archive(archive, cbz_path, locations, downscale, write_pdf, context);
+}
+}
+
+bool CBZToPDFConverter::convert_cbz_to_pdf(const std::string& cbz_path,
+                                           const std::string& output_pdf_path,
+                                           const PDFWriteOptions& pdf_options,
+                                           const PageDownscale& downscale,
+                                           const ConversionContext& context) {
+    const bool converted = convert_archive_file(cbz_path, downscale,
+        [&](const std::vector<PDFImageInput>& images, const ConversionContext& write_context) {
+            return PDFCreator::create_pdf_from_images(images, output_pdf_path, pdf_options, write_context);
+        }, context);
+    if (converted) {
+        LogMessage(LogLevel::info, context.log) << "Created PDF: " << output_pdf_path;
+    }
+    return converted;
+}
+
+bool CBZToPDFConverter::convert_cbz_to_pdf(const std::string& cbz_path,
+                                           const OutputWriter& output,
+                                           const PDFWriteOptions& pdf_options,
+                                           const PageDownscale& downscale,
+                                           const ConversionContext& context) {
+    return convert_archive_file(cbz_path, downscale,
+        [&](const std::vector<PDFImageInput>& images, const ConversionContext& write_context) {
+            return PDFCreator::create_pdf_from_images(images, output, pdf_options, write_context);
+        }, context);
+}
+
+bool CBZToPDFConverter::convert_cbz_to_pdf(std::span<const std::uint8_t> cbz_data,
+                                           const OutputWriter& output,
+                                           const PDFWriteOptions& pdf_options,
+                                           const PageDownscale& downscale,
+                                           const ConversionContext& context) {
+    std::optional<TraceSpan> load_span(std::in_place, "archive_load");
+    std::optional<StageTimer> load_timer(std::in_place, context.stats, ConversionStage::load);
+    zip_error_t error;
+    zip_error_init(&error);
+    zip_source_t* source = zip_source_buffer_create(cbz_data.data(), cbz_data.size(), 0, &error);
+    zip_t* archive = source ? zip_open_from_source(source, ZIP_RDONLY, &error) : nullptr;
+    if (!archive) {
+        LogMessage(LogLevel::error, context.log) << "Failed to open CBZ from memory. Reason: " << zip_error_strerror(&error);
+        zip_error_fini(&error);
+        if (source) {
+            zip_source_free(source);
+        }
+        return false;
+    }
+    zip_error_fini(&error);
+    load_timer.reset();
+    load_span.reset();
+
+    // Nothing can be copied file-to-file here; every entry is read through libzip.
+    return convert_archive(archive, "in-memory CBZ", {}, downscale,
+        [&](const std::vector<PDFImageInput>& images, const ConversionContext& write_context) {
+            return PDFCreator::create_pdf_from_images(images, output, pdf_options, write_context);
+        }, context);
+}
@@ -1,9 +1,46 @@
 #pragma once
 
+#include <cstdint>
+#include <span>
 #include <string>
 
+#include "conversion_context.h"
+#include "pdf_creator.h"
+
+// Fits pages to a reading device's screen. JPEG pages larger than the box are decoded
+// at reduced size and re-encoded, on the page workers; pages that fit (and PNG pages)
+// are embedded unchanged.
+struct PageDownscale {
+    int max_width = 0;   // 0: no limit on this side
+    int max_height = 0;
+    int quality = 85;    // JPEG quality of re-encoded pages
+
+    bool enabled() const { return max_width > 0 || max_height > 0; }
+    bool exceeds(int width, int height) const {
+        return (max_width > 0 && width > max_width) || (max_height > 0 && height > max_height);
+    }
+};
+
 class CBZToPDFConverter {
 public:
     static bool convert_cbz_to_pdf(const std::string& cbz_path,
-                                   const std::string& output_pdf_path);
+                                   const std::string& output_pdf_path,
+                                   const PDFWriteOptions& pdf_options = {},
+                                   const PageDownscale& downscale = {},
+                                   const ConversionContext& context = {});
+
+    // Converts the archive at cbz_path and hands the PDF to output, e.g. a pipe.
+    static bool convert_cbz_to_pdf(const std::string& cbz_path,
+                                   const OutputWriter& output,
+                                   const PDFWriteOptions& pdf_options = {},
+                                   const PageDownscale& downscale = {},
+                                   const ConversionContext& context = {});
+
+    // Converts an archive held in memory and hands the PDF to output, without touching
+    // the filesystem. cbz_data must stay valid until this returns.
+    static bool convert_cbz_to_pdf(std::span<const std::uint8_t> cbz_data,
+                                   const OutputWriter& output,
+                                   const PDFWriteOptions& pdf_options = {},
+                                   const PageDownscale& downscale = {},
+                                   const ConversionContext& context = {});
 };
@@ -0,0 +1,244 @@
+#include "concurrency.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+// I/O threads of the threads backend: enough to keep a network filesystem busy without
+// queueing unbounded blocking calls.
+constexpr unsigned int kDefaultIoThreads = 4;
+
+std::atomic<unsigned int> g_worker_threads{0};
+std::atomic<unsigned int> g_io_threads{0};
+std::atomic_bool g_pinning{false};
+
+struct CpuLimit {
+    unsigned int cpus = 0;
+    std::string source;
+};
+
+#ifdef __linux__
+const char* const kCgroupRoot = "/sys/fs/cgroup";
+
+bool read_first_line(const std::string& path, std::string& line) {
+    std::ifstream file(path);
+    return file && std::getline(file, line);
+}
+
+// CPUs allowed by a quota of `quota` microseconds per `period`, rounded up: a quota of
+// 1.5 CPUs still keeps two workers busy part of the time.
+unsigned int cpus_for_quota(long long quota, long long period) {
+    return static_cast<unsigned int>(std::max(1.0, std::ceil(static_cast<double>(quota) / static_cast<double>(period))));
+}
+
+// The cgroup path of this process for the v2 hierarchy, or for the v1 hierarchy with
+// the cpu controller, from /proc/self/cgroup.
+bool own_cgroup(bool& unified, std::string& path) {
+    std::ifstream file("/proc/self/cgroup");
+    std::string line;
+    bool found_v2 = false;
+    std::string v2_path;
+    while (std::getline(file, line)) {
+        const auto first = line.find(':');
+        const auto second = first == std::string::npos ? std::string::npos : line.find(':', first + 1);
+        if (second == std::string::npos) {
+            continue;
+        }
+        const std::string controllers = line.substr(first + 1, second - first - 1);
+        const std::string cgroup_path = line.substr(second + 1);
+        if (controllers.empty()) {
+            found_v2 = true;
+            v2_path = cgroup_path;
+            continue;
+        }
+        std::stringstream list(controllers);
+        std::string controller;
+        while (std::getline(list, controller, ',')) {
+            if (controller == "cpu") {
+                unified = false;
+                path = cgroup_path;
+                return true;
+            }
+        }
+    }
+    if (found_v2) {
+        unified = true;
+        path = v2_path;
+    }
+    return found_v2;
+}
+
+// Walks from the process's cgroup up to the mount point and keeps the strictest quota.
+// Without a cgroup namespace the process's path may not exist under the mount (the
+// container's cgroup is mounted as the root); those levels are simply skipped.
+CpuLimit cgroup_limit() {
+    CpuLimit limit;
+    bool unified = false;
+    std::string path;
+    if (!own_cgroup(unified, path)) {
+        return limit;
+    }
+
+    std::string mount = kCgroupRoot;
+    if (!unified) {
+        for (const char* candidate : {"/sys/fs/cgroup/cpu,cpuacct", "/sys/fs/cgroup/cpu"}) {
+            std::ifstream probe(std::string(candidate) + "/cpu.cfs_period_us");
+            if (probe) {
+                mount = candidate;
+                break;
+            }
+        }
+    }
+
+    while (true) {
+        const std::string directory = mount + (path == "/" ? "" : path);
+        long long quota = -1;
+        long long period = 0;
+        std::string line;
+        if (unified) {
+            // "max 100000" or "<quota> <period>"
+            if (read_first_line(directory + "/cpu.max", line)) {
+                std::stringstream fields(line);
+                std::string quota_text;
+                fields >> quota_text >> period;
+                if (quota_text != "max") {
+                    quota = std::atoll(quota_text.c_str());
+                }
+            }
+        } else if (read_first_line(directory + "/cpu.cfs_quota_us", line)) {
+            quota = std::atoll(line.c_str());
+            if (read_first_line(directory + "/cpu.cfs_period_us", line)) {
+                period = std::atoll(line.c_str());
+            }
+        }
+
+        if (quota > 0 && period > 0) {
+            const unsigned int cpus = cpus_for_quota(quota, period);
+            if (limit.cpus == 0 || cpus < limit.cpus) {
+                limit.cpus = cpus;
+                limit.source = std::string(unified ? "cgroup v2" : "cgroup v1") + " quota " +
+                               std::to_string(quota) + "/" + std::to_string(period);
+            }
+        }
+
+        if (path.empty() || path == "/") {
+            break;
+        }
+        const auto slash = path.find_last_of('/');
+        path = slash == 0 || slash == std::string::npos ? "/" : path.substr(0, slash);
+    }
+    return limit;
+}
+
+bool affinity_mask(cpu_set_t& mask) {
+    CPU_ZERO(&mask);
+    return sched_getaffinity(0, sizeof(mask), &mask) == 0;
+}
+#endif
+
+struct Detected {
+    unsigned int cpus = 1;
+    std::string description;
+    std::vector<int> allowed_cpus;  // the affinity mask at startup, before any pinning
+};
+
+Detected detect() {
+    const unsigned int online = std::max(1u, std::thread::hardware_concurrency());
+    Detected detected;
+    detected.cpus = online;
+    std::string source;
+
+#ifdef __linux__
+    cpu_set_t mask;
+    if (affinity_mask(mask)) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &mask)) {
+                detected.allowed_cpus.push_back(cpu);
+            }
+        }
+        const auto allowed = static_cast<unsigned int>(detected.allowed_cpus.size());
+        if (allowed > 0 && allowed < detected.cpus) {
+            detected.cpus = allowed;
+            source = "affinity mask";
+        }
+    }
+    const CpuLimit limit = cgroup_limit();
+    if (limit.cpus > 0 && limit.cpus < detected.cpus) {
+        detected.cpus = limit.cpus;
+        source = limit.source;
+    }
+#endif
+
+    detected.description = std::to_string(detected.cpus) + " (" +
+                           (source.empty() ? std::string() : source + ", ") +
+                           std::to_string(online) + " online)";
+    return detected;
+}
+
+const Detected& detected() {
+    static const Detected value = detect();
+    return value;
+}
+}
+
+unsigned int Concurrency::available_cpus() {
+    return detected().cpus;
+}
+
+const std::string& Concurrency::describe() {
+    return detected().description;
+}
+
+void Concurrency::set_worker_threads(unsigned int count) {
+    g_worker_threads = count;
+}
+
+unsigned int Concurrency::worker_threads() {
+    const unsigned int count = g_worker_threads;
+    return count > 0 ? count : available_cpus();
+}
+
+void Concurrency::set_io_threads(unsigned int count) {
+    g_io_threads = count;
+}
+
+unsigned int Concurrency::io_threads() {
+    const unsigned int count = g_io_threads;
+    return count > 0 ? count : kDefaultIoThreads;
+}
+
+void Concurrency::set_pinning(bool enabled) {
+    g_pinning = enabled;
+}
+
+bool Concurrency::pinning() {
+    return g_pinning;
+}
+
+void Concurrency::pin_current_thread(unsigned int worker_index, unsigned int slot) {
+#ifdef __linux__
+    const std::vector<int>& cpus = detected().allowed_cpus;
+    if (!g_pinning || cpus.empty()) {
+        return;
+    }
+    const std::size_t cpu = (static_cast<std::size_t>(slot) * worker_threads() + worker_index) % cpus.size();
+    cpu_set_t target;
+    CPU_ZERO(&target);
+    CPU_SET(cpus[cpu], &target);
+    pthread_setaffinity_np(pthread_self(), sizeof(target), &target);
+#else
+    (void)worker_index;
+    (void)slot;
+#endif
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+
+// How many CPUs the process may actually use, and the thread counts derived from it.
+// std::thread::hardware_concurrency() reports every CPU of the machine; in a container
+// whose CFS quota or cpuset allows only a few of them, sizing worker pools from it
+// oversubscribes the quota and the workers spend their time throttled.
+class Concurrency {
+public:
+    // The smallest of the online CPU count, the CPUs in this process's affinity mask and
+    // the cgroup v1 or v2 CPU quota (rounded up, and the strictest along the cgroup's
+    // path). Detected once; always at least 1.
+    static unsigned int available_cpus();
+    // Where available_cpus() came from, e.g. "8 (cgroup v2 quota 800000/100000, 96 online)".
+    static const std::string& describe();
+
+    // Render, encode and repack workers per conversion: the override when one is set,
+    // otherwise available_cpus(). Can be changed between conversions.
+    static void set_worker_threads(unsigned int count);  // 0 restores the automatic count
+    static unsigned int worker_threads();
+
+    // Blocking I/O threads of the threads I/O backend. Only effective before the backend
+    // is first used.
+    static void set_io_threads(unsigned int count);  // 0 restores the default of 4
+    static unsigned int io_threads();
+
+    // With pinning on, pin_current_thread(n, slot) binds the calling worker to CPU
+    // slot * worker_threads() + n of the process's affinity mask (wrapping around), so
+    // that workers stop migrating between cores. Files converting at the same time use
+    // different slots, so their workers do not stack on the same CPUs. Linux only;
+    // elsewhere, and with pinning off, it does nothing.
+    static void set_pinning(bool enabled);
+    static bool pinning();
+    static void pin_current_thread(unsigned int worker_index, unsigned int slot = 0);
+};
@@ -0,0 +1,117 @@
+#include "content_hash.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+// Multipliers from xxHash; the stripe loop follows XXH64, with a second, independently
+// mixed 64-bit result derived from the same lanes for the high half.
+constexpr std::uint64_t kPrime1 = 0x9E3779B185EBCA87ULL;
+constexpr std::uint64_t kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr std::uint64_t kPrime3 = 0x165667B19E3779F9ULL;
+constexpr std::uint64_t kPrime4 = 0x85EBCA77C2B2AE63ULL;
+constexpr std::uint64_t kPrime5 = 0x27D4EB2F165667C5ULL;
+
+constexpr std::size_t kStripeSize = 32;
+
+std::uint64_t rotl(std::uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+std::uint64_t load_u64(const std::uint8_t* data) {
+    std::uint64_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+std::uint64_t round(std::uint64_t lane, std::uint64_t input) {
+    lane += input * kPrime2;
+    lane = rotl(lane, 31);
+    return lane * kPrime1;
+}
+
+std::uint64_t merge(std::uint64_t hash, std::uint64_t lane) {
+    hash ^= round(0, lane);
+    return hash * kPrime1 + kPrime4;
+}
+
+std::uint64_t avalanche(std::uint64_t hash) {
+    hash ^= hash >> 33;
+    hash *= kPrime2;
+    hash ^= hash >> 29;
+    hash *= kPrime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+// Folds the trailing bytes (fewer than a stripe) into a partial result.
+std::uint64_t fold_tail(std::uint64_t hash, const std::uint8_t* tail, std::size_t size) {
+    std::size_t index = 0;
+    for (; index + 8 <= size; index += 8) {
+        hash ^= round(0, load_u64(tail + index));
+        hash = rotl(hash, 27) * kPrime1 + kPrime4;
+    }
+    for (; index < size; ++index) {
+        hash ^= tail[index] * kPrime5;
+        hash = rotl(hash, 11) * kPrime1;
+    }
+    return hash;
+}
+}
+
+ContentHash ContentHash::of(const void* data, std::size_t size) {
+    ContentHasher hasher;
+    hasher.update(data, size);
+    return hasher.finish();
+}
+
+ContentHasher::ContentHasher()
+    : lanes_{kPrime1 + kPrime2, kPrime2, 0, 0 - kPrime1} {}
+
+void ContentHasher::consume_stripe(const std::uint8_t* stripe) {
+    for (int lane = 0; lane < 4; ++lane) {
+        lanes_[lane] = round(lanes_[lane], load_u64(stripe + 8 * lane));
+    }
+}
+
+void ContentHasher::update(const void* data, std::size_t size) {
+    const auto* bytes = static_cast<const std::uint8_t*>(data);
+    total_size_ += size;
+
+    if (pending_size_ != 0) {
+        const std::size_t take = std::min(size, kStripeSize - pending_size_);
+        std::memcpy(pending_ + pending_size_, bytes, take);
+        pending_size_ += take;
+        bytes += take;
+        size -= take;
+        if (pending_size_ < kStripeSize) {
+            return;
+        }
+        consume_stripe(pending_);
+        pending_size_ = 0;
+    }
+
+    for (; size >= kStripeSize; bytes += kStripeSize, size -= kStripeSize) {
+        consume_stripe(bytes);
+    }
+    std::memcpy(pending_, bytes, size);
+    pending_size_ = size;
+}
+
+ContentHash ContentHasher::finish() const {
+    // Low half: XXH64's convergence. High half: the lanes in a different order and
+    // rotation, seeded with the length, so the halves do not fail together.
+    std::uint64_t low = rotl(lanes_[0], 1) + rotl(lanes_[1], 7) + rotl(lanes_[2], 12) + rotl(lanes_[3], 18);
+    std::uint64_t high = rotl(lanes_[3], 3) + rotl(lanes_[2], 17) + rotl(lanes_[1], 29) + rotl(lanes_[0], 41);
+    for (int lane = 0; lane < 4; ++lane) {
+        low = merge(low, lanes_[lane]);
+        high = merge(high, lanes_[3 - lane] ^ kPrime5);
+    }
+    low += total_size_;
+    high ^= total_size_ * kPrime3;
+
+    ContentHash hash;
+    hash.low = avalanche(fold_tail(low, pending_, pending_size_));
+    hash.high = avalanche(fold_tail(high ^ kPrime4, pending_, pending_size_) * kPrime5);
+    return hash;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// 128-bit fingerprint of a byte sequence, used to find repeated pages (blank
+// separators, covers, adverts) so their data is encoded and stored once. Not
+// cryptographic, but wide enough that accidental collisions between pages are not a
+// practical concern.
+struct ContentHash {
+    std::uint64_t low = 0;
+    std::uint64_t high = 0;
+
+    static ContentHash of(const void* data, std::size_t size);
+
+    bool operator==(const ContentHash& other) const {
+        return low == other.low && high == other.high;
+    }
+    bool operator!=(const ContentHash& other) const {
+        return !(*this == other);
+    }
+
+    // For unordered containers.
+    struct Hasher {
+        std::size_t operator()(const ContentHash& hash) const {
+            return static_cast<std::size_t>(hash.low);
+        }
+    };
+};
+
+// Computes a ContentHash over data supplied in pieces, e.g. the rows of an image with
+// padded strides. Feeding the same bytes in any split gives the same hash as
+// ContentHash::of().
+class ContentHasher {
+public:
+    ContentHasher();
+
+    void update(const void* data, std::size_t size);
+    ContentHash finish() const;
+
+private:
+    void consume_stripe(const std::uint8_t* stripe);
+
+    std::uint64_t lanes_[4];
+    std::uint8_t pending_[32];
+    std::size_t pending_size_ = 0;
+    std::uint64_t total_size_ = 0;
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <string>
+
+#include "log.h"
+
+class ConversionStats;
+
+// Receives the number of pages finished so far and the total for the conversion step.
+// May be called from page worker threads, but never concurrently for one conversion.
+using PageProgress = std::function<void(int done, int total)>;
+
+// Receives the zero-based page index and output path of each page image once it has been
+// written. Called from page worker threads, possibly concurrently.
+using PageWritten = std::function<void(int page, const std::string& path)>;
+
+// Optional per-conversion hooks passed down from ConverterService to the core classes.
+// A default-constructed context disables all of them.
+struct ConversionContext {
+    ConversionStats* stats = nullptr;
+    // Receives this conversion's log messages; empty means the default console output.
+    LogSink log;
+    // Set from another thread to abandon the conversion. Checked before every page, so
+    // at most the pages already rendering finish; partial outputs are removed.
+    const std::atomic_bool* cancel = nullptr;
+    PageProgress progress;
+    PageWritten page_written;
+    // Which of the files converting at the same time this is, 0 to jobs - 1 (or the
+    // worker process's slot with --processes); offsets the CPUs its workers pin to.
+    unsigned int cpu_slot = 0;
+
+    bool cancelled() const {
+        return cancel && cancel->load(std::memory_order_relaxed);
+    }
+
+    void report_progress(int done, int total) const {
+        if (progress) {
+            progress(done, total);
+        }
+    }
+};
@@ -0,0 +1,177 @@
+#include "conversion_stats.h"
+
+#include <fstream>
+#include <string>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+namespace {
+// Peak resident set size of the process so far. On Linux this is VmHWM, which
+// reset_peak_rss() can lower again between files; elsewhere it is getrusage's
+// lifetime maximum.
+std::uint64_t read_peak_rss() {
+#ifdef __linux__
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind("VmHWM:", 0) == 0) {
+            return std::stoull(line.substr(6)) * 1024;
+        }
+    }
+#endif
+#ifndef _WIN32
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+        return static_cast<std::uint64_t>(usage.ru_maxrss);
+#else
+        return static_cast<std::uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+    }
+#endif
+    return 0;
+}
+
+void reset_peak_rss() {
+#ifdef __linux__
+    // Writing 5 to clear_refs resets VmHWM to the current RSS (Linux 4.0+).
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    clear_refs << "5";
+#endif
+}
+
+std::int64_t to_nanoseconds(ConversionStats::Clock::duration duration) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+}
+}
+
+const char* conversion_stage_name(ConversionStage stage) {
+    switch (stage) {
+    case ConversionStage::load: return "load";
+    case ConversionStage::read: return "read";
+    case ConversionStage::render: return "render";
+    case ConversionStage::analyze: return "analyze";
+    case ConversionStage::encode: return "encode";
+    case ConversionStage::write: return "write";
+    case ConversionStage::zip: return "zip";
+    case ConversionStage::pdf_write: return "pdf_write";
+    default: return "unknown";
+    }
+}
+
+void ConversionStats::begin() {
+    for (auto& counters : stages_) {
+        counters.nanoseconds = 0;
+        counters.bytes = 0;
+        counters.calls = 0;
+        counters.duplicates = 0;
+        counters.duplicate_bytes = 0;
+        counters.saved_nanoseconds = 0;
+    }
+    pages_ = 0;
+    queue_wait_nanoseconds_ = 0;
+    input_bytes_ = 0;
+    output_bytes_ = 0;
+    wall_nanoseconds_ = 0;
+    peak_rss_bytes_ = 0;
+
+    if (measure_peak_rss_) {
+        reset_peak_rss();
+    }
+    started_ = Clock::now();
+}
+
+void ConversionStats::finish() {
+    wall_nanoseconds_ = to_nanoseconds(Clock::now() - started_);
+    peak_rss_bytes_ = measure_peak_rss_ ? read_peak_rss() : 0;
+}
+
+void ConversionStats::set_measure_peak_rss(bool enabled) {
+    measure_peak_rss_ = enabled;
+}
+
+std::uint64_t ConversionStats::process_peak_rss() {
+    return read_peak_rss();
+}
+
+void ConversionStats::add(ConversionStage stage, Clock::duration elapsed, std::uint64_t bytes) {
+    auto& counters = stages_[static_cast<std::size_t>(stage)];
+    counters.nanoseconds.fetch_add(to_nanoseconds(elapsed), std::memory_order_relaxed);
+    counters.bytes.fetch_add(bytes, std::memory_order_relaxed);
+    counters.calls.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ConversionStats::add_duplicates(ConversionStage stage, int pages, std::uint64_t bytes, Clock::duration saved) {
+    auto& counters = stages_[static_cast<std::size_t>(stage)];
+    counters.duplicates.fetch_add(static_cast<std::uint64_t>(pages), std::memory_order_relaxed);
+    counters.duplicate_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    counters.saved_nanoseconds.fetch_add(to_nanoseconds(saved), std::memory_order_relaxed);
+}
+
+void ConversionStats::add_pages(int pages) {
+    pages_.fetch_add(pages, std::memory_order_relaxed);
+}
+
+void ConversionStats::add_queue_wait(Clock::duration wait) {
+    queue_wait_nanoseconds_.fetch_add(to_nanoseconds(wait), std::memory_order_relaxed);
+}
+
+void ConversionStats::set_io_bytes(std::uint64_t input_bytes, std::uint64_t output_bytes) {
+    input_bytes_ = input_bytes;
+    output_bytes_ = output_bytes;
+}
+
+ConversionStats::StageTotals ConversionStats::stage(ConversionStage stage) const {
+    const auto& counters = stages_[static_cast<std::size_t>(stage)];
+    StageTotals totals;
+    totals.seconds = static_cast<double>(counters.nanoseconds.load()) / 1e9;
+    totals.bytes = counters.bytes.load();
+    totals.calls = counters.calls.load();
+    totals.duplicates = counters.duplicates.load();
+    totals.duplicate_bytes = counters.duplicate_bytes.load();
+    totals.saved_seconds = static_cast<double>(counters.saved_nanoseconds.load()) / 1e9;
+    return totals;
+}
+
+int ConversionStats::pages() const {
+    return pages_.load();
+}
+
+double ConversionStats::wall_seconds() const {
+    return static_cast<double>(wall_nanoseconds_) / 1e9;
+}
+
+double ConversionStats::queue_wait_seconds() const {
+    return static_cast<double>(queue_wait_nanoseconds_.load()) / 1e9;
+}
+
+std::uint64_t ConversionStats::input_bytes() const {
+    return input_bytes_.load();
+}
+
+std::uint64_t ConversionStats::output_bytes() const {
+    return output_bytes_.load();
+}
+
+std::uint64_t ConversionStats::peak_rss_bytes() const {
+    return peak_rss_bytes_;
+}
+
+StageTimer::StageTimer(ConversionStats* stats, ConversionStage stage)
+    : stats_(stats), stage_(stage) {
+    if (stats_) {
+        start_ = ConversionStats::Clock::now();
+    }
+}
+
+StageTimer::~StageTimer() {
+    if (stats_) {
+        stats_->add(stage_, ConversionStats::Clock::now() - start_, bytes_);
+    }
+}
+
+void StageTimer::add_bytes(std::uint64_t bytes) {
+    bytes_ += bytes;
+}
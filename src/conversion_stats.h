@@ -0,0 +1,105 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+enum class ConversionStage {
+    load,       // opening and parsing the input document or archive
+    read,       // reading archive entries
+    render,     // rasterising PDF pages
+    analyze,    // finding blank pages and content bounds of rendered pages
+    encode,     // compressing page images (JPEG/PNG, PNG to PDF image data)
+    write,      // writing page images to disk
+    zip,        // adding entries to and finalising CBZ archives
+    pdf_write,  // laying out and writing PDF files
+    count
+};
+
+const char* conversion_stage_name(ConversionStage stage);
+
+// Counters for one file conversion. Updated concurrently by page workers; all methods
+// are thread-safe.
+class ConversionStats {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct StageTotals {
+        double seconds = 0.0;
+        std::uint64_t bytes = 0;
+        std::uint64_t calls = 0;
+        // Repeated pages whose data this stage reused instead of processing it again.
+        std::uint64_t duplicates = 0;
+        std::uint64_t duplicate_bytes = 0;
+        double saved_seconds = 0.0;  // estimated
+    };
+
+    // Clears all counters, starts the wall clock and resets the process peak RSS where
+    // the platform allows it, so the peak measured by finish() belongs to this file.
+    void begin();
+    void finish();
+
+    // Whether begin() and finish() measure a peak RSS for this file (the default). The
+    // peak is process-wide, so it must be turned off while other files convert in the
+    // same process: their begin() would reset it. peak_rss_bytes() is 0 when off.
+    void set_measure_peak_rss(bool enabled);
+    // The process's peak RSS since start, or since the last reset by a begin().
+    static std::uint64_t process_peak_rss();
+
+    void add(ConversionStage stage, Clock::duration elapsed, std::uint64_t bytes = 0);
+    // Records repeated pages that a stage reused (e.g. copied an earlier page's encoded
+    // file instead of encoding it), with the bytes involved and the time that saved.
+    void add_duplicates(ConversionStage stage, int pages, std::uint64_t bytes, Clock::duration saved);
+    void add_pages(int pages);
+    void add_queue_wait(Clock::duration wait);
+    void set_io_bytes(std::uint64_t input_bytes, std::uint64_t output_bytes);
+
+    StageTotals stage(ConversionStage stage) const;
+    int pages() const;
+    double wall_seconds() const;
+    double queue_wait_seconds() const;
+    std::uint64_t input_bytes() const;
+    std::uint64_t output_bytes() const;
+    std::uint64_t peak_rss_bytes() const;
+
+private:
+    struct StageCounters {
+        std::atomic<std::int64_t> nanoseconds{0};
+        std::atomic<std::uint64_t> bytes{0};
+        std::atomic<std::uint64_t> calls{0};
+        std::atomic<std::uint64_t> duplicates{0};
+        std::atomic<std::uint64_t> duplicate_bytes{0};
+        std::atomic<std::int64_t> saved_nanoseconds{0};
+    };
+
+    std::array<StageCounters, static_cast<std::size_t>(ConversionStage::count)> stages_;
+    std::atomic<int> pages_{0};
+    std::atomic<std::int64_t> queue_wait_nanoseconds_{0};
+    std::atomic<std::uint64_t> input_bytes_{0};
+    std::atomic<std::uint64_t> output_bytes_{0};
+    Clock::time_point started_;
+    std::int64_t wall_nanoseconds_ = 0;
+    std::uint64_t peak_rss_bytes_ = 0;
+    bool measure_peak_rss_ = true;
+};
+
+// Adds the time between construction and destruction to a stage. A null stats pointer
+// makes it a no-op, so call sites need no checks.
+class StageTimer {
+public:
+    StageTimer(ConversionStats* stats, ConversionStage stage);
+    ~StageTimer();
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+    void add_bytes(std::uint64_t bytes);
+
+private:
+    ConversionStats* stats_;
+    ConversionStage stage_;
+    ConversionStats::Clock::time_point start_;
+    std::uint64_t bytes_ = 0;
+};
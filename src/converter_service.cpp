@@ -3,25 +3,100 @@
 #include "pdf_image_extractor.h"
 #include "cbz_creator.h"
 #include "cbz_to_pdf_converter.h"
+#include "conversion_stats.h"
+#include "log.h"
+#include "trace.h"
+#include "zip_writer.h"
 
 #include <algorithm>
 #include <cctype>
+#include <ctime>
 #include <exception>
-#include <iostream>
+#include <map>
+#include <mutex>
 
 namespace {
-void Emit(const ConverterService::Logger& logger, const std::string& message) {
+void Emit(const LogSink& sink, const std::string& message, LogLevel level = LogLevel::info) {
+    Log::write(level, message, sink);
+}
+
+void EmitSeparator(const LogSink& sink) {
+    Emit(sink, std::string(50, '='));
+}
+
+// Sends every message of one conversion, including those of the core classes, to the
+// caller's Logger when one is given.
+ConversionContext RouteLog(const ConversionContext& context, const ConverterService::Logger& logger) {
+    ConversionContext routed = context;
     if (logger) {
-        logger(message);
-    } else {
-        std::cout << message << std::endl;
+        routed.log = [logger](LogLevel, const std::string& message) { logger(message); };
     }
+    return routed;
 }
 
-void EmitSeparator(const ConverterService::Logger& logger) {
-    Emit(logger, std::string(50, '='));
+// Removes the images a cancelled conversion had already written, and their directory
+// if nothing else is left in it.
+void RemovePartialImages(const std::filesystem::path& output_dir,
+                         const std::vector<PDFImageExtractor::ImageInfo>& images) {
+    std::error_code ec;
+    for (const auto& image : images) {
+        std::filesystem::remove(output_dir / image.name, ec);
+    }
+    std::filesystem::remove(output_dir, ec);
 }
 
+std::uint64_t PathSize(const std::filesystem::path& path) {
+    std::error_code ec;
+    if (std::filesystem::is_regular_file(path, ec)) {
+        return std::filesystem::file_size(path, ec);
+    }
+
+    std::uint64_t total = 0;
+    if (std::filesystem::is_directory(path, ec)) {
+        for (const auto& entry : std::filesystem::recursive_directory_iterator(path, ec)) {
+            if (entry.is_regular_file(ec)) {
+                total += entry.file_size(ec);
+            }
+        }
+    }
+    return total;
+}
+
+// Brackets one file conversion in the caller's stats, however the conversion returns.
+class StatsScope {
+public:
+    StatsScope(ConversionStats* stats, std::filesystem::path input, std::filesystem::path output)
+        : stats_(stats), input_(std::move(input)), output_(std::move(output)) {
+        if (stats_) {
+            stats_->begin();
+        }
+    }
+
+    ~StatsScope() {
+        if (stats_) {
+            stats_->set_io_bytes(PathSize(input_), output_.empty() ? streamed_bytes_ : PathSize(output_));
+            stats_->finish();
+        }
+    }
+
+    StatsScope(const StatsScope&) = delete;
+    StatsScope& operator=(const StatsScope&) = delete;
+
+    // Wraps a stream the output goes to instead of output, to count its bytes.
+    OutputWriter count(const OutputWriter& writer) {
+        return [this, &writer](const void* data, std::size_t size) {
+            streamed_bytes_ += size;
+            return writer(data, size);
+        };
+    }
+
+private:
+    ConversionStats* stats_;
+    std::filesystem::path input_;
+    std::filesystem::path output_;
+    std::uint64_t streamed_bytes_ = 0;
+};
+
 std::string ToLower(std::string value) {
     std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c) {
         return static_cast<char>(std::tolower(c));
@@ -43,7 +118,7 @@ std::vector<std::filesystem::path> ConverterService::FindPdfFiles(const std::fil
             }
         }
     } catch (const std::exception& e) {
-        Emit({}, std::string("Error reading directory: ") + e.what());
+        Emit({}, std::string("Error reading directory: ") + e.what(), LogLevel::error);
     }
 
     std::sort(pdf_files.begin(), pdf_files.end());
@@ -63,7 +138,7 @@ std::vector<std::filesystem::path> ConverterService::FindCbzFiles(const std::fil
             }
         }
     } catch (const std::exception& e) {
-        Emit({}, std::string("Error reading directory: ") + e.what());
+        Emit({}, std::string("Error reading directory: ") + e.what(), LogLevel::error);
     }
 
     std::sort(cbz_files.begin(), cbz_files.end());
@@ -73,50 +148,86 @@ std::vector<std::filesystem::path> ConverterService::FindCbzFiles(const std::fil
 bool ConverterService::ConvertSinglePdf(const std::filesystem::path& pdf_path,
                                         const std::filesystem::path& base_output_dir,
                                         const PdfConversionOptions& options,
-                                        const Logger& logger) {
+                                        const Logger& logger,
+                                        const ConversionContext& caller_context) {
+    const ConversionContext context = RouteLog(caller_context, logger);
+    const LogSink& log = context.log;
     const std::string pdf_name = pdf_path.stem().string();
     const std::filesystem::path output_dir = base_output_dir / pdf_name;
+    const std::filesystem::path cbz_path = base_output_dir / (pdf_name + ".cbz");
+    StatsScope stats_scope(context.stats, pdf_path, options.create_cbz ? cbz_path : output_dir);
+    TraceSpan span("convert_pdf", pdf_path.string());
 
-    Emit(logger, "");
-    EmitSeparator(logger);
-    Emit(logger, "Processing: " + pdf_path.string());
-    Emit(logger, "Output directory: " + output_dir.string());
+    Emit(log, "");
+    EmitSeparator(log);
+    Emit(log, "Processing: " + pdf_path.string());
+    Emit(log, "Output directory: " + output_dir.string());
+
+    // With create_cbz, rendering and archiving each count one progress step per page.
+    ConversionContext extract_context = context;
+    if (context.progress) {
+        extract_context.progress = [&context, &options](int done, int total) {
+            context.report_progress(done, options.create_cbz ? 2 * total : total);
+        };
+    }
 
-    PDFImageExtractor extractor(pdf_path.string(), options.format, options.quality, options.dpi);
+    PDFImageExtractor extractor(pdf_path.string(), options.format, options.quality, options.dpi, extract_context,
+                                options.page_analysis, options.resolution);
     if (!extractor.is_valid()) {
-        Emit(logger, "Error: Could not load PDF file: " + pdf_path.string());
+        Emit(log, "Error: Could not load PDF file: " + pdf_path.string(), LogLevel::error);
         return false;
     }
 
-    Emit(logger, "PDF loaded successfully! Total pages: " + std::to_string(extractor.get_page_count()));
+    Emit(log, "PDF loaded successfully! Total pages: " + std::to_string(extractor.get_page_count()));
 
     auto extracted_images = extractor.extract_all_images(output_dir.string());
+    if (context.cancelled()) {
+        RemovePartialImages(output_dir, extracted_images);
+        Emit(log, "Cancelled: " + pdf_path.string(), LogLevel::warning);
+        return false;
+    }
     if (extracted_images.empty()) {
-        Emit(logger, "No images found in the PDF.");
+        Emit(log, "No images found in the PDF.", LogLevel::error);
         return false;
     }
 
-    Emit(logger, "Extracted " + std::to_string(extracted_images.size()) + " images");
+    Emit(log, "Extracted " + std::to_string(extracted_images.size()) + " images");
 
     if (options.create_cbz) {
-        const std::string cbz_filename = pdf_name + ".cbz";
-        const std::filesystem::path cbz_path = base_output_dir / cbz_filename;
+        const int page_count = extractor.get_page_count();
+        ConversionContext zip_context = context;
+        if (context.progress) {
+            zip_context.progress = [&context, page_count](int done, int total) {
+                context.report_progress(page_count + done * page_count / total, 2 * page_count);
+            };
+        }
+
+        RepeatedPageNames repeated_pages;
+        for (const auto& image : extracted_images) {
+            if (!image.repeats.empty()) {
+                repeated_pages.insert(image.name);
+            }
+        }
 
-        Emit(logger, "Creating CBZ archive...");
-        if (CBZCreator::create_cbz_from_directory(output_dir.string(), cbz_path.string())) {
-            Emit(logger, "CBZ file created: " + cbz_path.string());
+        Emit(log, "Creating CBZ archive...");
+        if (CBZCreator::create_cbz_from_directory(output_dir.string(), cbz_path.string(), zip_context, repeated_pages)) {
+            Emit(log, "CBZ file created: " + cbz_path.string());
 
             if (options.clean_images) {
-                Emit(logger, "Cleaning up individual image files...");
+                Emit(log, "Cleaning up individual image files...");
                 try {
                     std::filesystem::remove_all(output_dir);
-                    Emit(logger, "Cleanup complete!");
+                    Emit(log, "Cleanup complete!");
                 } catch (const std::exception& e) {
-                    Emit(logger, std::string("Warning: Failed to clean up: ") + e.what());
+                    Emit(log, std::string("Warning: Failed to clean up: ") + e.what(), LogLevel::warning);
                 }
             }
+        } else if (context.cancelled()) {
+            RemovePartialImages(output_dir, extracted_images);
+            Emit(log, "Cancelled: " + pdf_path.string(), LogLevel::warning);
+            return false;
         } else {
-            Emit(logger, "Failed to create CBZ archive for: " + pdf_path.string());
+            Emit(log, "Failed to create CBZ archive for: " + pdf_path.string(), LogLevel::error);
             return false;
         }
     }
@@ -126,26 +237,126 @@ bool ConverterService::ConvertSinglePdf(const std::filesystem::path& pdf_path,
 
 bool ConverterService::ConvertSingleCbz(const std::filesystem::path& cbz_path,
                                         const std::filesystem::path& base_output_dir,
-                                        const Logger& logger) {
+                                        const CbzConversionOptions& options,
+                                        const Logger& logger,
+                                        const ConversionContext& caller_context) {
+    const ConversionContext context = RouteLog(caller_context, logger);
+    const LogSink& log = context.log;
     const std::string cbz_name = cbz_path.stem().string();
     std::error_code ec;
     std::filesystem::create_directories(base_output_dir, ec);
     if (ec) {
-        Emit(logger, std::string("Error creating output directory: ") + ec.message());
+        Emit(log, std::string("Error creating output directory: ") + ec.message(), LogLevel::error);
         return false;
     }
 
     const std::filesystem::path output_pdf = base_output_dir / (cbz_name + ".pdf");
+    StatsScope stats_scope(context.stats, cbz_path, output_pdf);
+    TraceSpan span("convert_cbz", cbz_path.string());
+
+    Emit(log, "");
+    EmitSeparator(log);
+    Emit(log, "Processing CBZ: " + cbz_path.string());
+    Emit(log, "Output PDF: " + output_pdf.string());
 
-    Emit(logger, "");
-    EmitSeparator(logger);
-    Emit(logger, "Processing CBZ: " + cbz_path.string());
-    Emit(logger, "Output PDF: " + output_pdf.string());
+    PDFWriteOptions pdf_options;
+    pdf_options.layout = options.pdf_layout;
 
-    if (!CBZToPDFConverter::convert_cbz_to_pdf(cbz_path.string(), output_pdf.string())) {
-        Emit(logger, "Failed to convert CBZ to PDF: " + cbz_path.string());
+    if (!CBZToPDFConverter::convert_cbz_to_pdf(cbz_path.string(), output_pdf.string(), pdf_options,
+                                               options.downscale, context)) {
+        if (context.cancelled()) {
+            Emit(log, "Cancelled: " + cbz_path.string(), LogLevel::warning);
+            return false;
+        }
+        Emit(log, "Failed to convert CBZ to PDF: " + cbz_path.string(), LogLevel::error);
+        return false;
+    }
+
+    return true;
+}
+
+bool ConverterService::StreamPdfToCbz(const std::filesystem::path& pdf_path,
+                                      const OutputWriter& output,
+                                      const PdfConversionOptions& options,
+                                      const Logger& logger,
+                                      const ConversionContext& caller_context) {
+    const ConversionContext context = RouteLog(caller_context, logger);
+    const LogSink& log = context.log;
+    StatsScope stats_scope(context.stats, pdf_path, {});
+    TraceSpan span("convert_pdf", pdf_path.string());
+
+    Emit(log, "Processing: " + pdf_path.string());
+    Emit(log, "Streaming CBZ to standard output");
+
+    PDFImageExtractor extractor(pdf_path.string(), options.format, options.quality, options.dpi, context,
+                                options.page_analysis, options.resolution);
+    if (!extractor.is_valid()) {
+        Emit(log, "Error: Could not load PDF file: " + pdf_path.string(), LogLevel::error);
+        return false;
+    }
+
+    Emit(log, "PDF loaded successfully! Total pages: " + std::to_string(extractor.get_page_count()));
+
+    // Pages are added as their workers finish them, so the entries follow completion
+    // order; the central directory lists them in page order.
+    ZipWriter zip;
+    if (!zip.open(stats_scope.count(output))) {
+        Emit(log, "Failed to start CBZ archive: " + zip.error(), LogLevel::error);
+        return false;
+    }
+    std::mutex zip_mutex;
+    std::map<std::string, int> page_of;
+    const std::time_t now = std::time(nullptr);
+    const auto extracted_images = extractor.extract_all_images(
+        [&](int page, const std::string& name, const std::uint8_t* data, std::size_t size) {
+            std::lock_guard<std::mutex> lock(zip_mutex);
+            page_of[name] = page;
+            return zip.add_stored(name, data, size, now) && zip.flush();
+        });
+    if (context.cancelled()) {
+        Emit(log, "Cancelled: " + pdf_path.string(), LogLevel::warning);
+        return false;
+    }
+    if (extracted_images.empty()) {
+        Emit(log, "No images found in the PDF.", LogLevel::error);
+        return false;
+    }
+    zip.sort_directory([&page_of](const std::string& a, const std::string& b) { return page_of[a] < page_of[b]; });
+    if (!zip.commit()) {
+        Emit(log, "Failed to stream CBZ archive for " + pdf_path.string() + ": " + zip.error(), LogLevel::error);
+        return false;
+    }
+
+    Emit(log, "Streamed " + std::to_string(extracted_images.size()) + " pages as CBZ");
+    return true;
+}
+
+bool ConverterService::StreamCbzToPdf(const std::filesystem::path& cbz_path,
+                                      const OutputWriter& output,
+                                      const CbzConversionOptions& options,
+                                      const Logger& logger,
+                                      const ConversionContext& caller_context) {
+    const ConversionContext context = RouteLog(caller_context, logger);
+    const LogSink& log = context.log;
+    StatsScope stats_scope(context.stats, cbz_path, {});
+    TraceSpan span("convert_cbz", cbz_path.string());
+
+    Emit(log, "Processing CBZ: " + cbz_path.string());
+    Emit(log, "Streaming PDF to standard output");
+
+    PDFWriteOptions pdf_options;
+    pdf_options.layout = options.pdf_layout;
+
+    if (!CBZToPDFConverter::convert_cbz_to_pdf(cbz_path.string(), stats_scope.count(output), pdf_options,
+                                               options.downscale, context)) {
+        if (context.cancelled()) {
+            Emit(log, "Cancelled: " + cbz_path.string(), LogLevel::warning);
+            return false;
+        }
+        Emit(log, "Failed to convert CBZ to PDF: " + cbz_path.string(), LogLevel::error);
         return false;
     }
 
+    Emit(log, "Streamed PDF for " + cbz_path.string());
     return true;
 }
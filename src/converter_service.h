@@ -5,12 +5,25 @@
 #include <string>
 #include <vector>
 
+#include "cbz_to_pdf_converter.h"
+#include "conversion_context.h"
+#include "page_analysis.h"
+#include "pdf_creator.h"
+#include "pdf_image_extractor.h"
+
 struct PdfConversionOptions {
     bool create_cbz = false;
     bool clean_images = false;
     std::string format = "jpeg";
     int quality = 80;
     double dpi = 150.0;
+    PageResolution resolution;  // per-page DPI from a pixel target; overrides dpi when set
+    PageAnalysisOptions page_analysis;
+};
+
+struct CbzConversionOptions {
+    PDFLayout pdf_layout = PDFLayout::classic;
+    PageDownscale downscale;  // device profile; off unless a maximum size is set
 };
 
 class ConverterService {
@@ -23,9 +36,28 @@ public:
     static bool ConvertSinglePdf(const std::filesystem::path& pdf_path,
                                  const std::filesystem::path& base_output_dir,
                                  const PdfConversionOptions& options,
-                                 const Logger& logger = {});
+                                 const Logger& logger = {},
+                                 const ConversionContext& context = {});
 
     static bool ConvertSingleCbz(const std::filesystem::path& cbz_path,
                                  const std::filesystem::path& base_output_dir,
-                                 const Logger& logger = {});
+                                 const CbzConversionOptions& options = {},
+                                 const Logger& logger = {},
+                                 const ConversionContext& context = {});
+
+    // Write the converted file to output (e.g. standard output, which may be a pipe)
+    // instead of the filesystem. PDF pages go out as soon as each one is encoded, as
+    // entries of a CBZ whose central directory follows the last page; no image files
+    // are written. Bytes already handed to output stay there if the conversion fails.
+    static bool StreamPdfToCbz(const std::filesystem::path& pdf_path,
+                               const OutputWriter& output,
+                               const PdfConversionOptions& options,
+                               const Logger& logger = {},
+                               const ConversionContext& context = {});
+
+    static bool StreamCbzToPdf(const std::filesystem::path& cbz_path,
+                               const OutputWriter& output,
+                               const CbzConversionOptions& options = {},
+                               const Logger& logger = {},
+                               const ConversionContext& context = {});
 };
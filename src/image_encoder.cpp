@@ -0,0 +1,605 @@
+#include "image_encoder.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <csetjmp>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+
+// jpeglib.h relies on size_t and FILE being declared before it is included.
+#include <jpeglib.h>
+#include <png.h>
+
+namespace {
+struct JpegErrorManager {
+    jpeg_error_mgr base;
+    std::jmp_buf jump;
+    int warnings = 0;
+};
+
+void on_jpeg_error(j_common_ptr info) {
+    auto* manager = reinterpret_cast<JpegErrorManager*>(info->err);
+    std::longjmp(manager->jump, 1);
+}
+
+// Counts corrupt-data warnings (level -1) instead of printing them.
+void on_jpeg_message(j_common_ptr info, int level) {
+    if (level < 0) {
+        ++reinterpret_cast<JpegErrorManager*>(info->err)->warnings;
+    }
+}
+
+// An application segment copied from one JPEG to another: marker code and payload.
+struct JpegMarker {
+    int marker = 0;
+    std::vector<std::uint8_t> data;
+};
+
+struct JpegLayout {
+    J_COLOR_SPACE color_space = JCS_RGB;
+    int components = 3;
+    // False when rows have to be converted to packed RGB before compression.
+    bool native = true;
+};
+
+JpegLayout jpeg_input_layout(PixelFormat format) {
+    JpegLayout layout;
+    switch (format) {
+    case PixelFormat::gray8:
+        layout.color_space = JCS_GRAYSCALE;
+        layout.components = 1;
+        return layout;
+    case PixelFormat::rgb24:
+        return layout;
+#ifdef JCS_EXTENSIONS
+    case PixelFormat::bgr24:
+        layout.color_space = JCS_EXT_BGR;
+        return layout;
+    case PixelFormat::argb32:
+        // 0xAARRGGBB words are laid out B, G, R, A on little-endian machines.
+        if constexpr (std::endian::native == std::endian::little) {
+            layout.color_space = JCS_EXT_BGRX;
+            layout.components = 4;
+            return layout;
+        }
+        break;
+#endif
+    default:
+        break;
+    }
+    layout.native = false;
+    return layout;
+}
+
+// Converts one row to packed RGB for libjpeg builds without colorspace extensions.
+void convert_row_to_rgb(const PixelBuffer& pixels, const std::uint8_t* row, std::uint8_t* rgb) {
+    for (int x = 0; x < pixels.width; ++x) {
+        if (pixels.format == PixelFormat::bgr24) {
+            rgb[x * 3 + 0] = row[x * 3 + 2];
+            rgb[x * 3 + 1] = row[x * 3 + 1];
+            rgb[x * 3 + 2] = row[x * 3 + 0];
+        } else {
+            std::uint32_t value;
+            std::memcpy(&value, row + x * 4, sizeof(value));
+            rgb[x * 3 + 0] = static_cast<std::uint8_t>(value >> 16);
+            rgb[x * 3 + 1] = static_cast<std::uint8_t>(value >> 8);
+            rgb[x * 3 + 2] = static_cast<std::uint8_t>(value);
+        }
+    }
+}
+
+// Compresses straight into the caller's vector, growing it as needed, so a reused output
+// buffer keeps its capacity from page to page instead of going through jpeg_mem_dest's
+// malloc and a final copy.
+struct VectorDestination {
+    jpeg_destination_mgr base;
+    std::vector<std::uint8_t>* output;
+};
+
+constexpr std::size_t kInitialJpegOutputSize = 64 * 1024;
+
+void init_vector_destination(j_compress_ptr info) {
+    auto* destination = reinterpret_cast<VectorDestination*>(info->dest);
+    std::vector<std::uint8_t>& output = *destination->output;
+    output.resize(std::max(output.capacity(), kInitialJpegOutputSize));
+    destination->base.next_output_byte = output.data();
+    destination->base.free_in_buffer = output.size();
+}
+
+boolean grow_vector_destination(j_compress_ptr info) {
+    auto* destination = reinterpret_cast<VectorDestination*>(info->dest);
+    std::vector<std::uint8_t>& output = *destination->output;
+    // libjpeg calls this only when the buffer is completely full.
+    const std::size_t used = output.size();
+    output.resize(used * 2);
+    destination->base.next_output_byte = output.data() + used;
+    destination->base.free_in_buffer = output.size() - used;
+    return TRUE;
+}
+
+void term_vector_destination(j_compress_ptr info) {
+    auto* destination = reinterpret_cast<VectorDestination*>(info->dest);
+    destination->output->resize(destination->output->size() - destination->base.free_in_buffer);
+}
+
+void append_png_data(png_structp png, png_bytep data, png_size_t length) {
+    auto* output = static_cast<std::vector<std::uint8_t>*>(png_get_io_ptr(png));
+    output->insert(output->end(), data, data + length);
+}
+
+void flush_png_data(png_structp) {}
+
+// Kept apart from encode_jpeg so that no local variable is live across setjmp. markers
+// are written after the JFIF header.
+bool compress_jpeg(const PixelBuffer& pixels, const JpegLayout& layout, int quality, double dpi,
+                   const std::vector<JpegMarker>& markers, std::vector<std::uint8_t>& row_buffer,
+                   std::vector<std::uint8_t>& output) {
+    jpeg_compress_struct info;
+    JpegErrorManager error_manager;
+    VectorDestination destination;
+    info.err = jpeg_std_error(&error_manager.base);
+    error_manager.base.error_exit = on_jpeg_error;
+
+    if (setjmp(error_manager.jump)) {
+        jpeg_destroy_compress(&info);
+        return false;
+    }
+
+    jpeg_create_compress(&info);
+    destination.base.init_destination = init_vector_destination;
+    destination.base.empty_output_buffer = grow_vector_destination;
+    destination.base.term_destination = term_vector_destination;
+    destination.output = &output;
+    info.dest = &destination.base;
+
+    info.image_width = static_cast<JDIMENSION>(pixels.width);
+    info.image_height = static_cast<JDIMENSION>(pixels.height);
+    info.input_components = layout.components;
+    info.in_color_space = layout.color_space;
+    jpeg_set_defaults(&info);
+    jpeg_set_quality(&info, quality, TRUE);
+    if (dpi > 0) {
+        info.density_unit = 1;
+        info.X_density = static_cast<UINT16>(dpi + 0.5);
+        info.Y_density = static_cast<UINT16>(dpi + 0.5);
+    }
+
+    jpeg_start_compress(&info, TRUE);
+    for (const JpegMarker& marker : markers) {
+        jpeg_write_marker(&info, marker.marker, marker.data.data(), static_cast<unsigned int>(marker.data.size()));
+    }
+    while (info.next_scanline < info.image_height) {
+        const std::uint8_t* row = pixels.data + static_cast<std::size_t>(info.next_scanline) * pixels.stride;
+        JSAMPROW row_pointer = const_cast<JSAMPROW>(row);
+        if (!layout.native) {
+            convert_row_to_rgb(pixels, row, row_buffer.data());
+            row_pointer = row_buffer.data();
+        }
+        jpeg_write_scanlines(&info, &row_pointer, 1);
+    }
+    jpeg_finish_compress(&info);
+    jpeg_destroy_compress(&info);
+    return true;
+}
+
+// Kept apart from optimize_jpeg for the same reason as compress_jpeg. Both structs are
+// zero-initialised so that jpeg_destroy_* is safe whichever step fails.
+bool transcode_jpeg(const std::uint8_t* data, std::size_t size, bool progressive, std::vector<std::uint8_t>& output) {
+    jpeg_decompress_struct input{};
+    jpeg_compress_struct info{};
+    JpegErrorManager error_manager;
+    VectorDestination destination;
+    input.err = jpeg_std_error(&error_manager.base);
+    info.err = &error_manager.base;
+    error_manager.base.error_exit = on_jpeg_error;
+    error_manager.base.emit_message = on_jpeg_message;
+
+    if (setjmp(error_manager.jump)) {
+        jpeg_destroy_compress(&info);
+        jpeg_destroy_decompress(&input);
+        return false;
+    }
+
+    jpeg_create_decompress(&input);
+    jpeg_create_compress(&info);
+    jpeg_mem_src(&input, const_cast<unsigned char*>(data), static_cast<unsigned long>(size));
+    // EXIF (orientation) and ICC profiles change how the page is shown, so they are
+    // kept; comments and other application segments are dropped.
+    jpeg_save_markers(&input, JPEG_APP0 + 1, 0xFFFF);
+    jpeg_save_markers(&input, JPEG_APP0 + 2, 0xFFFF);
+    jpeg_read_header(&input, TRUE);
+    jvirt_barray_ptr* coefficients = jpeg_read_coefficients(&input);
+
+    destination.base.init_destination = init_vector_destination;
+    destination.base.empty_output_buffer = grow_vector_destination;
+    destination.base.term_destination = term_vector_destination;
+    destination.output = &output;
+    info.dest = &destination.base;
+
+    jpeg_copy_critical_parameters(&input, &info);
+    if (input.saw_JFIF_marker) {
+        info.density_unit = input.density_unit;
+        info.X_density = input.X_density;
+        info.Y_density = input.Y_density;
+    }
+    info.optimize_coding = TRUE;
+    if (progressive) {
+        jpeg_simple_progression(&info);
+    }
+    jpeg_write_coefficients(&info, coefficients);
+    for (jpeg_saved_marker_ptr marker = input.marker_list; marker; marker = marker->next) {
+        jpeg_write_marker(&info, marker->marker, marker->data, marker->data_length);
+    }
+    jpeg_finish_compress(&info);
+    jpeg_finish_decompress(&input);
+    jpeg_destroy_compress(&info);
+    jpeg_destroy_decompress(&input);
+    // A damaged input may decode differently elsewhere; leave it untouched.
+    return error_manager.warnings == 0;
+}
+
+// Image size from the JPEG header. Kept apart from downscale_jpeg for the same reason
+// as compress_jpeg.
+bool read_jpeg_size(const std::uint8_t* data, std::size_t size, int& width, int& height) {
+    jpeg_decompress_struct info{};
+    JpegErrorManager error_manager;
+    info.err = jpeg_std_error(&error_manager.base);
+    error_manager.base.error_exit = on_jpeg_error;
+
+    if (setjmp(error_manager.jump)) {
+        jpeg_destroy_decompress(&info);
+        return false;
+    }
+
+    jpeg_create_decompress(&info);
+    jpeg_mem_src(&info, const_cast<unsigned char*>(data), static_cast<unsigned long>(size));
+    jpeg_read_header(&info, TRUE);
+    width = static_cast<int>(info.image_width);
+    height = static_cast<int>(info.image_height);
+    jpeg_destroy_decompress(&info);
+    return width > 0 && height > 0;
+}
+
+std::uint32_t read_tiff_value(const std::uint8_t* data, int bytes, bool little_endian) {
+    std::uint32_t value = 0;
+    for (int i = 0; i < bytes; ++i) {
+        const int shift = little_endian ? 8 * i : 8 * (bytes - 1 - i);
+        value |= static_cast<std::uint32_t>(data[i]) << shift;
+    }
+    return value;
+}
+
+void write_tiff_value(std::uint8_t* data, int bytes, bool little_endian, std::uint32_t value) {
+    for (int i = 0; i < bytes; ++i) {
+        const int shift = little_endian ? 8 * i : 8 * (bytes - 1 - i);
+        data[i] = static_cast<std::uint8_t>(value >> shift);
+    }
+}
+
+// Sets the pixel dimensions recorded in an APP1 Exif payload (IFD0 ImageWidth and
+// ImageLength, Exif PixelXDimension and PixelYDimension) to width x height. The pixels
+// are resampled without rotating them, so Orientation still applies and is kept.
+// Payloads that are not Exif, or whose structure does not hold together, are left alone.
+void set_exif_dimensions(std::vector<std::uint8_t>& payload, int width, int height) {
+    static constexpr std::uint8_t kExifHeader[] = {'E', 'x', 'i', 'f', 0, 0};
+    constexpr std::size_t kTiffStart = sizeof(kExifHeader);
+    if (payload.size() < kTiffStart + 8 || !std::equal(std::begin(kExifHeader), std::end(kExifHeader), payload.begin())) {
+        return;
+    }
+    std::uint8_t* tiff = payload.data() + kTiffStart;
+    const std::size_t tiff_size = payload.size() - kTiffStart;
+    const bool little_endian = tiff[0] == 'I' && tiff[1] == 'I';
+    if ((!little_endian && !(tiff[0] == 'M' && tiff[1] == 'M')) || read_tiff_value(tiff + 2, 2, little_endian) != 42) {
+        return;
+    }
+
+    constexpr std::uint32_t kTypeShort = 3;
+    constexpr std::uint32_t kTypeLong = 4;
+    // Updates the directory at offset and returns the Exif sub-directory it points to, if any.
+    auto update_directory = [&](std::uint32_t offset, std::uint32_t width_tag, std::uint32_t height_tag) {
+        std::uint32_t exif_directory = 0;
+        if (offset > tiff_size - 2) {
+            return exif_directory;
+        }
+        const std::uint32_t entries = read_tiff_value(tiff + offset, 2, little_endian);
+        for (std::uint32_t e = 0; e < entries; ++e) {
+            const std::size_t entry = offset + 2 + static_cast<std::size_t>(e) * 12;
+            if (entry + 12 > tiff_size) {
+                break;
+            }
+            const std::uint32_t tag = read_tiff_value(tiff + entry, 2, little_endian);
+            const std::uint32_t type = read_tiff_value(tiff + entry + 2, 2, little_endian);
+            const std::uint32_t count = read_tiff_value(tiff + entry + 4, 4, little_endian);
+            if (tag == 0x8769 && type == kTypeLong && count == 1) {
+                exif_directory = read_tiff_value(tiff + entry + 8, 4, little_endian);
+            } else if ((tag == width_tag || tag == height_tag) && count == 1 && (type == kTypeShort || type == kTypeLong)) {
+                // A single value sits in the entry itself, at its start.
+                write_tiff_value(tiff + entry + 8, type == kTypeShort ? 2 : 4, little_endian,
+                                 static_cast<std::uint32_t>(tag == width_tag ? width : height));
+            }
+        }
+        return exif_directory;
+    };
+    const std::uint32_t exif_directory = update_directory(read_tiff_value(tiff + 4, 4, little_endian), 0x0100, 0x0101);
+    if (exif_directory != 0) {
+        update_directory(exif_directory, 0xA002, 0xA003);
+    }
+}
+
+// Decodes a JPEG with the largest IDCT scaling (1/8, 1/4 or 1/2) that still leaves at
+// least min_width x min_height pixels, into packed gray or RGB rows. The EXIF (APP1)
+// and ICC profile (APP2) segments are copied to markers. Kept apart for the same reason.
+bool decompress_jpeg_scaled(const std::uint8_t* data, std::size_t size, int min_width, int min_height,
+                            std::vector<std::uint8_t>& pixels, int& width, int& height, int& components,
+                            std::vector<JpegMarker>& markers) {
+    jpeg_decompress_struct info{};
+    JpegErrorManager error_manager;
+    info.err = jpeg_std_error(&error_manager.base);
+    error_manager.base.error_exit = on_jpeg_error;
+    error_manager.base.emit_message = on_jpeg_message;
+
+    if (setjmp(error_manager.jump)) {
+        jpeg_destroy_decompress(&info);
+        return false;
+    }
+
+    jpeg_create_decompress(&info);
+    jpeg_mem_src(&info, const_cast<unsigned char*>(data), static_cast<unsigned long>(size));
+    jpeg_save_markers(&info, JPEG_APP0 + 1, 0xFFFF);
+    jpeg_save_markers(&info, JPEG_APP0 + 2, 0xFFFF);
+    jpeg_read_header(&info, TRUE);
+    if (info.num_components != 1 && info.num_components != 3) {
+        jpeg_destroy_decompress(&info);
+        return false;
+    }
+    for (jpeg_saved_marker_ptr marker = info.marker_list; marker; marker = marker->next) {
+        markers.push_back({marker->marker, std::vector<std::uint8_t>(marker->data, marker->data + marker->data_length)});
+    }
+    info.out_color_space = info.num_components == 1 ? JCS_GRAYSCALE : JCS_RGB;
+
+    // libjpeg rounds scaled dimensions up.
+    unsigned int denominator = 8;
+    while (denominator > 1 &&
+           ((info.image_width + denominator - 1) / denominator < static_cast<unsigned int>(min_width) ||
+            (info.image_height + denominator - 1) / denominator < static_cast<unsigned int>(min_height))) {
+        denominator /= 2;
+    }
+    info.scale_num = 1;
+    info.scale_denom = denominator;
+
+    jpeg_start_decompress(&info);
+    width = static_cast<int>(info.output_width);
+    height = static_cast<int>(info.output_height);
+    components = info.output_components;
+    const std::size_t stride = static_cast<std::size_t>(width) * static_cast<std::size_t>(components);
+    pixels.resize(stride * static_cast<std::size_t>(height));
+    while (info.output_scanline < info.output_height) {
+        JSAMPROW row = pixels.data() + static_cast<std::size_t>(info.output_scanline) * stride;
+        jpeg_read_scanlines(&info, &row, 1);
+    }
+    jpeg_finish_decompress(&info);
+    jpeg_destroy_decompress(&info);
+    return error_manager.warnings == 0;
+}
+
+// Source pixels covered by each destination pixel along one axis when shrinking
+// source_size to target_size, as a first index and fractional coverage weights that
+// sum to one.
+struct AreaWeights {
+    std::vector<int> first;
+    std::vector<int> count;
+    std::vector<float> weights;  // count[i] entries per destination pixel, in order
+};
+
+AreaWeights area_weights(int source_size, int target_size) {
+    AreaWeights result;
+    const double scale = static_cast<double>(source_size) / target_size;
+    for (int i = 0; i < target_size; ++i) {
+        const double start = i * scale;
+        const double end = std::min<double>(source_size, (i + 1) * scale);
+        const int first = static_cast<int>(start);
+        const int last = std::min(source_size, static_cast<int>(std::ceil(end)));
+        result.first.push_back(first);
+        result.count.push_back(last - first);
+        for (int j = first; j < last; ++j) {
+            const double covered = std::min<double>(end, j + 1) - std::max<double>(start, j);
+            result.weights.push_back(static_cast<float>(covered / scale));
+        }
+    }
+    return result;
+}
+
+// Area-averaging shrink of packed 8-bit rows, one destination row at a time: the
+// source rows under it are blended into a single row, which is then narrowed.
+void shrink_pixels(const std::vector<std::uint8_t>& source, int width, int height, int components,
+                   int target_width, int target_height, std::vector<std::uint8_t>& target) {
+    const AreaWeights columns = area_weights(width, target_width);
+    const AreaWeights rows = area_weights(height, target_height);
+    const std::size_t source_stride = static_cast<std::size_t>(width) * static_cast<std::size_t>(components);
+    const std::size_t target_stride = static_cast<std::size_t>(target_width) * static_cast<std::size_t>(components);
+    target.resize(target_stride * static_cast<std::size_t>(target_height));
+    std::vector<float> blended(source_stride);
+
+    std::size_t row_weight = 0;
+    for (int y = 0; y < target_height; ++y) {
+        std::fill(blended.begin(), blended.end(), 0.0f);
+        for (int k = 0; k < rows.count[y]; ++k) {
+            const float weight = rows.weights[row_weight++];
+            const std::uint8_t* row = source.data() + static_cast<std::size_t>(rows.first[y] + k) * source_stride;
+            for (std::size_t i = 0; i < source_stride; ++i) {
+                blended[i] += weight * row[i];
+            }
+        }
+
+        std::uint8_t* out = target.data() + static_cast<std::size_t>(y) * target_stride;
+        std::size_t column_weight = 0;
+        for (int x = 0; x < target_width; ++x) {
+            for (int c = 0; c < components; ++c) {
+                float sum = 0.0f;
+                for (int k = 0; k < columns.count[x]; ++k) {
+                    sum += columns.weights[column_weight + k] *
+                           blended[static_cast<std::size_t>(columns.first[x] + k) * components + c];
+                }
+                out[static_cast<std::size_t>(x) * components + c] =
+                    static_cast<std::uint8_t>(std::clamp(sum + 0.5f, 0.0f, 255.0f));
+            }
+            column_weight += columns.count[x];
+        }
+    }
+}
+}
+
+bool ImageEncoder::optimize_jpeg(const std::uint8_t* data, std::size_t size, bool progressive,
+                                 std::vector<std::uint8_t>& output) {
+    if (!data || size == 0) {
+        return false;
+    }
+    const bool ok = transcode_jpeg(data, size, progressive, output);
+    if (!ok) {
+        output.clear();
+    }
+    return ok;
+}
+
+bool ImageEncoder::downscale_jpeg(const std::uint8_t* data, std::size_t size, int max_width, int max_height,
+                                  int quality, std::vector<std::uint8_t>& output, int& width, int& height) {
+    output.clear();
+    if (!data || size == 0 || (max_width <= 0 && max_height <= 0)) {
+        return false;
+    }
+
+    int full_width = 0;
+    int full_height = 0;
+    if (!read_jpeg_size(data, size, full_width, full_height)) {
+        return false;
+    }
+
+    double scale = 1.0;
+    if (max_width > 0) {
+        scale = std::min(scale, static_cast<double>(max_width) / full_width);
+    }
+    if (max_height > 0) {
+        scale = std::min(scale, static_cast<double>(max_height) / full_height);
+    }
+    if (scale >= 1.0) {
+        return false;
+    }
+    const int target_width = std::max(1, static_cast<int>(std::lround(full_width * scale)));
+    const int target_height = std::max(1, static_cast<int>(std::lround(full_height * scale)));
+
+    std::vector<std::uint8_t> decoded;
+    int decoded_width = 0;
+    int decoded_height = 0;
+    int components = 0;
+    std::vector<JpegMarker> markers;
+    if (!decompress_jpeg_scaled(data, size, target_width, target_height, decoded, decoded_width, decoded_height,
+                                components, markers)) {
+        return false;
+    }
+    for (JpegMarker& marker : markers) {
+        if (marker.marker == JPEG_APP0 + 1) {
+            set_exif_dimensions(marker.data, target_width, target_height);
+        }
+    }
+
+    std::vector<std::uint8_t> shrunk;
+    if (decoded_width != target_width || decoded_height != target_height) {
+        shrink_pixels(decoded, decoded_width, decoded_height, components, target_width, target_height, shrunk);
+    } else {
+        shrunk.swap(decoded);
+    }
+
+    PixelBuffer pixels;
+    pixels.data = shrunk.data();
+    pixels.width = target_width;
+    pixels.height = target_height;
+    pixels.stride = target_width * components;
+    pixels.format = components == 1 ? PixelFormat::gray8 : PixelFormat::rgb24;
+    // Gray and RGB rows are always native to libjpeg, so no row buffer is needed.
+    std::vector<std::uint8_t> row_buffer;
+    if (!compress_jpeg(pixels, jpeg_input_layout(pixels.format), quality, 0.0, markers, row_buffer, output)) {
+        output.clear();
+        return false;
+    }
+    width = target_width;
+    height = target_height;
+    return true;
+}
+
+bool ImageEncoder::encode_jpeg(const PixelBuffer& pixels, int quality, double dpi, std::vector<std::uint8_t>& output) {
+    if (!pixels.data || pixels.width <= 0 || pixels.height <= 0) {
+        return false;
+    }
+
+    const JpegLayout layout = jpeg_input_layout(pixels.format);
+    std::vector<std::uint8_t> row_buffer;
+    if (!layout.native) {
+        row_buffer.resize(static_cast<std::size_t>(pixels.width) * 3);
+    }
+
+    const bool ok = compress_jpeg(pixels, layout, quality, dpi, {}, row_buffer, output);
+    if (!ok) {
+        output.clear();
+    }
+    return ok;
+}
+
+bool ImageEncoder::encode_png(const PixelBuffer& pixels, double dpi, std::vector<std::uint8_t>& output) {
+    if (!pixels.data || pixels.width <= 0 || pixels.height <= 0) {
+        return false;
+    }
+
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    if (!png) {
+        return false;
+    }
+    png_infop info = png_create_info_struct(png);
+    if (!info) {
+        png_destroy_write_struct(&png, nullptr);
+        return false;
+    }
+
+    output.clear();
+    if (setjmp(png_jmpbuf(png))) {
+        png_destroy_write_struct(&png, &info);
+        return false;
+    }
+
+    png_set_write_fn(png, &output, append_png_data, flush_png_data);
+
+    int color_type = PNG_COLOR_TYPE_RGB;
+    if (pixels.format == PixelFormat::gray8) {
+        color_type = PNG_COLOR_TYPE_GRAY;
+    } else if (pixels.format == PixelFormat::argb32) {
+        color_type = PNG_COLOR_TYPE_RGB_ALPHA;
+    }
+
+    png_set_IHDR(png, info, static_cast<png_uint_32>(pixels.width), static_cast<png_uint_32>(pixels.height), 8,
+                 color_type, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    if (dpi > 0) {
+        const auto pixels_per_meter = static_cast<png_uint_32>(dpi / 0.0254 + 0.5);
+        png_set_pHYs(png, info, pixels_per_meter, pixels_per_meter, PNG_RESOLUTION_METER);
+    }
+    png_write_info(png, info);
+
+    if (pixels.format == PixelFormat::bgr24) {
+        png_set_bgr(png);
+    } else if (pixels.format == PixelFormat::argb32) {
+        // 0xAARRGGBB words are B, G, R, A in memory on little-endian machines.
+        if constexpr (std::endian::native == std::endian::little) {
+            png_set_bgr(png);
+        } else {
+            png_set_swap_alpha(png);
+        }
+    }
+
+    for (int y = 0; y < pixels.height; ++y) {
+        png_write_row(png, const_cast<png_bytep>(pixels.data + static_cast<std::size_t>(y) * pixels.stride));
+    }
+
+    png_write_end(png, info);
+    png_destroy_write_struct(&png, &info);
+    return true;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum class PixelFormat {
+    gray8,
+    rgb24,
+    bgr24,
+    argb32  // native-endian 0xAARRGGBB words, as rendered by Poppler
+};
+
+struct PixelBuffer {
+    const std::uint8_t* data = nullptr;
+    int width = 0;
+    int height = 0;
+    int stride = 0;
+    PixelFormat format = PixelFormat::argb32;
+};
+
+// In-memory JPEG/PNG encoding of rendered pages, so that encoded bytes can go through
+// OutputSink (or anywhere else) instead of a library-owned file handle. The output vector
+// is overwritten; its existing capacity is reused, so callers encoding many pages should
+// pass the same buffer each time.
+class ImageEncoder {
+public:
+    static bool encode_jpeg(const PixelBuffer& pixels, int quality, double dpi, std::vector<std::uint8_t>& output);
+    static bool encode_png(const PixelBuffer& pixels, double dpi, std::vector<std::uint8_t>& output);
+
+    // Rewrites a JPEG losslessly, like jpegtran -optimize [-progressive]: the DCT
+    // coefficients are copied unchanged and only the entropy coding is redone with
+    // optimal Huffman tables. EXIF and ICC segments are kept. Fails, leaving output
+    // empty, for anything libjpeg cannot read cleanly.
+    static bool optimize_jpeg(const std::uint8_t* data, std::size_t size, bool progressive,
+                              std::vector<std::uint8_t>& output);
+
+    // Shrinks a grayscale or color JPEG to fit within max_width x max_height (0: no
+    // limit on that side), keeping its aspect ratio, and re-encodes it at quality.
+    // Most of the reduction is done by the decoder's scaled IDCT (1/2, 1/4 or 1/8), so
+    // the full-size image is never decoded; an area-averaging resample of less than 2x
+    // does the rest. EXIF and ICC profile segments are carried over, with the EXIF
+    // pixel dimensions set to the new size. Sets width and height to the new size.
+    // Fails, leaving output empty, for images that already fit, CMYK images and damaged
+    // data.
+    static bool downscale_jpeg(const std::uint8_t* data, std::size_t size, int max_width, int max_height,
+                               int quality, std::vector<std::uint8_t>& output, int& width, int& height);
+};
@@ -0,0 +1,203 @@
+#include "image_header.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+
+namespace {
+constexpr std::uint8_t kPngSignature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+std::uint16_t read_u16_be(const std::uint8_t* data) {
+    return static_cast<std::uint16_t>(data[0] << 8 | data[1]);
+}
+
+std::uint32_t read_u32_be(const std::uint8_t* data) {
+    return static_cast<std::uint32_t>(data[0]) << 24 |
+           static_cast<std::uint32_t>(data[1]) << 16 |
+           static_cast<std::uint32_t>(data[2]) << 8 |
+           static_cast<std::uint32_t>(data[3]);
+}
+
+std::uint32_t read_u24_le(const std::uint8_t* data) {
+    return static_cast<std::uint32_t>(data[0]) |
+           static_cast<std::uint32_t>(data[1]) << 8 |
+           static_cast<std::uint32_t>(data[2]) << 16;
+}
+
+HeaderStatus parse_jpeg(const std::uint8_t* data, std::size_t size, ImageHeader& header) {
+    std::size_t index = 2;
+    while (index + 1 < size) {
+        if (data[index] != 0xFF) {
+            ++index;
+            continue;
+        }
+
+        // Any number of 0xFF fill bytes may precede a marker.
+        ++index;
+        while (index < size && data[index] == 0xFF) {
+            ++index;
+        }
+        if (index >= size) {
+            return HeaderStatus::need_more;
+        }
+        const std::uint8_t marker = data[index++];
+
+        // Standalone markers (TEM, RSTn, SOI, EOI) have no length field.
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD9)) {
+            continue;
+        }
+
+        if (marker == 0xDA) {
+            return HeaderStatus::invalid; // scan data before any frame header
+        }
+
+        if (index + 1 >= size) {
+            return HeaderStatus::need_more;
+        }
+
+        const std::uint16_t segment_length = read_u16_be(data + index);
+        if (segment_length < 2) {
+            return HeaderStatus::invalid;
+        }
+
+        const bool is_sof = (marker >= 0xC0 && marker <= 0xC3) ||
+                            (marker >= 0xC5 && marker <= 0xC7) ||
+                            (marker >= 0xC9 && marker <= 0xCB) ||
+                            (marker >= 0xCD && marker <= 0xCF);
+        if (is_sof) {
+            if (segment_length < 8) {
+                return HeaderStatus::invalid;
+            }
+            if (index + 8 > size) {
+                return HeaderStatus::need_more;
+            }
+            header.height = read_u16_be(data + index + 3);
+            header.width = read_u16_be(data + index + 5);
+            header.components = data[index + 7];
+            return header.width > 0 && header.height > 0 ? HeaderStatus::complete : HeaderStatus::invalid;
+        }
+
+        index += segment_length;
+    }
+
+    return HeaderStatus::need_more;
+}
+
+HeaderStatus parse_png(const std::uint8_t* data, std::size_t size, ImageHeader& header) {
+    // Signature, IHDR length and type, then width, height, bit depth and color type.
+    constexpr std::size_t kIhdrEnd = 8 + 8 + 10;
+    if (size < kIhdrEnd) {
+        return HeaderStatus::need_more;
+    }
+    if (std::memcmp(data + 12, "IHDR", 4) != 0) {
+        return HeaderStatus::invalid;
+    }
+
+    const std::uint32_t width = read_u32_be(data + 16);
+    const std::uint32_t height = read_u32_be(data + 20);
+    if (width == 0 || height == 0 || width > 0x7FFFFFFF || height > 0x7FFFFFFF) {
+        return HeaderStatus::invalid;
+    }
+
+    switch (data[25]) {
+    case 0: header.components = 1; break; // gray
+    case 2: header.components = 3; break; // RGB
+    case 3: header.components = 3; break; // palette, expanded to RGB
+    case 4: header.components = 2; break; // gray + alpha
+    case 6: header.components = 4; break; // RGBA
+    default: return HeaderStatus::invalid;
+    }
+
+    header.width = static_cast<int>(width);
+    header.height = static_cast<int>(height);
+    return HeaderStatus::complete;
+}
+
+HeaderStatus parse_webp(const std::uint8_t* data, std::size_t size, ImageHeader& header) {
+    // RIFF header (12 bytes), then the first chunk's FourCC and size.
+    constexpr std::size_t kChunkData = 20;
+    if (size < kChunkData + 10) {
+        return HeaderStatus::need_more;
+    }
+
+    const std::uint8_t* chunk = data + kChunkData;
+    if (std::memcmp(data + 12, "VP8 ", 4) == 0) {
+        // Lossy: 3-byte frame tag, start code, then 14-bit width and height.
+        if (chunk[3] != 0x9D || chunk[4] != 0x01 || chunk[5] != 0x2A) {
+            return HeaderStatus::invalid;
+        }
+        header.width = (chunk[6] | chunk[7] << 8) & 0x3FFF;
+        header.height = (chunk[8] | chunk[9] << 8) & 0x3FFF;
+        header.components = 3;
+    } else if (std::memcmp(data + 12, "VP8L", 4) == 0) {
+        // Lossless: signature byte, then 14-bit width-1, 14-bit height-1 and an alpha bit.
+        if (chunk[0] != 0x2F) {
+            return HeaderStatus::invalid;
+        }
+        const std::uint32_t bits = static_cast<std::uint32_t>(chunk[1]) |
+                                   static_cast<std::uint32_t>(chunk[2]) << 8 |
+                                   static_cast<std::uint32_t>(chunk[3]) << 16 |
+                                   static_cast<std::uint32_t>(chunk[4]) << 24;
+        header.width = static_cast<int>((bits & 0x3FFF) + 1);
+        header.height = static_cast<int>(((bits >> 14) & 0x3FFF) + 1);
+        header.components = (bits >> 28) & 1 ? 4 : 3;
+    } else if (std::memcmp(data + 12, "VP8X", 4) == 0) {
+        // Extended: flags byte, 3 reserved bytes, then 24-bit canvas width-1 and height-1.
+        header.width = static_cast<int>(read_u24_le(chunk + 4) + 1);
+        header.height = static_cast<int>(read_u24_le(chunk + 7) + 1);
+        header.components = chunk[0] & 0x10 ? 4 : 3;
+    } else {
+        return HeaderStatus::invalid;
+    }
+
+    return header.width > 0 && header.height > 0 ? HeaderStatus::complete : HeaderStatus::invalid;
+}
+}
+
+ImageFormat ImageHeaderParser::format_from_name(const std::string& file_name) {
+    std::string extension = std::filesystem::path(file_name).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) {
+        return static_cast<char>(std::tolower(c));
+    });
+    if (extension == ".jpg" || extension == ".jpeg") {
+        return ImageFormat::jpeg;
+    }
+    if (extension == ".png") {
+        return ImageFormat::png;
+    }
+    if (extension == ".webp") {
+        return ImageFormat::webp;
+    }
+    return ImageFormat::unknown;
+}
+
+const char* ImageHeaderParser::format_name(ImageFormat format) {
+    switch (format) {
+    case ImageFormat::jpeg: return "jpeg";
+    case ImageFormat::png: return "png";
+    case ImageFormat::webp: return "webp";
+    default: return "unknown";
+    }
+}
+
+HeaderStatus ImageHeaderParser::parse(const std::uint8_t* data, std::size_t size, ImageHeader& header) {
+    header = ImageHeader{};
+    if (size < 12) {
+        return HeaderStatus::need_more;
+    }
+
+    if (data[0] == 0xFF && data[1] == 0xD8) {
+        header.format = ImageFormat::jpeg;
+        return parse_jpeg(data, size, header);
+    }
+    if (std::memcmp(data, kPngSignature, sizeof(kPngSignature)) == 0) {
+        header.format = ImageFormat::png;
+        return parse_png(data, size, header);
+    }
+    if (std::memcmp(data, "RIFF", 4) == 0 && std::memcmp(data + 8, "WEBP", 4) == 0) {
+        header.format = ImageFormat::webp;
+        return parse_webp(data, size, header);
+    }
+    return HeaderStatus::invalid;
+}
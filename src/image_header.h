@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+enum class ImageFormat {
+    unknown,
+    jpeg,
+    png,
+    webp
+};
+
+enum class HeaderStatus {
+    complete,   // dimensions were found
+    need_more,  // the header continues past the bytes supplied so far
+    invalid     // not a recognised or well-formed image
+};
+
+struct ImageHeader {
+    ImageFormat format = ImageFormat::unknown;
+    int width = 0;
+    int height = 0;
+    int components = 0;
+};
+
+// Reads image dimensions from the leading bytes of a file without decoding it: the
+// SOF segment of a JPEG, the IHDR chunk of a PNG, or the VP8/VP8L/VP8X chunk of a WebP.
+class ImageHeaderParser {
+public:
+    // Guesses the format from a file name's extension (case-insensitive).
+    static ImageFormat format_from_name(const std::string& file_name);
+    static const char* format_name(ImageFormat format);
+
+    // Parses the start of an image whose format is detected from its signature. When
+    // need_more is returned, call again with a longer prefix of the same file.
+    static HeaderStatus parse(const std::uint8_t* data, std::size_t size, ImageHeader& header);
+};
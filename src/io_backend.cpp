@@ -0,0 +1,528 @@
+#include "io_backend.h"
+#include "concurrency.h"
+#include "log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifdef CONVERTER_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+struct IoRequest {
+    IoBatch* batch = nullptr;
+    int fd = -1;
+    std::uint8_t* data = nullptr;
+    std::size_t size = 0;
+    std::uint64_t offset = 0;
+    bool write = false;
+    std::size_t transferred = 0;
+};
+
+// Executes requests and reports each one exactly once through finish().
+class IoEngine {
+public:
+    virtual ~IoEngine() = default;
+    virtual void submit(IoRequest* request) = 0;
+
+protected:
+    static void finish(IoRequest* request, const std::string& error) {
+        IoBatch* batch = request->batch;
+        delete request;
+        batch->complete(error);
+    }
+
+    static std::string describe(const IoRequest& request, int error) {
+        if (error == 0) {
+            return std::string(request.write ? "Short write" : "Unexpected end of file") + " at offset " +
+                   std::to_string(request.offset + request.transferred);
+        }
+        return std::string(request.write ? "Write" : "Read") + " failed at offset " +
+               std::to_string(request.offset + request.transferred) + " (" + std::strerror(error) + ")";
+    }
+};
+
+namespace {
+#ifndef _WIN32
+// Transfers as much of the request as one call allows; returns bytes moved or -errno.
+long long transfer_once(const IoRequest& request) {
+    const auto offset = static_cast<off_t>(request.offset + request.transferred);
+    std::uint8_t* data = request.data + request.transferred;
+    const std::size_t remaining = request.size - request.transferred;
+    const ssize_t result = request.write ? ::pwrite(request.fd, data, remaining, offset)
+                                         : ::pread(request.fd, data, remaining, offset);
+    return result < 0 ? -static_cast<long long>(errno) : static_cast<long long>(result);
+}
+#endif
+
+// Runs each request to completion with blocking positional I/O on one of a few I/O
+// threads. On Windows, which has no pread/pwrite, requests run on the submitting thread.
+class ThreadEngine : public IoEngine {
+public:
+    ThreadEngine() {
+#ifndef _WIN32
+        const unsigned int thread_count = Concurrency::io_threads();
+        for (unsigned int i = 0; i < thread_count; ++i) {
+            threads_.emplace_back([this]() { run(); });
+        }
+#endif
+    }
+
+    ~ThreadEngine() override {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    void submit(IoRequest* request) override {
+#ifdef _WIN32
+        execute(request);
+#else
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push_back(request);
+        }
+        wake_.notify_one();
+#endif
+    }
+
+private:
+    void run() {
+        for (;;) {
+            IoRequest* request = nullptr;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+                if (queue_.empty()) {
+                    return;
+                }
+                request = queue_.front();
+                queue_.pop_front();
+            }
+            execute(request);
+        }
+    }
+
+    static void execute(IoRequest* request) {
+#ifdef _WIN32
+        if (_lseeki64(request->fd, static_cast<__int64>(request->offset), SEEK_SET) < 0) {
+            finish(request, describe(*request, errno));
+            return;
+        }
+        while (request->transferred < request->size) {
+            const auto chunk = static_cast<unsigned int>(std::min<std::size_t>(request->size - request->transferred, 1u << 30));
+            std::uint8_t* data = request->data + request->transferred;
+            const int result = request->write ? _write(request->fd, data, chunk) : _read(request->fd, data, chunk);
+            if (result <= 0) {
+                finish(request, describe(*request, result < 0 ? errno : 0));
+                return;
+            }
+            request->transferred += static_cast<std::size_t>(result);
+        }
+#else
+        while (request->transferred < request->size) {
+            const long long result = transfer_once(*request);
+            if (result == -EINTR) {
+                continue;
+            }
+            if (result <= 0) {
+                finish(request, describe(*request, static_cast<int>(-result)));
+                return;
+            }
+            request->transferred += static_cast<std::size_t>(result);
+        }
+#endif
+        finish(request, {});
+    }
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<IoRequest*> queue_;
+    bool stopping_ = false;
+    std::vector<std::thread> threads_;
+};
+
+#ifdef CONVERTER_HAVE_IO_URING
+constexpr unsigned int kRingEntries = 256;
+
+int ring_setup(unsigned int entries, io_uring_params& params) {
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+}
+
+int ring_enter(int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags) {
+    return static_cast<int>(::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+int ring_register(int fd, unsigned int opcode, void* argument, unsigned int count) {
+    return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, argument, count));
+}
+
+std::uint32_t load_acquire(const std::uint32_t* value) {
+    return std::atomic_ref<const std::uint32_t>(*value).load(std::memory_order_acquire);
+}
+
+void store_release(std::uint32_t* value, std::uint32_t next) {
+    std::atomic_ref<std::uint32_t>(*value).store(next, std::memory_order_release);
+}
+
+// One ring driven by a dedicated thread. Submitting threads only append to a queue and
+// poke an eventfd; the ring thread keeps a read of that eventfd in flight, so it sleeps
+// in io_uring_enter until either I/O completes or new requests arrive, and submits
+// everything queued since its last wake-up in a single call.
+class UringEngine : public IoEngine {
+public:
+    // Returns null when the kernel lacks io_uring or the read/write operations.
+    static std::unique_ptr<UringEngine> create() {
+        auto engine = std::unique_ptr<UringEngine>(new UringEngine());
+        if (!engine->open()) {
+            return nullptr;
+        }
+        engine->thread_ = std::thread([raw = engine.get()]() { raw->run(); });
+        return engine;
+    }
+
+    ~UringEngine() override {
+        if (thread_.joinable()) {
+            stopping_.store(true, std::memory_order_release);
+            poke();
+            thread_.join();
+        }
+        if (sqes_ != MAP_FAILED) {
+            ::munmap(sqes_, sqes_size_);
+        }
+        if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+            ::munmap(cq_ring_, cq_ring_size_);
+        }
+        if (sq_ring_ != MAP_FAILED) {
+            ::munmap(sq_ring_, sq_ring_size_);
+        }
+        if (event_fd_ >= 0) {
+            ::close(event_fd_);
+        }
+        if (ring_fd_ >= 0) {
+            ::close(ring_fd_);
+        }
+    }
+
+    void submit(IoRequest* request) override {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!failed_) {
+                queue_.push_back(request);
+                request = nullptr;
+            }
+        }
+        if (request) {
+            finish(request, describe(*request, EIO));
+            return;
+        }
+        poke();
+    }
+
+private:
+    UringEngine() = default;
+
+    bool open() {
+        io_uring_params params{};
+        ring_fd_ = ring_setup(kRingEntries, params);
+        if (ring_fd_ < 0) {
+            return false;
+        }
+
+        // IORING_OP_READ/WRITE need Linux 5.6; older kernels report them unsupported.
+        std::vector<std::uint8_t> probe_storage(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op));
+        auto* probe = reinterpret_cast<io_uring_probe*>(probe_storage.data());
+        if (ring_register(ring_fd_, IORING_REGISTER_PROBE, probe, 256) < 0 ||
+            probe->last_op < IORING_OP_WRITE ||
+            !(probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) ||
+            !(probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED)) {
+            return false;
+        }
+
+        sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(std::uint32_t);
+        cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_mmap) {
+            sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+        }
+
+        sq_ring_ = ::mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          ring_fd_, IORING_OFF_SQ_RING);
+        if (sq_ring_ == MAP_FAILED) {
+            return false;
+        }
+        cq_ring_ = single_mmap ? sq_ring_
+                               : ::mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                        ring_fd_, IORING_OFF_CQ_RING);
+        if (cq_ring_ == MAP_FAILED) {
+            return false;
+        }
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ring_fd_, IORING_OFF_SQES);
+        if (sqes_ == MAP_FAILED) {
+            return false;
+        }
+
+        auto* sq = static_cast<std::uint8_t*>(sq_ring_);
+        sq_tail_ = reinterpret_cast<std::uint32_t*>(sq + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<std::uint32_t*>(sq + params.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<std::uint32_t*>(sq + params.sq_off.array);
+        auto* cq = static_cast<std::uint8_t*>(cq_ring_);
+        cq_head_ = reinterpret_cast<std::uint32_t*>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<std::uint32_t*>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<std::uint32_t*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        capacity_ = params.sq_entries;
+
+        event_fd_ = ::eventfd(0, EFD_CLOEXEC);
+        return event_fd_ >= 0;
+    }
+
+    void poke() {
+        const std::uint64_t one = 1;
+        [[maybe_unused]] const ssize_t ignored = ::write(event_fd_, &one, sizeof(one));
+    }
+
+    void prepare(std::uint8_t opcode, int fd, void* data, std::size_t size, std::uint64_t offset, std::uint64_t user_data) {
+        const std::uint32_t tail = *sq_tail_;
+        const std::uint32_t index = tail & sq_mask_;
+        io_uring_sqe& sqe = static_cast<io_uring_sqe*>(sqes_)[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = opcode;
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<std::uint64_t>(data);
+        sqe.len = static_cast<std::uint32_t>(std::min<std::size_t>(size, 1u << 30));
+        sqe.off = offset;
+        sqe.user_data = user_data;
+        sq_array_[index] = index;
+        store_release(sq_tail_, tail + 1);
+        ++to_submit_;
+        ++in_flight_;
+    }
+
+    void prepare(IoRequest* request) {
+        prepare(request->write ? IORING_OP_WRITE : IORING_OP_READ, request->fd, request->data + request->transferred,
+                request->size - request->transferred, request->offset + request->transferred,
+                reinterpret_cast<std::uint64_t>(request));
+    }
+
+    void run() {
+        std::uint64_t wake_count = 0;
+        bool wake_armed = false;
+        std::deque<IoRequest*> backlog;
+
+        for (;;) {
+            if (!wake_armed) {
+                // Offset -1 reads at the file position, the only meaning an eventfd has.
+                prepare(IORING_OP_READ, event_fd_, &wake_count, sizeof(wake_count), ~std::uint64_t{0}, 0);
+                wake_armed = true;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                backlog.insert(backlog.end(), queue_.begin(), queue_.end());
+                queue_.clear();
+            }
+            while (!backlog.empty() && in_flight_ < capacity_) {
+                prepare(backlog.front());
+                backlog.pop_front();
+            }
+
+            // The only request left is the eventfd read: nothing is pending.
+            if (in_flight_ == 1 && backlog.empty() && stopping_.load(std::memory_order_acquire)) {
+                return;
+            }
+
+            const int entered = ring_enter(ring_fd_, to_submit_, 1, IORING_ENTER_GETEVENTS);
+            if (entered < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                fail_all(backlog, errno);
+                return;
+            }
+            if (entered > 0) {
+                to_submit_ -= std::min(to_submit_, static_cast<unsigned int>(entered));
+            }
+
+            std::uint32_t head = *cq_head_;
+            const std::uint32_t tail = load_acquire(cq_tail_);
+            for (; head != tail; ++head) {
+                const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+                --in_flight_;
+                if (cqe.user_data == 0) {
+                    wake_armed = false;
+                    continue;
+                }
+                auto* request = reinterpret_cast<IoRequest*>(cqe.user_data);
+                if (cqe.res == -EINTR || cqe.res == -EAGAIN) {
+                    backlog.push_back(request);
+                } else if (cqe.res <= 0) {
+                    finish(request, describe(*request, -cqe.res));
+                } else {
+                    request->transferred += static_cast<std::size_t>(cqe.res);
+                    if (request->transferred < request->size) {
+                        backlog.push_back(request); // short transfer: continue where it stopped
+                    } else {
+                        finish(request, {});
+                    }
+                }
+            }
+            store_release(cq_head_, head);
+        }
+    }
+
+    // Used only if the ring itself breaks; requests already in the kernel are abandoned
+    // with their batches, which is acceptable only because it indicates a kernel fault.
+    void fail_all(std::deque<IoRequest*>& backlog, int error) {
+        LogMessage(LogLevel::error) << "io_uring failed: " << std::strerror(error);
+        std::lock_guard<std::mutex> lock(mutex_);
+        backlog.insert(backlog.end(), queue_.begin(), queue_.end());
+        queue_.clear();
+        for (IoRequest* request : backlog) {
+            finish(request, describe(*request, error));
+        }
+        failed_ = true;
+    }
+
+    int ring_fd_ = -1;
+    int event_fd_ = -1;
+    void* sq_ring_ = MAP_FAILED;
+    void* cq_ring_ = MAP_FAILED;
+    void* sqes_ = MAP_FAILED;
+    std::size_t sq_ring_size_ = 0;
+    std::size_t cq_ring_size_ = 0;
+    std::size_t sqes_size_ = 0;
+    std::uint32_t* sq_tail_ = nullptr;
+    std::uint32_t* sq_array_ = nullptr;
+    std::uint32_t sq_mask_ = 0;
+    std::uint32_t* cq_head_ = nullptr;
+    std::uint32_t* cq_tail_ = nullptr;
+    std::uint32_t cq_mask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+    unsigned int capacity_ = 0;
+    unsigned int to_submit_ = 0;
+    unsigned int in_flight_ = 0;
+
+    std::mutex mutex_;
+    std::deque<IoRequest*> queue_;
+    std::atomic<bool> stopping_{false};
+    bool failed_ = false;
+    std::thread thread_;
+};
+#endif
+
+IoBackendKind g_preferred = IoBackendKind::automatic;
+}
+
+IoBatch::~IoBatch() {
+    wait();
+}
+
+bool IoBatch::wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this]() { return pending_ == 0; });
+    return error_.empty();
+}
+
+const std::string& IoBatch::error() const {
+    return error_;
+}
+
+void IoBatch::add() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pending_ == 0) {
+        error_.clear();
+    }
+    ++pending_;
+}
+
+void IoBatch::complete(const std::string& error) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!error.empty() && error_.empty()) {
+        error_ = error;
+    }
+    if (--pending_ == 0) {
+        done_.notify_all();
+    }
+}
+
+void IoBackend::set_preferred(IoBackendKind kind) {
+    g_preferred = kind;
+}
+
+IoBackend& IoBackend::shared() {
+    static IoBackend backend(g_preferred);
+    return backend;
+}
+
+IoBackend::IoBackend(IoBackendKind preferred) {
+#ifdef CONVERTER_HAVE_IO_URING
+    if (preferred != IoBackendKind::threads) {
+        engine_ = UringEngine::create();
+        if (engine_) {
+            kind_ = IoBackendKind::io_uring;
+            return;
+        }
+        if (preferred == IoBackendKind::io_uring) {
+            LogMessage(LogLevel::warning) << "Warning: io_uring is not available; using I/O threads";
+        }
+    }
+#else
+    if (preferred == IoBackendKind::io_uring) {
+        LogMessage(LogLevel::warning) << "Warning: built without io_uring support; using I/O threads";
+    }
+#endif
+    engine_ = std::make_unique<ThreadEngine>();
+    kind_ = IoBackendKind::threads;
+}
+
+IoBackend::~IoBackend() = default;
+
+IoBackendKind IoBackend::kind() const {
+    return kind_;
+}
+
+const char* IoBackend::name(IoBackendKind kind) {
+    switch (kind) {
+    case IoBackendKind::automatic: return "auto";
+    case IoBackendKind::threads: return "threads";
+    case IoBackendKind::io_uring: return "io_uring";
+    }
+    return "unknown";
+}
+
+void IoBackend::read(IoBatch& batch, int fd, void* data, std::size_t size, std::uint64_t offset) {
+    if (size == 0) {
+        return;
+    }
+    batch.add();
+    engine_->submit(new IoRequest{&batch, fd, static_cast<std::uint8_t*>(data), size, offset, false});
+}
+
+void IoBackend::write(IoBatch& batch, int fd, const void* data, std::size_t size, std::uint64_t offset) {
+    if (size == 0) {
+        return;
+    }
+    batch.add();
+    // The engines never write through the pointer of a write request.
+    engine_->submit(new IoRequest{&batch, fd, static_cast<std::uint8_t*>(const_cast<void*>(data)), size, offset, true});
+}
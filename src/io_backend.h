@@ -0,0 +1,73 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+enum class IoBackendKind {
+    automatic,  // io_uring where built in and supported by the kernel, else threads
+    threads,    // blocking pread/pwrite on a small pool of I/O threads
+    io_uring    // batched submissions to a Linux io_uring
+};
+
+class IoEngine;
+struct IoRequest;
+
+// Completion state for a group of asynchronous requests. Requests added to a batch
+// complete in any order; wait() returns once all of them have. A batch can be reused
+// after wait() returns, and its destructor waits for anything still in flight.
+class IoBatch {
+public:
+    IoBatch() = default;
+    ~IoBatch();
+
+    IoBatch(const IoBatch&) = delete;
+    IoBatch& operator=(const IoBatch&) = delete;
+
+    // False if any request failed or hit end of file; error() then describes the first.
+    bool wait();
+    const std::string& error() const;
+
+private:
+    friend class IoBackend;
+    friend class IoEngine;
+    void add();
+    void complete(const std::string& error);
+
+    std::mutex mutex_;
+    std::condition_variable done_;
+    std::size_t pending_ = 0;
+    std::string error_;
+};
+
+// Process-wide asynchronous positional file I/O, so that compute threads hand reads and
+// writes off instead of blocking on storage. Requests are queued immediately and
+// submitted in batches; short transfers are continued until complete. Buffers must stay
+// valid, and file descriptors open, until the batch they belong to has been waited on.
+class IoBackend {
+public:
+    // Chooses the backend used by shared(); only effective before its first use.
+    static void set_preferred(IoBackendKind kind);
+    static IoBackend& shared();
+
+    ~IoBackend();
+
+    IoBackend(const IoBackend&) = delete;
+    IoBackend& operator=(const IoBackend&) = delete;
+
+    // The backend in effect: threads or io_uring, never automatic.
+    IoBackendKind kind() const;
+    static const char* name(IoBackendKind kind);
+
+    void read(IoBatch& batch, int fd, void* data, std::size_t size, std::uint64_t offset);
+    void write(IoBatch& batch, int fd, const void* data, std::size_t size, std::uint64_t offset);
+
+private:
+    explicit IoBackend(IoBackendKind preferred);
+
+    std::unique_ptr<IoEngine> engine_;
+    IoBackendKind kind_ = IoBackendKind::threads;
+};
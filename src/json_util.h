@@ -0,0 +1,12 @@
+#pragma once
+
+#include <string>
+
+// Helpers for the JSON the converter writes by hand: --stats and --inspect reports,
+// trace files and benchmark results.
+class JsonUtil {
+public:
+    // Returns text escaped for use inside a JSON string literal: quotes, backslashes and
+    // every control character, the common ones by name (\n, \r, \t), the rest as \u00XX.
+    static std::string escape(const std::string& text);
+};
@@ -0,0 +1,327 @@
+#include "lease_queue.h"
+#include "content_hash.h"
+#include "log.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <random>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+std::string host_name() {
+#ifdef _WIN32
+    const char* name = std::getenv("COMPUTERNAME");
+    return name ? name : "localhost";
+#else
+    char name[256] = {};
+    return ::gethostname(name, sizeof(name) - 1) == 0 ? name : "localhost";
+#endif
+}
+
+int process_id() {
+#ifdef _WIN32
+    return _getpid();
+#else
+    return static_cast<int>(::getpid());
+#endif
+}
+
+// A file name for a job that is safe on any filesystem, with a hash of the original
+// name so that names differing only in replaced characters stay distinct.
+std::string key_for(const std::string& job) {
+    std::string key;
+    for (const char c : job) {
+        const bool safe = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+                          c == '.' || c == '-' || c == '_';
+        key += safe ? c : '_';
+    }
+    if (!key.empty() && key[0] == '.') {
+        key[0] = '_';
+    }
+    char suffix[16];
+    std::snprintf(suffix, sizeof(suffix), "-%08x", static_cast<unsigned int>(ContentHash::of(job.data(), job.size()).low));
+    return key + suffix;
+}
+
+bool write_file(const std::filesystem::path& path, const std::string& content) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file << content;
+    return static_cast<bool>(file);
+}
+
+std::string read_file(const std::filesystem::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), {});
+}
+
+// Sets the modification time to now. On POSIX "now" comes from the file server (NFS
+// sends SET_TO_SERVER_TIME), which is what makes lease ages comparable across nodes.
+bool touch(const std::filesystem::path& path) {
+#ifdef _WIN32
+    std::error_code error;
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+    return !error;
+#else
+    return ::utimensat(AT_FDCWD, path.c_str(), nullptr, 0) == 0;
+#endif
+}
+
+double seconds_between(std::filesystem::file_time_type earlier, std::filesystem::file_time_type later) {
+    return std::chrono::duration<double>(later - earlier).count();
+}
+}
+
+LeaseQueue::LeaseQueue(LeaseQueueOptions options)
+    : options_(std::move(options)) {
+    std::random_device random;
+    char tag[16];
+    std::snprintf(tag, sizeof(tag), "%08x", static_cast<unsigned int>(random()));
+    owner_ = host_name() + ":" + std::to_string(process_id()) + ":" + tag;
+}
+
+LeaseQueue::~LeaseQueue() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    stop_.notify_all();
+    if (heartbeat_.joinable()) {
+        heartbeat_.join();
+    }
+    std::error_code error;
+    std::filesystem::remove(options_.directory / "clocks" / key_for(owner_), error);
+}
+
+bool LeaseQueue::open() {
+    std::error_code error;
+    for (const char* name : {"leases", "done", "failed", "clocks"}) {
+        std::filesystem::create_directories(options_.directory / name, error);
+        if (error) {
+            error_ = "Cannot create " + (options_.directory / name).string() + ": " + error.message();
+            return false;
+        }
+    }
+    if (!write_file(options_.directory / "clocks" / key_for(owner_), owner_ + "\n")) {
+        error_ = "Cannot write to " + (options_.directory / "clocks").string();
+        return false;
+    }
+
+    heartbeat_ = std::thread([this]() {
+        Trace::set_thread_name("lease heartbeat");
+        const auto interval = std::chrono::duration<double>(options_.lease_seconds / 3.0);
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stop_.wait_for(lock, interval, [this]() { return stopping_; })) {
+            lock.unlock();
+            renew_leases();
+            lock.lock();
+        }
+    });
+    return true;
+}
+
+const std::string& LeaseQueue::error() const {
+    return error_;
+}
+
+const std::string& LeaseQueue::owner() const {
+    return owner_;
+}
+
+std::filesystem::path LeaseQueue::lease_path(const std::string& key) const {
+    return options_.directory / "leases" / (key + ".lease");
+}
+
+std::filesystem::path LeaseQueue::done_path(const std::string& key) const {
+    return options_.directory / "done" / key;
+}
+
+std::filesystem::path LeaseQueue::failed_path(const std::string& key) const {
+    return options_.directory / "failed" / key;
+}
+
+std::filesystem::file_time_type LeaseQueue::server_now() {
+    const auto clock = options_.directory / "clocks" / key_for(owner_);
+    std::error_code error;
+    if (!touch(clock)) {
+        write_file(clock, owner_ + "\n");
+    }
+    const auto now = std::filesystem::last_write_time(clock, error);
+    return error ? std::filesystem::file_time_type::clock::now() : now;
+}
+
+LeaseQueue::Claim LeaseQueue::claim(const std::string& key) {
+    std::error_code error;
+    const auto finished = [&]() {
+        return std::filesystem::exists(done_path(key), error) || std::filesystem::exists(failed_path(key), error);
+    };
+    if (finished()) {
+        return Claim::finished;
+    }
+
+    // Two attempts: the second follows reclaiming an expired lease.
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        const auto candidate = options_.directory / "leases" / ("." + key + "." + key_for(owner_));
+        if (!write_file(candidate, owner_ + "\n")) {
+            LogMessage(LogLevel::error) << "Cannot write to " << (options_.directory / "leases").string();
+            return Claim::held_elsewhere;
+        }
+        std::filesystem::create_hard_link(candidate, lease_path(key), error);
+        // A link whose reply was lost still shows up in the link count (NFS retransmits).
+        const bool won = !error || std::filesystem::hard_link_count(candidate, error) == 2;
+        std::filesystem::remove(candidate, error);
+
+        if (won) {
+            // Another instance may have finished the job and dropped its lease just now.
+            if (finished()) {
+                std::filesystem::remove(lease_path(key), error);
+                return Claim::finished;
+            }
+            std::lock_guard<std::mutex> lock(mutex_);
+            held_.insert(key);
+            return Claim::claimed;
+        }
+        if (!reclaim_if_expired(key)) {
+            break;
+        }
+    }
+    return Claim::held_elsewhere;
+}
+
+bool LeaseQueue::reclaim_if_expired(const std::string& key) {
+    std::error_code error;
+    const auto lease = lease_path(key);
+    const auto renewed = std::filesystem::last_write_time(lease, error);
+    if (error) {
+        return true;  // released in the meantime
+    }
+    if (seconds_between(renewed, server_now()) < options_.lease_seconds) {
+        return false;
+    }
+
+    // Moving the lease aside is atomic, so only one instance can take it.
+    const auto expired = options_.directory / "leases" / ("." + key + ".expired." + key_for(owner_));
+    std::filesystem::rename(lease, expired, error);
+    if (error) {
+        return true;  // another instance got there first
+    }
+    const auto moved_renewed = std::filesystem::last_write_time(expired, error);
+    if (!error && seconds_between(moved_renewed, server_now()) < options_.lease_seconds) {
+        // The lease was renewed or taken again between the check and the move: put it back.
+        std::filesystem::create_hard_link(expired, lease, error);
+        std::filesystem::remove(expired, error);
+        return false;
+    }
+
+    std::string previous = read_file(expired);
+    previous.erase(std::remove(previous.begin(), previous.end(), '\n'), previous.end());
+    LogMessage(LogLevel::warning) << "Warning: reclaiming " << key << " from " << previous
+                                  << ", whose lease expired";
+    std::filesystem::remove(expired, error);
+    return true;
+}
+
+void LeaseQueue::release(const std::string& key, bool success) {
+    write_file(success ? done_path(key) : failed_path(key), owner_ + "\n");
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        held_.erase(key);
+    }
+    // Leave a lease that another instance has taken over alone.
+    std::error_code error;
+    if (read_file(lease_path(key)) == owner_ + "\n") {
+        std::filesystem::remove(lease_path(key), error);
+    }
+}
+
+void LeaseQueue::renew_leases() {
+    std::set<std::string> held;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        held = held_;
+    }
+    for (const auto& key : held) {
+        if (read_file(lease_path(key)) != owner_ + "\n" || !touch(lease_path(key))) {
+            LogMessage(LogLevel::warning) << "Warning: lost the lease on " << key
+                                          << "; another instance may convert it as well";
+            std::lock_guard<std::mutex> lock(mutex_);
+            held_.erase(key);
+        }
+    }
+}
+
+void LeaseQueue::drain(const std::vector<std::string>& jobs, const std::vector<std::size_t>& order, int parallel,
+                       const std::function<bool(std::size_t)>& run_job) {
+    enum : char { open_job, running_here, settled };
+    std::vector<char> status(jobs.size(), open_job);
+    std::vector<std::string> keys;
+    for (const auto& job : jobs) {
+        keys.push_back(key_for(job));
+    }
+    std::mutex status_mutex;
+
+    auto worker = [&]() {
+        Trace::set_thread_name("queue worker");
+        while (true) {
+            bool held_elsewhere = false;
+            bool ran = false;
+            for (const std::size_t index : order) {
+                {
+                    std::lock_guard<std::mutex> lock(status_mutex);
+                    if (status[index] != open_job) {
+                        continue;
+                    }
+                    status[index] = running_here;
+                }
+                const Claim claim_result = claim(keys[index]);
+                if (claim_result == Claim::claimed) {
+                    LogMessage(LogLevel::debug) << "Claimed " << jobs[index];
+                    release(keys[index], run_job(index));
+                    ran = true;
+                }
+                std::lock_guard<std::mutex> lock(status_mutex);
+                if (claim_result == Claim::held_elsewhere) {
+                    status[index] = open_job;
+                    held_elsewhere = true;
+                } else {
+                    status[index] = settled;
+                }
+                if (ran) {
+                    break;  // start again from the costliest job still open
+                }
+            }
+            if (ran) {
+                continue;
+            }
+            if (!held_elsewhere) {
+                return;
+            }
+            // Wait for the other instances to finish their jobs or for their leases to expire.
+            std::this_thread::sleep_for(std::chrono::duration<double>(options_.poll_seconds));
+        }
+    };
+
+    const std::size_t thread_count = std::min<std::size_t>(jobs.size(), static_cast<std::size_t>(std::max(parallel, 1)));
+    if (thread_count <= 1) {
+        worker();
+        return;
+    }
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < thread_count; ++t) {
+        threads.emplace_back(worker);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
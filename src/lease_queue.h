@@ -0,0 +1,76 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct LeaseQueueOptions {
+    std::filesystem::path directory;  // shared by every instance, e.g. on an NFS mount
+    double lease_seconds = 60.0;      // a lease not renewed for this long is reclaimed
+    double poll_seconds = 5.0;        // wait before looking again at jobs other instances hold
+};
+
+// Shares the files of a batch between instances of the converter, typically on
+// different nodes, through lease files in a shared directory. An instance converts a
+// file only while it holds the file's lease; a background thread renews its leases, so
+// the leases of an instance that dies expire and other instances take its files over.
+//
+// Layout under the queue directory: leases/<key>.lease (held), done/<key> and
+// failed/<key> (finished, never claimed again). Leases are taken by hard-linking a
+// private file to the lease name, which is atomic on NFS as well as on local disks.
+// Lease ages are measured against the file server's clock (the modification time of a
+// file this instance has just touched), so clock skew between nodes does not matter.
+//
+// A file can occasionally be converted twice, when an instance stalls past its lease
+// and another one takes over; outputs are replaced atomically, so this only costs time.
+class LeaseQueue {
+public:
+    explicit LeaseQueue(LeaseQueueOptions options);
+    ~LeaseQueue();
+
+    LeaseQueue(const LeaseQueue&) = delete;
+    LeaseQueue& operator=(const LeaseQueue&) = delete;
+
+    // Creates the queue's subdirectories and starts renewing leases.
+    bool open();
+    const std::string& error() const;
+    // host:pid:random, written into every lease this instance holds.
+    const std::string& owner() const;
+
+    // Runs run_job(index) on up to `parallel` threads for every job whose lease this
+    // instance wins, taking jobs in the given order, and returns once every job is
+    // done or failed, whichever instance finished it. jobs are the names that identify
+    // files across instances (file names within the shared input directory).
+    // run_job returns whether the job succeeded.
+    void drain(const std::vector<std::string>& jobs, const std::vector<std::size_t>& order, int parallel,
+               const std::function<bool(std::size_t)>& run_job);
+
+private:
+    enum class Claim { claimed, held_elsewhere, finished };
+
+    Claim claim(const std::string& key);
+    void release(const std::string& key, bool success);
+    bool reclaim_if_expired(const std::string& key);
+    std::filesystem::file_time_type server_now();
+    void renew_leases();
+
+    std::filesystem::path lease_path(const std::string& key) const;
+    std::filesystem::path done_path(const std::string& key) const;
+    std::filesystem::path failed_path(const std::string& key) const;
+
+    LeaseQueueOptions options_;
+    std::string owner_;
+    std::string error_;
+
+    std::mutex mutex_;
+    std::condition_variable stop_;
+    bool stopping_ = false;
+    std::set<std::string> held_;
+    std::thread heartbeat_;
+};
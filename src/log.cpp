@@ -0,0 +1,262 @@
+#include "log.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace {
+struct LogRecord {
+    LogLevel level = LogLevel::info;
+    std::string message;
+    LogSink sink;
+};
+
+// Bounded multi-producer queue after Dmitry Vyukov's MPMC ring: each slot carries a
+// sequence number that tells producers and the consumer whose turn it is, so neither
+// side takes a lock. Only the delivery thread pops.
+class LogRing {
+public:
+    LogRing() {
+        for (std::size_t i = 0; i < kCapacity; ++i) {
+            slots_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool try_push(LogRecord& record) {
+        std::size_t position = tail_.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = slots_[position & (kCapacity - 1)];
+            const std::size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            const auto difference = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(position);
+            if (difference == 0) {
+                if (tail_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    slot.record = std::move(record);
+                    slot.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool try_pop(LogRecord& record) {
+        Slot& slot = slots_[head_ & (kCapacity - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != head_ + 1) {
+            return false;
+        }
+        record = std::move(slot.record);
+        slot.record = LogRecord{};
+        slot.sequence.store(head_ + kCapacity, std::memory_order_release);
+        ++head_;
+        return true;
+    }
+
+private:
+    static constexpr std::size_t kCapacity = 4096;
+
+    struct Slot {
+        std::atomic<std::size_t> sequence{0};
+        LogRecord record;
+    };
+
+    std::array<Slot, kCapacity> slots_;
+    alignas(64) std::atomic<std::size_t> tail_{0};
+    alignas(64) std::size_t head_ = 0;
+};
+
+std::atomic<LogLevel> g_level{LogLevel::info};
+std::atomic<bool> g_stderr_only{false};
+
+std::atomic<bool> g_async{false};
+std::atomic<bool> g_stopping{false};
+std::atomic<bool> g_consumer_sleeping{false};
+std::atomic<std::uint64_t> g_queued{0};
+std::atomic<std::uint64_t> g_delivered{0};
+std::unique_ptr<LogRing> g_ring;
+std::thread g_consumer;
+
+// Wakes the delivery thread and flush() callers; never held while formatting.
+std::mutex g_wake_mutex;
+std::condition_variable g_wake;
+std::condition_variable g_drained;
+
+// Serialises synchronous delivery, which has no queue to keep lines in order.
+std::mutex g_sync_mutex;
+
+void deliver(const LogRecord& record, bool flush_line) {
+    if (record.sink) {
+        record.sink(record.level, record.message);
+        return;
+    }
+
+    const bool to_stderr = record.level <= LogLevel::warning || g_stderr_only.load(std::memory_order_relaxed);
+    std::ostream& stream = to_stderr ? std::cerr : std::cout;
+    stream << record.message << '\n';
+    if (flush_line) {
+        stream.flush();
+    }
+}
+
+void consume() {
+    LogRecord record;
+    for (;;) {
+        bool delivered_any = false;
+        while (g_ring->try_pop(record)) {
+            deliver(record, false);
+            g_delivered.fetch_add(1, std::memory_order_release);
+            delivered_any = true;
+        }
+
+        if (delivered_any) {
+            std::cout.flush();
+            std::cerr.flush();
+            std::lock_guard<std::mutex> lock(g_wake_mutex);
+            g_drained.notify_all();
+            continue;
+        }
+
+        if (g_stopping.load(std::memory_order_acquire) &&
+            g_delivered.load(std::memory_order_acquire) == g_queued.load(std::memory_order_acquire)) {
+            return;
+        }
+
+        // A producer may push between the empty pop above and this wait; the timeout
+        // bounds the delay in that case instead of locking on every push.
+        std::unique_lock<std::mutex> lock(g_wake_mutex);
+        g_consumer_sleeping.store(true, std::memory_order_seq_cst);
+        g_wake.wait_for(lock, std::chrono::milliseconds(20));
+        g_consumer_sleeping.store(false, std::memory_order_relaxed);
+    }
+}
+}
+
+void Log::set_level(LogLevel level) {
+    g_level.store(level, std::memory_order_relaxed);
+}
+
+LogLevel Log::level() {
+    return g_level.load(std::memory_order_relaxed);
+}
+
+void Log::set_stderr_only(bool enabled) {
+    g_stderr_only.store(enabled, std::memory_order_relaxed);
+}
+
+bool Log::enabled(LogLevel level) {
+    return level <= g_level.load(std::memory_order_relaxed);
+}
+
+bool Log::parse_level(const std::string& name, LogLevel& level) {
+    if (name == "quiet") {
+        level = LogLevel::warning;
+    } else if (name == "info") {
+        level = LogLevel::info;
+    } else if (name == "debug") {
+        level = LogLevel::debug;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void Log::write(LogLevel level, std::string message, const LogSink& sink) {
+    if (!enabled(level)) {
+        return;
+    }
+
+    LogRecord record{level, std::move(message), sink};
+    if (!g_async.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(g_sync_mutex);
+        deliver(record, true);
+        return;
+    }
+
+    // A full ring applies back-pressure instead of dropping messages.
+    g_queued.fetch_add(1, std::memory_order_acq_rel);
+    while (!g_ring->try_push(record)) {
+        g_wake.notify_one();
+        std::this_thread::yield();
+    }
+    if (g_consumer_sleeping.load(std::memory_order_seq_cst)) {
+        g_wake.notify_one();
+    }
+}
+
+void Log::error(std::string message, const LogSink& sink) {
+    write(LogLevel::error, std::move(message), sink);
+}
+
+void Log::warning(std::string message, const LogSink& sink) {
+    write(LogLevel::warning, std::move(message), sink);
+}
+
+void Log::info(std::string message, const LogSink& sink) {
+    write(LogLevel::info, std::move(message), sink);
+}
+
+void Log::debug(std::string message, const LogSink& sink) {
+    write(LogLevel::debug, std::move(message), sink);
+}
+
+void Log::flush() {
+    if (!g_async.load(std::memory_order_acquire)) {
+        std::cout.flush();
+        return;
+    }
+
+    const std::uint64_t target = g_queued.load(std::memory_order_acquire);
+    std::unique_lock<std::mutex> lock(g_wake_mutex);
+    g_wake.notify_one();
+    g_drained.wait(lock, [target]() { return g_delivered.load(std::memory_order_acquire) >= target; });
+}
+
+AsyncLogSession::AsyncLogSession() {
+    if (g_async.load(std::memory_order_acquire)) {
+        return;
+    }
+    g_ring = std::make_unique<LogRing>();
+    g_stopping.store(false, std::memory_order_release);
+    g_consumer = std::thread(consume);
+    g_async.store(true, std::memory_order_release);
+    owner_ = true;
+}
+
+AsyncLogSession::~AsyncLogSession() {
+    if (!owner_) {
+        return;
+    }
+    Log::flush();
+    g_async.store(false, std::memory_order_release);
+    g_stopping.store(true, std::memory_order_release);
+    g_wake.notify_one();
+    g_consumer.join();
+    g_ring.reset();
+}
+
+LogMessage::LogMessage(LogLevel level) : level_(level) {
+    if (Log::enabled(level_)) {
+        stream_.emplace();
+    }
+}
+
+LogMessage::LogMessage(LogLevel level, const LogSink& sink) : level_(level), sink_(&sink) {
+    if (Log::enabled(level_)) {
+        stream_.emplace();
+    }
+}
+
+LogMessage::~LogMessage() {
+    if (stream_) {
+        Log::write(level_, stream_->str(), sink_ ? *sink_ : LogSink{});
+    }
+}
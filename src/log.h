@@ -0,0 +1,82 @@
+#pragma once
+
+#include <functional>
+#include <optional>
+#include <sstream>
+#include <string>
+
+enum class LogLevel {
+    error,
+    warning,
+    info,   // one line per file and per conversion step (default)
+    debug   // per-page and per-entry detail
+};
+
+// Receives messages for one conversion instead of the default stdout/stderr writer.
+using LogSink = std::function<void(LogLevel, const std::string&)>;
+
+// Process-wide leveled logging. Messages above the current level are dropped before
+// they are formatted. While an AsyncLogSession exists, messages are queued in a
+// lock-free ring and delivered in order by a background thread, which flushes the
+// standard streams once per batch rather than once per line; otherwise they are
+// delivered synchronously by the calling thread.
+class Log {
+public:
+    static void set_level(LogLevel level);
+    static LogLevel level();
+    static bool enabled(LogLevel level);
+    // Sends info and debug messages to stderr as well, for when stdout carries output.
+    static void set_stderr_only(bool enabled);
+
+    // "quiet" (errors and warnings), "info" or "debug".
+    static bool parse_level(const std::string& name, LogLevel& level);
+
+    static void write(LogLevel level, std::string message, const LogSink& sink = {});
+
+    static void error(std::string message, const LogSink& sink = {});
+    static void warning(std::string message, const LogSink& sink = {});
+    static void info(std::string message, const LogSink& sink = {});
+    static void debug(std::string message, const LogSink& sink = {});
+
+    // Blocks until every message queued so far has been delivered.
+    static void flush();
+};
+
+// Starts background delivery for its lifetime and drains the queue on destruction.
+class AsyncLogSession {
+public:
+    AsyncLogSession();
+    ~AsyncLogSession();
+
+    AsyncLogSession(const AsyncLogSession&) = delete;
+    AsyncLogSession& operator=(const AsyncLogSession&) = delete;
+
+private:
+    bool owner_ = false; // false for sessions nested inside an active one
+};
+
+// Stream-style helper for messages built from several values:
+//     LogMessage(LogLevel::debug, sink) << "Added " << name << " (" << size << " bytes)";
+// Nothing is formatted when the level is disabled.
+class LogMessage {
+public:
+    explicit LogMessage(LogLevel level);
+    LogMessage(LogLevel level, const LogSink& sink); // sink must outlive the message
+    ~LogMessage();
+
+    LogMessage(const LogMessage&) = delete;
+    LogMessage& operator=(const LogMessage&) = delete;
+
+    template <typename T>
+    LogMessage& operator<<(const T& value) {
+        if (stream_) {
+            *stream_ << value;
+        }
+        return *this;
+    }
+
+private:
+    LogLevel level_;
+    const LogSink* sink_ = nullptr;
+    std::optional<std::ostringstream> stream_;
+};
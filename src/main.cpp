@@ -1,27 +1,434 @@
 #include <algorithm>
+#include <chrono>
+#include <deque>
+#include <exception>
 #include <filesystem>
+#include <functional>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
+#include "batch_planner.h"
+#include "cbz_inspector.h"
+#include "cbz_repacker.h"
+#include "concurrency.h"
+#include "conversion_stats.h"
 #include "converter_service.h"
+#include "io_backend.h"
+#include "lease_queue.h"
+#include "log.h"
+#include "output_sink.h"
+#include "process_pool.h"
+#include "run_report.h"
+#include "trace.h"
+
+namespace {
+// "inspect <cbz_file_or_directory> [--output <file.json>]": prints page count, order,
+// format and dimensions of each archive as JSON without converting anything.
+int run_inspect(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " inspect <cbz_file_or_directory> [--output <file.json>]" << std::endl;
+        return 1;
+    }
+
+    const std::string input_path = argv[2];
+    std::string output_path;
+    for (int i = 3; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--output" && i + 1 < argc) {
+            output_path = argv[++i];
+        } else {
+            std::cerr << "Error: Unknown inspect option: " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<std::filesystem::path> cbz_files;
+    const bool is_directory = std::filesystem::is_directory(input_path);
+    if (is_directory) {
+        cbz_files = ConverterService::FindCbzFiles(input_path);
+    } else if (std::filesystem::is_regular_file(input_path)) {
+        cbz_files.emplace_back(input_path);
+    } else {
+        std::cerr << "Error: Input path does not exist or is not accessible: " << input_path << std::endl;
+        return 1;
+    }
+
+    int failed = 0;
+    std::string json = is_directory ? "[" : "";
+    for (std::size_t i = 0; i < cbz_files.size(); ++i) {
+        CBZIndex index;
+        if (!CBZInspector::inspect(cbz_files[i].string(), index)) {
+            failed++;
+        }
+        if (is_directory) {
+            json += i == 0 ? "\n" : ",\n";
+        }
+        json += CBZInspector::to_json(index);
+    }
+    json += is_directory ? "\n]\n" : "\n";
+
+    if (output_path.empty()) {
+        std::cout << json;
+    } else {
+        std::ofstream output(output_path, std::ios::binary);
+        output << json;
+        if (!output) {
+            std::cerr << "Error: Failed to write " << output_path << std::endl;
+            return 1;
+        }
+    }
+
+    return failed > 0 ? 1 : 0;
+}
+
+// Screen sizes in pixels (portrait) accepted by name for --pdf-max-size.
+struct DeviceProfile {
+    const char* name;
+    int width;
+    int height;
+};
+
+constexpr DeviceProfile kDeviceProfiles[] = {
+    {"kindle-paperwhite", 1236, 1648},
+    {"kobo-clara", 1072, 1448},
+    {"kobo-libra", 1264, 1680},
+    {"remarkable", 1404, 1872},
+    {"ipad", 1640, 2360},
+};
+
+std::string device_names() {
+    std::string names;
+    for (const auto& profile : kDeviceProfiles) {
+        names += (names.empty() ? "" : ", ") + std::string(profile.name);
+    }
+    return names;
+}
+
+// Parses "<width>x<height>" or a device name into downscale's maximum size.
+bool parse_max_size(const std::string& text, PageDownscale& downscale) {
+    for (const auto& profile : kDeviceProfiles) {
+        if (text == profile.name) {
+            downscale.max_width = profile.width;
+            downscale.max_height = profile.height;
+            return true;
+        }
+    }
+    const auto separator = text.find('x');
+    if (separator == std::string::npos) {
+        return false;
+    }
+    try {
+        downscale.max_width = std::stoi(text.substr(0, separator));
+        downscale.max_height = std::stoi(text.substr(separator + 1));
+    } catch (const std::exception&) {
+        return false;
+    }
+    return downscale.max_width > 0 && downscale.max_height > 0;
+}
+
+// Handles --threads, --io-threads and --pin-threads, which every mode accepts, by
+// applying them to Concurrency. Returns false if argv[i] is none of them; sets invalid
+// (after printing why) if its value is out of range.
+bool parse_concurrency_option(int argc, char* argv[], int& i, bool& invalid) {
+    const std::string arg = argv[i];
+    if ((arg == "--threads" || arg == "--io-threads") && i + 1 < argc) {
+        const int count = std::stoi(argv[++i]);
+        if (count < 0) {
+            std::cerr << "Error: " << arg << " must not be negative" << std::endl;
+            invalid = true;
+        } else if (arg == "--threads") {
+            Concurrency::set_worker_threads(static_cast<unsigned int>(count));
+        } else {
+            Concurrency::set_io_threads(static_cast<unsigned int>(count));
+        }
+        return true;
+    }
+    if (arg == "--pin-threads") {
+        Concurrency::set_pinning(true);
+        return true;
+    }
+    return false;
+}
+
+// "repack <cbz_file_or_directory> [output_dir] [--progressive]": writes a cleaned-up,
+// losslessly optimized copy of each archive under output_dir with the same file name.
+int run_repack(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " repack <cbz_file_or_directory> [output_dir] [--progressive]" << std::endl;
+        return 1;
+    }
+
+    const std::string input_path = argv[2];
+    std::string output_dir = "./repacked";
+    RepackOptions options;
+    for (int i = 3; i < argc; ++i) {
+        const std::string arg = argv[i];
+        bool invalid = false;
+        if (arg == "--progressive") {
+            options.progressive = true;
+        } else if (parse_concurrency_option(argc, argv, i, invalid)) {
+            if (invalid) {
+                return 1;
+            }
+        } else if (i == 3 && arg.rfind("--", 0) != 0) {
+            output_dir = arg;
+        } else {
+            std::cerr << "Error: Unknown repack option: " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<std::filesystem::path> cbz_files;
+    if (std::filesystem::is_directory(input_path)) {
+        cbz_files = ConverterService::FindCbzFiles(input_path);
+    } else if (std::filesystem::is_regular_file(input_path)) {
+        cbz_files.emplace_back(input_path);
+    } else {
+        std::cerr << "Error: Input path does not exist or is not accessible: " << input_path << std::endl;
+        return 1;
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(output_dir, error);
+    if (error) {
+        std::cerr << "Error: Cannot create output directory " << output_dir << ": " << error.message() << std::endl;
+        return 1;
+    }
+
+    int failed = 0;
+    RepackResult total;
+    for (const auto& cbz_file : cbz_files) {
+        const std::filesystem::path output_path = std::filesystem::path(output_dir) / cbz_file.filename();
+        if (std::filesystem::equivalent(cbz_file, output_path, error)) {
+            std::cerr << "Error: Refusing to overwrite " << cbz_file.string() << "; choose another output directory" << std::endl;
+            failed++;
+            continue;
+        }
+
+        RepackResult result;
+        if (!CBZRepacker::repack(cbz_file.string(), output_path.string(), options, result)) {
+            failed++;
+            continue;
+        }
+        total.pages += result.pages;
+        total.optimized_pages += result.optimized_pages;
+        total.input_bytes += result.input_bytes;
+        total.output_bytes += result.output_bytes;
+        total.seconds += result.seconds;
+    }
+
+    if (cbz_files.size() > 1 && total.input_bytes > 0) {
+        std::cout << "Repacked " << (cbz_files.size() - failed) << " of " << cbz_files.size() << " archives, "
+                  << total.pages << " pages (" << total.optimized_pages << " optimized): "
+                  << total.input_bytes << " -> " << total.output_bytes << " bytes, "
+                  << static_cast<int>(100.0 * (1.0 - static_cast<double>(total.output_bytes) / static_cast<double>(total.input_bytes)))
+                  << "% smaller" << std::endl;
+    }
+    return failed > 0 ? 1 : 0;
+}
+
+// How run_batch spreads the files of a batch.
+struct BatchMode {
+    int jobs = 1;
+    ProcessPoolOptions pool;      // used when pool.processes > 0
+    LeaseQueue* queue = nullptr;  // shares the batch with other instances when set
+    bool collect_stats = false;
+};
+
+// Converts every file with convert, costliest first on up to mode.jobs threads, or in
+// worker processes when mode.pool asks for them, and adds the results to report in
+// input order. With a queue, only the files this instance wins are converted and
+// reported. Each file's estimated and actual time is logged so that the cost model
+// can be checked against real runs.
+void run_batch(const std::vector<std::filesystem::path>& files, const std::vector<JobEstimate>& estimates,
+               const BatchMode& mode,
+               const std::function<bool(const std::filesystem::path&, const ConversionContext&)>& convert,
+               const std::function<std::string(const std::filesystem::path&)>& output_path_of,
+               RunReport& report, int& successful, int& failed) {
+    const ProcessPoolOptions& pool = mode.pool;
+    const int jobs = mode.jobs;
+    const bool collect_stats = mode.collect_stats;
+    std::vector<RunReport::FileEntry> entries(files.size());
+    std::vector<double> actual_seconds(files.size(), 0.0);
+    std::vector<char> ran_here(files.size(), mode.queue ? 0 : 1);
+
+    if (pool.processes > 0) {
+        LogMessage(LogLevel::info) << "Processing " << files.size() << " files, longest first, in "
+                                   << std::min<std::size_t>(files.size(), static_cast<std::size_t>(pool.processes))
+                                   << " worker processes";
+        std::vector<std::string> paths;
+        for (const auto& file : files) {
+            paths.push_back(file.string());
+        }
+        std::vector<ProcessJobResult> results;
+        if (!ProcessPool::run(paths, estimates, pool, results)) {
+            LogMessage(LogLevel::error) << "Could not start any worker process";
+        }
+        const RunReport::FileEntry not_converted = RunReport::entry_for({}, {}, false, ConversionStats{});
+        for (std::size_t i = 0; i < files.size() && i < results.size(); ++i) {
+            if (!results[i].completed) {
+                entries[i] = not_converted;
+            } else if (!RunReport::decode_measurements(results[i].reply, entries[i])) {
+                LogMessage(LogLevel::error) << "Unreadable reply from the worker that converted " << files[i].string();
+                entries[i] = not_converted;
+            }
+            entries[i].attempts = std::max(results[i].attempts, 1);
+            entries[i].quarantined = results[i].quarantined;
+            actual_seconds[i] = results[i].seconds;
+        }
+    } else {
+        std::deque<ConversionStats> stats(files.size());
+        // Peak RSS is process-wide, so a file only has its own while no other file
+        // converts alongside it; otherwise the report keeps just the batch's peak.
+        const bool one_at_a_time = jobs <= 1 || files.size() <= 1;
+        // Each running file holds a CPU slot, so that pinned workers of files converting
+        // at the same time land on different CPUs.
+        std::mutex slots_mutex;
+        std::vector<char> slot_taken(static_cast<std::size_t>(std::max(jobs, 1)), 0);
+        auto convert_file = [&](std::size_t i) {
+            ConversionContext context;
+            stats[i].set_measure_peak_rss(one_at_a_time);
+            context.stats = collect_stats ? &stats[i] : nullptr;
+            {
+                std::lock_guard<std::mutex> lock(slots_mutex);
+                const auto free_slot = std::find(slot_taken.begin(), slot_taken.end(), 0);
+                if (free_slot != slot_taken.end()) {
+                    *free_slot = 1;
+                    context.cpu_slot = static_cast<unsigned int>(free_slot - slot_taken.begin());
+                }
+            }
+            const auto started = std::chrono::steady_clock::now();
+            const bool ok = convert(files[i], context);
+            {
+                std::lock_guard<std::mutex> lock(slots_mutex);
+                slot_taken[context.cpu_slot] = 0;
+            }
+            actual_seconds[i] = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+            entries[i] = RunReport::entry_for({}, {}, ok, stats[i]);
+            ran_here[i] = 1;
+            return ok;
+        };
+        if (mode.queue) {
+            LogMessage(LogLevel::info) << "Sharing " << files.size() << " files with other instances as "
+                                       << mode.queue->owner() << ", " << jobs << " at a time";
+            std::vector<std::string> names;
+            for (const auto& file : files) {
+                names.push_back(file.filename().string());
+            }
+            mode.queue->drain(names, BatchPlanner::longest_first(estimates), jobs, convert_file);
+        } else {
+            LogMessage(LogLevel::info) << "Processing " << files.size() << " files, longest first, "
+                                       << std::min<std::size_t>(files.size(), static_cast<std::size_t>(jobs)) << " at a time";
+            BatchPlanner::run(estimates, jobs, [&](std::size_t i) { convert_file(i); });
+        }
+    }
+
+    double estimated_total = 0.0;
+    double actual_total = 0.0;
+    for (std::size_t i = 0; i < files.size(); ++i) {
+        if (!ran_here[i]) {
+            continue;
+        }
+        if (entries[i].success) {
+            successful++;
+        } else {
+            failed++;
+        }
+        LogMessage(LogLevel::info) << "Cost of " << files[i].filename().string() << ": estimated "
+                                   << estimates[i].seconds << " s, took " << actual_seconds[i] << " s";
+        estimated_total += estimates[i].seconds;
+        actual_total += actual_seconds[i];
+        if (collect_stats) {
+            entries[i].input_path = files[i].string();
+            entries[i].output_path = output_path_of(files[i]);
+            entries[i].estimated_seconds = estimates[i].seconds;
+            report.add_entry(std::move(entries[i]));
+        }
+    }
+    if (estimated_total > 0.0) {
+        LogMessage(LogLevel::info) << "Cost model: estimated " << estimated_total << " s, measured " << actual_total
+                                   << " s (actual/estimated " << actual_total / estimated_total << ")";
+    }
+}
+
+// Worker process side of --processes: converts each path the pool sends and replies
+// with the result and its measurements. cpu_slot is the worker's slot in the pool.
+int serve_worker(const std::function<bool(const std::filesystem::path&, const ConversionContext&)>& convert,
+                 unsigned int cpu_slot) {
+    return ProcessPool::serve([&](const std::string& path) {
+        ConversionStats stats;
+        ConversionContext context;
+        context.stats = &stats;
+        context.cpu_slot = cpu_slot;
+        const bool ok = convert(path, context);
+        return RunReport::encode_measurements(RunReport::entry_for({}, {}, ok, stats));
+    });
+}
+}
 
 int main(int argc, char* argv[]) {
+    if (argc >= 2 && std::string(argv[1]) == "inspect") {
+        return run_inspect(argc, argv);
+    }
+    if (argc >= 2 && std::string(argv[1]) == "repack") {
+        return run_repack(argc, argv);
+    }
+
     if (argc < 2) {
         std::cout << "Usage: " << argv[0] << " <input_file_or_directory> [output_directory] [options]" << std::endl;
+        std::cout << "       " << argv[0] << " inspect <cbz_file_or_directory> [--output <file.json>]" << std::endl;
+        std::cout << "       " << argv[0] << " repack <cbz_file_or_directory> [output_directory] [--progressive]" << std::endl;
         std::cout << "Options:" << std::endl;
         std::cout << "  --cbz                Create a CBZ (Comic Book Archive) file instead of separate images" << std::endl;
         std::cout << "  --clean              Remove individual image files after creating CBZ (requires --cbz)" << std::endl;
         std::cout << "  --format <format>    Output format: png or jpeg (default: jpeg)" << std::endl;
         std::cout << "  --quality <1-100>    JPEG quality (default: 80, ignored for PNG)" << std::endl;
         std::cout << "  --dpi <value>        DPI for image extraction (default: 150)" << std::endl;
-        std::cout << "  --pdf                Convert CBZ archives to PDF documents (JPEG pages only)" << std::endl;
+        std::cout << "  --target-height <px> Render each page at the DPI that makes it this many pixels tall (overrides --dpi)" << std::endl;
+        std::cout << "  --max-long-edge <px> Lower the DPI of any page whose longer side would exceed this many pixels" << std::endl;
+        std::cout << "  --blank-pages <mode> Blank rendered pages: keep, flag (log them) or skip (default: keep)" << std::endl;
+        std::cout << "  --crop               Crop rendered pages to their content, leaving a small border" << std::endl;
+        std::cout << "  --crop-border <px>   Border kept around the content with --crop (default: 8)" << std::endl;
+        std::cout << "  --pdf                Convert CBZ archives to PDF documents (JPEG and PNG pages)" << std::endl;
+        std::cout << "  --pdf-layout <mode>  PDF structure for --pdf: classic, compact or linearized (default: classic)" << std::endl;
+        std::cout << "  --pdf-max-size <s>   With --pdf, shrink JPEG pages to fit WxH or a device: kindle-paperwhite, kobo-clara," << std::endl;
+        std::cout << "                       kobo-libra, remarkable, ipad (smaller pages are copied unchanged)" << std::endl;
+        std::cout << "  --pdf-quality <1-100>  JPEG quality of pages shrunk by --pdf-max-size (default: 85)" << std::endl;
+        std::cout << "  --stats <file>       Write per-file stage timings, byte counts and peak RSS as JSON" << std::endl;
+        std::cout << "  --stats-prometheus <file>  Write the same metrics in Prometheus text format" << std::endl;
+        std::cout << "  --trace <file>       Record a per-thread timeline in Chrome trace-event format (Perfetto)" << std::endl;
+        std::cout << "  --log-level <level>  quiet (errors and warnings), info or debug (per-page detail) (default: info)" << std::endl;
+        std::cout << "  --io-backend <kind>  File I/O: auto, threads or io_uring (default: auto)" << std::endl;
+        std::cout << "  --jobs <n>           Files converted at the same time, costliest first (default: 1)" << std::endl;
+        std::cout << "  --threads <n>        Page workers per file (default: CPUs allowed by affinity and cgroup quota)" << std::endl;
+        std::cout << "  --io-threads <n>     Blocking I/O threads of the threads backend (default: 4)" << std::endl;
+        std::cout << "  --pin-threads        Pin each page worker to one of the allowed CPUs, one set of CPUs per file converting at once" << std::endl;
+        std::cout << "  --processes <n>      Convert files in n worker processes; a crashed or hung worker is replaced" << std::endl;
+        std::cout << "  --job-timeout <s>    With --processes, kill a worker after this long on one file (default: from its estimate)" << std::endl;
+        std::cout << "  --retries <n>        With --processes, retries of a file whose worker crashed or hung (default: 1)" << std::endl;
+        std::cout << "  --queue <dir>        Share the batch with other instances through lease files in a shared directory" << std::endl;
+        std::cout << "  --lease-seconds <s>  With --queue, time after which a lease that is not renewed is reclaimed (default: 60)" << std::endl;
+        std::cout << "  -                    As the output directory: write the CBZ (with --cbz) or PDF (with --pdf) of a single input file to stdout" << std::endl;
         std::cout << "Examples:" << std::endl;
         std::cout << "  " << argv[0] << " document.pdf ./extracted_images" << std::endl;
         std::cout << "  " << argv[0] << " /path/to/pdfs/ ./converted_comics --cbz --clean" << std::endl;
         std::cout << "  " << argv[0] << " document.pdf ./output --format png --dpi 300" << std::endl;
         std::cout << "  " << argv[0] << " document.pdf ./output --format jpeg --quality 90 --dpi 150" << std::endl;
+        std::cout << "  " << argv[0] << " scan.pdf ./output --cbz --crop --blank-pages skip" << std::endl;
+        std::cout << "  " << argv[0] << " /path/to/pdfs/ ./output --cbz --target-height 2400" << std::endl;
         std::cout << "  " << argv[0] << " comic.cbz ./output --pdf" << std::endl;
+        std::cout << "  " << argv[0] << " comic.cbz ./output --pdf --pdf-layout linearized" << std::endl;
+        std::cout << "  " << argv[0] << " /path/to/cbzs/ ./output --pdf --pdf-max-size kobo-libra" << std::endl;
+        std::cout << "  " << argv[0] << " document.pdf - --cbz | ssh host 'cat > document.cbz'" << std::endl;
+        std::cout << "  " << argv[0] << " /path/to/pdfs/ ./output --cbz --stats run.json" << std::endl;
+        std::cout << "  " << argv[0] << " /path/to/pdfs/ ./output --cbz --processes 4 --job-timeout 600" << std::endl;
+        std::cout << "  " << argv[0] << " /mnt/shared/pdfs/ /mnt/shared/out --cbz --queue /mnt/shared/queue" << std::endl;
+        std::cout << "  " << argv[0] << " inspect /path/to/comics/ --output index.json" << std::endl;
+        std::cout << "  " << argv[0] << " repack /path/to/comics/ ./repacked --progressive" << std::endl;
         return 1;
     }
     
@@ -33,6 +440,23 @@ int main(int argc, char* argv[]) {
     std::string format = "jpeg";
     int quality = 80;
     double dpi = 150.0;
+    PageResolution resolution;
+    PageAnalysisOptions page_analysis;
+    PDFLayout pdf_layout = PDFLayout::classic;
+    PageDownscale downscale;
+    std::string stats_path;
+    std::string prometheus_path;
+    std::string trace_path;
+    LogLevel log_level = LogLevel::info;
+    IoBackendKind io_backend = IoBackendKind::automatic;
+    int jobs = 1;
+    bool threads_set = false;
+    ProcessPoolOptions pool;
+    pool.processes = 0;
+    LeaseQueueOptions queue_options;
+    bool worker_process = false;  // started by a pool, see ProcessPool
+    unsigned int worker_slot = 0;
+    bool to_stdout = false;       // output "-": stream the one converted file to stdout
     
     // Parse arguments
     for (int i = 2; i < argc; ++i) {
@@ -61,6 +485,130 @@ int main(int argc, char* argv[]) {
                 std::cerr << "Error: DPI must be greater than 0" << std::endl;
                 return 1;
             }
+        } else if (arg == "--target-height" && i + 1 < argc) {
+            resolution.target_height = std::stoi(argv[++i]);
+            if (resolution.target_height <= 0) {
+                std::cerr << "Error: Target height must be greater than 0" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--max-long-edge" && i + 1 < argc) {
+            resolution.max_long_edge = std::stoi(argv[++i]);
+            if (resolution.max_long_edge <= 0) {
+                std::cerr << "Error: Maximum long edge must be greater than 0" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--blank-pages" && i + 1 < argc) {
+            const std::string mode = argv[++i];
+            if (mode == "keep") {
+                page_analysis.blank_pages = BlankPageMode::keep;
+            } else if (mode == "flag") {
+                page_analysis.blank_pages = BlankPageMode::flag;
+            } else if (mode == "skip") {
+                page_analysis.blank_pages = BlankPageMode::skip;
+            } else {
+                std::cerr << "Error: Blank page mode must be 'keep', 'flag' or 'skip'" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--crop") {
+            page_analysis.crop = true;
+        } else if (arg == "--crop-border" && i + 1 < argc) {
+            page_analysis.crop_border = std::stoi(argv[++i]);
+            if (page_analysis.crop_border < 0) {
+                std::cerr << "Error: Crop border must not be negative" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--pdf-layout" && i + 1 < argc) {
+            const std::string layout = argv[++i];
+            if (layout == "classic") {
+                pdf_layout = PDFLayout::classic;
+            } else if (layout == "compact") {
+                pdf_layout = PDFLayout::compact;
+            } else if (layout == "linearized") {
+                pdf_layout = PDFLayout::linearized;
+            } else {
+                std::cerr << "Error: PDF layout must be 'classic', 'compact' or 'linearized'" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--pdf-max-size" && i + 1 < argc) {
+            if (!parse_max_size(argv[++i], downscale)) {
+                std::cerr << "Error: PDF maximum size must be <width>x<height> or one of: " << device_names() << std::endl;
+                return 1;
+            }
+        } else if (arg == "--pdf-quality" && i + 1 < argc) {
+            downscale.quality = std::stoi(argv[++i]);
+            if (downscale.quality < 1 || downscale.quality > 100) {
+                std::cerr << "Error: PDF quality must be between 1 and 100" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--stats" && i + 1 < argc) {
+            stats_path = argv[++i];
+        } else if (arg == "--stats-prometheus" && i + 1 < argc) {
+            prometheus_path = argv[++i];
+        } else if (arg == "--trace" && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (arg.rfind("--trace=", 0) == 0) {
+            trace_path = arg.substr(8);
+        } else if (arg == "--log-level" && i + 1 < argc) {
+            if (!Log::parse_level(argv[++i], log_level)) {
+                std::cerr << "Error: Log level must be 'quiet', 'info' or 'debug'" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--io-backend" && i + 1 < argc) {
+            const std::string backend = argv[++i];
+            if (backend == "auto") {
+                io_backend = IoBackendKind::automatic;
+            } else if (backend == "threads") {
+                io_backend = IoBackendKind::threads;
+            } else if (backend == "io_uring") {
+                io_backend = IoBackendKind::io_uring;
+            } else {
+                std::cerr << "Error: I/O backend must be 'auto', 'threads' or 'io_uring'" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--jobs" && i + 1 < argc) {
+            jobs = std::stoi(argv[++i]);
+            if (jobs < 1) {
+                std::cerr << "Error: Jobs must be at least 1" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--processes" && i + 1 < argc) {
+            pool.processes = std::stoi(argv[++i]);
+            if (pool.processes < 1) {
+                std::cerr << "Error: Processes must be at least 1" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--job-timeout" && i + 1 < argc) {
+            pool.job_timeout = std::stod(argv[++i]);
+            if (pool.job_timeout <= 0) {
+                std::cerr << "Error: Job timeout must be greater than 0" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--retries" && i + 1 < argc) {
+            pool.retries = std::stoi(argv[++i]);
+            if (pool.retries < 0) {
+                std::cerr << "Error: Retries must not be negative" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--queue" && i + 1 < argc) {
+            queue_options.directory = argv[++i];
+        } else if (arg == "--lease-seconds" && i + 1 < argc) {
+            queue_options.lease_seconds = std::stod(argv[++i]);
+            if (queue_options.lease_seconds <= 0) {
+                std::cerr << "Error: Lease seconds must be greater than 0" << std::endl;
+                return 1;
+            }
+            queue_options.poll_seconds = std::min(queue_options.poll_seconds, queue_options.lease_seconds / 3.0);
+        } else if (arg == "--worker-process") {
+            worker_process = true;
+        } else if (arg == "--worker-slot" && i + 1 < argc) {
+            worker_slot = static_cast<unsigned int>(std::stoul(argv[++i]));
+        } else if (bool invalid = false; parse_concurrency_option(argc, argv, i, invalid)) {
+            if (invalid) {
+                return 1;
+            }
+            threads_set = threads_set || arg == "--threads";
+        } else if (arg == "-") {
+            to_stdout = true;
         } else if (arg[0] != '-') {
             output_dir = arg;
         }
@@ -73,118 +621,257 @@ int main(int argc, char* argv[]) {
             return 1;
         }
     } else {
+        if (downscale.enabled()) {
+            std::cerr << "Error: --pdf-max-size requires --pdf" << std::endl;
+            return 1;
+        }
         if (clean_images && !create_cbz) {
             std::cerr << "Error: --clean option requires --cbz option" << std::endl;
             return 1;
         }
     }
+    if (pool.processes > 0 && jobs > 1) {
+        std::cerr << "Error: --jobs and --processes cannot be combined" << std::endl;
+        return 1;
+    }
+    if (pool.processes > 0 && !queue_options.directory.empty()) {
+        std::cerr << "Error: --queue and --processes cannot be combined" << std::endl;
+        return 1;
+    }
+    if (to_stdout) {
+        if (!create_cbz && !output_pdf) {
+            std::cerr << "Error: Writing to standard output needs --cbz or --pdf" << std::endl;
+            return 1;
+        }
+        if (!std::filesystem::is_regular_file(input_path)) {
+            std::cerr << "Error: Writing to standard output needs a single input file" << std::endl;
+            return 1;
+        }
+        if (pool.processes > 0 || !queue_options.directory.empty()) {
+            std::cerr << "Error: --processes and --queue cannot be combined with writing to standard output" << std::endl;
+            return 1;
+        }
+    }
 
-    std::cout << "Comic Converter" << std::endl;
-    std::cout << "================" << std::endl;
+    Log::set_level(log_level);
+    Log::set_stderr_only(to_stdout);
+    // Messages are written by a background thread from here on; it is drained on return.
+    AsyncLogSession log_session;
+
+    if (!worker_process) {
+        LogMessage(LogLevel::info) << "Comic Converter";
+        LogMessage(LogLevel::info) << "================";
+    }
+
+    IoBackend::set_preferred(io_backend);
+    LogMessage(LogLevel::debug) << "I/O backend: " << IoBackend::name(IoBackend::shared().kind());
+    // Files converting side by side share the CPUs rather than each taking all of them.
+    const int parallel_files = pool.processes > 0 ? pool.processes : jobs;
+    if (parallel_files > 1 && !threads_set) {
+        Concurrency::set_worker_threads(std::max(1u, Concurrency::available_cpus() / static_cast<unsigned int>(parallel_files)));
+    }
+    LogMessage(LogLevel::debug) << "CPUs available: " << Concurrency::describe() << "; page workers per file: "
+                                << Concurrency::worker_threads() << (Concurrency::pinning() ? ", pinned" : "");
+
+    CbzConversionOptions cbz_options;
+    cbz_options.pdf_layout = pdf_layout;
+    cbz_options.downscale = downscale;
+    const OutputWriter stdout_writer = to_stdout ? write_to_stdout() : OutputWriter{};
+    auto convert_cbz = [&](const std::filesystem::path& cbz_path, const ConversionContext& context) {
+        if (to_stdout) {
+            return ConverterService::StreamCbzToPdf(cbz_path, stdout_writer, cbz_options, {}, context);
+        }
+        return ConverterService::ConvertSingleCbz(cbz_path, output_dir, cbz_options, {}, context);
+    };
+
+    PdfConversionOptions pdf_options;
+    pdf_options.create_cbz = create_cbz;
+    pdf_options.clean_images = clean_images;
+    pdf_options.format = format;
+    pdf_options.quality = quality;
+    pdf_options.dpi = dpi;
+    pdf_options.resolution = resolution;
+    pdf_options.page_analysis = page_analysis;
+    auto convert_pdf = [&](const std::filesystem::path& pdf_path, const ConversionContext& context) {
+        if (to_stdout) {
+            return ConverterService::StreamPdfToCbz(pdf_path, stdout_writer, pdf_options, {}, context);
+        }
+        return ConverterService::ConvertSinglePdf(pdf_path, output_dir, pdf_options, {}, context);
+    };
+
+    if (worker_process) {
+        if (output_pdf) {
+            return serve_worker(convert_cbz, worker_slot);
+        }
+        return serve_worker(convert_pdf, worker_slot);
+    }
+    if (pool.processes > 0) {
+        // Workers run this program again with the same options.
+#ifdef __linux__
+        pool.worker_command.push_back("/proc/self/exe");
+#else
+        pool.worker_command.push_back(argv[0]);
+#endif
+        pool.worker_command.insert(pool.worker_command.end(), argv + 1, argv + argc);
+        pool.worker_command.push_back("--worker-process");
+        pool.slot_option = "--worker-slot";
+    }
     
     int successful = 0;
     int failed = 0;
+
+    const bool collect_stats = !stats_path.empty() || !prometheus_path.empty();
+    RunReport report;
+    report.begin();
+
+    if (!trace_path.empty()) {
+        Trace::start();
+        Trace::set_thread_name("main");
+    }
+
+    BatchMode batch_mode;
+    batch_mode.jobs = jobs;
+    batch_mode.pool = pool;
+    batch_mode.collect_stats = collect_stats;
+    std::unique_ptr<LeaseQueue> queue;
+    if (!queue_options.directory.empty()) {
+        queue = std::make_unique<LeaseQueue>(queue_options);
+        if (!queue->open()) {
+            LogMessage(LogLevel::error) << "Error: " << queue->error();
+            return 1;
+        }
+        batch_mode.queue = queue.get();
+    }
     
     if (output_pdf) {
         std::vector<std::filesystem::path> cbz_files;
 
         if (std::filesystem::is_directory(input_path)) {
-            std::cout << "Input directory: " << input_path << std::endl;
+            LogMessage(LogLevel::info) << "Input directory: " << input_path;
             cbz_files = ConverterService::FindCbzFiles(input_path);
 
             if (cbz_files.empty()) {
-                std::cerr << "No CBZ files found in directory: " << input_path << std::endl;
+                LogMessage(LogLevel::error) << "No CBZ files found in directory: " << input_path;
                 return 1;
             }
 
-            std::cout << "Found " << cbz_files.size() << " CBZ files" << std::endl;
+            LogMessage(LogLevel::info) << "Found " << cbz_files.size() << " CBZ files";
         } else if (std::filesystem::is_regular_file(input_path)) {
             std::string extension = std::filesystem::path(input_path).extension().string();
             std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
             if (extension != ".cbz") {
-                std::cerr << "Error: Input file is not a CBZ archive: " << input_path << std::endl;
+                LogMessage(LogLevel::error) << "Error: Input file is not a CBZ archive: " << input_path;
                 return 1;
             }
-            std::cout << "Input file: " << input_path << std::endl;
+            LogMessage(LogLevel::info) << "Input file: " << input_path;
             cbz_files.emplace_back(input_path);
         } else {
-            std::cerr << "Error: Input path does not exist or is not accessible: " << input_path << std::endl;
+            LogMessage(LogLevel::error) << "Error: Input path does not exist or is not accessible: " << input_path;
             return 1;
         }
 
-        std::cout << "Output directory: " << output_dir << std::endl;
-        std::cout << "Mode: PDF output" << std::endl;
+        LogMessage(LogLevel::info) << "Output directory: " << (to_stdout ? "standard output" : output_dir);
+        LogMessage(LogLevel::info) << "Mode: PDF output";
+        if (downscale.enabled()) {
+            LogMessage(LogLevel::info) << "Largest page: " << downscale.max_width << "x" << downscale.max_height
+                                       << " px (larger JPEG pages re-encoded at quality " << downscale.quality << ")";
+        }
 
+        std::vector<JobEstimate> estimates;
         for (const auto& cbz_path : cbz_files) {
-            if (ConverterService::ConvertSingleCbz(cbz_path, output_dir)) {
-                successful++;
-            } else {
-                failed++;
-            }
+            estimates.push_back(BatchPlanner::estimate_cbz(cbz_path.string()));
         }
+        run_batch(cbz_files, estimates, batch_mode, convert_cbz,
+            [&](const std::filesystem::path& cbz_path) {
+                if (to_stdout) {
+                    return std::string("-");
+                }
+                return (std::filesystem::path(output_dir) / (cbz_path.stem().string() + ".pdf")).string();
+            },
+            report, successful, failed);
     } else {
         std::vector<std::filesystem::path> pdf_files;
 
         if (std::filesystem::is_directory(input_path)) {
-            std::cout << "Input directory: " << input_path << std::endl;
+            LogMessage(LogLevel::info) << "Input directory: " << input_path;
             pdf_files = ConverterService::FindPdfFiles(input_path);
 
             if (pdf_files.empty()) {
-                std::cerr << "No PDF files found in directory: " << input_path << std::endl;
+                LogMessage(LogLevel::error) << "No PDF files found in directory: " << input_path;
                 return 1;
             }
 
-            std::cout << "Found " << pdf_files.size() << " PDF files" << std::endl;
+            LogMessage(LogLevel::info) << "Found " << pdf_files.size() << " PDF files";
         } else if (std::filesystem::is_regular_file(input_path)) {
             std::string extension = std::filesystem::path(input_path).extension().string();
             std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
             if (extension != ".pdf") {
-                std::cerr << "Error: Input file is not a PDF: " << input_path << std::endl;
+                LogMessage(LogLevel::error) << "Error: Input file is not a PDF: " << input_path;
                 return 1;
             }
-            std::cout << "Input PDF: " << input_path << std::endl;
+            LogMessage(LogLevel::info) << "Input PDF: " << input_path;
             pdf_files.emplace_back(input_path);
         } else {
-            std::cerr << "Error: Input path does not exist or is not accessible: " << input_path << std::endl;
+            LogMessage(LogLevel::error) << "Error: Input path does not exist or is not accessible: " << input_path;
             return 1;
         }
 
-        std::cout << "Output directory: " << output_dir << std::endl;
-        std::cout << "Mode: PDF to images" << std::endl;
-        std::cout << "Image format: " << format << std::endl;
+        LogMessage(LogLevel::info) << "Output directory: " << (to_stdout ? "standard output" : output_dir);
+        LogMessage(LogLevel::info) << "Mode: PDF to images";
+        LogMessage(LogLevel::info) << "Image format: " << format;
         if (format == "jpeg") {
-            std::cout << "JPEG quality: " << quality << std::endl;
+            LogMessage(LogLevel::info) << "JPEG quality: " << quality;
+        }
+        if (resolution.target_height > 0) {
+            LogMessage(LogLevel::info) << "Page height: " << resolution.target_height << " px (DPI chosen per page)";
+        } else {
+            LogMessage(LogLevel::info) << "DPI: " << dpi;
+        }
+        if (resolution.max_long_edge > 0) {
+            LogMessage(LogLevel::info) << "Longest page edge: at most " << resolution.max_long_edge << " px";
         }
-        std::cout << "DPI: " << dpi << std::endl;
         if (create_cbz) {
-            std::cout << "Output format: CBZ (Comic Book Archive)" << std::endl;
+            LogMessage(LogLevel::info) << "Output format: CBZ (Comic Book Archive)";
             if (clean_images) {
-                std::cout << "Clean mode: Individual images will be removed after CBZ creation" << std::endl;
+                LogMessage(LogLevel::info) << "Clean mode: Individual images will be removed after CBZ creation";
             }
         } else {
-            std::cout << "Output format: Individual " << format << " images" << std::endl;
+            LogMessage(LogLevel::info) << "Output format: Individual " << format << " images";
         }
 
-        PdfConversionOptions pdf_options;
-        pdf_options.create_cbz = create_cbz;
-        pdf_options.clean_images = clean_images;
-        pdf_options.format = format;
-        pdf_options.quality = quality;
-        pdf_options.dpi = dpi;
-
+        std::vector<JobEstimate> estimates;
         for (const auto& pdf_path : pdf_files) {
-            if (ConverterService::ConvertSinglePdf(pdf_path, output_dir, pdf_options)) {
-                successful++;
-            } else {
-                failed++;
-            }
+            // Worker processes are there to contain documents that crash Poppler, so this
+            // process does not open them.
+            estimates.push_back(pool.processes > 0 ? BatchPlanner::estimate_pdf_size(pdf_path.string())
+                                                   : BatchPlanner::estimate_pdf(pdf_path.string(), dpi, resolution, format));
         }
+        run_batch(pdf_files, estimates, batch_mode, convert_pdf,
+            [&](const std::filesystem::path& pdf_path) {
+                if (to_stdout) {
+                    return std::string("-");
+                }
+                const std::string output_name = pdf_path.stem().string() + (create_cbz ? ".cbz" : "");
+                return (std::filesystem::path(output_dir) / output_name).string();
+            },
+            report, successful, failed);
     }
     
-    std::cout << "\n" << std::string(50, '=') << std::endl;
-    std::cout << "Processing complete!" << std::endl;
-    std::cout << "Successful: " << successful << std::endl;
-    std::cout << "Failed: " << failed << std::endl;
+    LogMessage(LogLevel::info) << "\n" << std::string(50, '=');
+    LogMessage(LogLevel::info) << "Processing complete!";
+    LogMessage(LogLevel::info) << "Successful: " << successful;
+    LogMessage(LogLevel::info) << "Failed: " << failed;
+
+    report.finish();
+    if (!stats_path.empty() && report.write_json(stats_path)) {
+        LogMessage(LogLevel::info) << "Statistics written to: " << stats_path;
+    }
+    if (!prometheus_path.empty() && report.write_prometheus(prometheus_path)) {
+        LogMessage(LogLevel::info) << "Prometheus metrics written to: " << prometheus_path;
+    }
+    if (!trace_path.empty() && Trace::write(trace_path)) {
+        LogMessage(LogLevel::info) << "Trace written to: " << trace_path;
+    }
     
     if (failed > 0) {
         return 1;
@@ -0,0 +1,562 @@
+#include "output_sink.h"
+#include "io_backend.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <malloc.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+namespace {
+constexpr std::size_t kBufferAlignment = 4096;
+
+char* allocate_aligned(std::size_t size) {
+#ifdef _WIN32
+    return static_cast<char*>(_aligned_malloc(size, kBufferAlignment));
+#else
+    return static_cast<char*>(std::aligned_alloc(kBufferAlignment, size));
+#endif
+}
+
+void free_aligned(char* buffer) {
+#ifdef _WIN32
+    _aligned_free(buffer);
+#else
+    std::free(buffer);
+#endif
+}
+
+int open_for_write(const std::string& path) {
+#ifdef _WIN32
+    return _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    return ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+#endif
+}
+
+// Creates a uniquely named file next to path for atomic replacement.
+int open_temporary(const std::string& path, std::string& temporary_path) {
+#ifdef _WIN32
+    temporary_path = path + ".partial";
+    return open_for_write(temporary_path);
+#else
+    std::string name = path + ".tmp-XXXXXX";
+    std::vector<char> pattern(name.begin(), name.end());
+    pattern.push_back('\0');
+    const int fd = ::mkstemp(pattern.data());
+    if (fd >= 0) {
+        ::fchmod(fd, 0644);
+        temporary_path.assign(pattern.data());
+    }
+    return fd;
+#endif
+}
+
+bool write_all(int fd, const char* data, std::size_t length) {
+    while (length > 0) {
+#ifdef _WIN32
+        const unsigned int chunk = static_cast<unsigned int>(std::min<std::size_t>(length, 1u << 30));
+        const int written = _write(fd, data, chunk);
+#else
+        const ssize_t written = ::write(fd, data, length);
+#endif
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= static_cast<std::size_t>(written);
+    }
+    return true;
+}
+
+bool sync_file(int fd, SyncMode mode) {
+    if (mode == SyncMode::none) {
+        return true;
+    }
+#ifdef _WIN32
+    return _commit(fd) == 0;
+#elif defined(__APPLE__)
+    (void)mode;
+    return ::fsync(fd) == 0;
+#else
+    return (mode == SyncMode::fdatasync ? ::fdatasync(fd) : ::fsync(fd)) == 0;
+#endif
+}
+
+// Makes a rename durable by syncing the directory that holds the target.
+void sync_parent_directory(const std::string& path) {
+#ifndef _WIN32
+    auto parent = std::filesystem::path(path).parent_path();
+    if (parent.empty()) {
+        parent = ".";
+    }
+    const int fd = ::open(parent.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+#else
+    (void)path;
+#endif
+}
+
+void close_fd(int fd) {
+#ifdef _WIN32
+    _close(fd);
+#else
+    ::close(fd);
+#endif
+}
+
+#ifndef _WIN32
+// Copies length bytes starting at offset of in_fd to the current position of out_fd
+// without staging them in a user-space buffer: copy_file_range (reflink/in-kernel copy
+// on the same filesystem), then sendfile, and finally write() from an mmap of the input.
+bool copy_range(int in_fd, std::uint64_t offset, int out_fd, std::uint64_t length) {
+    auto in_offset = static_cast<off_t>(offset);
+    std::uint64_t remaining = length;
+
+#ifdef __linux__
+    bool try_copy_file_range = true;
+    bool try_sendfile = true;
+    while (remaining > 0 && (try_copy_file_range || try_sendfile)) {
+        ssize_t copied = 0;
+        if (try_copy_file_range) {
+            copied = ::copy_file_range(in_fd, &in_offset, out_fd, nullptr, remaining, 0);
+        } else {
+            copied = ::sendfile(out_fd, in_fd, &in_offset, remaining);
+        }
+
+        if (copied > 0) {
+            remaining -= static_cast<std::uint64_t>(copied);
+            continue;
+        }
+        if (copied < 0 && errno == EINTR) {
+            continue;
+        }
+        if (copied < 0 && errno != EXDEV && errno != EINVAL && errno != ENOSYS &&
+            errno != EOPNOTSUPP && errno != EBADF) {
+            return false;
+        }
+        // Unsupported for this pair of files (or unexpected EOF): try the next mechanism.
+        if (try_copy_file_range) {
+            try_copy_file_range = false;
+        } else {
+            try_sendfile = false;
+        }
+    }
+#endif
+
+    if (remaining == 0) {
+        return true;
+    }
+
+    const long page_size = ::sysconf(_SC_PAGESIZE);
+    const off_t aligned_offset = in_offset - (in_offset % page_size);
+    const std::size_t lead = static_cast<std::size_t>(in_offset - aligned_offset);
+    const std::size_t map_length = lead + static_cast<std::size_t>(remaining);
+    void* mapping = ::mmap(nullptr, map_length, PROT_READ, MAP_PRIVATE, in_fd, aligned_offset);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+
+    const bool ok = write_all(out_fd, static_cast<const char*>(mapping) + lead, static_cast<std::size_t>(remaining));
+    ::munmap(mapping, map_length);
+    return ok;
+}
+#endif
+}
+
+// Double buffering for async sinks: buffer_ is filled while spare is being written.
+struct OutputSink::AsyncState {
+    char* spare = nullptr;
+    IoBatch writes[2];  // in-flight write of buffer_ (current) and spare (the other)
+    int current = 0;
+    IoBatch external;   // write_external() payloads
+
+    ~AsyncState() {
+        free_aligned(spare);
+    }
+};
+
+OutputSink::OutputSink(OutputSinkOptions options)
+    : options_(options) {
+    // aligned_alloc requires a size that is a multiple of the alignment.
+    buffer_capacity_ = std::max(kBufferAlignment, (options_.buffer_size + kBufferAlignment - 1) / kBufferAlignment * kBufferAlignment);
+}
+
+OutputSink::~OutputSink() {
+    if (!committed_) {
+        discard();
+    }
+    close_files();
+    // AsyncState's batches wait for any write still using buffer_ before it is freed.
+    async_.reset();
+    free_aligned(buffer_);
+}
+
+OutputWriter append_to_buffer(std::vector<std::uint8_t>& buffer) {
+    return [&buffer](const void* data, std::size_t size) {
+        const auto* bytes = static_cast<const std::uint8_t*>(data);
+        buffer.insert(buffer.end(), bytes, bytes + size);
+        return true;
+    };
+}
+
+OutputWriter write_to_stdout() {
+#ifdef _WIN32
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    return [](const void* data, std::size_t size) {
+        return std::fwrite(data, 1, size, stdout) == size && std::fflush(stdout) == 0;
+    };
+}
+
+bool OutputSink::open(const std::string& path) {
+    if (fd_ >= 0 || writer_) {
+        return fail("Output sink is already open: " + path_);
+    }
+
+    path_ = path;
+    committed_ = false;
+    offset_ = 0;
+    buffered_ = 0;
+    error_.clear();
+
+    if (!buffer_) {
+        buffer_ = allocate_aligned(buffer_capacity_);
+        if (!buffer_) {
+            return fail("Failed to allocate output buffer");
+        }
+    }
+    if (options_.async && !async_) {
+        async_ = std::make_unique<AsyncState>();
+        async_->spare = allocate_aligned(buffer_capacity_);
+        if (!async_->spare) {
+            return fail("Failed to allocate output buffer");
+        }
+    }
+
+    const auto parent_dir = std::filesystem::path(path).parent_path();
+    if (!parent_dir.empty()) {
+        std::error_code ec;
+        std::filesystem::create_directories(parent_dir, ec);
+    }
+
+    if (options_.atomic) {
+        fd_ = open_temporary(path, write_path_);
+    } else {
+        write_path_ = path;
+        fd_ = open_for_write(path);
+    }
+
+    if (fd_ < 0) {
+        return fail("Failed to open output file: " + path + " (" + std::strerror(errno) + ")");
+    }
+    return true;
+}
+
+bool OutputSink::open(OutputWriter writer) {
+    if (fd_ >= 0 || writer_) {
+        return fail("Output sink is already open: " + path_);
+    }
+
+    path_ = "output stream";
+    committed_ = false;
+    offset_ = 0;
+    buffered_ = 0;
+    error_.clear();
+    write_path_.clear();
+    // Writes go to the caller on this thread; a buffer pair left by an earlier async
+    // file is released once its writes are done.
+    async_.reset();
+
+    if (!buffer_) {
+        buffer_ = allocate_aligned(buffer_capacity_);
+        if (!buffer_) {
+            return fail("Failed to allocate output buffer");
+        }
+    }
+    if (!writer) {
+        return fail("No output writer given");
+    }
+    writer_ = std::move(writer);
+    return true;
+}
+
+bool OutputSink::write(const void* data, std::size_t size) {
+    if (!ok()) {
+        return false;
+    }
+
+    const char* bytes = static_cast<const char*>(data);
+    if (async_) {
+        // The caller's memory may be reused as soon as this returns, so everything is
+        // staged through the buffers.
+        while (size > 0) {
+            const std::size_t chunk = std::min(size, buffer_capacity_ - buffered_);
+            std::memcpy(buffer_ + buffered_, bytes, chunk);
+            buffered_ += chunk;
+            offset_ += chunk;
+            bytes += chunk;
+            size -= chunk;
+            if (buffered_ == buffer_capacity_ && !flush_buffer()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    if (size >= buffer_capacity_) {
+        // Large payloads bypass the buffer entirely.
+        if (!flush_buffer() || !write_direct(bytes, size)) {
+            return false;
+        }
+        offset_ += size;
+        return true;
+    }
+
+    if (buffered_ + size > buffer_capacity_ && !flush_buffer()) {
+        return false;
+    }
+    std::memcpy(buffer_ + buffered_, bytes, size);
+    buffered_ += size;
+    offset_ += size;
+    return true;
+}
+
+bool OutputSink::write(std::string_view text) {
+    return write(text.data(), text.size());
+}
+
+bool OutputSink::write_number(std::uint64_t value) {
+    char digits[24];
+    const auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    return write(digits, static_cast<std::size_t>(result.ptr - digits));
+}
+
+bool OutputSink::write_external(const void* data, std::size_t size) {
+    if (!async_) {
+        return write(data, size);
+    }
+    // Buffered bytes precede data in the file, so they are submitted first.
+    if (!ok() || !flush_buffer()) {
+        return false;
+    }
+    IoBackend::shared().write(async_->external, fd_, data, size, offset_);
+    offset_ += size;
+    return true;
+}
+
+bool OutputSink::append_file_range(const std::string& path, std::uint64_t offset, std::uint64_t length) {
+    if (!ok() || !flush_buffer()) {
+        return false;
+    }
+    if (writer_) {
+        return copy_through_buffer(path, offset, length);
+    }
+    // Async writes are positional and leave the file position alone; the copy below
+    // writes at the file position, so settle the writes and move it to the end.
+    if (async_) {
+        if (!wait_for_writes()) {
+            return false;
+        }
+#ifdef _WIN32
+        _lseeki64(fd_, static_cast<__int64>(offset_), SEEK_SET);
+#else
+        ::lseek(fd_, static_cast<off_t>(offset_), SEEK_SET);
+#endif
+    }
+
+#ifndef _WIN32
+    if (source_fd_ < 0 || source_path_ != path) {
+        if (source_fd_ >= 0) {
+            ::close(source_fd_);
+        }
+        source_path_ = path;
+        source_fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (source_fd_ < 0) {
+            return fail("Failed to open " + path + " (" + std::strerror(errno) + ")");
+        }
+    }
+
+    if (!copy_range(source_fd_, offset, fd_, length)) {
+        return fail("Failed to copy data from " + path + " (" + std::strerror(errno) + ")");
+    }
+    offset_ += length;
+    return true;
+#else
+    return copy_through_buffer(path, offset, length);
+#endif
+}
+
+bool OutputSink::flush() {
+    return ok() && flush_buffer();
+}
+
+std::uint64_t OutputSink::offset() const {
+    return offset_;
+}
+
+bool OutputSink::commit() {
+    if (!ok() || !flush_buffer() || (async_ && !wait_for_writes())) {
+        return false;
+    }
+    if (writer_) {
+        writer_ = nullptr;
+        committed_ = true;
+        return true;
+    }
+
+    if (!sync_file(fd_, options_.sync)) {
+        return fail("Failed to sync " + path_ + " (" + std::strerror(errno) + ")");
+    }
+
+    close_files();
+
+    if (options_.atomic) {
+        std::error_code ec;
+        std::filesystem::rename(write_path_, path_, ec);
+        if (ec) {
+            std::filesystem::remove(write_path_, ec);
+            return fail("Failed to move output into place: " + path_);
+        }
+        if (options_.sync != SyncMode::none) {
+            sync_parent_directory(path_);
+        }
+    }
+
+    write_path_.clear();
+    committed_ = true;
+    return true;
+}
+
+void OutputSink::discard() {
+    if (async_) {
+        // Nothing may still be writing into the file or out of our buffers.
+        async_->writes[0].wait();
+        async_->writes[1].wait();
+        async_->external.wait();
+    }
+    close_files();
+    if (!write_path_.empty()) {
+        std::error_code ec;
+        std::filesystem::remove(write_path_, ec);
+        write_path_.clear();
+    }
+    buffered_ = 0;
+}
+
+bool OutputSink::ok() const {
+    return (fd_ >= 0 || writer_) && error_.empty();
+}
+
+const std::string& OutputSink::error() const {
+    return error_;
+}
+
+bool OutputSink::flush_buffer() {
+    if (buffered_ == 0) {
+        return true;
+    }
+    if (async_) {
+        AsyncState& state = *async_;
+        IoBackend::shared().write(state.writes[state.current], fd_, buffer_, buffered_, offset_ - buffered_);
+        buffered_ = 0;
+        state.current ^= 1;
+        std::swap(buffer_, state.spare);
+        // The buffer switched to may still be on its way to storage.
+        if (!state.writes[state.current].wait()) {
+            return fail("Failed writing to " + path_ + ": " + state.writes[state.current].error());
+        }
+        return true;
+    }
+    if (!write_direct(buffer_, buffered_)) {
+        return false;
+    }
+    buffered_ = 0;
+    return true;
+}
+
+bool OutputSink::write_direct(const char* data, std::size_t size) {
+    if (writer_) {
+        return writer_(data, size) || fail("Failed writing to " + path_);
+    }
+    if (!write_all(fd_, data, size)) {
+        return fail("Failed writing to " + path_ + " (" + std::strerror(errno) + ")");
+    }
+    return true;
+}
+
+// Reads a byte range of another file through the sink's own buffer, where the data
+// cannot be moved file-to-file.
+bool OutputSink::copy_through_buffer(const std::string& path, std::uint64_t offset, std::uint64_t length) {
+    std::ifstream input(path, std::ios::binary);
+    input.seekg(static_cast<std::streamoff>(offset));
+    std::uint64_t remaining = length;
+    while (input && remaining > 0) {
+        const auto chunk = static_cast<std::streamsize>(std::min<std::uint64_t>(remaining, buffer_capacity_));
+        input.read(buffer_, chunk);
+        const auto read = static_cast<std::size_t>(input.gcount());
+        if (!write_direct(buffer_, read)) {
+            return false;
+        }
+        remaining -= read;
+        offset_ += read;
+    }
+    return remaining == 0 || fail("Failed to copy data from " + path);
+}
+
+bool OutputSink::wait_for_writes() {
+    for (IoBatch* batch : {&async_->writes[0], &async_->writes[1], &async_->external}) {
+        if (!batch->wait()) {
+            return fail("Failed writing to " + path_ + ": " + batch->error());
+        }
+    }
+    return true;
+}
+
+bool OutputSink::fail(const std::string& message) {
+    if (error_.empty()) {
+        error_ = message;
+    }
+    return false;
+}
+
+void OutputSink::close_files() {
+    writer_ = nullptr;
+    if (fd_ >= 0) {
+        close_fd(fd_);
+        fd_ = -1;
+    }
+#ifndef _WIN32
+    if (source_fd_ >= 0) {
+        ::close(source_fd_);
+        source_fd_ = -1;
+    }
+#endif
+}
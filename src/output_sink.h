@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class SyncMode {
+    none,       // leave write-back to the OS
+    fdatasync,  // flush file data before commit
+    fsync       // flush file data and metadata before commit
+};
+
+// Receives output bytes in order, for output that goes to memory or a socket rather
+// than a file. Returning false fails the write.
+using OutputWriter = std::function<bool(const void* data, std::size_t size)>;
+
+// An OutputWriter that appends to buffer, which must outlive the writer.
+OutputWriter append_to_buffer(std::vector<std::uint8_t>& buffer);
+// An OutputWriter for standard output (switched to binary mode on Windows), which may
+// be a pipe. Each piece is flushed as it arrives so a reader sees it straight away.
+OutputWriter write_to_stdout();
+
+struct OutputSinkOptions {
+    std::size_t buffer_size = 4 * 1024 * 1024;
+    SyncMode sync = SyncMode::none;
+    // Write to a temporary file next to the target and rename it into place on commit,
+    // so readers never observe a partially written file.
+    bool atomic = true;
+    // Hand full buffers to IoBackend and keep filling a second one while the first is
+    // written, so the producing thread does not wait on storage between flushes.
+    bool async = false;
+};
+
+// Buffered, offset-tracking file writer shared by the PDF and page writers. Output is
+// staged in a page-aligned buffer and handed to the kernel in large writes; numbers are
+// formatted with std::to_chars straight into that buffer. Nothing becomes visible at
+// the target path until commit(); destroying an uncommitted sink removes its output.
+class OutputSink {
+public:
+    explicit OutputSink(OutputSinkOptions options = {});
+    ~OutputSink();
+
+    OutputSink(const OutputSink&) = delete;
+    OutputSink& operator=(const OutputSink&) = delete;
+
+    bool open(const std::string& path);
+    // Hands the output to writer in buffer-sized pieces instead of writing a file; the
+    // atomic, async and sync options do not apply. Bytes already handed over stay with
+    // the writer's owner when the sink is discarded, so it should drop them unless
+    // commit() succeeds.
+    bool open(OutputWriter writer);
+
+    bool write(const void* data, std::size_t size);
+    bool write(std::string_view text);
+    bool write_number(std::uint64_t value);
+
+    // Queues size bytes to be written straight from data, without copying them into the
+    // sink's buffer; data must stay valid until commit() or discard(). Without async
+    // this is the same as write().
+    bool write_external(const void* data, std::size_t size);
+
+    // Appends a byte range of another file. Where the platform allows it the bytes are
+    // moved by the kernel (copy_file_range/sendfile) or written from an mmap of the
+    // source, never through this sink's buffer.
+    bool append_file_range(const std::string& path, std::uint64_t offset, std::uint64_t length);
+
+    // Hands everything buffered so far to the file or writer without committing, e.g.
+    // so that a reader at the other end of a pipe can start on it.
+    bool flush();
+
+    // Number of bytes written so far, i.e. the offset of the next byte in the file.
+    std::uint64_t offset() const;
+
+    bool commit();
+    void discard();
+
+    bool ok() const;
+    const std::string& error() const;
+
+private:
+    struct AsyncState;
+
+    bool flush_buffer();
+    bool write_direct(const char* data, std::size_t size);
+    bool copy_through_buffer(const std::string& path, std::uint64_t offset, std::uint64_t length);
+    bool wait_for_writes();
+    bool fail(const std::string& message);
+    void close_files();
+
+    OutputSinkOptions options_;
+    std::string path_;
+    std::string write_path_;
+    int fd_ = -1;
+    OutputWriter writer_;
+    int source_fd_ = -1;
+    std::string source_path_;
+    char* buffer_ = nullptr;
+    std::size_t buffer_capacity_ = 0;
+    std::size_t buffered_ = 0;
+    std::uint64_t offset_ = 0;
+    bool committed_ = false;
+    std::string error_;
+    std::unique_ptr<AsyncState> async_;
+};
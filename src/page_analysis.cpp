@@ -0,0 +1,166 @@
+#include "page_analysis.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PAGE_ANALYSIS_SSE2 1
+#endif
+
+namespace {
+int bytes_per_pixel(PixelFormat format) {
+    switch (format) {
+    case PixelFormat::gray8:
+        return 1;
+    case PixelFormat::rgb24:
+    case PixelFormat::bgr24:
+        return 3;
+    case PixelFormat::argb32:
+    default:
+        return 4;
+    }
+}
+
+// Scans rows as plain bytes. For argb32 the alpha byte of every pixel is forced to
+// 0xFF first, so only colour channels can count as ink; the pattern repeats every four
+// bytes, so it lines up with any 16-byte block that starts on a pixel boundary.
+class RowScanner {
+public:
+    RowScanner(PixelFormat format, int white_threshold)
+        : threshold_(static_cast<std::uint8_t>(std::clamp(white_threshold, 1, 255))) {
+        if (format == PixelFormat::argb32) {
+            const std::size_t alpha = std::endian::native == std::endian::little ? 3 : 0;
+            for (std::size_t i = alpha; i < sizeof(ignore_); i += 4) {
+                ignore_[i] = 0xFF;
+            }
+        }
+#ifdef PAGE_ANALYSIS_SSE2
+        ignore_vector_ = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ignore_));
+        threshold_vector_ = _mm_set1_epi8(static_cast<char>(threshold_));
+#endif
+    }
+
+    // Offset of the first ink byte in [begin, end), or end if there is none. begin
+    // must be a multiple of 4 for argb32.
+    std::size_t first_ink(const std::uint8_t* row, std::size_t begin, std::size_t end) const {
+        std::size_t i = begin;
+#ifdef PAGE_ANALYSIS_SSE2
+        for (; i + 16 <= end; i += 16) {
+            const int mask = ink_mask(row + i);
+            if (mask != 0) {
+                return i + static_cast<std::size_t>(std::countr_zero(static_cast<unsigned>(mask)));
+            }
+        }
+#endif
+        for (; i < end; ++i) {
+            if (is_ink(row[i], i)) {
+                return i;
+            }
+        }
+        return end;
+    }
+
+    // One past the offset of the last ink byte in [begin, end), or begin if there is
+    // none. end must be a multiple of 4 for argb32 (true of any row's byte width).
+    std::size_t last_ink(const std::uint8_t* row, std::size_t begin, std::size_t end) const {
+        std::size_t i = end;
+#ifdef PAGE_ANALYSIS_SSE2
+        for (; i >= begin + 16; i -= 16) {
+            const int mask = ink_mask(row + i - 16);
+            if (mask != 0) {
+                return i - 16 + 32 - static_cast<std::size_t>(std::countl_zero(static_cast<unsigned>(mask)));
+            }
+        }
+#endif
+        for (; i > begin; --i) {
+            if (is_ink(row[i - 1], i - 1)) {
+                return i;
+            }
+        }
+        return begin;
+    }
+
+private:
+    bool is_ink(std::uint8_t value, std::size_t offset) const {
+        return static_cast<std::uint8_t>(value | ignore_[offset % 16]) < threshold_;
+    }
+
+#ifdef PAGE_ANALYSIS_SSE2
+    // Bit i set when byte i of the block is below the threshold.
+    int ink_mask(const std::uint8_t* block) const {
+        const __m128i values = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block)), ignore_vector_);
+        const __m128i paper = _mm_cmpeq_epi8(_mm_max_epu8(values, threshold_vector_), values);
+        return ~_mm_movemask_epi8(paper) & 0xFFFF;
+    }
+
+    __m128i ignore_vector_;
+    __m128i threshold_vector_;
+#endif
+    std::uint8_t ignore_[16] = {};
+    std::uint8_t threshold_;
+};
+}
+
+PageContent PageAnalysis::find_content(const PixelBuffer& pixels, int white_threshold) {
+    PageContent content;
+    if (!pixels.data || pixels.width <= 0 || pixels.height <= 0) {
+        return content;
+    }
+
+    const RowScanner scanner(pixels.format, white_threshold);
+    const int pixel_size = bytes_per_pixel(pixels.format);
+    const std::size_t row_size = static_cast<std::size_t>(pixels.width) * static_cast<std::size_t>(pixel_size);
+
+    // Byte range [left, right) holding all ink found so far.
+    std::size_t left = row_size;
+    std::size_t right = 0;
+    for (int y = 0; y < pixels.height; ++y) {
+        const std::uint8_t* row = pixels.data + static_cast<std::size_t>(y) * static_cast<std::size_t>(pixels.stride);
+        const std::size_t first = scanner.first_ink(row, 0, row_size);
+        if (first == row_size) {
+            continue;
+        }
+        if (content.blank) {
+            content.blank = false;
+            content.top = y;
+        }
+        content.bottom = y + 1;
+        left = std::min(left, first);
+        // Ink at or left of the known right edge cannot move it.
+        right = std::max(right, scanner.last_ink(row, std::max(first, right), row_size));
+    }
+
+    if (!content.blank) {
+        content.left = static_cast<int>(left / static_cast<std::size_t>(pixel_size));
+        content.right = static_cast<int>((right - 1) / static_cast<std::size_t>(pixel_size)) + 1;
+    }
+    return content;
+}
+
+PixelBuffer PageAnalysis::crop(const PixelBuffer& pixels, const PageContent& content, int border) {
+    if (content.blank) {
+        return pixels;
+    }
+    const int left = std::max(0, content.left - border);
+    const int top = std::max(0, content.top - border);
+    const int right = std::min(pixels.width, content.right + border);
+    const int bottom = std::min(pixels.height, content.bottom + border);
+
+    PixelBuffer cropped = pixels;
+    cropped.data = pixels.data + static_cast<std::size_t>(top) * static_cast<std::size_t>(pixels.stride) +
+                   static_cast<std::size_t>(left) * static_cast<std::size_t>(bytes_per_pixel(pixels.format));
+    cropped.width = right - left;
+    cropped.height = bottom - top;
+    return cropped;
+}
+
+const char* PageAnalysis::implementation() {
+#ifdef PAGE_ANALYSIS_SSE2
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
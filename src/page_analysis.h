@@ -0,0 +1,48 @@
+#pragma once
+
+#include "image_encoder.h"
+
+enum class BlankPageMode {
+    keep,  // write blank pages like any other
+    flag,  // write them, but report them in the log and in ImageInfo::blank
+    skip   // leave them out of the output
+};
+
+struct PageAnalysisOptions {
+    BlankPageMode blank_pages = BlankPageMode::keep;
+    // Crops each page to its content bounding box plus crop_border pixels on every side
+    // (clamped to the page), so margins are neither encoded nor stored.
+    bool crop = false;
+    int crop_border = 8;
+    // Channel values at or above this count as paper, so faint scanner noise and
+    // antialiasing at the edge of the paper do not count as content.
+    int white_threshold = 245;
+
+    bool enabled() const {
+        return blank_pages != BlankPageMode::keep || crop;
+    }
+};
+
+// Content bounding box of a rendered page in pixels; right and bottom are exclusive.
+struct PageContent {
+    bool blank = true;
+    int left = 0;
+    int top = 0;
+    int right = 0;
+    int bottom = 0;
+};
+
+// Finds the non-white area of a rendered page before it is encoded. Rows are scanned
+// 16 bytes at a time with SSE2 where available, and each row stops as soon as it
+// reaches the part of the box already known, so the cost is mostly the margins and
+// blank rows rather than the whole page.
+class PageAnalysis {
+public:
+    static PageContent find_content(const PixelBuffer& pixels, int white_threshold);
+
+    // The part of pixels inside content, grown by border; shares pixels' memory.
+    static PixelBuffer crop(const PixelBuffer& pixels, const PageContent& content, int border);
+
+    // "sse2" or "scalar", for logs and benchmarks.
+    static const char* implementation();
+};
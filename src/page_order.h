@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Page ordering used for images inside CBZ archives: entries are ordered by the first
+// number in their file stem ("page2" before "page10"), then by stem. Entries without
+// a number sort after numbered ones.
+class PageOrder {
+public:
+    // Returns the indices of names in page order.
+    static std::vector<std::size_t> order(const std::vector<std::string>& names);
+
+    template <typename T, typename NameOf>
+    static void sort(std::vector<T>& items, NameOf name_of) {
+        std::vector<std::string> names;
+        names.reserve(items.size());
+        for (const auto& item : items) {
+            names.push_back(name_of(item));
+        }
+
+        std::vector<T> sorted;
+        sorted.reserve(items.size());
+        for (const std::size_t index : order(names)) {
+            sorted.push_back(std::move(items[index]));
+        }
+        items = std::move(sorted);
+    }
+};
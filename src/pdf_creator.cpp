@@ -1,135 +1,830 @@
 #include "pdf_creator.h"
-#include <fstream>
-#include <iostream>
-#include <sstream>
-#include <filesystem>
-#include <cstdio>
+
+#include "buffer_pool.h"
+#include "conversion_stats.h"
+#include "log.h"
+#include "output_sink.h"
+#include "trace.h"
+
+#include <zlib.h>
+
+#include <charconv>
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+#include <utility>
 
 namespace {
-struct PdfObjectOffset {
-    long long value = 0;
+// Objects per object stream in the compact layout; readers inflate a whole object
+// stream to reach any object in it, so keep them reasonably small.
+constexpr std::size_t kObjectsPerStream = 100;
+
+// The linearization dictionary and the first-page trailer are written before the
+// offsets they contain are known, so both are padded to a fixed width.
+constexpr std::size_t kLinearizationDictionaryWidth = 192;
+constexpr std::size_t kFirstPageTrailerWidth = 128;
+
+constexpr char kBinaryHeaderComment[] = "%\xE2\xE3\xCF\xD3\n";
+
+struct PageObjectIds {
+    int page = 0;
+    int image = 0;
+    int soft_mask = 0; // 0 when the image has no alpha channel
+    int content = 0;
+};
+
+// A piece of the output file: either an indirect object (id != 0) or raw text such as
+// the header or a cross-reference table. The payload, if any, sits between head and
+// tail and is never copied into the part itself.
+struct PdfPart {
+    int id = 0;
+    std::string head;
+    const std::vector<std::uint8_t>* data = nullptr;
+    const PDFFileSegment* segment = nullptr;
+    const PDFDeferredData* deferred = nullptr;
+    std::vector<std::uint8_t> owned_data;
+    std::string tail;
+    std::uint64_t offset = 0;
+
+    std::uint64_t payload_size() const {
+        if (segment) {
+            return segment->length;
+        }
+        if (deferred) {
+            return deferred->length;
+        }
+        if (data) {
+            return data->size();
+        }
+        return owned_data.size();
+    }
+
+    std::uint64_t size() const {
+        return head.size() + payload_size() + tail.size();
+    }
+};
+
+struct PageParts {
+    std::string page_dictionary;
+    std::vector<PdfPart> streams; // image, optional soft mask, content
 };
 
-void write_newline(std::ofstream& stream) {
-    stream << '\n';
+std::string object_header(int id) {
+    return std::to_string(id) + " 0 obj\n";
 }
+
+std::string pad_to(std::string text, std::size_t width) {
+    if (text.size() < width) {
+        text.append(width - text.size(), ' ');
+    }
+    return text;
 }
 
-bool PDFCreator::create_pdf_from_images(const std::vector<PDFImageInput>& images,
-                                        const std::string& output_pdf_path) {
-    if (images.empty()) {
-        std::cerr << "No images provided for PDF creation" << std::endl;
+std::string xref_entry(std::uint64_t offset) {
+    char digits[20];
+    const auto result = std::to_chars(digits, digits + sizeof(digits), offset);
+    const auto length = static_cast<std::size_t>(result.ptr - digits);
+    std::string entry(length < 10 ? 10 - length : 0, '0');
+    entry.append(digits, length);
+    entry += " 00000 n \n";
+    return entry;
+}
+
+PdfPart raw_part(std::string text) {
+    PdfPart part;
+    part.head = std::move(text);
+    return part;
+}
+
+PdfPart dictionary_object(int id, const std::string& dictionary) {
+    PdfPart part;
+    part.id = id;
+    part.head = object_header(id) + dictionary + "\nendobj\n";
+    return part;
+}
+
+// entries holds the stream dictionary up to (not including) its /Length key.
+PdfPart stream_object(int id, const std::string& entries, std::uint64_t length) {
+    PdfPart part;
+    part.id = id;
+    part.head = object_header(id) + "<< " + entries + "/Length " + std::to_string(length) + " >>\nstream\n";
+    part.tail = "\nendstream\nendobj\n";
+    return part;
+}
+
+bool deflate_bytes(const std::string& input, std::vector<std::uint8_t>& output) {
+    uLongf compressed_size = compressBound(static_cast<uLong>(input.size()));
+    output.resize(compressed_size);
+    if (compress2(output.data(), &compressed_size, reinterpret_cast<const Bytef*>(input.data()),
+                  static_cast<uLong>(input.size()), Z_BEST_COMPRESSION) != Z_OK) {
         return false;
     }
+    output.resize(compressed_size);
+    return true;
+}
+
+std::uint64_t assign_offsets(std::vector<PdfPart>& parts, std::uint64_t offset = 0) {
+    for (auto& part : parts) {
+        part.offset = offset;
+        offset += part.size();
+    }
+    return offset;
+}
+
+std::uint64_t image_length(const PDFImageInput& image) {
+    if (image.segment) {
+        return image.segment->length;
+    }
+    if (image.deferred) {
+        return image.deferred->length;
+    }
+    return image.data.size();
+}
+
+// Everything that has to match for two pages to share one image XObject.
+struct SharedImageKey {
+    ContentHash data;
+    ContentHash alpha;
+    std::uint64_t length = 0;
+    int width = 0;
+    int height = 0;
+    int components = 0;
+    int bits_per_component = 0;
+    PDFImageFilter filter = PDFImageFilter::dct;
+    bool png_predictors = false;
 
-    const auto parent_dir = std::filesystem::path(output_pdf_path).parent_path();
-    if (!parent_dir.empty()) {
-        std::filesystem::create_directories(parent_dir);
+    bool operator==(const SharedImageKey& other) const {
+        return data == other.data && alpha == other.alpha && length == other.length &&
+               width == other.width && height == other.height && components == other.components &&
+               bits_per_component == other.bits_per_component && filter == other.filter &&
+               png_predictors == other.png_predictors;
     }
-    std::ofstream output(output_pdf_path, std::ios::binary);
-    if (!output) {
-        std::cerr << "Failed to open output PDF: " << output_pdf_path << std::endl;
+};
+
+struct SharedImageKeyHasher {
+    std::size_t operator()(const SharedImageKey& key) const {
+        return ContentHash::Hasher()(key.data) ^ static_cast<std::size_t>(key.length);
+    }
+};
+
+// For each image, the index of the first image with identical data and parameters (its
+// own index if there is none), so that repeated pages reference one image XObject.
+// Segment and deferred images without a caller-supplied fingerprint are never shared.
+std::vector<std::size_t> find_shared_images(const std::vector<PDFImageInput>& images) {
+    std::vector<std::size_t> shared(images.size());
+    std::unordered_map<SharedImageKey, std::size_t, SharedImageKeyHasher> first_seen;
+    for (std::size_t i = 0; i < images.size(); ++i) {
+        shared[i] = i;
+        const PDFImageInput& image = images[i];
+        SharedImageKey key;
+        if (image.content_hash) {
+            key.data = *image.content_hash;
+        } else if (!image.segment && !image.deferred) {
+            key.data = ContentHash::of(image.data.data(), image.data.size());
+        } else {
+            continue;
+        }
+        if (!image.alpha.empty()) {
+            key.alpha = ContentHash::of(image.alpha.data(), image.alpha.size());
+        }
+        key.length = image_length(image);
+        key.width = image.width;
+        key.height = image.height;
+        key.components = image.components;
+        key.bits_per_component = image.bits_per_component;
+        key.filter = image.filter;
+        key.png_predictors = image.png_predictors;
+        shared[i] = first_seen.emplace(key, i).first->second;
+    }
+    return shared;
+}
+
+// Pages that repeat an earlier image get no image or soft mask objects of their own;
+// link_shared_images() points them at the first page's once all ids are assigned.
+void assign_page_ids(const std::vector<PDFImageInput>& images, const std::vector<std::size_t>& shared,
+                     std::size_t first, std::size_t last, int& next_id, std::vector<PageObjectIds>& ids) {
+    for (std::size_t i = first; i < last; ++i) {
+        ids[i].page = next_id++;
+        if (shared[i] == i) {
+            ids[i].image = next_id++;
+            if (!images[i].alpha.empty()) {
+                ids[i].soft_mask = next_id++;
+            }
+        }
+        ids[i].content = next_id++;
+    }
+}
+
+void link_shared_images(const std::vector<std::size_t>& shared, std::vector<PageObjectIds>& ids) {
+    for (std::size_t i = 0; i < ids.size(); ++i) {
+        if (shared[i] != i) {
+            ids[i].image = ids[shared[i]].image;
+            ids[i].soft_mask = ids[shared[i]].soft_mask;
+        }
+    }
+}
+
+std::string image_entries(const PDFImageInput& image, int soft_mask_id) {
+    std::string entries = "/Type /XObject /Subtype /Image ";
+    entries += "/Width " + std::to_string(image.width) + ' ';
+    entries += "/Height " + std::to_string(image.height) + ' ';
+    if (image.components == 1) {
+        entries += "/ColorSpace /DeviceGray ";
+    } else if (image.components == 4) {
+        entries += "/ColorSpace /DeviceCMYK ";
+    } else {
+        entries += "/ColorSpace /DeviceRGB ";
+    }
+    entries += "/BitsPerComponent " + std::to_string(image.bits_per_component) + ' ';
+    if (image.filter == PDFImageFilter::flate) {
+        entries += "/Filter /FlateDecode ";
+        if (image.png_predictors) {
+            entries += "/DecodeParms << /Predictor 15 /Colors " + std::to_string(image.components) +
+                       " /BitsPerComponent " + std::to_string(image.bits_per_component) +
+                       " /Columns " + std::to_string(image.width) + " >> ";
+        }
+    } else {
+        entries += "/Filter /DCTDecode ";
+    }
+    if (soft_mask_id != 0) {
+        entries += "/SMask " + std::to_string(soft_mask_id) + " 0 R ";
+    }
+    return entries;
+}
+
+// owns_image is false for a page that reuses another page's image XObject.
+PageParts build_page(const PDFImageInput& image, int page_index, const PageObjectIds& ids, int pages_id,
+                     bool owns_image) {
+    PageParts parts;
+    const std::string image_resource_name = "Im" + std::to_string(page_index + 1);
+
+    parts.page_dictionary = "<< /Type /Page /Parent " + std::to_string(pages_id) + " 0 R ";
+    parts.page_dictionary += "/MediaBox [0 0 " + std::to_string(image.width) + ' ' + std::to_string(image.height) + "] ";
+    parts.page_dictionary += "/Resources << /XObject << /" + image_resource_name + ' ' +
+                             std::to_string(ids.image) + " 0 R >> >> ";
+    parts.page_dictionary += "/Contents " + std::to_string(ids.content) + " 0 R >>";
+
+    if (owns_image) {
+        PdfPart image_part = stream_object(ids.image, image_entries(image, ids.soft_mask), image_length(image));
+        if (image.segment) {
+            image_part.segment = &*image.segment;
+        } else if (image.deferred) {
+            image_part.deferred = &*image.deferred;
+        } else {
+            image_part.data = &image.data;
+        }
+        parts.streams.push_back(std::move(image_part));
+    }
+
+    if (owns_image && ids.soft_mask != 0) {
+        const std::string entries = "/Type /XObject /Subtype /Image /Width " + std::to_string(image.width) +
+                                    " /Height " + std::to_string(image.height) +
+                                    " /ColorSpace /DeviceGray /BitsPerComponent 8 /Filter /FlateDecode ";
+        PdfPart soft_mask_part = stream_object(ids.soft_mask, entries, image.alpha.size());
+        soft_mask_part.data = &image.alpha;
+        parts.streams.push_back(std::move(soft_mask_part));
+    }
+
+    const std::string content_stream = "q " + std::to_string(image.width) + " 0 0 " +
+                                       std::to_string(image.height) + " 0 0 cm /" +
+                                       image_resource_name + " Do Q\n";
+    PdfPart content_part = stream_object(ids.content, "", content_stream.size());
+    content_part.owned_data.assign(content_stream.begin(), content_stream.end());
+    content_part.tail = "endstream\nendobj\n";
+    parts.streams.push_back(std::move(content_part));
+
+    return parts;
+}
+
+std::string pages_dictionary(const std::vector<PageObjectIds>& ids) {
+    std::string dictionary = "<< /Type /Pages /Count " + std::to_string(ids.size()) + " /Kids [";
+    for (const auto& page : ids) {
+        dictionary += ' ' + std::to_string(page.page) + " 0 R";
+    }
+    dictionary += " ] >>";
+    return dictionary;
+}
+
+// Classic PDF 1.4 layout: catalog, page tree, pages in order, then a plain xref table.
+std::vector<PdfPart> plan_classic(const std::vector<PDFImageInput>& images, const std::vector<std::size_t>& shared) {
+    std::vector<PageObjectIds> ids(images.size());
+    int next_id = 3;
+    assign_page_ids(images, shared, 0, images.size(), next_id, ids);
+    link_shared_images(shared, ids);
+    const int total_objects = next_id - 1;
+
+    std::vector<PdfPart> parts;
+    parts.push_back(raw_part("%PDF-1.4\n"));
+    parts.push_back(dictionary_object(1, "<< /Type /Catalog /Pages 2 0 R >>"));
+    parts.push_back(dictionary_object(2, pages_dictionary(ids)));
+    for (std::size_t i = 0; i < images.size(); ++i) {
+        PageParts page = build_page(images[i], static_cast<int>(i), ids[i], 2, shared[i] == i);
+        parts.push_back(dictionary_object(ids[i].page, page.page_dictionary));
+        for (auto& stream : page.streams) {
+            parts.push_back(std::move(stream));
+        }
+    }
+
+    const std::uint64_t xref_offset = assign_offsets(parts);
+    std::vector<std::uint64_t> offsets(static_cast<std::size_t>(total_objects) + 1);
+    for (const auto& part : parts) {
+        if (part.id != 0) {
+            offsets[static_cast<std::size_t>(part.id)] = part.offset;
+        }
+    }
+
+    std::string xref = "xref\n0 " + std::to_string(total_objects + 1) + "\n0000000000 65535 f \n";
+    for (int id = 1; id <= total_objects; ++id) {
+        xref += xref_entry(offsets[static_cast<std::size_t>(id)]);
+    }
+    xref += "trailer\n<< /Size " + std::to_string(total_objects + 1) + " /Root 1 0 R >>\n";
+    xref += "startxref\n" + std::to_string(xref_offset) + "\n%%EOF";
+    parts.push_back(raw_part(std::move(xref)));
+    return parts;
+}
+
+// PDF 1.5 layout: every non-stream object (catalog, page tree, page dictionaries) is
+// packed into compressed object streams and the xref table becomes a compressed
+// cross-reference stream.
+bool plan_compact(const std::vector<PDFImageInput>& images, const std::vector<std::size_t>& shared,
+                  std::vector<PdfPart>& parts) {
+    std::vector<PageObjectIds> ids(images.size());
+    int next_id = 3;
+    assign_page_ids(images, shared, 0, images.size(), next_id, ids);
+    link_shared_images(shared, ids);
+
+    std::vector<std::pair<int, std::string>> dictionaries;
+    std::vector<PdfPart> streams;
+    dictionaries.emplace_back(1, "<< /Type /Catalog /Pages 2 0 R >>");
+    dictionaries.emplace_back(2, pages_dictionary(ids));
+    for (std::size_t i = 0; i < images.size(); ++i) {
+        PageParts page = build_page(images[i], static_cast<int>(i), ids[i], 2, shared[i] == i);
+        dictionaries.emplace_back(ids[i].page, std::move(page.page_dictionary));
+        for (auto& stream : page.streams) {
+            streams.push_back(std::move(stream));
+        }
+    }
+
+    // Object number -> (object stream number, index within it) for compressed objects.
+    std::vector<std::pair<int, int>> compressed_location(static_cast<std::size_t>(next_id));
+
+    parts.clear();
+    parts.push_back(raw_part(std::string("%PDF-1.5\n") + kBinaryHeaderComment));
+    for (std::size_t first = 0; first < dictionaries.size(); first += kObjectsPerStream) {
+        const std::size_t last = std::min(dictionaries.size(), first + kObjectsPerStream);
+        const int stream_id = next_id++;
+
+        std::string index;
+        std::string bodies;
+        for (std::size_t i = first; i < last; ++i) {
+            index += std::to_string(dictionaries[i].first) + ' ' + std::to_string(bodies.size()) + ' ';
+            bodies += dictionaries[i].second;
+            bodies += '\n';
+            compressed_location[static_cast<std::size_t>(dictionaries[i].first)] = {stream_id, static_cast<int>(i - first)};
+        }
+
+        std::vector<std::uint8_t> compressed;
+        if (!deflate_bytes(index + bodies, compressed)) {
+            return false;
+        }
+        PdfPart object_stream = stream_object(stream_id,
+                                              "/Type /ObjStm /N " + std::to_string(last - first) +
+                                              " /First " + std::to_string(index.size()) + " /Filter /FlateDecode ",
+                                              compressed.size());
+        object_stream.owned_data = std::move(compressed);
+        parts.push_back(std::move(object_stream));
+    }
+
+    for (auto& stream : streams) {
+        parts.push_back(std::move(stream));
+    }
+
+    const int xref_id = next_id++;
+    const std::uint64_t xref_offset = assign_offsets(parts);
+
+    std::vector<std::uint64_t> offsets(static_cast<std::size_t>(next_id));
+    for (const auto& part : parts) {
+        if (part.id != 0) {
+            offsets[static_cast<std::size_t>(part.id)] = part.offset;
+        }
+    }
+    offsets[static_cast<std::size_t>(xref_id)] = xref_offset;
+
+    int offset_width = 1;
+    while (offset_width < 8 && (xref_offset >> (8 * offset_width)) != 0) {
+        ++offset_width;
+    }
+
+    std::string entries;
+    auto append_field = [&entries](std::uint64_t value, int width) {
+        for (int shift = 8 * (width - 1); shift >= 0; shift -= 8) {
+            entries += static_cast<char>((value >> shift) & 0xFF);
+        }
+    };
+    for (int id = 0; id < next_id; ++id) {
+        const auto index = static_cast<std::size_t>(id);
+        if (id == 0) {
+            append_field(0, 1);
+            append_field(0, offset_width);
+            append_field(0xFFFF, 2);
+        } else if (index < compressed_location.size() && compressed_location[index].first != 0) {
+            append_field(2, 1);
+            append_field(static_cast<std::uint64_t>(compressed_location[index].first), offset_width);
+            append_field(static_cast<std::uint64_t>(compressed_location[index].second), 2);
+        } else {
+            append_field(1, 1);
+            append_field(offsets[static_cast<std::size_t>(id)], offset_width);
+            append_field(0, 2);
+        }
+    }
+
+    std::vector<std::uint8_t> compressed_entries;
+    if (!deflate_bytes(entries, compressed_entries)) {
         return false;
     }
+    PdfPart xref_stream = stream_object(xref_id,
+                                        "/Type /XRef /Size " + std::to_string(next_id) +
+                                        " /W [1 " + std::to_string(offset_width) + " 2] /Root 1 0 R /Filter /FlateDecode ",
+                                        compressed_entries.size());
+    xref_stream.owned_data = std::move(compressed_entries);
+    parts.push_back(std::move(xref_stream));
+    parts.push_back(raw_part("startxref\n" + std::to_string(xref_offset) + "\n%%EOF"));
+    return true;
+}
+
+// Packs unsigned values MSB-first, as hint tables require.
+class BitWriter {
+public:
+    void write(std::uint64_t value, int bits) {
+        for (int bit = bits - 1; bit >= 0; --bit) {
+            current_ = static_cast<std::uint8_t>(current_ << 1 | ((value >> bit) & 1));
+            if (++used_ == 8) {
+                bytes_.push_back(static_cast<char>(current_));
+                current_ = 0;
+                used_ = 0;
+            }
+        }
+    }
+
+    void flush() {
+        if (used_ != 0) {
+            write(0, 8 - used_);
+        }
+    }
+
+    const std::string& bytes() const {
+        return bytes_;
+    }
+
+private:
+    std::string bytes_;
+    std::uint8_t current_ = 0;
+    int used_ = 0;
+};
+
+int bits_needed(std::uint64_t value) {
+    int bits = 0;
+    while (value != 0) {
+        ++bits;
+        value >>= 1;
+    }
+    return bits;
+}
 
-    const int page_count = static_cast<int>(images.size());
-    const int total_objects = 2 + page_count * 3;
-    std::vector<PdfObjectOffset> offsets(total_objects + 1);
+struct PageHint {
+    std::uint64_t objects = 0;
+    std::uint64_t offset = 0;
+    std::uint64_t length = 0;
+    std::uint64_t content_offset = 0; // relative to the start of the page
+    std::uint64_t content_length = 0;
+};
 
-    auto record_offset = [&](int object_id) {
-        offsets[object_id].value = static_cast<long long>(output.tellp());
+// Builds the primary hint stream data (page offset hint table followed by an empty
+// shared object hint table). Offsets must be computed as if the hint stream itself
+// were not present in the file.
+std::string build_hint_tables(const std::vector<PageHint>& pages, std::size_t& shared_table_offset) {
+    auto least = [&pages](auto field) {
+        std::uint64_t value = pages.front().*field;
+        for (const auto& page : pages) {
+            value = std::min(value, page.*field);
+        }
+        return value;
     };
+    auto delta_bits = [&pages](auto field, std::uint64_t minimum) {
+        std::uint64_t value = 0;
+        for (const auto& page : pages) {
+            value = std::max(value, page.*field - minimum);
+        }
+        return bits_needed(value);
+    };
+
+    const std::uint64_t least_objects = least(&PageHint::objects);
+    const std::uint64_t least_length = least(&PageHint::length);
+    const std::uint64_t least_content_offset = least(&PageHint::content_offset);
+    const std::uint64_t least_content_length = least(&PageHint::content_length);
+    const int objects_bits = delta_bits(&PageHint::objects, least_objects);
+    const int length_bits = delta_bits(&PageHint::length, least_length);
+    const int content_offset_bits = delta_bits(&PageHint::content_offset, least_content_offset);
+    const int content_length_bits = delta_bits(&PageHint::content_length, least_content_length);
+
+    BitWriter writer;
+    writer.write(least_objects, 32);
+    writer.write(pages.front().offset, 32);
+    writer.write(static_cast<std::uint64_t>(objects_bits), 16);
+    writer.write(least_length, 32);
+    writer.write(static_cast<std::uint64_t>(length_bits), 16);
+    writer.write(least_content_offset, 32);
+    writer.write(static_cast<std::uint64_t>(content_offset_bits), 16);
+    writer.write(least_content_length, 32);
+    writer.write(static_cast<std::uint64_t>(content_length_bits), 16);
+    writer.write(0, 16); // bits for the number of shared object references
+    writer.write(0, 16); // bits for shared object identifiers
+    writer.write(0, 16); // bits for fractional positions
+    writer.write(1, 16); // denominator of fractional positions
+
+    // Each per-page item is written for all pages and starts on a byte boundary.
+    // Items 3-5 (shared object references) take zero bits because nothing is shared.
+    for (const auto& page : pages) {
+        writer.write(page.objects - least_objects, objects_bits);
+    }
+    writer.flush();
+    for (const auto& page : pages) {
+        writer.write(page.length - least_length, length_bits);
+    }
+    writer.flush();
+    for (const auto& page : pages) {
+        writer.write(page.content_offset - least_content_offset, content_offset_bits);
+    }
+    writer.flush();
+    for (const auto& page : pages) {
+        writer.write(page.content_length - least_content_length, content_length_bits);
+    }
+    writer.flush();
+
+    shared_table_offset = writer.bytes().size();
+    writer.write(0, 32); // object number of the first shared object
+    writer.write(0, 32); // location of the first shared object
+    writer.write(0, 32); // shared object entries for the first page
+    writer.write(0, 32); // shared object entries in the shared objects section
+    writer.write(0, 16); // bits for objects per group
+    writer.write(0, 32); // least group length
+    writer.write(0, 16); // bits for group length differences
+    return writer.bytes();
+}
+
+// Linearized ("fast web view") layout. The file starts with the linearization
+// dictionary, a cross-reference section covering the document-level objects and the
+// first page, the primary hint stream and the first page itself, so a viewer can show
+// page 1 after reading /E bytes. The remaining pages follow, numbered from 1, and are
+// covered by the main cross-reference table at the end of the file.
+bool plan_linearized(const std::vector<PDFImageInput>& images, const std::vector<std::size_t>& shared,
+                     std::vector<PdfPart>& parts) {
+    const std::size_t page_count = images.size();
+    std::vector<PageObjectIds> ids(page_count);
+
+    int next_id = 1;
+    assign_page_ids(images, shared, 1, page_count, next_id, ids);
+    const int main_section_count = next_id - 1;
+    const int linearization_id = next_id++;
+    const int catalog_id = next_id++;
+    const int pages_id = next_id++;
+    assign_page_ids(images, shared, 0, 1, next_id, ids);
+    // A shared image stays in the section of the first page that uses it; later pages
+    // reach it through the cross-reference table rather than the shared object hints.
+    link_shared_images(shared, ids);
+    const int hint_id = next_id++;
+    const int total_objects = next_id - 1;
+    const int first_section_count = total_objects - main_section_count;
+
+    const std::string header = std::string("%PDF-1.4\n") + kBinaryHeaderComment;
+    const std::string first_xref_head = "xref\n" + std::to_string(linearization_id) + ' ' +
+                                        std::to_string(first_section_count) + '\n';
+
+    parts.clear();
+    parts.push_back(raw_part(header));
+    parts.push_back(dictionary_object(linearization_id, std::string(kLinearizationDictionaryWidth, ' ')));
+    parts.push_back(raw_part(first_xref_head + std::string(static_cast<std::size_t>(first_section_count) * 20, ' ') +
+                             "trailer\n" + std::string(kFirstPageTrailerWidth, ' ') + "\nstartxref\n0\n%%EOF\n"));
+    parts.push_back(dictionary_object(catalog_id, "<< /Type /Catalog /Pages " + std::to_string(pages_id) + " 0 R >>"));
+    parts.push_back(dictionary_object(pages_id, pages_dictionary(ids)));
+    const std::size_t hint_position = parts.size();
+
+    std::vector<std::size_t> page_start(page_count);
+    std::vector<std::size_t> content_position(page_count);
+    for (std::size_t i = 0; i < page_count; ++i) {
+        PageParts page = build_page(images[i], static_cast<int>(i), ids[i], pages_id, shared[i] == i);
+        page_start[i] = parts.size();
+        parts.push_back(dictionary_object(ids[i].page, page.page_dictionary));
+        for (auto& stream : page.streams) {
+            parts.push_back(std::move(stream));
+        }
+        content_position[i] = parts.size() - 1;
+    }
+    const std::size_t main_xref_position = parts.size();
+
+    // Offsets without the hint stream feed the hint tables.
+    const std::uint64_t end_without_hint = assign_offsets(parts);
+    std::vector<PageHint> hints(page_count);
+    for (std::size_t i = 0; i < page_count; ++i) {
+        const std::size_t next = i + 1 < page_count ? page_start[i + 1] : main_xref_position;
+        const std::uint64_t end = next < parts.size() ? parts[next].offset : end_without_hint;
+        hints[i].objects = next - page_start[i];
+        hints[i].offset = parts[page_start[i]].offset;
+        hints[i].length = end - hints[i].offset;
+        hints[i].content_offset = parts[content_position[i]].offset - hints[i].offset;
+        hints[i].content_length = parts[content_position[i]].size();
+    }
+
+    std::size_t shared_table_offset = 0;
+    const std::string hint_tables = build_hint_tables(hints, shared_table_offset);
+    PdfPart hint_stream = stream_object(hint_id, "/S " + std::to_string(shared_table_offset) + ' ', hint_tables.size());
+    hint_stream.owned_data.assign(hint_tables.begin(), hint_tables.end());
+    parts.insert(parts.begin() + static_cast<std::ptrdiff_t>(hint_position), std::move(hint_stream));
 
-    output << "%PDF-1.4\n";
-
-    // Object 1: Catalog
-    record_offset(1);
-    output << "1 0 obj\n";
-    output << "<< /Type /Catalog /Pages 2 0 R >>\n";
-    output << "endobj\n";
-
-    // Object 2: Pages
-    record_offset(2);
-    output << "2 0 obj\n";
-    output << "<< /Type /Pages /Count " << page_count << " /Kids [";
-    for (int i = 0; i < page_count; ++i) {
-        const int page_object_id = 3 + i * 3;
-        output << ' ' << page_object_id << " 0 R";
-    }
-    output << " ] >>\n";
-    output << "endobj\n";
-
-    for (int page_index = 0; page_index < page_count; ++page_index) {
-        const auto& image = images[page_index];
-        const int page_object_id = 3 + page_index * 3;
-        const int image_object_id = page_object_id + 1;
-        const int content_object_id = page_object_id + 2;
-        const std::string image_resource_name = "Im" + std::to_string(page_index + 1);
-
-        // Page object
-        record_offset(page_object_id);
-        output << page_object_id << " 0 obj\n";
-        output << "<< /Type /Page /Parent 2 0 R ";
-        output << "/MediaBox [0 0 " << image.width << ' ' << image.height << "] ";
-        output << "/Resources << /XObject << /" << image_resource_name << ' ' << image_object_id << " 0 R >> >> ";
-        output << "/Contents " << content_object_id << " 0 R >>\n";
-        output << "endobj\n";
-
-        // Image object
-        record_offset(image_object_id);
-        output << image_object_id << " 0 obj\n";
-        output << "<< /Type /XObject /Subtype /Image ";
-        output << "/Width " << image.width << ' ';
-        output << "/Height " << image.height << ' ';
-        if (image.components == 1) {
-            output << "/ColorSpace /DeviceGray ";
-        } else if (image.components == 4) {
-            output << "/ColorSpace /DeviceCMYK ";
+    const std::uint64_t main_xref_offset = assign_offsets(parts);
+    std::vector<std::uint64_t> offsets(static_cast<std::size_t>(total_objects) + 1);
+    for (const auto& part : parts) {
+        if (part.id != 0) {
+            offsets[static_cast<std::size_t>(part.id)] = part.offset;
+        }
+    }
+
+    const std::uint64_t first_xref_offset = parts[2].offset;
+    const std::string main_xref_head = "xref\n0 " + std::to_string(main_section_count + 1);
+    std::string main_xref = main_xref_head + "\n0000000000 65535 f \n";
+    for (int id = 1; id <= main_section_count; ++id) {
+        main_xref += xref_entry(offsets[static_cast<std::size_t>(id)]);
+    }
+    main_xref += "trailer\n<< /Size " + std::to_string(main_section_count + 1) + " >>\n";
+    main_xref += "startxref\n" + std::to_string(first_xref_offset) + "\n%%EOF\n";
+    parts.push_back(raw_part(std::move(main_xref)));
+    const std::uint64_t file_length = assign_offsets(parts);
+
+    // Positions recorded before the hint stream was inserted are one lower now.
+    const PdfPart& hint_part = parts[hint_position];
+    const PdfPart& last_first_page_part = parts[content_position[0] + 1];
+    const std::string linearization = "<< /Linearized 1 /L " + std::to_string(file_length) +
+                                      " /H [ " + std::to_string(hint_part.offset) + ' ' + std::to_string(hint_part.size()) +
+                                      " ] /O " + std::to_string(ids[0].page) +
+                                      " /E " + std::to_string(last_first_page_part.offset + last_first_page_part.size()) +
+                                      " /N " + std::to_string(page_count) +
+                                      " /T " + std::to_string(main_xref_offset + main_xref_head.size()) + " >>";
+
+    std::string first_xref = first_xref_head;
+    for (int id = linearization_id; id <= total_objects; ++id) {
+        first_xref += xref_entry(offsets[static_cast<std::size_t>(id)]);
+    }
+    const std::string first_trailer = "<< /Size " + std::to_string(total_objects + 1) +
+                                      " /Prev " + std::to_string(main_xref_offset) +
+                                      " /Root " + std::to_string(catalog_id) + " 0 R >>";
+    if (linearization.size() > kLinearizationDictionaryWidth || first_trailer.size() > kFirstPageTrailerWidth) {
+        return false;
+    }
+    first_xref += "trailer\n" + pad_to(first_trailer, kFirstPageTrailerWidth) + "\nstartxref\n0\n%%EOF\n";
+
+    parts[1] = dictionary_object(linearization_id, pad_to(linearization, kLinearizationDictionaryWidth));
+    parts[2] = raw_part(std::move(first_xref));
+    return true;
+}
+
+// Shared by the file and writer overloads: open_output opens the sink on the
+// destination, which output_pdf_path names in messages.
+bool write_pdf(const std::vector<PDFImageInput>& images, const std::function<bool(OutputSink&)>& open_output,
+               const std::string& output_pdf_path, const PDFWriteOptions& options, const ConversionContext& context) {
+    if (images.empty()) {
+        LogMessage(LogLevel::error, context.log) << "No images provided for PDF creation";
+        return false;
+    }
+
+    TraceSpan span("pdf_write");
+    StageTimer timer(context.stats, ConversionStage::pdf_write);
+    const auto started = ConversionStats::Clock::now();
+
+    const std::vector<std::size_t> shared = find_shared_images(images);
+    int duplicate_pages = 0;
+    std::uint64_t duplicate_bytes = 0;
+    for (std::size_t i = 0; i < images.size(); ++i) {
+        if (shared[i] != i) {
+            ++duplicate_pages;
+            duplicate_bytes += image_length(images[i]) + images[i].alpha.size();
+        }
+    }
+
+    std::vector<PdfPart> parts;
+    bool planned = true;
+    switch (options.layout) {
+    case PDFLayout::classic:
+        parts = plan_classic(images, shared);
+        break;
+    case PDFLayout::compact:
+        planned = plan_compact(images, shared, parts);
+        break;
+    case PDFLayout::linearized:
+        planned = plan_linearized(images, shared, parts);
+        break;
+    }
+    if (!planned) {
+        LogMessage(LogLevel::error, context.log) << "Failed to lay out PDF: " << output_pdf_path;
+        return false;
+    }
+
+    // Writes are queued on the I/O backend so that loading the next deferred image
+    // overlaps with writing the previous one.
+    OutputSinkOptions sink_options;
+    sink_options.sync = options.sync;
+    sink_options.async = true;
+    OutputSink output(sink_options);
+    if (!open_output(output)) {
+        LogMessage(LogLevel::error, context.log) << output.error();
+        return false;
+    }
+
+    // Offsets in the cross-reference data were computed from the planned part sizes,
+    // so anything written short (e.g. a truncated archive segment) would corrupt them.
+    std::uint64_t total_size = 0;
+    for (const auto& part : parts) {
+        total_size += part.size();
+    }
+
+    // Progress is reported in pages, in proportion to the bytes written so far.
+    const int total_pages = static_cast<int>(images.size());
+    int pages_reported = 0;
+
+    // Deferred image data goes through one pooled buffer for the whole file.
+    BufferPool::Lease deferred_data = BufferPool::shared().acquire();
+
+    std::uint64_t expected_offset = 0;
+    for (const auto& part : parts) {
+        if (context.cancelled()) {
+            // The output sink discards its temporary file when it goes out of scope.
+            return false;
+        }
+
+        output.write(part.head);
+        if (part.segment) {
+            output.append_file_range(part.segment->path, part.segment->offset, part.segment->length);
+        } else if (part.deferred) {
+            deferred_data->clear();
+            if (!part.deferred->load(*deferred_data) || deferred_data->size() != part.deferred->length) {
+                LogMessage(LogLevel::error, context.log) << "Failed to load image data while writing " << output_pdf_path;
+                return false;
+            }
+            output.write(deferred_data->data(), deferred_data->size());
+        } else if (part.data) {
+            // Image data and parts outlive commit(), so they are written without a copy;
+            // the deferred buffer above is reused and has to go through write().
+            output.write_external(part.data->data(), part.data->size());
         } else {
-            output << "/ColorSpace /DeviceRGB ";
-        }
-        output << "/BitsPerComponent 8 ";
-        output << "/Filter /DCTDecode ";
-        output << "/Length " << image.data.size() << " >>\n";
-        output << "stream\n";
-        output.write(reinterpret_cast<const char*>(image.data.data()), static_cast<std::streamsize>(image.data.size()));
-        write_newline(output);
-        output << "endstream\n";
-        output << "endobj\n";
-
-        // Content stream
-        const std::string content_stream = "q " + std::to_string(image.width) + " 0 0 " +
-                                           std::to_string(image.height) + " 0 0 cm /" +
-                                           image_resource_name + " Do Q\n";
-        record_offset(content_object_id);
-        output << content_object_id << " 0 obj\n";
-        output << "<< /Length " << content_stream.size() << " >>\n";
-        output << "stream\n";
-        output << content_stream;
-        output << "endstream\n";
-        output << "endobj\n";
-    }
-
-    const long long xref_offset = static_cast<long long>(output.tellp());
-    output << "xref\n";
-    output << "0 " << (total_objects + 1) << "\n";
-    output << "0000000000 65535 f \n";
-    for (int i = 1; i <= total_objects; ++i) {
-        char buffer[32];
-        std::snprintf(buffer, sizeof(buffer), "%010lld 00000 n \n", offsets[i].value);
-        output << buffer;
-    }
-
-    output << "trailer\n";
-    output << "<< /Size " << (total_objects + 1) << " /Root 1 0 R >>\n";
-    output << "startxref\n" << xref_offset << "\n";
-    output << "%%EOF";
-
-    if (!output) {
-        std::cerr << "Failed while writing PDF: " << output_pdf_path << std::endl;
+            output.write_external(part.owned_data.data(), part.owned_data.size());
+        }
+        output.write(part.tail);
+
+        expected_offset += part.size();
+        if (output.ok() && output.offset() != expected_offset) {
+            LogMessage(LogLevel::error, context.log) << "PDF layout mismatch while writing " << output_pdf_path;
+            return false;
+        }
+
+        const int pages_done = static_cast<int>(expected_offset * total_pages / total_size);
+        if (pages_done != pages_reported) {
+            pages_reported = pages_done;
+            context.report_progress(pages_done, total_pages);
+        }
+    }
+
+    timer.add_bytes(output.offset());
+    if (!output.commit()) {
+        LogMessage(LogLevel::error, context.log) << "Failed while writing PDF: " << output.error();
         return false;
     }
 
-    output.close();
+    if (duplicate_pages > 0) {
+        // The time saved is estimated from this file's own write rate.
+        const auto elapsed = ConversionStats::Clock::now() - started;
+        const auto saved = std::chrono::duration_cast<ConversionStats::Clock::duration>(
+            elapsed * (static_cast<double>(duplicate_bytes) / static_cast<double>(std::max<std::uint64_t>(total_size, 1))));
+        if (context.stats) {
+            context.stats->add_duplicates(ConversionStage::pdf_write, duplicate_pages, duplicate_bytes, saved);
+        }
+        LogMessage(LogLevel::info, context.log) << "Shared " << duplicate_pages << " repeated page images ("
+                                                << duplicate_bytes << " bytes not written)";
+    }
     return true;
 }
+}
+
+bool PDFCreator::create_pdf_from_images(const std::vector<PDFImageInput>& images,
+                                        const std::string& output_pdf_path,
+                                        const PDFWriteOptions& options,
+                                        const ConversionContext& context) {
+    return write_pdf(images, [&output_pdf_path](OutputSink& output) { return output.open(output_pdf_path); },
+                     output_pdf_path, options, context);
+}
+
+bool PDFCreator::create_pdf_from_images(const std::vector<PDFImageInput>& images,
+                                        const OutputWriter& output,
+                                        const PDFWriteOptions& options,
+                                        const ConversionContext& context) {
+    return write_pdf(images, [&output](OutputSink& sink) { return sink.open(output); },
+                     "output stream", options, context);
+}
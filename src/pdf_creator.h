@@ -1,19 +1,82 @@
 #pragma once
 
+#include "content_hash.h"
+#include "conversion_context.h"
+#include "output_sink.h"
+
 #include <string>
 #include <vector>
 #include <cstdint>
+#include <functional>
+#include <optional>
+
+struct PDFFileSegment {
+    std::string path;
+    std::uint64_t offset = 0;
+    std::uint64_t length = 0;
+};
+
+enum class PDFImageFilter {
+    dct,   // data is a complete JPEG file
+    flate  // data is a zlib stream of raw samples
+};
+
+// Image bytes produced on demand while the PDF is written, into a buffer that is reused
+// for every page, instead of being held in memory for the whole conversion. load must
+// fill the buffer with exactly length bytes.
+struct PDFDeferredData {
+    std::uint64_t length = 0;
+    std::function<bool(std::vector<std::uint8_t>& output)> load;
+};
 
 struct PDFImageInput {
     std::string name;
-    int width;
-    int height;
-    int components;
+    int width = 0;
+    int height = 0;
+    int components = 0;
     std::vector<std::uint8_t> data;
+    // When set, the image bytes are copied from this byte range of another file
+    // (e.g. a stored CBZ entry) instead of from data.
+    std::optional<PDFFileSegment> segment;
+    // When set (and segment is not), the image bytes are loaded from here at write time.
+    std::optional<PDFDeferredData> deferred;
+    PDFImageFilter filter = PDFImageFilter::dct;
+    int bits_per_component = 8;
+    // Flate data whose rows carry PNG filter-type bytes (/Predictor 15).
+    bool png_predictors = false;
+    // Optional zlib-compressed 8-bit alpha channel, written as a soft mask.
+    std::vector<std::uint8_t> alpha;
+    // Fingerprint of the image bytes, for segment and deferred images whose bytes are
+    // not at hand, or of the bytes in-memory data was derived from (a downscaled page);
+    // other in-memory data is fingerprinted by PDFCreator. Pages with the same
+    // fingerprint, alpha and parameters reference a single image XObject.
+    std::optional<ContentHash> content_hash;
+};
+
+enum class PDFLayout {
+    classic,    // PDF 1.4 with a plain cross-reference table
+    compact,    // PDF 1.5 object streams and a compressed cross-reference stream
+    linearized  // PDF 1.4 linearized for fast first-page display over range requests
+};
+
+struct PDFWriteOptions {
+    PDFLayout layout = PDFLayout::classic;
+    // The PDF is written to a temporary file and renamed into place once complete;
+    // sync controls whether it is flushed to stable storage before the rename.
+    SyncMode sync = SyncMode::none;
 };
 
 class PDFCreator {
 public:
     static bool create_pdf_from_images(const std::vector<PDFImageInput>& images,
-                                       const std::string& output_pdf_path);
+                                       const std::string& output_pdf_path,
+                                       const PDFWriteOptions& options = {},
+                                       const ConversionContext& context = {});
+
+    // Same, but hands the PDF to output as it is written instead of creating a file.
+    // Segment images are still read from their files.
+    static bool create_pdf_from_images(const std::vector<PDFImageInput>& images,
+                                       const OutputWriter& output,
+                                       const PDFWriteOptions& options = {},
+                                       const ConversionContext& context = {});
 };
@@ -1,33 +1,190 @@
 #include "pdf_image_extractor.h"
+#include "concurrency.h"
+#include "conversion_stats.h"
+#include "image_encoder.h"
+#include "log.h"
+#include "output_sink.h"
+#include "page_analysis.h"
+#include "trace.h"
 #include <poppler-document.h>
 #include <poppler-page.h>
 #include <poppler-image.h>
 #include <poppler-page-renderer.h>
-#include <iostream>
 #include <filesystem>
 #include <fstream>
 #include <thread>
 #include <future>
 #include <algorithm>
+#include <deque>
+#include <limits>
+#include <optional>
 
-PDFImageExtractor::PDFImageExtractor(const std::string& pdf_path, const std::string& format, int quality, double dpi)
-    : pdf_path_(pdf_path), valid_(false), format_(format), quality_(quality), dpi_(dpi) {
+namespace {
+bool describe_pixels(const poppler::image& image, PixelBuffer& pixels) {
+    switch (image.format()) {
+    case poppler::image::format_gray8:
+        pixels.format = PixelFormat::gray8;
+        break;
+    case poppler::image::format_rgb24:
+        pixels.format = PixelFormat::rgb24;
+        break;
+    case poppler::image::format_bgr24:
+        pixels.format = PixelFormat::bgr24;
+        break;
+    case poppler::image::format_argb32:
+        pixels.format = PixelFormat::argb32;
+        break;
+    default:
+        return false;
+    }
+
+    pixels.data = reinterpret_cast<const std::uint8_t*>(image.const_data());
+    pixels.width = image.width();
+    pixels.height = image.height();
+    pixels.stride = static_cast<std::size_t>(image.bytes_per_row());
+    return true;
+}
+
+bool encode_page(const PixelBuffer& pixels, const std::string& format, int quality, double dpi,
+                 const ConversionContext& context, std::vector<std::uint8_t>& encoded) {
+    TraceSpan span("encode");
+    StageTimer timer(context.stats, ConversionStage::encode);
+    const bool encoded_ok = format == "jpeg" ? ImageEncoder::encode_jpeg(pixels, quality, dpi, encoded)
+                                             : ImageEncoder::encode_png(pixels, dpi, encoded);
+    timer.add_bytes(encoded.size());
+    return encoded_ok;
+}
+
+// Encodes the rendered page in memory and starts writing it through an atomic output
+// sink, so an interrupted run never leaves a truncated image behind under the final
+// name. The write runs in the background while the next page renders; commit() on the
+// returned sink completes it. pixels is the (possibly cropped) view of image to encode;
+// when null, the format is not one the encoder handles and image is saved directly,
+// leaving sink empty.
+bool start_page_write(const poppler::image& image, const PixelBuffer* pixels, const std::string& path,
+                      const std::string& format, int quality, double dpi, const ConversionContext& context,
+                      std::vector<std::uint8_t>& encoded, std::unique_ptr<OutputSink>& sink) {
+    if (!pixels) {
+        TraceSpan span("write");
+        StageTimer timer(context.stats, ConversionStage::write);
+        return image.save(path, format, static_cast<int>(dpi));
+    }
+
+    if (!encode_page(*pixels, format, quality, dpi, context, encoded)) {
+        return false;
+    }
+
+    // The encoded image is handed over in one write straight from its buffer, so a
+    // small staging buffer suffices.
+    OutputSinkOptions sink_options;
+    sink_options.buffer_size = 64 * 1024;
+    sink_options.async = true;
+    sink = std::make_unique<OutputSink>(sink_options);
+    if (!sink->open(path) || !sink->write_external(encoded.data(), encoded.size())) {
+        LogMessage(LogLevel::error, context.log) << sink->error();
+        sink.reset();
+        return false;
+    }
+    return true;
+}
+
+// Fingerprint of the visible pixels and their layout; row padding is skipped so that
+// equal pages always hash alike.
+ContentHash fingerprint_pixels(const PixelBuffer& pixels) {
+    std::size_t bytes_per_pixel = 4;
+    if (pixels.format == PixelFormat::gray8) {
+        bytes_per_pixel = 1;
+    } else if (pixels.format == PixelFormat::rgb24 || pixels.format == PixelFormat::bgr24) {
+        bytes_per_pixel = 3;
+    }
+
+    ContentHasher hasher;
+    const int layout[] = {pixels.width, pixels.height, static_cast<int>(pixels.format)};
+    hasher.update(layout, sizeof(layout));
+    const std::size_t row_size = static_cast<std::size_t>(pixels.width) * bytes_per_pixel;
+    for (int y = 0; y < pixels.height; ++y) {
+        hasher.update(pixels.data + static_cast<std::size_t>(y) * pixels.stride, row_size);
+    }
+    return hasher.finish();
+}
 
+// Rendered pages whose writes a worker lets run while it renders the next ones.
+constexpr std::size_t kPagesInFlight = 2;
+}
+
+double PageResolution::dpi_for(double width_points, double height_points, double fixed_dpi) const {
+    double dpi = fixed_dpi;
+    if (target_height > 0 && height_points > 0.0) {
+        dpi = target_height * 72.0 / height_points;
+    }
+    const double long_edge = std::max(width_points, height_points);
+    if (max_long_edge > 0 && long_edge > 0.0) {
+        dpi = std::min(dpi, max_long_edge * 72.0 / long_edge);
+    }
+    return dpi;
+}
+
+// A rendered page whose image is still being written. The encoded bytes stay leased
+// until the write is committed; sink is declared last so that a discarded page waits
+// for its write before the buffer goes back to the pool.
+struct PDFImageExtractor::PendingPage {
+    int page_index = 0;
+    std::string path;
+    ImageInfo info;
+    std::uint64_t bytes = 0;
+    std::optional<ContentHash> pixels_hash; // unset for repeats and unhashable formats
+    ConversionStats::Clock::duration encode_time{};
+    BufferPool::Lease encoded;
+    const PageImageOutput* output = nullptr;  // set when the page goes to memory, not to path
+    std::unique_ptr<OutputSink> sink;
+};
+
+PDFImageExtractor::PDFImageExtractor(const std::string& pdf_path, const std::string& format, int quality, double dpi,
+                                     const ConversionContext& context, const PageAnalysisOptions& analysis,
+                                     const PageResolution& resolution)
+    : pdf_path_(pdf_path), valid_(false), format_(format), quality_(quality), dpi_(dpi), context_(context),
+      analysis_(analysis), resolution_(resolution) {
+
+    TraceSpan span("document_load");
+    StageTimer timer(context_.stats, ConversionStage::load);
     try {
-        document_ = std::unique_ptr<poppler::document>(
-            poppler::document::load_from_file(pdf_path_)
-        );
-
-        if (document_ && !document_->is_locked()) {
-            renderer_ = std::make_unique<poppler::page_renderer>();
-            renderer_->set_render_hint(poppler::page_renderer::antialiasing, true);
-            renderer_->set_render_hint(poppler::page_renderer::text_antialiasing, true);
-            valid_ = true;
-        } else {
-            std::cerr << "Failed to load PDF or PDF is locked: " << pdf_path_ << std::endl;
-        }
+        open_document(poppler::document::load_from_file(pdf_path_));
     } catch (const std::exception& e) {
-        std::cerr << "Error loading PDF : " << e.what() << std::endl;
+        LogMessage(LogLevel::error, context_.log) << "Error loading PDF : " << e.what();
+    }
+}
+
+PDFImageExtractor::PDFImageExtractor(std::span<const std::uint8_t> pdf_data, const std::string& name,
+                                     const std::string& format, int quality, double dpi,
+                                     const ConversionContext& context, const PageAnalysisOptions& analysis,
+                                     const PageResolution& resolution)
+    : pdf_path_(name), valid_(false), format_(format), quality_(quality), dpi_(dpi), context_(context),
+      analysis_(analysis), resolution_(resolution) {
+
+    TraceSpan span("document_load");
+    StageTimer timer(context_.stats, ConversionStage::load);
+    if (pdf_data.size() > static_cast<std::size_t>(std::numeric_limits<int>::max())) {
+        LogMessage(LogLevel::error, context_.log) << "PDF is too large to load from memory: " << pdf_path_;
+        return;
+    }
+    try {
+        // Poppler reads the caller's bytes in place rather than copying them.
+        open_document(poppler::document::load_from_raw_data(reinterpret_cast<const char*>(pdf_data.data()),
+                                                            static_cast<int>(pdf_data.size())));
+    } catch (const std::exception& e) {
+        LogMessage(LogLevel::error, context_.log) << "Error loading PDF : " << e.what();
+    }
+}
+
+void PDFImageExtractor::open_document(poppler::document* document) {
+    document_ = std::unique_ptr<poppler::document>(document);
+    if (document_ && !document_->is_locked()) {
+        renderer_ = std::make_unique<poppler::page_renderer>();
+        renderer_->set_render_hint(poppler::page_renderer::antialiasing, true);
+        renderer_->set_render_hint(poppler::page_renderer::text_antialiasing, true);
+        valid_ = true;
+    } else {
+        LogMessage(LogLevel::error, context_.log) << "Failed to load PDF or PDF is locked: " << pdf_path_;
     }
 }
 
@@ -47,78 +204,297 @@ std::string PDFImageExtractor::generate_image_filename(int page_index, int image
     return base_name + "_page" + std::to_string(page_index + 1) + "_img" + std::to_string(image_index + 1) + "." + format;
 }
 
+// The page rectangle is unrotated while the renderer applies the page's rotation, so
+// quarter turns swap width and height.
+double PDFImageExtractor::page_dpi(const poppler::page& page, double dpi, const PageResolution& resolution) {
+    if (!resolution.enabled()) {
+        return dpi;
+    }
+    const poppler::rectf rect = page.page_rect();
+    const auto orientation = page.orientation();
+    const bool quarter_turn = orientation == poppler::page::landscape || orientation == poppler::page::seascape;
+    return quarter_turn ? resolution.dpi_for(rect.height(), rect.width(), dpi)
+                        : resolution.dpi_for(rect.width(), rect.height(), dpi);
+}
+
+// Estimated encoded size of one page, from the first page's geometry, so that a fresh
+// output buffer is allocated at its working size up front instead of grown by doubling.
+std::size_t PDFImageExtractor::encoded_size_hint() const {
+    if (!valid_ || document_->pages() == 0) {
+        return 0;
+    }
+    const auto page = std::unique_ptr<poppler::page>(document_->create_page(0));
+    if (!page) {
+        return 0;
+    }
+    const poppler::rectf rect = page->page_rect();
+    const double scale = page_dpi(*page, dpi_, resolution_) / 72.0;
+    const auto pixels = static_cast<std::size_t>(std::max(0.0, rect.width() * scale) * std::max(0.0, rect.height() * scale));
+    // Roughly 0.4 bytes per pixel for JPEG at common qualities; PNG stays near raw size.
+    return format_ == "jpeg" ? pixels * 2 / 5 : pixels * 3;
+}
+
 std::vector<PDFImageExtractor::ImageInfo> PDFImageExtractor::extract_images_from_page(int page_index, const std::string& output_dir) {
     std::vector<ImageInfo> extracted_images;
+    std::deque<PendingPage> in_flight;
+    start_page(page_index, PageDestination{output_dir}, encoded_size_hint(), in_flight);
+    for (auto& pending : in_flight) {
+        finish_page(pending, extracted_images);
+    }
+    return extracted_images;
+}
 
+void PDFImageExtractor::start_page(int page_index, const PageDestination& destination, std::size_t size_hint,
+                                   std::deque<PendingPage>& in_flight) {
     if (!valid_ || page_index < 0 || page_index >= document_->pages()) {
-        std::cerr << "Invalid page index : " << page_index << std::endl;
-        return extracted_images;
+        LogMessage(LogLevel::error, context_.log) << "Invalid page index : " << page_index;
+        return;
     }
     
+    if (context_.cancelled()) {
+        return;
+    }
+
+    TraceSpan page_span("page", page_index);
+    // Set while this page is registered as a first copy that has not been encoded yet,
+    // so that an exception withdraws it rather than leaving its repeats waiting.
+    std::optional<ContentHash> unencoded;
     try {
-        std::filesystem::create_directories(output_dir);
+        if (!destination.output) {
+            std::filesystem::create_directories(destination.directory);
+        }
         
         auto page = std::unique_ptr<poppler::page>(document_->create_page(page_index));
         if (!page) {
-            std::cerr << "Failed to create page: " << page_index << std::endl;
-            return extracted_images;
+            LogMessage(LogLevel::error, context_.log) << "Failed to create page: " << page_index;
+            return;
         }
         
+        const double dpi = page_dpi(*page, dpi_, resolution_);
+        if (resolution_.enabled()) {
+            LogMessage(LogLevel::debug, context_.log) << "Rendering page " << (page_index + 1) << " at " << dpi << " DPI";
+        }
+
         // Use shared page renderer to convert page to image
         poppler::image page_image;
         {
-            std::lock_guard<std::mutex> lock(renderer_mutex_);
-            page_image = renderer_->render_page(page.get(), dpi_, dpi_);
+            std::unique_lock<std::mutex> lock(renderer_mutex_, std::defer_lock);
+            {
+                // The renderer is shared, so time spent here shows how serialised rendering
+                // is; it is the page's queue wait in the stats.
+                TraceSpan wait_span("render_wait");
+                const auto wait_start = ConversionStats::Clock::now();
+                lock.lock();
+                if (context_.stats) {
+                    context_.stats->add_queue_wait(ConversionStats::Clock::now() - wait_start);
+                }
+            }
+            // Pages queue up on the renderer, so check again once it is ours.
+            if (context_.cancelled()) {
+                return;
+            }
+            TraceSpan render_span("render");
+            StageTimer timer(context_.stats, ConversionStage::render);
+            page_image = renderer_->render_page(page.get(), dpi, dpi);
         }
         
+        if (context_.cancelled()) {
+            return;
+        }
+
         if (page_image.is_valid()) {
-            std::string filename = generate_image_filename(page_index, 0, format_);
-            std::string full_path = std::filesystem::path(output_dir) / filename;
+            PixelBuffer rendered;
+            const bool described = describe_pixels(page_image, rendered);
+            PixelBuffer pixels = rendered;
+            bool blank = false;
+            if (described && analysis_.enabled()) {
+                TraceSpan analyze_span("analyze");
+                StageTimer timer(context_.stats, ConversionStage::analyze);
+                const PageContent content = PageAnalysis::find_content(rendered, analysis_.white_threshold);
+                blank = content.blank;
+                if (analysis_.crop) {
+                    pixels = PageAnalysis::crop(rendered, content, analysis_.crop_border);
+                }
+            }
+            if (blank && analysis_.blank_pages == BlankPageMode::skip) {
+                LogMessage(LogLevel::debug, context_.log) << "Skipping blank page " << (page_index + 1);
+                ++skipped_blank_pages_;
+                return;
+            }
+            if (blank && analysis_.blank_pages == BlankPageMode::flag) {
+                LogMessage(LogLevel::info, context_.log) << "Page " << (page_index + 1) << " is blank";
+            }
 
-            bool save_success;
-            if (format_ == "jpeg") {
-                save_success = page_image.save(full_path, format_, quality_);
+            PendingPage pending;
+            pending.page_index = page_index;
+            pending.info.name = generate_image_filename(page_index, 0, format_);
+            pending.info.width = pixels.width;
+            pending.info.height = pixels.height;
+            pending.info.format = format_;
+            pending.info.blank = blank;
+            pending.output = destination.output;
+            if (!destination.output) {
+                pending.path = std::filesystem::path(destination.directory) / pending.info.name;
+            }
+
+            // Repeats are copied from an earlier page's file or bytes, so there are none in
+            // memory. The first copy is registered before it is encoded, so that a repeat
+            // rendered meanwhile (by this worker or another) waits for it.
+            std::optional<WrittenPage> repeated;
+            if (described && !destination.output) {
+                const ContentHash pixels_hash = fingerprint_pixels(pixels);
+                std::unique_lock<std::mutex> lock(written_mutex_);
+                auto found = written_pages_.find(pixels_hash);
+                while (found != written_pages_.end() && !found->second.committed && !found->second.encoded) {
+                    written_changed_.wait(lock);
+                    found = written_pages_.find(pixels_hash);
+                }
+                if (found == written_pages_.end()) {
+                    written_pages_.emplace(pixels_hash, WrittenPage{pending.path});
+                    pending.pixels_hash = pixels_hash;
+                    unencoded = pixels_hash;
+                } else {
+                    repeated = found->second;
+                    if (!repeated->committed) {
+                        // Taken while the lock keeps the first copy's buffer alive.
+                        pending.encoded = BufferPool::shared().acquire(repeated->encoded->size());
+                        pending.encoded->assign(repeated->encoded->begin(), repeated->encoded->end());
+                    }
+                }
+            }
+
+            bool started = false;
+            if (repeated) {
+                // Same pixels as an earlier page: copy its encoded file, or its bytes while
+                // that file is still being written.
+                OutputSinkOptions sink_options;
+                sink_options.async = true;
+                pending.sink = std::make_unique<OutputSink>(sink_options);
+                started = pending.sink->open(pending.path) &&
+                          (repeated->committed ? pending.sink->append_file_range(repeated->path, 0, repeated->size)
+                                               : pending.sink->write_external(pending.encoded->data(), pending.encoded->size()));
+                if (!started) {
+                    LogMessage(LogLevel::error, context_.log) << pending.sink->error();
+                    pending.sink.reset();
+                } else {
+                    pending.bytes = repeated->size;
+                    pending.info.repeats = std::filesystem::path(repeated->path).filename().string();
+                    if (context_.stats) {
+                        context_.stats->add_duplicates(ConversionStage::encode, 1, repeated->size, repeated->encode_time);
+                    }
+                    LogMessage(LogLevel::debug, context_.log) << "Page " << (page_index + 1) << " repeats "
+                                                               << std::filesystem::path(repeated->path).filename().string();
+                }
+            } else if (destination.output) {
+                // Handed to the output in finish_page(), like a file write is completed there.
+                pending.encoded = BufferPool::shared().acquire(size_hint);
+                started = described && encode_page(pixels, format_, quality_, dpi, context_, *pending.encoded);
+                pending.bytes = pending.encoded->size();
             } else {
-                save_success = page_image.save(full_path, format_);
+                pending.encoded = BufferPool::shared().acquire(size_hint);
+                const auto encode_start = ConversionStats::Clock::now();
+                started = start_page_write(page_image, described ? &pixels : nullptr, pending.path, format_, quality_,
+                                           dpi, context_, *pending.encoded, pending.sink);
+                pending.encode_time = ConversionStats::Clock::now() - encode_start;
+                pending.bytes = pending.encoded->size();
+                if (started && pending.pixels_hash) {
+                    std::lock_guard<std::mutex> lock(written_mutex_);
+                    WrittenPage& written = written_pages_.at(*pending.pixels_hash);
+                    written.size = pending.bytes;
+                    written.encode_time = pending.encode_time;
+                    written.encoded = &*pending.encoded;  // stays put when the lease moves
+                    written_changed_.notify_all();
+                }
             }
+            unencoded.reset();
 
-            if (save_success) {
-                ImageInfo info;
-                info.name = filename;
-                info.width = page_image.width();
-                info.height = page_image.height();
-                info.format = format_;
-                extracted_images.push_back(info);
-                
-                std::cout << "Extracted page as image: " << filename 
-                          << " (" << info.width << "x" << info.height << ")" << std::endl;
+            if (started) {
+                in_flight.push_back(std::move(pending));
             } else {
-                std::cerr << "Failed to save page image: " << filename << std::endl;
+                forget_page(pending.pixels_hash);
+                LogMessage(LogLevel::error, context_.log) << "Failed to save page image: " << pending.info.name;
             }
         } else {
-            std::cerr << "Failed to render page " << (page_index + 1) << std::endl;
+            LogMessage(LogLevel::error, context_.log) << "Failed to render page " << (page_index + 1);
         }
     } catch (const std::exception& e) {
-        std::cerr << "Error extracting images from page " << page_index << ": " << e.what() << std::endl;
+        forget_page(unencoded);
+        LogMessage(LogLevel::error, context_.log) << "Error extracting images from page " << page_index << ": " << e.what();
     }
-    
-    return extracted_images;
+}
+
+void PDFImageExtractor::finish_page(PendingPage& pending, std::vector<ImageInfo>& images) {
+    if (pending.output) {
+        TraceSpan span("write");
+        StageTimer timer(context_.stats, ConversionStage::write);
+        timer.add_bytes(pending.bytes);
+        if (!(*pending.output)(pending.page_index, pending.info.name, pending.encoded->data(), pending.encoded->size())) {
+            LogMessage(LogLevel::error, context_.log) << "Failed to save page image: " << pending.info.name;
+            return;
+        }
+    } else if (pending.sink) {
+        // Only the part of the write that did not overlap rendering is counted here.
+        TraceSpan span("write");
+        StageTimer timer(context_.stats, ConversionStage::write);
+        timer.add_bytes(pending.bytes);
+        if (!pending.sink->commit()) {
+            forget_page(pending.pixels_hash);
+            LogMessage(LogLevel::error, context_.log) << pending.sink->error();
+            LogMessage(LogLevel::error, context_.log) << "Failed to save page image: " << pending.info.name;
+            return;
+        }
+    }
+
+    // Later repeats copy the committed file; the encoded buffer goes back to the pool.
+    if (pending.pixels_hash && pending.sink) {
+        std::lock_guard<std::mutex> lock(written_mutex_);
+        WrittenPage& written = written_pages_.at(*pending.pixels_hash);
+        written.committed = true;
+        written.encoded = nullptr;
+    }
+
+    images.push_back(pending.info);
+    if (context_.stats) {
+        context_.stats->add_pages(1);
+    }
+    if (context_.page_written && !pending.output) {
+        context_.page_written(pending.page_index, pending.path);
+    }
+    LogMessage(LogLevel::debug, context_.log) << "Extracted page as image: " << pending.info.name
+                                               << " (" << pending.info.width << "x" << pending.info.height << ")";
+}
+
+void PDFImageExtractor::forget_page(const std::optional<ContentHash>& pixels_hash) {
+    if (!pixels_hash) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(written_mutex_);
+    written_pages_.erase(*pixels_hash);
+    written_changed_.notify_all();
 }
 
 std::vector<PDFImageExtractor::ImageInfo> PDFImageExtractor::extract_all_images(const std::string& output_dir) {
+    return extract_all(PageDestination{output_dir});
+}
+
+std::vector<PDFImageExtractor::ImageInfo> PDFImageExtractor::extract_all_images(const PageImageOutput& output) {
+    return extract_all(PageDestination{{}, &output});
+}
+
+std::vector<PDFImageExtractor::ImageInfo> PDFImageExtractor::extract_all(const PageDestination& destination) {
     std::vector<ImageInfo> all_images;
     
     if (!valid_) {
-        std::cerr << "PDF document is not valid" << std::endl;
+        LogMessage(LogLevel::error, context_.log) << "PDF document is not valid";
         return all_images;
     }
     
     int total_pages = get_page_count();
-    std::cout << "Extracting images from " << total_pages << " pages..." << std::endl;
+    LogMessage(LogLevel::info, context_.log) << "Extracting images from " << total_pages << " pages...";
     
-    // Use parallel processing for page extraction
-    const unsigned int num_threads = std::min(static_cast<unsigned int>(total_pages), 
-                                               std::thread::hardware_concurrency());
+    // Use parallel processing for page extraction, one worker per CPU the process may use
+    const unsigned int num_threads = std::min(static_cast<unsigned int>(total_pages),
+                                               Concurrency::worker_threads());
     
     std::vector<std::future<std::vector<ImageInfo>>> futures;
     std::vector<int> page_indices;
@@ -129,15 +505,47 @@ std::vector<PDFImageExtractor::ImageInfo> PDFImageExtractor::extract_all_images(
     }
     
     // Launch async tasks
+    std::mutex progress_mutex;
+    int pages_done = 0;
+
+    // Each in-flight page leases its own output buffer; the pool recycles them across pages.
+    const std::size_t size_hint = encoded_size_hint();
     for (unsigned int t = 0; t < num_threads; ++t) {
         int start = (total_pages * t) / num_threads;
         int end = (total_pages * (t + 1)) / num_threads;
         
-        futures.emplace_back(std::async(std::launch::async, [this, &output_dir, start, end]() {
+        futures.emplace_back(std::async(std::launch::async, [this, &destination, &progress_mutex, &pages_done,
+                                                               total_pages, start, end, size_hint, t]() {
+            Trace::set_thread_name("page worker");
+            Concurrency::pin_current_thread(t, context_.cpu_slot);
             std::vector<ImageInfo> thread_images;
+            std::deque<PendingPage> in_flight;
+            // Pages handed to an output have no file write to overlap with the next
+            // render, so they are finished straight away instead of waiting in line.
+            const std::size_t pages_in_flight = destination.output ? 0 : kPagesInFlight;
             for (int i = start; i < end; ++i) {
-                auto page_images = extract_images_from_page(i, output_dir);
-                thread_images.insert(thread_images.end(), page_images.begin(), page_images.end());
+                if (context_.cancelled()) {
+                    break;
+                }
+                start_page(i, destination, size_hint, in_flight);
+                while (in_flight.size() > pages_in_flight) {
+                    finish_page(in_flight.front(), thread_images);
+                    in_flight.pop_front();
+                }
+
+                // Serialised so the reported counts only ever increase.
+                if (context_.progress) {
+                    std::lock_guard<std::mutex> lock(progress_mutex);
+                    context_.report_progress(++pages_done, total_pages);
+                }
+            }
+            // Writes still running on cancellation are discarded with their sinks.
+            for (auto& pending : in_flight) {
+                if (context_.cancelled()) {
+                    forget_page(pending.pixels_hash);
+                } else {
+                    finish_page(pending, thread_images);
+                }
             }
             return thread_images;
         }));
@@ -149,6 +557,9 @@ std::vector<PDFImageExtractor::ImageInfo> PDFImageExtractor::extract_all_images(
         all_images.insert(all_images.end(), thread_images.begin(), thread_images.end());
     }
     
-    std::cout << "Total images extracted: " << all_images.size() << std::endl;
+    if (skipped_blank_pages_ > 0) {
+        LogMessage(LogLevel::info, context_.log) << "Skipped blank pages: " << skipped_blank_pages_.load();
+    }
+    LogMessage(LogLevel::info, context_.log) << "Total images extracted: " << all_images.size();
     return all_images;
 }
\ No newline at end of file
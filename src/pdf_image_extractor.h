@@ -1,18 +1,57 @@
 #pragma once
 
+#include <chrono>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <span>
 #include <string>
 #include <vector>
+#include <deque>
 #include <memory>
 #include <mutex>
+#include <optional>
+#include <unordered_map>
+
+#include "buffer_pool.h"
+#include "content_hash.h"
+#include "conversion_context.h"
+#include "page_analysis.h"
 
 namespace poppler {
     class document;
+    class page;
     class page_renderer;
 }
 
+// Renders pages to a pixel size rather than all at one DPI: each page's DPI is worked
+// out from its page rectangle before it is rendered, so oversized pages are not
+// rendered larger than needed and small ones come out large enough. 0 leaves a limit
+// unset; with neither set every page uses the fixed DPI.
+struct PageResolution {
+    int target_height = 0;  // render every page this many pixels tall
+    int max_long_edge = 0;  // cap on the longer side, applied after target_height or the fixed DPI
+
+    bool enabled() const { return target_height > 0 || max_long_edge > 0; }
+    // DPI for a page of the given size in points (as displayed, i.e. after rotation).
+    double dpi_for(double width_points, double height_points, double fixed_dpi) const;
+};
+
+// Receives each encoded page image instead of it being written to a file. Called from
+// page worker threads, possibly concurrently; returning false fails that page.
+using PageImageOutput = std::function<bool(int page, const std::string& name, const std::uint8_t* data, std::size_t size)>;
+
 class PDFImageExtractor {
 public:
-    explicit PDFImageExtractor(const std::string& pdf_path, const std::string& format = "jpeg", int quality = 80, double dpi = 150.0);
+    explicit PDFImageExtractor(const std::string& pdf_path, const std::string& format = "jpeg", int quality = 80, double dpi = 150.0,
+                               const ConversionContext& context = {}, const PageAnalysisOptions& analysis = {},
+                               const PageResolution& resolution = {});
+    // Renders a PDF held in memory, which must stay valid for the extractor's lifetime.
+    // name takes the place of the file name in the page image names.
+    PDFImageExtractor(std::span<const std::uint8_t> pdf_data, const std::string& name, const std::string& format = "jpeg",
+                      int quality = 80, double dpi = 150.0, const ConversionContext& context = {},
+                      const PageAnalysisOptions& analysis = {}, const PageResolution& resolution = {});
     ~PDFImageExtractor();
 
     bool is_valid() const;
@@ -23,10 +62,20 @@ public:
         int width;
         int height;
         std::string format;
+        bool blank = false;  // set when blank pages are flagged
+        // Name of the earlier page image this one is a byte-for-byte copy of; empty when
+        // the page was encoded itself.
+        std::string repeats;
     };
     
     std::vector<ImageInfo> extract_images_from_page(int page_index, const std::string& output_dir = ".");
     std::vector<ImageInfo> extract_all_images(const std::string& output_dir = ".");
+    // Hands every page image to output instead of writing files. Repeated pages are
+    // encoded again, since there is no earlier file to copy them from.
+    std::vector<ImageInfo> extract_all_images(const PageImageOutput& output);
+
+    // Rendering DPI of a page: dpi, unless resolution sets a pixel target.
+    static double page_dpi(const poppler::page& page, double dpi, const PageResolution& resolution);
 
 private:
     std::unique_ptr<poppler::document> document_;
@@ -37,6 +86,45 @@ private:
     std::string format_;
     int quality_;
     double dpi_;
+    ConversionContext context_;
+    PageAnalysisOptions analysis_;
+    PageResolution resolution_;
+    std::atomic<int> skipped_blank_pages_{0};
+
+    // Pages by fingerprint of their rendered pixels, registered when the first copy
+    // starts. A page that renders identically (blank separators, repeated covers) is
+    // copied from the first one instead of being encoded again: from its encoded bytes
+    // while its write is in flight, from its file once committed. A repeat that arrives
+    // while the first copy is still encoding waits for it on written_changed_.
+    struct WrittenPage {
+        std::string path;
+        std::uint64_t size = 0;
+        std::chrono::steady_clock::duration encode_time{};
+        // The first copy's encoded bytes, owned by its PendingPage; null while it is
+        // still encoding and once its file is committed.
+        const std::vector<std::uint8_t>* encoded = nullptr;
+        bool committed = false;
+    };
+    std::mutex written_mutex_;
+    std::condition_variable written_changed_;
+    std::unordered_map<ContentHash, WrittenPage, ContentHash::Hasher> written_pages_;
     
+    void open_document(poppler::document* document);
     std::string generate_image_filename(int page_index, int image_index, const std::string& format) const;
+    // Where finished pages go: files in directory, or output when it is set.
+    struct PageDestination {
+        std::string directory;
+        const PageImageOutput* output = nullptr;
+    };
+    std::vector<ImageInfo> extract_all(const PageDestination& destination);
+    // A page is rendered and encoded by start_page(), which leaves its write running;
+    // finish_page() waits for the write and records the image.
+    struct PendingPage;
+    void start_page(int page_index, const PageDestination& destination, std::size_t size_hint, std::deque<PendingPage>& in_flight);
+    void finish_page(PendingPage& pending, std::vector<ImageInfo>& images);
+    // Withdraws a first copy (by its pixels_hash; unset does nothing) that will not be
+    // committed, so that its repeats encode themselves instead of waiting for or
+    // copying from it.
+    void forget_page(const std::optional<ContentHash>& pixels_hash);
+    std::size_t encoded_size_hint() const;
 };
\ No newline at end of file
@@ -0,0 +1,169 @@
+#include "png_image_loader.h"
+#include "buffer_pool.h"
+#include "log.h"
+
+#include <png.h>
+#include <zlib.h>
+
+#include <cstring>
+
+namespace {
+constexpr std::uint8_t kPngSignature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+constexpr int kColorTypeGray = 0;
+constexpr int kColorTypeRgb = 2;
+
+struct PngHeader {
+    int width = 0;
+    int height = 0;
+    int bit_depth = 0;
+    int color_type = 0;
+    int interlace = 0;
+    bool has_transparency = false;
+};
+
+std::uint32_t read_u32_be(const std::uint8_t* data) {
+    return static_cast<std::uint32_t>(data[0]) << 24 |
+           static_cast<std::uint32_t>(data[1]) << 16 |
+           static_cast<std::uint32_t>(data[2]) << 8 |
+           static_cast<std::uint32_t>(data[3]);
+}
+
+// Walks the chunk list, reading IHDR and concatenating the IDAT payloads (which
+// together form a single zlib stream). CRCs are not verified.
+bool read_png_chunks(const std::vector<std::uint8_t>& data, PngHeader& header, std::vector<std::uint8_t>& idat) {
+    if (data.size() < sizeof(kPngSignature) || std::memcmp(data.data(), kPngSignature, sizeof(kPngSignature)) != 0) {
+        return false;
+    }
+
+    bool have_header = false;
+    std::size_t index = sizeof(kPngSignature);
+    while (index + 12 <= data.size()) {
+        const std::uint32_t length = read_u32_be(&data[index]);
+        const std::uint8_t* type = &data[index + 4];
+        const std::size_t payload = index + 8;
+        if (length > data.size() - payload - 4) {
+            return false;
+        }
+
+        if (std::memcmp(type, "IHDR", 4) == 0) {
+            if (length < 13) {
+                return false;
+            }
+            header.width = static_cast<int>(read_u32_be(&data[payload]));
+            header.height = static_cast<int>(read_u32_be(&data[payload + 4]));
+            header.bit_depth = data[payload + 8];
+            header.color_type = data[payload + 9];
+            header.interlace = data[payload + 12];
+            have_header = true;
+        } else if (std::memcmp(type, "tRNS", 4) == 0) {
+            header.has_transparency = true;
+        } else if (std::memcmp(type, "IDAT", 4) == 0) {
+            idat.insert(idat.end(), data.begin() + static_cast<std::ptrdiff_t>(payload),
+                        data.begin() + static_cast<std::ptrdiff_t>(payload + length));
+        } else if (std::memcmp(type, "IEND", 4) == 0) {
+            break;
+        }
+
+        index = payload + length + 4;
+    }
+
+    return have_header && header.width > 0 && header.height > 0 && !idat.empty();
+}
+
+// Compresses into a pooled scratch buffer sized for the worst case, then copies out only
+// the compressed bytes, so the image kept until the PDF is written holds no slack.
+bool deflate_samples(const std::uint8_t* samples, std::size_t size, std::vector<std::uint8_t>& output) {
+    uLongf compressed_size = compressBound(static_cast<uLong>(size));
+    BufferPool::Lease scratch = BufferPool::shared().acquire(compressed_size);
+    scratch->resize(compressed_size);
+    if (compress2(scratch->data(), &compressed_size, samples, static_cast<uLong>(size), Z_DEFAULT_COMPRESSION) != Z_OK) {
+        return false;
+    }
+    output.assign(scratch->data(), scratch->data() + compressed_size);
+    return true;
+}
+
+// Full decode through libpng for interlaced, paletted, 16-bit, transparent or
+// alpha images, producing 8-bit gray/RGB samples plus an optional alpha plane.
+bool decode_and_deflate(const std::vector<std::uint8_t>& png_data, PDFImageInput& image) {
+    png_image decoded;
+    std::memset(&decoded, 0, sizeof(decoded));
+    decoded.version = PNG_IMAGE_VERSION;
+
+    if (!png_image_begin_read_from_memory(&decoded, png_data.data(), png_data.size())) {
+        LogMessage(LogLevel::warning) << "Warning: Failed to read PNG " << image.name << ": " << decoded.message;
+        return false;
+    }
+
+    const bool has_color = (decoded.format & PNG_FORMAT_FLAG_COLOR) != 0;
+    const bool has_alpha = (decoded.format & PNG_FORMAT_FLAG_ALPHA) != 0;
+    decoded.format = (has_color ? PNG_FORMAT_RGB : PNG_FORMAT_GRAY) | (has_alpha ? PNG_FORMAT_FLAG_ALPHA : 0);
+
+    const int color_components = has_color ? 3 : 1;
+    const int channels = color_components + (has_alpha ? 1 : 0);
+    const std::size_t pixel_count = static_cast<std::size_t>(decoded.width) * decoded.height;
+
+    BufferPool::Lease pixel_buffer = BufferPool::shared().acquire(PNG_IMAGE_SIZE(decoded));
+    std::vector<std::uint8_t>& pixels = *pixel_buffer;
+    pixels.resize(PNG_IMAGE_SIZE(decoded));
+    if (!png_image_finish_read(&decoded, nullptr, pixels.data(), 0, nullptr)) {
+        LogMessage(LogLevel::warning) << "Warning: Failed to decode PNG " << image.name << ": " << decoded.message;
+        png_image_free(&decoded);
+        return false;
+    }
+
+    image.width = static_cast<int>(decoded.width);
+    image.height = static_cast<int>(decoded.height);
+    image.components = color_components;
+    image.bits_per_component = 8;
+    image.filter = PDFImageFilter::flate;
+    image.png_predictors = false;
+    image.alpha.clear();
+
+    if (!has_alpha) {
+        return deflate_samples(pixels.data(), pixels.size(), image.data);
+    }
+
+    BufferPool::Lease color_buffer = BufferPool::shared().acquire(pixel_count * color_components);
+    BufferPool::Lease alpha_buffer = BufferPool::shared().acquire(pixel_count);
+    std::vector<std::uint8_t>& color = *color_buffer;
+    std::vector<std::uint8_t>& alpha = *alpha_buffer;
+    color.resize(pixel_count * color_components);
+    alpha.resize(pixel_count);
+    for (std::size_t i = 0; i < pixel_count; ++i) {
+        const std::uint8_t* pixel = &pixels[i * channels];
+        std::memcpy(&color[i * color_components], pixel, static_cast<std::size_t>(color_components));
+        alpha[i] = pixel[color_components];
+    }
+
+    return deflate_samples(color.data(), color.size(), image.data) &&
+           deflate_samples(alpha.data(), alpha.size(), image.alpha);
+}
+}
+
+bool PNGImageLoader::load_for_pdf(const std::vector<std::uint8_t>& png_data, PDFImageInput& image) {
+    PngHeader header;
+    std::vector<std::uint8_t> idat;
+    if (!read_png_chunks(png_data, header, idat)) {
+        return false;
+    }
+
+    const bool passthrough = header.interlace == 0 &&
+                             header.bit_depth == 8 &&
+                             !header.has_transparency &&
+                             (header.color_type == kColorTypeGray || header.color_type == kColorTypeRgb);
+    if (!passthrough) {
+        return decode_and_deflate(png_data, image);
+    }
+
+    image.width = header.width;
+    image.height = header.height;
+    image.components = header.color_type == kColorTypeRgb ? 3 : 1;
+    image.bits_per_component = 8;
+    image.filter = PDFImageFilter::flate;
+    image.png_predictors = true;
+    image.data = std::move(idat);
+    image.alpha.clear();
+    return true;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "pdf_creator.h"
+
+class PNGImageLoader {
+public:
+    // Fills the image fields of a PDF image from a PNG file. Non-interlaced 8-bit gray
+    // and RGB images keep their compressed IDAT data as-is (FlateDecode with PNG
+    // predictors); everything else is decoded and re-deflated, with any alpha channel
+    // split out into a soft mask.
+    static bool load_for_pdf(const std::vector<std::uint8_t>& png_data, PDFImageInput& image);
+};
@@ -0,0 +1,412 @@
+#include "process_pool.h"
+#include "log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+
+#ifndef _WIN32
+#include <csignal>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+// Descriptor on which a worker writes its replies; 0-2 stay the usual streams so that
+// its log output still reaches the console.
+constexpr int kReplyFd = 3;
+
+constexpr double kMinJobTimeoutSeconds = 120.0;
+constexpr double kTimeoutPerEstimatedSecond = 20.0;
+// Workers of one slot that may die before finishing any job, e.g. because the command
+// exits on bad arguments, before the slot is given up.
+constexpr int kMaxEarlyExits = 3;
+// Exit status of a child whose exec failed, as shells use for a missing command.
+constexpr int kExecFailedStatus = 127;
+
+#ifndef _WIN32
+struct Worker {
+    pid_t pid = -1;
+    int job_fd = -1;     // parent's end of the worker's standard input
+    int reply_fd = -1;   // parent's end of the worker's reply pipe
+    std::string buffer;  // reply bytes received so far
+    bool busy = false;
+    std::size_t job = 0;
+    Clock::time_point started;
+    Clock::time_point deadline;
+    bool finished_job = false;  // this process has replied to at least one job
+    int early_exits = 0;        // workers of this slot that died before taking a job, since it last finished one
+};
+
+bool make_pipe(int fds[2]) {
+    if (::pipe(fds) != 0) {
+        return false;
+    }
+    ::fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    ::fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return true;
+}
+
+// Starts a worker and waits until it has exec'd; a command that cannot be executed
+// fails here, with errno set, rather than as a worker that dies on its first job.
+bool start_worker(const ProcessPoolOptions& options, std::size_t slot, Worker& worker) {
+    int job_pipe[2];
+    int reply_pipe[2];
+    int exec_pipe[2];  // the child's exec errno; closed without data by a successful exec
+    if (!make_pipe(job_pipe)) {
+        return false;
+    }
+    if (!make_pipe(reply_pipe)) {
+        ::close(job_pipe[0]);
+        ::close(job_pipe[1]);
+        return false;
+    }
+    if (!make_pipe(exec_pipe)) {
+        for (const int fd : {job_pipe[0], job_pipe[1], reply_pipe[0], reply_pipe[1]}) {
+            ::close(fd);
+        }
+        return false;
+    }
+
+    // Built before fork(): the child of a multithreaded process may only make
+    // async-signal-safe calls until it execs.
+    std::vector<std::string> command = options.worker_command;
+    if (!options.slot_option.empty()) {
+        command.push_back(options.slot_option);
+        command.push_back(std::to_string(slot));
+    }
+    std::vector<char*> argv;
+    for (const auto& argument : command) {
+        argv.push_back(const_cast<char*>(argument.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    const pid_t pid = ::fork();
+    if (pid < 0) {
+        for (const int fd : {job_pipe[0], job_pipe[1], reply_pipe[0], reply_pipe[1], exec_pipe[0], exec_pipe[1]}) {
+            ::close(fd);
+        }
+        return false;
+    }
+    if (pid == 0) {
+        // dup2() clears close-on-exec on the new descriptors.
+        if (::dup2(job_pipe[0], STDIN_FILENO) >= 0 && ::dup2(reply_pipe[1], kReplyFd) >= 0) {
+            ::execvp(argv[0], argv.data());
+        }
+        const int error = errno;
+        [[maybe_unused]] const ssize_t written = ::write(exec_pipe[1], &error, sizeof(error));
+        ::_exit(kExecFailedStatus);
+    }
+
+    ::close(job_pipe[0]);
+    ::close(reply_pipe[1]);
+    ::close(exec_pipe[1]);
+    int exec_error = 0;
+    ssize_t got = 0;
+    do {
+        got = ::read(exec_pipe[0], &exec_error, sizeof(exec_error));
+    } while (got < 0 && errno == EINTR);
+    ::close(exec_pipe[0]);
+    if (got > 0) {
+        for (const int fd : {job_pipe[1], reply_pipe[0]}) {
+            ::close(fd);
+        }
+        ::waitpid(pid, nullptr, 0);
+        errno = exec_error;
+        return false;
+    }
+    worker = Worker{};
+    worker.pid = pid;
+    worker.job_fd = job_pipe[1];
+    worker.reply_fd = reply_pipe[0];
+    return true;
+}
+
+// Closes the worker's pipes, killing it first if requested, and reaps it. Returns a
+// description of how it ended; exit_status, if given, receives the status it exited
+// with (-1 when it was killed).
+std::string stop_worker(Worker& worker, bool kill, int* exit_status = nullptr) {
+    if (kill && worker.pid > 0) {
+        ::kill(worker.pid, SIGKILL);
+    }
+    if (worker.job_fd >= 0) {
+        ::close(worker.job_fd);  // end of input: an idle worker exits on its own
+    }
+    if (worker.reply_fd >= 0) {
+        ::close(worker.reply_fd);
+    }
+    std::string ending = "stopped";
+    int status = 0;
+    if (exit_status) {
+        *exit_status = -1;
+    }
+    if (worker.pid > 0 && ::waitpid(worker.pid, &status, 0) == worker.pid) {
+        if (WIFSIGNALED(status)) {
+            ending = "killed by signal " + std::to_string(WTERMSIG(status)) + " (" + strsignal(WTERMSIG(status)) + ")";
+        } else if (WIFEXITED(status)) {
+            ending = "exited with status " + std::to_string(WEXITSTATUS(status));
+            if (exit_status) {
+                *exit_status = WEXITSTATUS(status);
+            }
+        }
+    }
+    worker = Worker{};
+    return ending;
+}
+
+// An idle worker has nothing to say, so any event on its reply pipe (end of file, or
+// output it should not have written) means it has died or is unusable.
+bool idle_worker_exited(const Worker& worker) {
+    pollfd fd{worker.reply_fd, POLLIN, 0};
+    return ::poll(&fd, 1, 0) > 0 && fd.revents != 0;
+}
+
+// Whether the job line written to the worker is still in its input pipe, i.e. it died
+// without reading it. Only answerable where FIONREAD works on pipes; false elsewhere.
+bool job_unread(const Worker& worker) {
+    int unread = 0;
+    return worker.job_fd >= 0 && ::ioctl(worker.job_fd, FIONREAD, &unread) == 0 && unread > 0;
+}
+
+bool write_all(int fd, const std::string& data) {
+    std::size_t written = 0;
+    while (written < data.size()) {
+        const ssize_t result = ::write(fd, data.data() + written, data.size() - written);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            return false;
+        }
+        written += static_cast<std::size_t>(result);
+    }
+    return true;
+}
+
+double timeout_for(const JobEstimate& estimate, const ProcessPoolOptions& options) {
+    if (options.job_timeout > 0.0) {
+        return options.job_timeout;
+    }
+    return std::max(kMinJobTimeoutSeconds, estimate.seconds * kTimeoutPerEstimatedSecond);
+}
+#endif
+}
+
+#ifdef _WIN32
+bool ProcessPool::run(const std::vector<std::string>&, const std::vector<JobEstimate>&,
+                      const ProcessPoolOptions&, std::vector<ProcessJobResult>& results) {
+    results.clear();
+    LogMessage(LogLevel::error) << "Worker processes are not supported on this platform";
+    return false;
+}
+
+int ProcessPool::serve(const std::function<std::string(const std::string&)>&) {
+    return 1;
+}
+#else
+bool ProcessPool::run(const std::vector<std::string>& jobs, const std::vector<JobEstimate>& estimates,
+                      const ProcessPoolOptions& options, std::vector<ProcessJobResult>& results) {
+    results.assign(jobs.size(), ProcessJobResult{});
+    if (jobs.empty()) {
+        return true;
+    }
+    // A worker that dies between jobs must fail the write, not end this process.
+    std::signal(SIGPIPE, SIG_IGN);
+
+    std::deque<std::size_t> pending;
+    std::size_t remaining = jobs.size();
+    for (const std::size_t index : BatchPlanner::longest_first(estimates)) {
+        if (jobs[index].find('\n') != std::string::npos) {
+            LogMessage(LogLevel::error) << "Cannot hand a job with a line break to a worker: " << jobs[index];
+            --remaining;
+        } else {
+            pending.push_back(index);
+        }
+    }
+
+    std::vector<Worker> workers(std::min<std::size_t>(jobs.size(), static_cast<std::size_t>(std::max(options.processes, 1))));
+    std::size_t running = 0;
+    for (std::size_t slot = 0; slot < workers.size(); ++slot) {
+        if (start_worker(options, slot, workers[slot])) {
+            ++running;
+        } else {
+            LogMessage(LogLevel::error) << "Failed to start a worker process: " << std::strerror(errno);
+        }
+    }
+    if (running == 0) {
+        return false;
+    }
+
+    // Starts a new worker in the slot of one that was stopped (keeping the slot's count
+    // of early exits), unless workers keep dying there without finishing a job.
+    auto replace_worker = [&](Worker& worker, int early_exits) {
+        if (early_exits > kMaxEarlyExits) {
+            LogMessage(LogLevel::error) << "Worker processes keep exiting before finishing a job; not restarting";
+            return;
+        }
+        if (start_worker(options, static_cast<std::size_t>(&worker - workers.data()), worker)) {
+            worker.early_exits = early_exits;
+            ++running;
+        } else {
+            LogMessage(LogLevel::error) << "Failed to restart a worker process: " << std::strerror(errno);
+        }
+    };
+
+    // Replaces a worker that died while it had no job, without charging any job for it.
+    auto restart_idle = [&](Worker& worker, const std::string& reason) {
+        const int early_exits = worker.early_exits + 1;
+        const std::string ending = stop_worker(worker, true);
+        --running;
+        LogMessage(LogLevel::warning) << "Warning: idle worker " << reason << " (" << ending << "); restarting it";
+        replace_worker(worker, early_exits);
+    };
+
+    // Kills the worker running a job, then queues the job again or quarantines it, and
+    // replaces the worker. A worker that never finished a job and died without taking
+    // this one (its line still unread, or the exec failure status) is not the job's
+    // fault: the job goes back without an attempt, and the slot counts an early exit.
+    auto fail_job = [&](Worker& worker, const std::string& reason) {
+        const std::size_t job = worker.job;
+        const double seconds = std::chrono::duration<double>(Clock::now() - worker.started).count();
+        const bool first_job = !worker.finished_job;
+        const bool unread = job_unread(worker);
+        const int early_exits = worker.early_exits;
+        int exit_status = -1;
+        const std::string ending = stop_worker(worker, true, &exit_status);
+        --running;
+        if (first_job && (unread || exit_status == kExecFailedStatus)) {
+            LogMessage(LogLevel::warning) << "Warning: worker " << reason << " (" << ending << ") before taking "
+                                          << jobs[job] << "; restarting it";
+            --results[job].attempts;
+            pending.push_front(job);
+            replace_worker(worker, early_exits + 1);
+            return;
+        }
+        results[job].seconds = seconds;
+        if (results[job].attempts <= options.retries) {
+            LogMessage(LogLevel::warning) << "Warning: worker " << reason << " (" << ending << ") on " << jobs[job]
+                                          << "; retrying in a new worker";
+            pending.push_front(job);
+        } else {
+            LogMessage(LogLevel::error) << "Worker " << reason << " (" << ending << ") on " << jobs[job] << " after "
+                                        << results[job].attempts << (results[job].attempts == 1 ? " attempt" : " attempts")
+                                        << "; quarantined";
+            results[job].quarantined = true;
+            --remaining;
+        }
+        replace_worker(worker, early_exits);
+    };
+
+    while (remaining > 0 && running > 0) {
+        for (auto& worker : workers) {
+            if (worker.pid <= 0 || worker.busy || pending.empty()) {
+                continue;
+            }
+            if (idle_worker_exited(worker)) {
+                restart_idle(worker, "exited");
+                continue;
+            }
+            worker.job = pending.front();
+            pending.pop_front();
+            worker.busy = true;
+            worker.started = Clock::now();
+            worker.deadline = worker.started + std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(timeout_for(estimates[worker.job], options)));
+            if (!write_all(worker.job_fd, jobs[worker.job] + "\n")) {
+                // The job never reached the worker, so it goes back without an attempt.
+                pending.push_front(worker.job);
+                restart_idle(worker, "could not be given a job");
+                continue;
+            }
+            ++results[worker.job].attempts;
+        }
+
+        // Wait for replies, waking at the nearest deadline.
+        std::vector<pollfd> fds;
+        std::vector<Worker*> polled;
+        auto wait = std::chrono::milliseconds(1000);
+        const auto now = Clock::now();
+        for (auto& worker : workers) {
+            if (worker.pid > 0 && worker.busy) {
+                fds.push_back({worker.reply_fd, POLLIN, 0});
+                polled.push_back(&worker);
+                wait = std::min(wait, std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::max(worker.deadline - now, Clock::duration::zero())));
+            }
+        }
+        if (fds.empty()) {
+            continue;
+        }
+        if (::poll(fds.data(), fds.size(), static_cast<int>(wait.count())) < 0 && errno != EINTR) {
+            LogMessage(LogLevel::error) << "Waiting for worker processes failed: " << std::strerror(errno);
+            break;
+        }
+
+        for (std::size_t i = 0; i < fds.size(); ++i) {
+            Worker& worker = *polled[i];
+            if (fds[i].revents != 0) {
+                char data[4096];
+                const ssize_t size = ::read(worker.reply_fd, data, sizeof(data));
+                if (size <= 0) {
+                    fail_job(worker, "crashed");
+                    continue;
+                }
+                worker.buffer.append(data, static_cast<std::size_t>(size));
+                const auto newline = worker.buffer.find('\n');
+                if (newline != std::string::npos) {
+                    ProcessJobResult& result = results[worker.job];
+                    result.completed = true;
+                    result.reply = worker.buffer.substr(0, newline);
+                    result.seconds = std::chrono::duration<double>(Clock::now() - worker.started).count();
+                    worker.buffer.erase(0, newline + 1);
+                    worker.busy = false;
+                    worker.finished_job = true;
+                    worker.early_exits = 0;
+                    --remaining;
+                    continue;
+                }
+            }
+            if (Clock::now() >= worker.deadline) {
+                const auto limit = std::chrono::duration<double>(worker.deadline - worker.started).count();
+                fail_job(worker, "timed out after " + std::to_string(static_cast<long long>(limit)) + " s");
+            }
+        }
+    }
+
+    if (remaining > 0) {
+        LogMessage(LogLevel::error) << "No worker processes left; " << remaining << " jobs were not run";
+    }
+    for (auto& worker : workers) {
+        if (worker.pid > 0) {
+            stop_worker(worker, worker.busy);
+        }
+    }
+    return true;
+}
+
+int ProcessPool::serve(const std::function<std::string(const std::string&)>& run_job) {
+    FILE* replies = ::fdopen(kReplyFd, "w");
+    if (!replies) {
+        std::cerr << "Error: not started as a worker process" << std::endl;
+        return 1;
+    }
+    std::string job;
+    while (std::getline(std::cin, job)) {
+        const std::string reply = run_job(job);
+        std::fprintf(replies, "%s\n", reply.c_str());
+        std::fflush(replies);
+    }
+    std::fclose(replies);
+    return 0;
+}
+#endif
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "batch_planner.h"
+
+struct ProcessPoolOptions {
+    int processes = 2;
+    // Seconds a job may run before its worker is killed as hung; 0 derives a limit from
+    // each job's estimate (20 times the estimate, at least two minutes).
+    double job_timeout = 0.0;
+    // Further attempts, each on a fresh worker, after a worker crashes or hangs on a job.
+    // A job that still fails is quarantined: reported as failed and not tried again.
+    int retries = 1;
+    // Program and arguments that start a worker, which must call ProcessPool::serve().
+    std::vector<std::string> worker_command;
+    // When set, appended to each worker's command with the worker's slot, 0 to
+    // processes - 1; a replacement worker takes over the slot of the worker it replaces.
+    std::string slot_option;
+};
+
+struct ProcessJobResult {
+    bool completed = false;   // a worker finished the job and replied
+    bool quarantined = false;
+    int attempts = 0;
+    double seconds = 0.0;     // wall time of the last attempt, as seen by the pool
+    std::string reply;        // the worker's reply when completed
+};
+
+// Runs batch jobs in separate worker processes, so that a document that crashes or hangs
+// the renderer takes down one worker instead of the whole batch, and so that workers do
+// not share the renderer's process-wide locks. Jobs are handed out costliest first over
+// a pipe to each worker's standard input, one line per job; each worker answers with one
+// line on file descriptor 3. A worker that dies or exceeds the job's time limit is killed
+// and replaced. POSIX only.
+class ProcessPool {
+public:
+    // Runs every job (a line of text without newlines, e.g. a file path) and fills
+    // results in job order. Returns false if no worker could be started at all.
+    static bool run(const std::vector<std::string>& jobs, const std::vector<JobEstimate>& estimates,
+                    const ProcessPoolOptions& options, std::vector<ProcessJobResult>& results);
+
+    // Worker side: answers each job read from standard input with run_job's reply, until
+    // the pool closes the pipe. The reply must not contain newlines. Returns the exit code.
+    static int serve(const std::function<std::string(const std::string& job)>& run_job);
+};
@@ -0,0 +1,293 @@
+#include "run_report.h"
+#include "json_util.h"
+#include "log.h"
+#include "output_sink.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+
+namespace {
+constexpr const char* kMetricPrefix = "comic_converter_";
+
+std::string format_double(double value) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.6f", value);
+    return text;
+}
+
+// Label values escape backslash, double quote and newline.
+std::string escape_label(const std::string& text) {
+    std::string escaped;
+    escaped.reserve(text.size());
+    for (const char c : text) {
+        if (c == '\\') {
+            escaped += "\\\\";
+        } else if (c == '"') {
+            escaped += "\\\"";
+        } else if (c == '\n') {
+            escaped += "\\n";
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+double pages_per_second(const RunReport::FileEntry& file) {
+    return file.wall_seconds > 0 ? file.pages / file.wall_seconds : 0.0;
+}
+
+void metric_header(std::string& text, const std::string& name, const char* type, const char* help) {
+    text += "# HELP " + std::string(kMetricPrefix) + name + " " + help + "\n";
+    text += "# TYPE " + std::string(kMetricPrefix) + name + " " + type + "\n";
+}
+
+void metric_line(std::string& text, const std::string& name, const std::string& labels, const std::string& value) {
+    text += kMetricPrefix + name + (labels.empty() ? "" : "{" + labels + "}") + " " + value + "\n";
+}
+
+bool write_atomically(const std::string& path, const std::string& content) {
+    OutputSink sink;
+    if (!sink.open(path) || !sink.write(content) || !sink.commit()) {
+        LogMessage(LogLevel::error) << "Failed to write report: " << sink.error();
+        return false;
+    }
+    return true;
+}
+}
+
+void RunReport::begin() {
+    files_.clear();
+    started_ = ConversionStats::Clock::now();
+}
+
+void RunReport::add_file(const std::string& input_path, const std::string& output_path, bool success,
+                         const ConversionStats& stats, double estimated_seconds) {
+    add_entry(entry_for(input_path, output_path, success, stats, estimated_seconds));
+}
+
+void RunReport::add_entry(FileEntry file) {
+    files_.push_back(std::move(file));
+}
+
+RunReport::FileEntry RunReport::entry_for(const std::string& input_path, const std::string& output_path, bool success,
+                                          const ConversionStats& stats, double estimated_seconds) {
+    FileEntry file;
+    file.input_path = input_path;
+    file.output_path = output_path;
+    file.success = success;
+    file.wall_seconds = stats.wall_seconds();
+    file.pages = stats.pages();
+    file.queue_wait_seconds = stats.queue_wait_seconds();
+    file.input_bytes = stats.input_bytes();
+    file.output_bytes = stats.output_bytes();
+    file.peak_rss_bytes = stats.peak_rss_bytes();
+    file.estimated_seconds = estimated_seconds;
+    for (std::size_t i = 0; i < static_cast<std::size_t>(ConversionStage::count); ++i) {
+        file.stages.push_back(stats.stage(static_cast<ConversionStage>(i)));
+    }
+    return file;
+}
+
+std::string RunReport::encode_measurements(const FileEntry& file) {
+    std::ostringstream text;
+    text.precision(17);
+    text << (file.success ? 1 : 0) << ' ' << file.wall_seconds << ' ' << file.pages << ' ' << file.queue_wait_seconds
+         << ' ' << file.input_bytes << ' ' << file.output_bytes << ' ' << file.peak_rss_bytes << ' ' << file.stages.size();
+    for (const auto& stage : file.stages) {
+        text << ' ' << stage.seconds << ' ' << stage.bytes << ' ' << stage.calls << ' ' << stage.duplicates
+             << ' ' << stage.duplicate_bytes << ' ' << stage.saved_seconds;
+    }
+    return text.str();
+}
+
+bool RunReport::decode_measurements(const std::string& text, FileEntry& file) {
+    std::istringstream fields(text);
+    int success = 0;
+    std::size_t stage_count = 0;
+    fields >> success >> file.wall_seconds >> file.pages >> file.queue_wait_seconds >> file.input_bytes
+           >> file.output_bytes >> file.peak_rss_bytes >> stage_count;
+    if (!fields || stage_count != static_cast<std::size_t>(ConversionStage::count)) {
+        return false;
+    }
+    file.success = success != 0;
+    file.stages.assign(stage_count, {});
+    for (auto& stage : file.stages) {
+        fields >> stage.seconds >> stage.bytes >> stage.calls >> stage.duplicates >> stage.duplicate_bytes >> stage.saved_seconds;
+    }
+    return static_cast<bool>(fields);
+}
+
+void RunReport::finish() {
+    wall_seconds_ = std::chrono::duration<double>(ConversionStats::Clock::now() - started_).count();
+    finished_unix_seconds_ = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+    peak_rss_bytes_ = ConversionStats::process_peak_rss();
+    for (const auto& file : files_) {
+        peak_rss_bytes_ = std::max(peak_rss_bytes_, file.peak_rss_bytes);
+    }
+}
+
+std::string RunReport::to_json() const {
+    int successful = 0;
+    for (const auto& file : files_) {
+        successful += file.success ? 1 : 0;
+    }
+
+    std::string json = "{\n";
+    json += "  \"wall_seconds\": " + format_double(wall_seconds_) + ",\n";
+    json += "  \"peak_rss_bytes\": " + std::to_string(peak_rss_bytes_) + ",\n";
+    json += "  \"successful\": " + std::to_string(successful) + ",\n";
+    json += "  \"failed\": " + std::to_string(files_.size() - static_cast<std::size_t>(successful)) + ",\n";
+    json += "  \"files\": [";
+    for (std::size_t i = 0; i < files_.size(); ++i) {
+        const auto& file = files_[i];
+        json += i == 0 ? "\n" : ",\n";
+        json += "    {\n";
+        json += "      \"input\": \"" + JsonUtil::escape(file.input_path) + "\",\n";
+        json += "      \"output\": \"" + JsonUtil::escape(file.output_path) + "\",\n";
+        json += "      \"success\": " + std::string(file.success ? "true" : "false") + ",\n";
+        json += "      \"wall_seconds\": " + format_double(file.wall_seconds) + ",\n";
+        if (file.estimated_seconds > 0.0) {
+            json += "      \"estimated_seconds\": " + format_double(file.estimated_seconds) + ",\n";
+        }
+        if (file.attempts > 1 || file.quarantined) {
+            json += "      \"attempts\": " + std::to_string(file.attempts) + ",\n";
+            json += "      \"quarantined\": " + std::string(file.quarantined ? "true" : "false") + ",\n";
+        }
+        json += "      \"pages\": " + std::to_string(file.pages) + ",\n";
+        json += "      \"pages_per_second\": " + format_double(pages_per_second(file)) + ",\n";
+        json += "      \"queue_wait_seconds\": " + format_double(file.queue_wait_seconds) + ",\n";
+        json += "      \"input_bytes\": " + std::to_string(file.input_bytes) + ",\n";
+        json += "      \"output_bytes\": " + std::to_string(file.output_bytes) + ",\n";
+        if (file.peak_rss_bytes != 0) {
+            json += "      \"peak_rss_bytes\": " + std::to_string(file.peak_rss_bytes) + ",\n";
+        }
+        json += "      \"stages\": {";
+        for (std::size_t s = 0; s < file.stages.size(); ++s) {
+            const auto& stage = file.stages[s];
+            json += s == 0 ? "\n" : ",\n";
+            json += "        \"" + std::string(conversion_stage_name(static_cast<ConversionStage>(s))) + "\": {" +
+                    "\"seconds\": " + format_double(stage.seconds) +
+                    ", \"bytes\": " + std::to_string(stage.bytes) +
+                    ", \"calls\": " + std::to_string(stage.calls);
+            if (stage.duplicates != 0) {
+                json += ", \"duplicates\": " + std::to_string(stage.duplicates) +
+                        ", \"duplicate_bytes\": " + std::to_string(stage.duplicate_bytes) +
+                        ", \"saved_seconds\": " + format_double(stage.saved_seconds);
+            }
+            json += "}";
+        }
+        json += "\n      }\n";
+        json += "    }";
+    }
+    json += files_.empty() ? "]\n" : "\n  ]\n";
+    json += "}\n";
+    return json;
+}
+
+std::string RunReport::to_prometheus() const {
+    int successful = 0;
+    for (const auto& file : files_) {
+        successful += file.success ? 1 : 0;
+    }
+
+    std::string text;
+    metric_header(text, "run_files", "gauge", "Files processed by the last run, by result.");
+    metric_line(text, "run_files", "result=\"success\"", std::to_string(successful));
+    metric_line(text, "run_files", "result=\"failure\"", std::to_string(files_.size() - static_cast<std::size_t>(successful)));
+
+    metric_header(text, "run_duration_seconds", "gauge", "Wall time of the last run.");
+    metric_line(text, "run_duration_seconds", "", format_double(wall_seconds_));
+
+    metric_header(text, "run_peak_rss_bytes", "gauge", "Peak resident set size of the last run, over all its processes.");
+    metric_line(text, "run_peak_rss_bytes", "", std::to_string(peak_rss_bytes_));
+
+    metric_header(text, "run_last_completion_timestamp_seconds", "gauge", "Unix time at which the last run finished.");
+    metric_line(text, "run_last_completion_timestamp_seconds", "", format_double(finished_unix_seconds_));
+
+    struct FileMetric {
+        const char* name;
+        const char* help;
+        double (*value)(const FileEntry&);
+    };
+    static const FileMetric file_metrics[] = {
+        {"file_success", "1 if the file converted successfully.", [](const FileEntry& f) { return f.success ? 1.0 : 0.0; }},
+        {"file_duration_seconds", "Wall time spent converting the file.", [](const FileEntry& f) { return f.wall_seconds; }},
+        {"file_estimated_seconds", "Conversion time estimated by the batch planner.", [](const FileEntry& f) { return f.estimated_seconds; }},
+        {"file_attempts", "Worker processes that tried the file.", [](const FileEntry& f) { return static_cast<double>(f.attempts); }},
+        {"file_quarantined", "1 if the file was given up after its workers crashed or hung.", [](const FileEntry& f) { return f.quarantined ? 1.0 : 0.0; }},
+        {"file_pages", "Pages produced for the file.", [](const FileEntry& f) { return static_cast<double>(f.pages); }},
+        {"file_pages_per_second", "Pages per second of wall time.", [](const FileEntry& f) { return pages_per_second(f); }},
+        {"file_queue_wait_seconds", "Total time pages waited for the shared renderer.", [](const FileEntry& f) { return f.queue_wait_seconds; }},
+        {"file_input_bytes", "Size of the input file.", [](const FileEntry& f) { return static_cast<double>(f.input_bytes); }},
+        {"file_output_bytes", "Size of the output written.", [](const FileEntry& f) { return static_cast<double>(f.output_bytes); }},
+    };
+    for (const auto& metric : file_metrics) {
+        metric_header(text, metric.name, "gauge", metric.help);
+        for (const auto& file : files_) {
+            metric_line(text, metric.name, "file=\"" + escape_label(file.input_path) + "\"", format_double(metric.value(file)));
+        }
+    }
+
+    // Only files that converted one at a time have a peak of their own.
+    metric_header(text, "file_peak_rss_bytes", "gauge", "Peak resident set size while converting the file.");
+    for (const auto& file : files_) {
+        if (file.peak_rss_bytes != 0) {
+            metric_line(text, "file_peak_rss_bytes", "file=\"" + escape_label(file.input_path) + "\"", std::to_string(file.peak_rss_bytes));
+        }
+    }
+
+    metric_header(text, "stage_seconds", "gauge", "Time spent per stage; summed across worker threads.");
+    for (const auto& file : files_) {
+        for (std::size_t s = 0; s < file.stages.size(); ++s) {
+            const std::string labels = "file=\"" + escape_label(file.input_path) + "\",stage=\"" +
+                                       conversion_stage_name(static_cast<ConversionStage>(s)) + "\"";
+            metric_line(text, "stage_seconds", labels, format_double(file.stages[s].seconds));
+        }
+    }
+
+    metric_header(text, "stage_bytes", "gauge", "Bytes produced or consumed per stage.");
+    for (const auto& file : files_) {
+        for (std::size_t s = 0; s < file.stages.size(); ++s) {
+            const std::string labels = "file=\"" + escape_label(file.input_path) + "\",stage=\"" +
+                                       conversion_stage_name(static_cast<ConversionStage>(s)) + "\"";
+            metric_line(text, "stage_bytes", labels, std::to_string(file.stages[s].bytes));
+        }
+    }
+
+    struct DuplicateMetric {
+        const char* name;
+        const char* help;
+        double (*value)(const ConversionStats::StageTotals&);
+    };
+    static const DuplicateMetric duplicate_metrics[] = {
+        {"stage_duplicate_pages", "Repeated pages whose data a stage reused.", [](const ConversionStats::StageTotals& t) { return static_cast<double>(t.duplicates); }},
+        {"stage_duplicate_bytes", "Bytes of repeated page data a stage did not process again.", [](const ConversionStats::StageTotals& t) { return static_cast<double>(t.duplicate_bytes); }},
+        {"stage_saved_seconds", "Estimated time a stage saved by reusing repeated pages.", [](const ConversionStats::StageTotals& t) { return t.saved_seconds; }},
+    };
+    for (const auto& metric : duplicate_metrics) {
+        metric_header(text, metric.name, "gauge", metric.help);
+        for (const auto& file : files_) {
+            for (std::size_t s = 0; s < file.stages.size(); ++s) {
+                if (file.stages[s].duplicates == 0) {
+                    continue;
+                }
+                const std::string labels = "file=\"" + escape_label(file.input_path) + "\",stage=\"" +
+                                           conversion_stage_name(static_cast<ConversionStage>(s)) + "\"";
+                metric_line(text, metric.name, labels, format_double(metric.value(file.stages[s])));
+            }
+        }
+    }
+
+    return text;
+}
+
+bool RunReport::write_json(const std::string& path) const {
+    return write_atomically(path, to_json());
+}
+
+bool RunReport::write_prometheus(const std::string& path) const {
+    return write_atomically(path, to_prometheus());
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "conversion_stats.h"
+
+// Collects the per-file statistics of a batch run and renders them as JSON or as a
+// Prometheus text exposition file for node_exporter's textfile collector.
+class RunReport {
+public:
+    struct FileEntry {
+        std::string input_path;
+        std::string output_path;
+        bool success = false;
+        double wall_seconds = 0.0;
+        int pages = 0;
+        double queue_wait_seconds = 0.0;
+        std::uint64_t input_bytes = 0;
+        std::uint64_t output_bytes = 0;
+        std::uint64_t peak_rss_bytes = 0;  // 0 when not measured (files converting side by side)
+        double estimated_seconds = 0.0;  // batch planner's estimate; 0 when none was made
+        int attempts = 1;                // worker processes that tried the file (--processes)
+        bool quarantined = false;        // given up after its workers crashed or hung
+        std::vector<ConversionStats::StageTotals> stages; // indexed by ConversionStage
+    };
+
+    void begin();
+    void add_file(const std::string& input_path, const std::string& output_path, bool success,
+                  const ConversionStats& stats, double estimated_seconds = 0.0);
+    void add_entry(FileEntry file);
+
+    static FileEntry entry_for(const std::string& input_path, const std::string& output_path, bool success,
+                               const ConversionStats& stats, double estimated_seconds = 0.0);
+    // The result and measurements of an entry (not its paths) as one line of text, so a
+    // worker process can hand them to the process that writes the report.
+    static std::string encode_measurements(const FileEntry& file);
+    static bool decode_measurements(const std::string& text, FileEntry& file);
+    // Also takes the batch's peak RSS: the highest of this process's peak and the
+    // per-file peaks (which come from worker processes with --processes).
+    void finish();
+
+    std::string to_json() const;
+    std::string to_prometheus() const;
+
+    // Both files are written atomically so collectors never read a partial report.
+    bool write_json(const std::string& path) const;
+    bool write_prometheus(const std::string& path) const;
+
+private:
+    std::vector<FileEntry> files_;
+    ConversionStats::Clock::time_point started_;
+    double wall_seconds_ = 0.0;
+    double finished_unix_seconds_ = 0.0;
+    std::uint64_t peak_rss_bytes_ = 0;
+};
@@ -0,0 +1,155 @@
+#include "trace.h"
+#include "json_util.h"
+#include "log.h"
+#include "output_sink.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+struct TraceEvent {
+    const char* name;
+    std::string detail;
+    std::int64_t page;
+    std::int64_t start_ns;
+    std::int64_t duration_ns;
+};
+
+struct ThreadBuffer {
+    std::uint32_t tid = 0;
+    std::string name;
+    std::vector<TraceEvent> events;
+};
+
+std::atomic<bool> g_enabled{false};
+Clock::time_point g_epoch;
+
+// Only touched when a thread records its first span and when the trace is started or
+// written; never while spans are being appended.
+std::mutex g_registry_mutex;
+std::vector<std::shared_ptr<ThreadBuffer>> g_registry;
+
+// Shared with the registry so events survive the worker threads that recorded them.
+thread_local std::shared_ptr<ThreadBuffer> t_buffer;
+
+ThreadBuffer& thread_buffer() {
+    if (!t_buffer) {
+        auto buffer = std::make_shared<ThreadBuffer>();
+        buffer->events.reserve(1024);
+        std::lock_guard<std::mutex> lock(g_registry_mutex);
+        buffer->tid = static_cast<std::uint32_t>(g_registry.size() + 1);
+        g_registry.push_back(buffer);
+        t_buffer = std::move(buffer);
+    }
+    return *t_buffer;
+}
+
+std::int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - g_epoch).count();
+}
+
+// Trace-event timestamps are microseconds; keep nanosecond precision as decimals.
+std::string microseconds(std::int64_t nanoseconds) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.3f", static_cast<double>(nanoseconds) / 1000.0);
+    return text;
+}
+}
+
+void Trace::start() {
+    std::lock_guard<std::mutex> lock(g_registry_mutex);
+    for (auto& buffer : g_registry) {
+        buffer->events.clear();
+    }
+    g_epoch = Clock::now();
+    g_enabled.store(true, std::memory_order_release);
+}
+
+void Trace::stop() {
+    g_enabled.store(false, std::memory_order_release);
+}
+
+bool Trace::enabled() {
+    return g_enabled.load(std::memory_order_relaxed);
+}
+
+void Trace::set_thread_name(const std::string& name) {
+    if (enabled()) {
+        thread_buffer().name = name;
+    }
+}
+
+bool Trace::write(const std::string& path) {
+    stop();
+
+    std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    auto separator = [&]() -> const char* {
+        const char* text = first ? "\n" : ",\n";
+        first = false;
+        return text;
+    };
+
+    {
+        std::lock_guard<std::mutex> lock(g_registry_mutex);
+        for (const auto& buffer : g_registry) {
+            if (buffer->events.empty()) {
+                continue;
+            }
+
+            const std::string tid = std::to_string(buffer->tid);
+            const std::string name = buffer->name.empty() ? "thread " + tid : buffer->name;
+            json += separator();
+            json += "{\"ph\":\"M\",\"pid\":1,\"tid\":" + tid + ",\"name\":\"thread_name\",\"args\":{\"name\":\"" +
+                    JsonUtil::escape(name) + "\"}}";
+
+            for (const auto& event : buffer->events) {
+                json += separator();
+                json += "{\"ph\":\"X\",\"pid\":1,\"tid\":" + tid + ",\"name\":\"" + event.name +
+                        "\",\"ts\":" + microseconds(event.start_ns) + ",\"dur\":" + microseconds(event.duration_ns);
+                if (event.page >= 0) {
+                    json += ",\"args\":{\"page\":" + std::to_string(event.page + 1) + "}";
+                } else if (!event.detail.empty()) {
+                    json += ",\"args\":{\"file\":\"" + JsonUtil::escape(event.detail) + "\"}";
+                }
+                json += "}";
+            }
+        }
+    }
+    json += "\n]}\n";
+
+    OutputSink sink;
+    if (!sink.open(path) || !sink.write(json) || !sink.commit()) {
+        LogMessage(LogLevel::error) << "Failed to write trace: " << sink.error();
+        return false;
+    }
+    return true;
+}
+
+TraceSpan::TraceSpan(const char* name, std::int64_t page) : name_(name), page_(page) {
+    if (Trace::enabled()) {
+        start_ns_ = now_ns();
+    }
+}
+
+TraceSpan::TraceSpan(const char* name, std::string detail) : name_(name) {
+    if (Trace::enabled()) {
+        detail_ = std::move(detail);
+        start_ns_ = now_ns();
+    }
+}
+
+TraceSpan::~TraceSpan() {
+    if (start_ns_ < 0 || !Trace::enabled()) {
+        return;
+    }
+    const std::int64_t end_ns = now_ns();
+    thread_buffer().events.push_back(TraceEvent{name_, std::move(detail_), page_, start_ns_, end_ns - start_ns_});
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Process-wide timeline recorder. Spans are appended to a buffer owned by the recording
+// thread, so the hot path takes no locks; a thread registers its buffer once, on its
+// first span. Output is Chrome trace-event JSON, viewable in Perfetto or chrome://tracing.
+class Trace {
+public:
+    // Discards earlier events and starts recording. Call while no spans are open.
+    static void start();
+    static void stop();
+    static bool enabled();
+
+    // Shown as the track name of the calling thread.
+    static void set_thread_name(const std::string& name);
+
+    // Stops recording and writes every thread's events. Call once the conversions that
+    // recorded them have returned; buffers of finished threads are kept until then.
+    static bool write(const std::string& path);
+};
+
+// Records the time between construction and destruction as a complete ("X") event on
+// the current thread. Does nothing unless Trace::start() has been called.
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name, std::int64_t page = -1);
+    TraceSpan(const char* name, std::string detail);
+    ~TraceSpan();
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* name_;      // must be a string literal: only the pointer is stored
+    std::int64_t page_ = -1;
+    std::string detail_;
+    std::int64_t start_ns_ = -1;
+};
@@ -0,0 +1,293 @@
+#include "zip_layout.h"
+
+#include "io_backend.h"
+
+#include <algorithm>
+#include <array>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+constexpr std::uint32_t kLocalHeaderSignature = 0x04034b50;
+constexpr std::uint32_t kCentralHeaderSignature = 0x02014b50;
+constexpr std::uint32_t kEndOfCentralDirSignature = 0x06054b50;
+constexpr std::uint32_t kZip64LocatorSignature = 0x07064b50;
+constexpr std::uint32_t kZip64EndOfCentralDirSignature = 0x06064b50;
+constexpr std::uint16_t kZip64ExtraFieldId = 0x0001;
+
+constexpr std::size_t kLocalHeaderSize = 30;
+constexpr std::size_t kCentralHeaderSize = 46;
+constexpr std::size_t kEndOfCentralDirSize = 22;
+constexpr std::size_t kZip64LocatorSize = 20;
+constexpr std::size_t kZip64EndOfCentralDirSize = 56;
+constexpr std::size_t kMaxCommentSize = 0xFFFF;
+
+std::uint16_t read_u16(const std::uint8_t* data) {
+    return static_cast<std::uint16_t>(data[0] | data[1] << 8);
+}
+
+std::uint32_t read_u32(const std::uint8_t* data) {
+    return static_cast<std::uint32_t>(data[0]) |
+           static_cast<std::uint32_t>(data[1]) << 8 |
+           static_cast<std::uint32_t>(data[2]) << 16 |
+           static_cast<std::uint32_t>(data[3]) << 24;
+}
+
+std::uint64_t read_u64(const std::uint8_t* data) {
+    return static_cast<std::uint64_t>(read_u32(data)) |
+           static_cast<std::uint64_t>(read_u32(data + 4)) << 32;
+}
+
+// Read-only archive handle. Reads go through IoBackend so that the many small
+// local-header reads can be issued as one batch.
+class ArchiveFile {
+public:
+    explicit ArchiveFile(const std::string& path) {
+#ifdef _WIN32
+        fd_ = _open(path.c_str(), _O_RDONLY | _O_BINARY);
+        struct _stat64 status;
+        if (fd_ >= 0 && _fstat64(fd_, &status) == 0) {
+            size_ = static_cast<std::uint64_t>(status.st_size);
+        }
+#else
+        fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat status;
+        if (fd_ >= 0 && ::fstat(fd_, &status) == 0) {
+            size_ = static_cast<std::uint64_t>(status.st_size);
+        }
+#endif
+    }
+
+    ~ArchiveFile() {
+        if (fd_ >= 0) {
+#ifdef _WIN32
+            _close(fd_);
+#else
+            ::close(fd_);
+#endif
+        }
+    }
+
+    ArchiveFile(const ArchiveFile&) = delete;
+    ArchiveFile& operator=(const ArchiveFile&) = delete;
+
+    bool is_open() const { return fd_ >= 0; }
+    std::uint64_t size() const { return size_; }
+    int fd() const { return fd_; }
+
+private:
+    int fd_ = -1;
+    std::uint64_t size_ = 0;
+};
+
+bool read_at(const ArchiveFile& input, std::uint64_t offset, std::uint8_t* buffer, std::size_t length) {
+    IoBatch batch;
+    IoBackend::shared().read(batch, input.fd(), buffer, length, offset);
+    return batch.wait();
+}
+
+struct CentralDirectory {
+    std::uint64_t offset = 0;
+    std::uint64_t size = 0;
+    std::uint64_t entries = 0;
+};
+
+bool find_central_directory(const ArchiveFile& input, std::uint64_t file_size, CentralDirectory& directory) {
+    if (file_size < kEndOfCentralDirSize) {
+        return false;
+    }
+
+    const std::uint64_t tail_size = std::min<std::uint64_t>(file_size, kEndOfCentralDirSize + kMaxCommentSize);
+    const std::uint64_t tail_offset = file_size - tail_size;
+    std::vector<std::uint8_t> tail(static_cast<std::size_t>(tail_size));
+    if (!read_at(input, tail_offset, tail.data(), tail.size())) {
+        return false;
+    }
+
+    std::size_t eocd = tail.size() - kEndOfCentralDirSize + 1;
+    do {
+        --eocd;
+        if (read_u32(&tail[eocd]) == kEndOfCentralDirSignature) {
+            break;
+        }
+    } while (eocd > 0);
+
+    if (read_u32(&tail[eocd]) != kEndOfCentralDirSignature) {
+        return false;
+    }
+
+    const std::uint8_t* record = &tail[eocd];
+    if (read_u16(record + 4) != 0 || read_u16(record + 6) != 0) {
+        return false; // split archives are not supported
+    }
+
+    directory.entries = read_u16(record + 10);
+    directory.size = read_u32(record + 12);
+    directory.offset = read_u32(record + 16);
+
+    const bool needs_zip64 = directory.entries == 0xFFFF ||
+                             directory.size == 0xFFFFFFFF ||
+                             directory.offset == 0xFFFFFFFF;
+    if (!needs_zip64) {
+        return true;
+    }
+
+    const std::uint64_t eocd_offset = tail_offset + eocd;
+    if (eocd_offset < kZip64LocatorSize) {
+        return false;
+    }
+
+    std::uint8_t locator[kZip64LocatorSize];
+    if (!read_at(input, eocd_offset - kZip64LocatorSize, locator, sizeof(locator)) ||
+        read_u32(locator) != kZip64LocatorSignature) {
+        return false;
+    }
+
+    std::uint8_t zip64_record[kZip64EndOfCentralDirSize];
+    if (!read_at(input, read_u64(locator + 8), zip64_record, sizeof(zip64_record)) ||
+        read_u32(zip64_record) != kZip64EndOfCentralDirSignature) {
+        return false;
+    }
+
+    directory.entries = read_u64(zip64_record + 32);
+    directory.size = read_u64(zip64_record + 40);
+    directory.offset = read_u64(zip64_record + 48);
+    return true;
+}
+
+void apply_zip64_extra(const std::uint8_t* extra, std::size_t extra_length,
+                       std::uint64_t& uncompressed_size, std::uint64_t& compressed_size,
+                       std::uint64_t& local_header_offset) {
+    std::size_t index = 0;
+    while (index + 4 <= extra_length) {
+        const std::uint16_t id = read_u16(extra + index);
+        const std::uint16_t length = read_u16(extra + index + 2);
+        index += 4;
+        if (index + length > extra_length) {
+            return;
+        }
+
+        if (id == kZip64ExtraFieldId) {
+            const std::uint8_t* field = extra + index;
+            const std::uint8_t* field_end = field + length;
+            if (uncompressed_size == 0xFFFFFFFF && field + 8 <= field_end) {
+                uncompressed_size = read_u64(field);
+                field += 8;
+            }
+            if (compressed_size == 0xFFFFFFFF && field + 8 <= field_end) {
+                compressed_size = read_u64(field);
+                field += 8;
+            }
+            if (local_header_offset == 0xFFFFFFFF && field + 8 <= field_end) {
+                local_header_offset = read_u64(field);
+            }
+            return;
+        }
+
+        index += length;
+    }
+}
+}
+
+std::vector<ZipEntryLocation> ZipLayout::locate_entries(const std::string& zip_path) {
+    std::vector<ZipEntryLocation> entries;
+
+    const ArchiveFile input(zip_path);
+    if (!input.is_open()) {
+        return entries;
+    }
+
+    const std::uint64_t file_size = input.size();
+    CentralDirectory directory;
+    if (!find_central_directory(input, file_size, directory) ||
+        directory.offset + directory.size > file_size) {
+        return entries;
+    }
+
+    std::vector<std::uint8_t> central(static_cast<std::size_t>(directory.size));
+    if (!read_at(input, directory.offset, central.data(), central.size())) {
+        return entries;
+    }
+
+    entries.reserve(static_cast<std::size_t>(std::min<std::uint64_t>(directory.entries, central.size() / kCentralHeaderSize)));
+
+    // Local headers of stored entries, read together in one batch once the central
+    // directory has been walked, instead of one blocking read per entry.
+    struct LocalHeaderRead {
+        std::size_t entry = 0;
+        std::uint64_t offset = 0;
+        std::uint64_t size = 0;
+        std::array<std::uint8_t, kLocalHeaderSize> header{};
+    };
+    std::vector<LocalHeaderRead> local_reads;
+
+    std::size_t index = 0;
+    for (std::uint64_t i = 0; i < directory.entries; ++i) {
+        if (index + kCentralHeaderSize > central.size() ||
+            read_u32(&central[index]) != kCentralHeaderSignature) {
+            return {};
+        }
+
+        const std::uint8_t* header = &central[index];
+        const std::uint16_t flags = read_u16(header + 8);
+        const std::uint16_t method = read_u16(header + 10);
+        std::uint64_t compressed_size = read_u32(header + 20);
+        std::uint64_t uncompressed_size = read_u32(header + 24);
+        const std::uint16_t name_length = read_u16(header + 28);
+        const std::uint16_t extra_length = read_u16(header + 30);
+        const std::uint16_t comment_length = read_u16(header + 32);
+        std::uint64_t local_header_offset = read_u32(header + 42);
+
+        const std::size_t record_size = kCentralHeaderSize + name_length + extra_length + comment_length;
+        if (index + record_size > central.size()) {
+            return {};
+        }
+
+        apply_zip64_extra(header + kCentralHeaderSize + name_length, extra_length,
+                          uncompressed_size, compressed_size, local_header_offset);
+
+        ZipEntryLocation entry;
+        entry.name.assign(reinterpret_cast<const char*>(header + kCentralHeaderSize), name_length);
+
+        const bool encrypted = (flags & 0x0001) != 0;
+        if (method == 0 && !encrypted && compressed_size == uncompressed_size &&
+            local_header_offset + kLocalHeaderSize <= file_size) {
+            local_reads.push_back(LocalHeaderRead{entries.size(), local_header_offset, uncompressed_size, {}});
+        }
+
+        entries.push_back(std::move(entry));
+        index += record_size;
+    }
+
+    // A failed read only means those entries are not marked stored; the batch reports
+    // the first error, so check each header's signature rather than the batch result.
+    IoBatch batch;
+    for (auto& read : local_reads) {
+        IoBackend::shared().read(batch, input.fd(), read.header.data(), read.header.size(), read.offset);
+    }
+    batch.wait();
+
+    for (const auto& read : local_reads) {
+        const std::uint8_t* local = read.header.data();
+        if (read_u32(local) != kLocalHeaderSignature) {
+            continue;
+        }
+        const std::uint64_t data_offset = read.offset + kLocalHeaderSize + read_u16(local + 26) + read_u16(local + 28);
+        if (data_offset + read.size <= file_size) {
+            ZipEntryLocation& entry = entries[read.entry];
+            entry.stored = true;
+            entry.data_offset = data_offset;
+            entry.size = read.size;
+        }
+    }
+
+    return entries;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct ZipEntryLocation {
+    std::string name;
+    bool stored = false;
+    std::uint64_t data_offset = 0;
+    std::uint64_t size = 0;
+};
+
+class ZipLayout {
+public:
+    // Reads the central directory of a ZIP archive and returns its entries in central
+    // directory order. For entries stored without compression or encryption, stored is
+    // set and data_offset/size describe the raw bytes inside the archive file.
+    // Returns an empty vector if the archive cannot be parsed.
+    static std::vector<ZipEntryLocation> locate_entries(const std::string& zip_path);
+};
@@ -0,0 +1,241 @@
+#include "zip_writer.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+namespace {
+constexpr std::uint32_t kLocalHeaderSignature = 0x04034b50;
+constexpr std::uint32_t kCentralHeaderSignature = 0x02014b50;
+constexpr std::uint32_t kEndOfCentralDirSignature = 0x06054b50;
+constexpr std::uint32_t kZip64LocatorSignature = 0x07064b50;
+constexpr std::uint32_t kZip64EndOfCentralDirSignature = 0x06064b50;
+constexpr std::uint16_t kZip64ExtraFieldId = 0x0001;
+
+// Version 2.0 for plain stored entries, 4.5 once ZIP64 fields are involved.
+constexpr std::uint16_t kVersionDefault = 20;
+constexpr std::uint16_t kVersionZip64 = 45;
+// Entry names are written as UTF-8 (general purpose flag bit 11).
+constexpr std::uint16_t kFlagUtf8Names = 0x0800;
+
+constexpr std::uint32_t kMax32 = 0xFFFFFFFF;
+constexpr std::uint16_t kMax16 = 0xFFFF;
+
+void put_u16(std::string& out, std::uint16_t value) {
+    out += static_cast<char>(value & 0xFF);
+    out += static_cast<char>(value >> 8);
+}
+
+void put_u32(std::string& out, std::uint32_t value) {
+    put_u16(out, static_cast<std::uint16_t>(value & 0xFFFF));
+    put_u16(out, static_cast<std::uint16_t>(value >> 16));
+}
+
+void put_u64(std::string& out, std::uint64_t value) {
+    put_u32(out, static_cast<std::uint32_t>(value & kMax32));
+    put_u32(out, static_cast<std::uint32_t>(value >> 32));
+}
+
+std::uint32_t clamp32(std::uint64_t value) {
+    return value >= kMax32 ? kMax32 : static_cast<std::uint32_t>(value);
+}
+
+void to_dos_time(std::time_t modified, std::uint16_t& dos_time, std::uint16_t& dos_date) {
+    std::tm local{};
+#ifdef _WIN32
+    localtime_s(&local, &modified);
+#else
+    localtime_r(&modified, &local);
+#endif
+    // MS-DOS dates start in 1980.
+    if (local.tm_year < 80) {
+        dos_time = 0;
+        dos_date = (1 << 5) | 1;
+        return;
+    }
+    dos_time = static_cast<std::uint16_t>(local.tm_hour << 11 | local.tm_min << 5 | local.tm_sec / 2);
+    dos_date = static_cast<std::uint16_t>((local.tm_year - 80) << 9 | (local.tm_mon + 1) << 5 | local.tm_mday);
+}
+}
+
+ZipWriter::ZipWriter(OutputSinkOptions sink_options)
+    : sink_(sink_options) {}
+
+bool ZipWriter::open(const std::string& path) {
+    entries_.clear();
+    error_.clear();
+    if (!sink_.open(path)) {
+        return fail(sink_.error());
+    }
+    return true;
+}
+
+bool ZipWriter::open(OutputWriter writer) {
+    entries_.clear();
+    error_.clear();
+    if (!sink_.open(std::move(writer))) {
+        return fail(sink_.error());
+    }
+    return true;
+}
+
+bool ZipWriter::add_stored(const std::string& name, const std::uint8_t* data, std::size_t size, std::time_t modified) {
+    if (!error_.empty()) {
+        return false;
+    }
+    if (name.empty() || name.size() > kMax16) {
+        return fail("Invalid ZIP entry name: " + name);
+    }
+
+    Entry entry;
+    entry.name = name;
+    entry.size = size;
+    entry.offset = sink_.offset();
+    entry.crc = static_cast<std::uint32_t>(crc32(0, nullptr, 0));
+    // zlib's crc32 takes a 32-bit length, so large entries are summed in pieces.
+    for (std::size_t done = 0; done < size;) {
+        const auto chunk = static_cast<uInt>(std::min<std::size_t>(size - done, std::numeric_limits<uInt>::max()));
+        entry.crc = static_cast<std::uint32_t>(crc32(entry.crc, data + done, chunk));
+        done += chunk;
+    }
+    to_dos_time(modified, entry.dos_time, entry.dos_date);
+
+    // Sizes go in the local header's ZIP64 extra field when they do not fit 32 bits.
+    const bool zip64_sizes = entry.size >= kMax32;
+    std::string header;
+    put_u32(header, kLocalHeaderSignature);
+    put_u16(header, zip64_sizes ? kVersionZip64 : kVersionDefault);
+    put_u16(header, kFlagUtf8Names);
+    put_u16(header, 0); // stored
+    put_u16(header, entry.dos_time);
+    put_u16(header, entry.dos_date);
+    put_u32(header, entry.crc);
+    put_u32(header, clamp32(entry.size));
+    put_u32(header, clamp32(entry.size));
+    put_u16(header, static_cast<std::uint16_t>(name.size()));
+    put_u16(header, zip64_sizes ? 20 : 0);
+    header += name;
+    if (zip64_sizes) {
+        put_u16(header, kZip64ExtraFieldId);
+        put_u16(header, 16);
+        put_u64(header, entry.size);
+        put_u64(header, entry.size);
+    }
+
+    if (!sink_.write(header) || !sink_.write(data, size)) {
+        return fail(sink_.error());
+    }
+    entries_.push_back(std::move(entry));
+    return true;
+}
+
+bool ZipWriter::flush() {
+    if (!error_.empty()) {
+        return false;
+    }
+    return sink_.flush() || fail(sink_.error());
+}
+
+void ZipWriter::sort_directory(const std::function<bool(const std::string&, const std::string&)>& before) {
+    std::stable_sort(entries_.begin(), entries_.end(), [&](const Entry& a, const Entry& b) {
+        return before(a.name, b.name);
+    });
+}
+
+bool ZipWriter::commit() {
+    if (!error_.empty()) {
+        return false;
+    }
+
+    const std::uint64_t directory_offset = sink_.offset();
+    std::string directory;
+    for (const auto& entry : entries_) {
+        std::string extra;
+        if (entry.size >= kMax32) {
+            put_u64(extra, entry.size);
+            put_u64(extra, entry.size);
+        }
+        if (entry.offset >= kMax32) {
+            put_u64(extra, entry.offset);
+        }
+        std::string zip64_field;
+        if (!extra.empty()) {
+            put_u16(zip64_field, kZip64ExtraFieldId);
+            put_u16(zip64_field, static_cast<std::uint16_t>(extra.size()));
+            zip64_field += extra;
+        }
+
+        const std::uint16_t version = zip64_field.empty() ? kVersionDefault : kVersionZip64;
+        put_u32(directory, kCentralHeaderSignature);
+        put_u16(directory, version); // made by (MS-DOS attributes)
+        put_u16(directory, version);
+        put_u16(directory, kFlagUtf8Names);
+        put_u16(directory, 0);
+        put_u16(directory, entry.dos_time);
+        put_u16(directory, entry.dos_date);
+        put_u32(directory, entry.crc);
+        put_u32(directory, clamp32(entry.size));
+        put_u32(directory, clamp32(entry.size));
+        put_u16(directory, static_cast<std::uint16_t>(entry.name.size()));
+        put_u16(directory, static_cast<std::uint16_t>(zip64_field.size()));
+        put_u16(directory, 0); // comment length
+        put_u16(directory, 0); // disk number
+        put_u16(directory, 0); // internal attributes
+        put_u32(directory, 0); // external attributes
+        put_u32(directory, clamp32(entry.offset));
+        directory += entry.name;
+        directory += zip64_field;
+    }
+    const std::uint64_t directory_size = directory.size();
+    const std::uint64_t count = entries_.size();
+
+    std::string end;
+    if (count >= kMax16 || directory_offset >= kMax32 || directory_size >= kMax32) {
+        const std::uint64_t zip64_end_offset = directory_offset + directory_size;
+        put_u32(end, kZip64EndOfCentralDirSignature);
+        put_u64(end, 44); // size of the rest of this record
+        put_u16(end, kVersionZip64);
+        put_u16(end, kVersionZip64);
+        put_u32(end, 0);
+        put_u32(end, 0);
+        put_u64(end, count);
+        put_u64(end, count);
+        put_u64(end, directory_size);
+        put_u64(end, directory_offset);
+
+        put_u32(end, kZip64LocatorSignature);
+        put_u32(end, 0);
+        put_u64(end, zip64_end_offset);
+        put_u32(end, 1);
+    }
+    put_u32(end, kEndOfCentralDirSignature);
+    put_u16(end, 0);
+    put_u16(end, 0);
+    put_u16(end, static_cast<std::uint16_t>(std::min<std::uint64_t>(count, kMax16)));
+    put_u16(end, static_cast<std::uint16_t>(std::min<std::uint64_t>(count, kMax16)));
+    put_u32(end, clamp32(directory_size));
+    put_u32(end, clamp32(directory_offset));
+    put_u16(end, 0);
+
+    if (!sink_.write(directory) || !sink_.write(end) || !sink_.commit()) {
+        return fail(sink_.error());
+    }
+    return true;
+}
+
+std::uint64_t ZipWriter::offset() const {
+    return sink_.offset();
+}
+
+const std::string& ZipWriter::error() const {
+    return error_;
+}
+
+bool ZipWriter::fail(const std::string& message) {
+    if (error_.empty()) {
+        error_ = message;
+    }
+    return false;
+}
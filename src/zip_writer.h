@@ -0,0 +1,59 @@
+#pragma once
+
+#include "output_sink.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Minimal ZIP writer for archives of stored (uncompressed) entries, written in order
+// through an OutputSink, so the archive only appears at its path once it is complete.
+// Each entry's bytes go straight to the sink instead of being held until the archive
+// is closed; ZIP64 records are added when offsets or the entry count need them.
+// Nothing is ever written twice or out of order, so an archive can also be streamed
+// to a pipe: every local header already carries its entry's sizes and CRC, and the
+// central directory follows the last entry.
+class ZipWriter {
+public:
+    explicit ZipWriter(OutputSinkOptions sink_options = {});
+
+    bool open(const std::string& path);
+    // Streams the archive to writer instead of a file.
+    bool open(OutputWriter writer);
+
+    // Writes one entry; modified is stored as an MS-DOS local time (2-second resolution).
+    bool add_stored(const std::string& name, const std::uint8_t* data, std::size_t size, std::time_t modified);
+
+    // Passes the entries added so far on to the file or writer.
+    bool flush();
+
+    // Orders the central directory, which is what readers list, independently of the
+    // order in which entries were added.
+    void sort_directory(const std::function<bool(const std::string&, const std::string&)>& before);
+
+    // Writes the central directory and renames the archive into place.
+    bool commit();
+
+    // Bytes written so far.
+    std::uint64_t offset() const;
+    const std::string& error() const;
+
+private:
+    struct Entry {
+        std::string name;
+        std::uint32_t crc = 0;
+        std::uint64_t size = 0;
+        std::uint64_t offset = 0;
+        std::uint16_t dos_time = 0;
+        std::uint16_t dos_date = 0;
+    };
+
+    bool fail(const std::string& message);
+
+    OutputSink sink_;
+    std::vector<Entry> entries_;
+    std::string error_;
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <iostream>
+
+// Minimal assertions for the test executables in tests/: a failed CHECK is reported
+// with its location and makes the test's exit code non-zero, without stopping it.
+namespace test {
+inline int& failures() {
+    static int count = 0;
+    return count;
+}
+
+inline bool check(bool passed, const char* expression, const char* file, int line) {
+    if (!passed) {
+        ++failures();
+        std::cerr << file << ":" << line << ": CHECK failed: " << expression << std::endl;
+    }
+    return passed;
+}
+
+// What main() returns: 0 when every check passed.
+inline int result() {
+    if (failures() > 0) {
+        std::cerr << failures() << (failures() == 1 ? " check" : " checks") << " failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+}
+
+#define CHECK(expression) test::check(static_cast<bool>(expression), #expression, __FILE__, __LINE__)
@@ -0,0 +1,183 @@
+// Several instances of this executable drain one LeaseQueue directory while one of
+// them is killed holding a lease. Every job must end up in done/ once; a job may only
+// be converted twice if an instance logged that it reclaimed or lost the lease.
+
+#include "check.h"
+#include "lease_queue.h"
+#include "log.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+constexpr int kInstances = 3;
+constexpr std::size_t kJobs = 12;
+constexpr double kLeaseSeconds = 1.0;
+constexpr auto kJobTime = std::chrono::milliseconds(150);
+
+std::vector<std::string> make_jobs() {
+    std::vector<std::string> jobs;
+    for (std::size_t i = 0; i < kJobs; ++i) {
+        jobs.push_back("job" + std::to_string(i) + ".pdf");
+    }
+    return jobs;
+}
+
+std::string read_file(const std::filesystem::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), {});
+}
+
+// One line per event, appended with a single write so that instances do not interleave.
+void append_line(const std::filesystem::path& path, const std::string& line) {
+    const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd >= 0) {
+        const std::string text = line + "\n";
+        [[maybe_unused]] const ssize_t written = ::write(fd, text.data(), text.size());
+        ::close(fd);
+    }
+}
+
+// Runs in a child process: drains the queue, recording when each job starts and finishes.
+int run_instance(const std::filesystem::path& directory) {
+    Log::set_level(LogLevel::warning);
+    LeaseQueueOptions options;
+    options.directory = directory / "queue";
+    options.lease_seconds = kLeaseSeconds;
+    options.poll_seconds = kLeaseSeconds / 5.0;
+    LeaseQueue queue(options);
+    if (!queue.open()) {
+        return 1;
+    }
+
+    const auto jobs = make_jobs();
+    std::vector<std::size_t> order(jobs.size());
+    std::iota(order.begin(), order.end(), 0);
+    const std::string pid = std::to_string(::getpid());
+    queue.drain(jobs, order, 1, [&](std::size_t index) {
+        append_line(directory / "events", "start " + jobs[index] + " " + pid);
+        std::this_thread::sleep_for(kJobTime);
+        append_line(directory / "events", "finish " + jobs[index] + " " + pid);
+        return true;
+    });
+    Log::flush();
+    return 0;
+}
+
+pid_t start_instance(const std::string& self, const std::filesystem::path& directory, int instance) {
+    const std::string log = (directory / ("instance" + std::to_string(instance) + ".log")).string();
+    const pid_t pid = ::fork();
+    if (pid == 0) {
+        const int fd = ::open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd >= 0) {
+            ::dup2(fd, STDERR_FILENO);
+            ::dup2(fd, STDOUT_FILENO);
+        }
+        const std::string dir = directory.string();
+        ::execl(self.c_str(), self.c_str(), "--instance", dir.c_str(), static_cast<char*>(nullptr));
+        ::_exit(127);
+    }
+    return pid;
+}
+
+// Waits until the instance has started a job, i.e. holds a lease it is renewing.
+bool wait_for_start(const std::filesystem::path& directory, pid_t pid) {
+    const std::string marker = " " + std::to_string(pid) + "\n";
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (std::chrono::steady_clock::now() < deadline) {
+        std::istringstream events(read_file(directory / "events"));
+        std::string line;
+        while (std::getline(events, line)) {
+            if (line.rfind("start ", 0) == 0 && (line + "\n").find(marker) != std::string::npos) {
+                return true;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return false;
+}
+
+void test_instance_killed_mid_lease(const std::string& self) {
+    const auto directory = std::filesystem::temp_directory_path() /
+                           ("lease_queue_test-" + std::to_string(::getpid()));
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+
+    std::vector<pid_t> pids;
+    for (int i = 0; i < kInstances; ++i) {
+        pids.push_back(start_instance(self, directory, i));
+    }
+    CHECK(wait_for_start(directory, pids[0]));
+    ::kill(pids[0], SIGKILL);
+    for (const pid_t pid : pids) {
+        int status = 0;
+        ::waitpid(pid, &status, 0);
+        if (pid != pids[0]) {
+            CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        }
+    }
+
+    std::string warnings;
+    for (int i = 1; i < kInstances; ++i) {
+        warnings += read_file(directory / ("instance" + std::to_string(i) + ".log"));
+    }
+    std::map<std::string, int> finished;
+    std::string killed_job;
+    std::istringstream events(read_file(directory / "events"));
+    std::string event, job, pid;
+    while (events >> event >> job >> pid) {
+        if (event == "finish") {
+            ++finished[job];
+            CHECK(pid != std::to_string(pids[0]));
+        } else if (pid == std::to_string(pids[0])) {
+            killed_job = job;
+        }
+    }
+
+    // The killed instance's job was taken over once its lease expired.
+    CHECK(!killed_job.empty());
+    CHECK(warnings.find("reclaiming " + killed_job + "-") != std::string::npos);
+
+    std::size_t done = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(directory / "queue" / "done")) {
+        (void)entry;
+        ++done;
+    }
+    CHECK(done == kJobs);
+    CHECK(std::filesystem::is_empty(directory / "queue" / "failed"));
+    CHECK(std::filesystem::is_empty(directory / "queue" / "leases"));
+
+    for (const auto& job_name : make_jobs()) {
+        CHECK(finished[job_name] >= 1);
+        if (finished[job_name] > 1) {
+            // A double conversion is only acceptable when an instance reported it.
+            CHECK(warnings.find(job_name + "-") != std::string::npos);
+        }
+    }
+
+    std::filesystem::remove_all(directory);
+}
+}
+
+int main(int argc, char** argv) {
+    if (argc == 3 && std::string(argv[1]) == "--instance") {
+        return run_instance(argv[2]);
+    }
+    Log::set_level(LogLevel::warning);
+    test_instance_killed_mid_lease(argv[0]);
+    Log::flush();
+    return test::result();
+}
@@ -0,0 +1,155 @@
+// PDFCreator output in each layout, written to a file and streamed, opened and rendered
+// with Poppler: page count and sizes, linearization, and the colour of every page.
+
+#include "check.h"
+#include "image_encoder.h"
+#include "log.h"
+#include "output_sink.h"
+#include "pdf_creator.h"
+
+#include <poppler-document.h>
+#include <poppler-image.h>
+#include <poppler-page.h>
+#include <poppler-page-renderer.h>
+#include <zlib.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+struct Color {
+    int red = 0;
+    int green = 0;
+    int blue = 0;
+};
+
+struct ExpectedPage {
+    int width = 0;
+    int height = 0;
+    Color color;
+};
+
+PDFImageInput jpeg_page(const std::string& name, int width, int height, Color color) {
+    std::vector<std::uint8_t> pixels;
+    for (int i = 0; i < width * height; ++i) {
+        pixels.push_back(static_cast<std::uint8_t>(color.red));
+        pixels.push_back(static_cast<std::uint8_t>(color.green));
+        pixels.push_back(static_cast<std::uint8_t>(color.blue));
+    }
+    PixelBuffer buffer;
+    buffer.data = pixels.data();
+    buffer.width = width;
+    buffer.height = height;
+    buffer.stride = width * 3;
+    buffer.format = PixelFormat::rgb24;
+
+    PDFImageInput image;
+    image.name = name;
+    image.width = width;
+    image.height = height;
+    image.components = 3;
+    CHECK(ImageEncoder::encode_jpeg(buffer, 95, 72.0, image.data));
+    return image;
+}
+
+PDFImageInput flate_gray_page(const std::string& name, int width, int height, int gray) {
+    const std::vector<std::uint8_t> samples(static_cast<std::size_t>(width * height), static_cast<std::uint8_t>(gray));
+    uLongf compressed_size = compressBound(static_cast<uLong>(samples.size()));
+    PDFImageInput image;
+    image.name = name;
+    image.width = width;
+    image.height = height;
+    image.components = 1;
+    image.filter = PDFImageFilter::flate;
+    image.data.resize(compressed_size);
+    CHECK(compress(image.data.data(), &compressed_size, samples.data(), static_cast<uLong>(samples.size())) == Z_OK);
+    image.data.resize(compressed_size);
+    return image;
+}
+
+// Two identical pages, which share one image object, and a page of a different kind.
+std::vector<PDFImageInput> sample_pages(std::vector<ExpectedPage>& expected) {
+    const Color red{200, 40, 40};
+    expected = {{60, 80, red}, {60, 80, red}, {50, 40, {90, 90, 90}}};
+    return {jpeg_page("page1.jpg", 60, 80, red), jpeg_page("page2.jpg", 60, 80, red),
+            flate_gray_page("page3.png", 50, 40, 90)};
+}
+
+bool close_to(int actual, int expected) {
+    return std::abs(actual - expected) <= 8;
+}
+
+void check_document(poppler::document* document, const std::vector<ExpectedPage>& expected, bool linearized) {
+    CHECK(document != nullptr);
+    if (!document) {
+        return;
+    }
+    std::unique_ptr<poppler::document> owned(document);
+    CHECK(!document->is_locked());
+    CHECK(document->is_linearized() == linearized);
+    CHECK(document->pages() == static_cast<int>(expected.size()));
+
+    poppler::page_renderer renderer;
+    renderer.set_image_format(poppler::image::format_rgb24);
+    for (int i = 0; i < document->pages() && i < static_cast<int>(expected.size()); ++i) {
+        std::unique_ptr<poppler::page> page(document->create_page(i));
+        CHECK(page != nullptr);
+        if (!page) {
+            continue;
+        }
+        const poppler::rectf box = page->page_rect(poppler::page::media_box);
+        CHECK(static_cast<int>(box.width()) == expected[i].width);
+        CHECK(static_cast<int>(box.height()) == expected[i].height);
+
+        const poppler::image image = renderer.render_page(page.get());
+        CHECK(image.is_valid() && image.width() == expected[i].width && image.height() == expected[i].height);
+        if (!image.is_valid() || image.width() < 1 || image.height() < 1) {
+            continue;
+        }
+        // The centre pixel, away from any edge antialiasing.
+        const auto* pixel = reinterpret_cast<const std::uint8_t*>(image.const_data()) +
+                            image.height() / 2 * image.bytes_per_row() + image.width() / 2 * 3;
+        CHECK(close_to(pixel[0], expected[i].color.red));
+        CHECK(close_to(pixel[1], expected[i].color.green));
+        CHECK(close_to(pixel[2], expected[i].color.blue));
+    }
+}
+
+void test_layout_file(PDFLayout layout, const std::string& name) {
+    std::vector<ExpectedPage> expected;
+    const auto images = sample_pages(expected);
+    const auto path = std::filesystem::temp_directory_path() / ("pdf_creator_test-" + name + ".pdf");
+    PDFWriteOptions options;
+    options.layout = layout;
+    CHECK(PDFCreator::create_pdf_from_images(images, path.string(), options));
+    check_document(poppler::document::load_from_file(path.string()), expected, layout == PDFLayout::linearized);
+    std::filesystem::remove(path);
+}
+
+void test_layout_streamed(PDFLayout layout) {
+    std::vector<ExpectedPage> expected;
+    const auto images = sample_pages(expected);
+    std::vector<std::uint8_t> buffer;
+    PDFWriteOptions options;
+    options.layout = layout;
+    CHECK(PDFCreator::create_pdf_from_images(images, append_to_buffer(buffer), options));
+    check_document(poppler::document::load_from_raw_data(reinterpret_cast<const char*>(buffer.data()),
+                                                         static_cast<int>(buffer.size())),
+                   expected, layout == PDFLayout::linearized);
+}
+}
+
+int main() {
+    Log::set_level(LogLevel::warning);
+    test_layout_file(PDFLayout::classic, "classic");
+    test_layout_file(PDFLayout::compact, "compact");
+    test_layout_file(PDFLayout::linearized, "linearized");
+    test_layout_streamed(PDFLayout::compact);
+    test_layout_streamed(PDFLayout::linearized);
+    Log::flush();
+    return test::result();
+}
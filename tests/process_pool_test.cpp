@@ -0,0 +1,76 @@
+// ProcessPool with workers that answer, that cannot be started and that exit before
+// taking a job. None of these may quarantine a job or keep restarting workers.
+
+#include "check.h"
+#include "log.h"
+#include "process_pool.h"
+
+#include <string>
+#include <vector>
+
+namespace {
+std::vector<std::string> make_jobs(std::size_t count) {
+    std::vector<std::string> jobs;
+    for (std::size_t i = 0; i < count; ++i) {
+        jobs.push_back("job" + std::to_string(i));
+    }
+    return jobs;
+}
+
+ProcessPoolOptions shell_pool(const std::string& script) {
+    ProcessPoolOptions options;
+    options.processes = 2;
+    options.retries = 0;
+    options.worker_command = {"/bin/sh", "-c", script};
+    return options;
+}
+
+void test_workers_reply() {
+    const auto jobs = make_jobs(5);
+    std::vector<ProcessJobResult> results;
+    CHECK(ProcessPool::run(jobs, std::vector<JobEstimate>(jobs.size()),
+                           shell_pool("while read job; do echo \"done $job\" >&3; done"), results));
+    CHECK(results.size() == jobs.size());
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        CHECK(results[i].completed);
+        CHECK(results[i].attempts == 1);
+        CHECK(results[i].reply == "done " + jobs[i]);
+    }
+}
+
+void test_missing_worker_command() {
+    const auto jobs = make_jobs(8);
+    ProcessPoolOptions options;
+    options.processes = 2;
+    options.retries = 0;
+    options.worker_command = {"/nonexistent/comic-converter-worker"};
+    std::vector<ProcessJobResult> results;
+    CHECK(!ProcessPool::run(jobs, std::vector<JobEstimate>(jobs.size()), options, results));
+    for (const auto& result : results) {
+        CHECK(!result.completed);
+        CHECK(!result.quarantined);
+        CHECK(result.attempts == 0);
+    }
+}
+
+void test_workers_exit_before_reading() {
+    const auto jobs = make_jobs(8);
+    std::vector<ProcessJobResult> results;
+    // Starts, like a worker given a bad option, but exits before reading a job.
+    CHECK(ProcessPool::run(jobs, std::vector<JobEstimate>(jobs.size()), shell_pool("exit 2"), results));
+    for (const auto& result : results) {
+        CHECK(!result.completed);
+        CHECK(!result.quarantined);
+        CHECK(result.attempts == 0);
+    }
+}
+}
+
+int main() {
+    Log::set_level(LogLevel::warning);
+    test_workers_reply();
+    test_missing_worker_command();
+    test_workers_exit_before_reading();
+    Log::flush();
+    return test::result();
+}
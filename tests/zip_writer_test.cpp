@@ -0,0 +1,169 @@
+// ZipWriter archives, written to a file and streamed, read back with libzip and with
+// ZipLayout::locate_entries, including one with enough entries to need ZIP64 records.
+
+#include "check.h"
+#include "log.h"
+#include "output_sink.h"
+#include "zip_layout.h"
+#include "zip_writer.h"
+
+#include <zip.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+using Entries = std::vector<std::pair<std::string, std::string>>;
+
+// A file name for this test, removed again by the test.
+std::filesystem::path temp_path(const std::string& name) {
+    return std::filesystem::temp_directory_path() / ("zip_writer_test-" + name);
+}
+
+std::string read_file(const std::filesystem::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), {});
+}
+
+Entries sample_entries() {
+    std::string page(5000, '\0');
+    for (std::size_t i = 0; i < page.size(); ++i) {
+        page[i] = static_cast<char>(i * 7 + 3);
+    }
+    return {{"page001.jpg", page}, {"page002.jpg", page.substr(0, 1234)}, {"empty.txt", ""},
+            {"ComicInfo.xml", "<ComicInfo><Title>Test</Title></ComicInfo>"}};
+}
+
+bool add_entries(ZipWriter& writer, const Entries& entries) {
+    const std::time_t modified = 1700000000;
+    for (const auto& [name, data] : entries) {
+        if (!writer.add_stored(name, reinterpret_cast<const std::uint8_t*>(data.data()), data.size(), modified)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The archive as libzip sees it, with its consistency checks enabled.
+bool read_with_libzip(const std::filesystem::path& path, Entries& entries) {
+    entries.clear();
+    int error = 0;
+    zip_t* archive = zip_open(path.string().c_str(), ZIP_RDONLY | ZIP_CHECKCONS, &error);
+    if (!archive) {
+        return false;
+    }
+    bool ok = true;
+    const zip_int64_t count = zip_get_num_entries(archive, 0);
+    for (zip_int64_t i = 0; ok && i < count; ++i) {
+        zip_stat_t stat;
+        zip_stat_init(&stat);
+        ok = zip_stat_index(archive, static_cast<zip_uint64_t>(i), 0, &stat) == 0 && stat.comp_method == ZIP_CM_STORE;
+        zip_file_t* file = ok ? zip_fopen_index(archive, static_cast<zip_uint64_t>(i), 0) : nullptr;
+        if (!file) {
+            ok = false;
+            break;
+        }
+        std::string data(static_cast<std::size_t>(stat.size), '\0');
+        ok = zip_fread(file, data.data(), stat.size) == static_cast<zip_int64_t>(stat.size);
+        zip_fclose(file);
+        entries.emplace_back(stat.name, std::move(data));
+    }
+    zip_discard(archive);
+    return ok;
+}
+
+// The archive as ZipLayout describes it, taking each entry's bytes from the offsets it reports.
+bool read_with_layout(const std::filesystem::path& path, Entries& entries) {
+    entries.clear();
+    const std::string archive = read_file(path);
+    for (const auto& location : ZipLayout::locate_entries(path.string())) {
+        if (!location.stored || location.data_offset + location.size > archive.size()) {
+            return false;
+        }
+        entries.emplace_back(location.name, archive.substr(static_cast<std::size_t>(location.data_offset),
+                                                           static_cast<std::size_t>(location.size)));
+    }
+    return true;
+}
+
+void check_archive(const std::filesystem::path& path, const Entries& expected) {
+    Entries entries;
+    CHECK(read_with_libzip(path, entries));
+    CHECK(entries == expected);
+    CHECK(read_with_layout(path, entries));
+    CHECK(entries == expected);
+}
+
+void test_file_archive() {
+    const auto path = temp_path("file.cbz");
+    const Entries entries = sample_entries();
+    ZipWriter writer;
+    CHECK(writer.open(path.string()));
+    CHECK(add_entries(writer, entries));
+    CHECK(writer.commit());
+    CHECK(writer.offset() == std::filesystem::file_size(path));
+    check_archive(path, entries);
+    std::filesystem::remove(path);
+}
+
+void test_streamed_archive() {
+    std::vector<std::uint8_t> buffer;
+    const Entries entries = sample_entries();
+    ZipWriter writer;
+    CHECK(writer.open(append_to_buffer(buffer)));
+    CHECK(add_entries(writer, entries));
+    CHECK(writer.commit());
+
+    const auto path = temp_path("streamed.cbz");
+    std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char*>(buffer.data()),
+                                               static_cast<std::streamsize>(buffer.size()));
+    check_archive(path, entries);
+    std::filesystem::remove(path);
+}
+
+void test_sorted_directory() {
+    const auto path = temp_path("sorted.cbz");
+    Entries entries = sample_entries();
+    ZipWriter writer;
+    CHECK(writer.open(path.string()));
+    CHECK(add_entries(writer, entries));
+    writer.sort_directory([](const std::string& a, const std::string& b) { return a < b; });
+    CHECK(writer.commit());
+    std::sort(entries.begin(), entries.end());
+    check_archive(path, entries);
+    std::filesystem::remove(path);
+}
+
+// More entries than the 16-bit counts of the classic end record hold.
+void test_zip64_entry_count() {
+    const auto path = temp_path("zip64.cbz");
+    Entries entries;
+    for (int i = 0; i < 70000; ++i) {
+        entries.emplace_back("p" + std::to_string(i), std::to_string(i * 31));
+    }
+    ZipWriter writer;
+    CHECK(writer.open(path.string()));
+    CHECK(add_entries(writer, entries));
+    CHECK(writer.commit());
+    CHECK(read_file(path).find(std::string("PK\x06\x06", 4)) != std::string::npos);
+    check_archive(path, entries);
+    std::filesystem::remove(path);
+}
+}
+
+int main() {
+    Log::set_level(LogLevel::warning);
+    test_file_archive();
+    test_streamed_archive();
+    test_sorted_directory();
+    test_zip64_entry_count();
+    Log::flush();
+    return test::result();
+}